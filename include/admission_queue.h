@@ -0,0 +1,66 @@
+#ifndef ADMISSION_QUEUE_H
+#define ADMISSION_QUEUE_H
+
+#include "platform_wrapper.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Admission control for connections beyond max_clients
+//
+// a full server parks new connections in a bounded FIFO instead of
+// dropping them, the oldest gets the next slot that frees. whoever
+// waited too long, or found the queue full, is told "busy, retry after
+// N ms" where N grows with the backlog and the recent time a slot is
+// held, so rejected clients come back spread out rather than at once.
+// owned by one accept loop, not thread safe
+
+class AdmissionQueue {
+public:
+    // capacity 0 rejects straight away, maxWaitMs 0 rejects on expire()
+    AdmissionQueue(size_t capacity, uint32_t maxWaitMs);
+    ~AdmissionQueue();
+
+    AdmissionQueue(const AdmissionQueue&) = delete;
+    AdmissionQueue& operator=(const AdmissionQueue&) = delete;
+
+    // takes ownership, false when full (the caller still owns socket)
+    bool push(Socket* socket);
+    // oldest waiting connection, nullptr when empty
+    Socket* pop();
+    // moves connections that waited past maxWaitMs into expired
+    void expire(std::vector<Socket*>& expired);
+    // closes everything still waiting, used at shutdown
+    void clear();
+
+    // takes a socket that was answered "busy". it stays half-closed until
+    // the peer's own request has been read, closing over unread bytes
+    // sends a reset that can overtake the answer
+    void linger(Socket* socket);
+    void drainLingering();
+
+    bool empty() const { return m_waiting.empty(); }
+    size_t size() const { return m_waiting.size(); }
+    // nothing waiting and nothing lingering, the accept loop may block
+    bool idle() const { return m_waiting.empty() && m_lingering.empty(); }
+
+    // how long a slot was held, feeds the retry hint
+    void recordSlotTime(uint64_t milliseconds);
+    uint32_t retryAfterMs(size_t slots) const;
+
+    static uint64_t nowMs();
+
+private:
+    struct Waiting {
+        Socket* socket;
+        uint64_t enqueuedMs;
+    };
+
+    size_t m_capacity;
+    uint32_t m_maxWaitMs;
+    std::deque<Waiting> m_waiting;
+    std::vector<Waiting> m_lingering;   // enqueuedMs = when it was answered
+    double m_averageSlotMs;             // moving average over finished connections
+};
+
+#endif
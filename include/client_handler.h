@@ -3,24 +3,57 @@
 
 #include "platform_wrapper.h"
 #include "protocol.h"
+#include "upload_writer.h"
+#include "io_ring.h"
+#include "connection_reaper.h"
+#include "client_registry.h"
+#include "metrics.h"
+#include "traffic_capture.h"
+#include "shm_channel.h"
 #include <string>
 #include <fstream>
 #include <vector>
 
 class FileManager;
+class CommitQueue;
+
+// server-wide settings shared by every handler
+struct HandlerOptions {
+    CommitQueue* commitQueue;     // durable mode when set, uploads are synced before the ack
+    UploadWriterOptions upload;   // block size, queue depth and direct I/O for upload writes
+    IoBackend ioBackend;          // uring drives transfers through a per-connection io_uring
+    ConnectionReaper* reaper;     // closes idle/stalled connections when set
+    Metrics* metrics;             // request counts and latencies, when set
+    TrafficCapture* capture;      // records incoming messages for replay, when set
+    size_t shmRingSize;           // shared-memory transport offered to Unix socket clients, 0 = off
+
+    HandlerOptions() : commitQueue(nullptr), ioBackend(IO_BACKEND_BLOCKING), reaper(nullptr), metrics(nullptr),
+                       capture(nullptr), shmRingSize(0) {}
+};
 
 class ClientHandler {
 public:
-    ClientHandler(Socket* clientSocket, FileManager* fileManager, uint32_t clientId, const std::string& passwordHash);
+    // smallest thread stack for a handler. every path (blocking and uring,
+    // durable, direct I/O) runs on 16 KB, this leaves twice that. buffers
+    // that scale with a transfer always live on the heap
+    static const size_t MIN_STACK_SIZE = 32 * 1024;
+    
+    // stats, when given, is kept up to date for monitoring
+    ClientHandler(Socket* clientSocket, FileManager* fileManager, uint32_t clientId, const std::string& passwordHash,
+                  const HandlerOptions& options = HandlerOptions(), ConnectionStats* stats = nullptr);
     ~ClientHandler();
     
     void run();
+    // unblocks the handler thread from another thread, used at shutdown
+    void stop();
     bool isRunning() const { return m_running; }
     uint32_t getClientId() const { return m_clientId; }
     
 private:
     void handleClient();
+    // times the request for the metrics around dispatchMessage()
     bool handleMessage(uint8_t messageType, const std::vector<uint8_t>& payload);
+    bool dispatchMessage(uint8_t messageType, const std::vector<uint8_t>& payload);
     
     bool handleConnectRequest(const std::vector<uint8_t>& payload);
     bool handleListFiles();
@@ -29,26 +62,66 @@ private:
     bool handleUploadData(const std::vector<uint8_t>& payload);
     bool handleUploadComplete(const std::vector<uint8_t>& payload);
     bool handleDeleteRequest(const std::vector<uint8_t>& payload);
+    bool handleShmRequest();
     
+    // small messages are queued, flushSends() writes them out once the
+    // request is handled; larger ones are sent straight from caller
+    // memory, e.g. a mapped file view, with the queue in front
     bool sendMessage(uint8_t messageType, const std::vector<uint8_t>& payload);
+    bool sendMessage(uint8_t messageType, const uint8_t* payload, size_t length);
+    // both messages in one write, the second normally a short status
+    bool sendMessageThen(uint8_t messageType, const uint8_t* payload, size_t length,
+                         uint8_t nextType, const std::vector<uint8_t>& nextPayload);
+    bool flushSends();
+    bool sendParts(SocketBuffer* parts, size_t count);
+    bool sendAll(const uint8_t* data, size_t length);
     void sendErrorResponse(const std::string& errorMsg);
 
+    // buffered while an upload streams in, direct reads otherwise
+    int receiveFully(uint8_t* buffer, size_t length);
+    int receiveSome(uint8_t* buffer, size_t length);
+    void releaseReceiveBuffer();
+
+    // io_uring backend, the ring is created on first use
+    bool ensureRing();
+    bool sendFileThroughRing(int fd, uint64_t fileSize);
+
     std::string m_serverPasswordHash;
     bool m_authenticated;
-    time_t m_lastActivity;
     int m_failedAttempts;
 
     bool handleAuthentication(const std::vector<uint8_t>& payload);
     bool checkAuthenticated();
-    void updateActivity();
-    bool checkTimeout();
+    // bytes moved, counted and pushing the reaper's deadline out
+    void countReceived(size_t bytes);
+    void countSent(size_t bytes);
+    void setBusy(bool busy);
+    void beginOperation(uint8_t messageType);
+    void endOperation();
+    int64_t operationDurationUs() const;
     
     Socket* m_clientSocket;
     FileManager* m_fileManager;
+    HandlerOptions m_options;
     uint32_t m_clientId;
     bool m_running;
     
-    std::ofstream m_uploadFile;
+    IoRing* m_ring;
+    bool m_ringUnavailable;
+    // once set every byte goes through it, the socket only tells whether
+    // the client is still there
+    ShmChannel* m_shm;
+    IoCompletion m_recvCompletion;
+    std::vector<uint8_t> m_recvBuffer;
+    size_t m_recvStart;
+    size_t m_recvEnd;
+    std::vector<uint8_t> m_sendBuffer;
+    
+    ConnectionTimer m_timer;
+    ConnectionStats* m_stats;
+    uint64_t m_operationStartUs;
+    
+    UploadWriter m_uploadWriter;
     std::string m_uploadFilename;
     uint64_t m_uploadExpectedSize;
     uint64_t m_uploadReceivedSize;
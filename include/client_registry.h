@@ -0,0 +1,111 @@
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include "platform_wrapper.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class ClientHandler;
+class ClientRegistry;
+
+// Registry of live connections
+//
+// one shard per accept loop, a fixed array of slots sized to its share
+// of max_clients. only the shard's accept loop takes and returns slots,
+// through a plain free list, so registering and removing a connection is
+// O(1) and takes no lock. a handler that ends pushes its slot on the
+// shard's lock-free finished stack and the accept loop reaps just those
+// rather than scanning every connection. monitoring reads the slots'
+// stats with atomic loads and never holds up either side
+
+// written only by the connection's handler thread, read by anyone.
+// one cache line per connection so handlers do not share lines
+struct alignas(64) ConnectionStats {
+    std::atomic<uint64_t> bytesIn;
+    std::atomic<uint64_t> bytesOut;
+    std::atomic<uint64_t> operations;           // requests handled
+    std::atomic<uint64_t> connectedMs;
+    std::atomic<uint64_t> operationStartMs;     // start of currentOperation
+    std::atomic<uint8_t> currentOperation;      // message type, 0 = waiting for a request
+
+    ConnectionStats() { reset(0); }
+    void reset(uint64_t nowMs);
+
+    // single writer, so a load and a store instead of a locked add
+    static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+};
+
+// one connection as seen by monitoring
+struct ConnectionSnapshot {
+    uint32_t clientId;
+    unsigned shard;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t operations;
+    uint64_t connectedMs;
+    uint64_t operationStartMs;
+    uint8_t currentOperation;
+};
+
+struct ClientSlot {
+    ConnectionStats stats;
+    std::atomic<uint32_t> clientId;     // 0 while the slot is free
+    // the accept loop's, never read by monitoring
+    ClientHandler* handler;
+    Thread* thread;
+    ClientRegistry* registry;
+    unsigned shard;
+    uint32_t index;
+    uint32_t nextFinished;
+
+    ClientSlot() : clientId(0), handler(nullptr), thread(nullptr), registry(nullptr),
+                   shard(0), index(0), nextFinished(0) {}
+};
+
+class ClientRegistry {
+public:
+    explicit ClientRegistry(const std::vector<size_t>& shardCapacities);
+    ~ClientRegistry();
+
+    ClientRegistry(const ClientRegistry&) = delete;
+    ClientRegistry& operator=(const ClientRegistry&) = delete;
+
+    // unique across shards, any thread
+    uint32_t allocateId() { return m_nextId.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // the shard's accept loop only (or anyone once it has stopped)
+    ClientSlot* acquire(unsigned shard, uint32_t clientId);     // nullptr when full
+    void release(ClientSlot* slot);
+    bool hasFreeSlot(unsigned shard) const { return !m_shards[shard]->freeSlots.empty(); }
+    size_t getActiveCount(unsigned shard) const;
+    void takeFinished(unsigned shard, std::vector<ClientSlot*>& finished);
+    void getActive(unsigned shard, std::vector<ClientSlot*>& active);
+
+    // from the handler's thread as its last step
+    void markFinished(ClientSlot* slot);
+
+    // any thread, lock-free. connections that come or go meanwhile may
+    // be missed but are never reported with another's numbers
+    void snapshot(std::vector<ConnectionSnapshot>& connections) const;
+
+    static uint64_t nowMs();
+
+private:
+    static const uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Shard {
+        std::vector<ClientSlot> slots;
+        std::vector<uint32_t> freeSlots;
+        std::atomic<uint32_t> finishedHead;     // stack threaded through nextFinished
+
+        explicit Shard(size_t capacity) : slots(capacity), finishedHead(NO_SLOT) {}
+    };
+
+    std::vector<Shard*> m_shards;
+    std::atomic<uint32_t> m_nextId;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef COMMIT_QUEUE_H
+#define COMMIT_QUEUE_H
+
+#include "platform_wrapper.h"
+#include <string>
+#include <vector>
+
+// Group commit for finished uploads
+//
+// handler threads hand over a closed file and block in commit(),
+// one commit thread collects everything that arrives within the
+// window, syncs the files and then each distinct parent directory
+// once, and wakes the whole batch together. an fsync per upload
+// becomes an fsync per batch under load
+//
+// the parents are synced up to the storage root: in the sharded
+// layout the shard directories can be as new as the file, and their
+// entries must be durable as well
+
+class CommitQueue {
+public:
+    CommitQueue(uint32_t windowMs, const std::string& storageRoot);
+    ~CommitQueue();
+
+    CommitQueue(const CommitQueue&) = delete;
+    CommitQueue& operator=(const CommitQueue&) = delete;
+
+    bool start();
+    void stop();
+
+    // returns once path and the directory entries leading to it from
+    // the storage root are on stable storage, false if a sync failed
+    bool commit(const std::string& path);
+
+    void printStats();
+
+private:
+    struct Request {
+        std::string path;
+        uint64_t enqueuedUs;
+        bool done;
+        bool success;
+    };
+
+    static ThreadReturn THREAD_CALL commitThreadFunction(void* arg);
+    void commitThreadMain();
+    void syncBatch(std::vector<Request*>& batch);
+
+    void collectDirectories(const std::string& path, std::vector<std::string>& directories) const;
+
+    static bool syncFile(const std::string& path);
+    static bool syncDirectory(const std::string& path);
+    static uint64_t nowUs();
+
+    uint32_t m_windowMs;
+    std::string m_rootPrefix;          // storage root with a trailing '/'
+    bool m_running;
+
+    Mutex m_mutex;
+    ConditionVariable m_pendingCond;   // commit thread waits for work
+    ConditionVariable m_doneCond;      // handlers wait for their batch
+    std::vector<Request*> m_pending;
+    Thread m_thread;
+
+    // guarded by m_mutex
+    uint64_t m_batches;
+    uint64_t m_files;
+    uint64_t m_maxBatch;
+    uint64_t m_totalLatencyUs;
+    uint64_t m_maxLatencyUs;
+};
+
+#endif
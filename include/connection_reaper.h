@@ -0,0 +1,79 @@
+#ifndef CONNECTION_REAPER_H
+#define CONNECTION_REAPER_H
+
+#include "platform_wrapper.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <vector>
+
+// Idle and stalled connection reaper
+//
+// a handler blocked in receive/send never gets to check its own timeout,
+// so one reaper thread keeps a timer per connection on a timing wheel and
+// shuts the socket down from outside, which wakes the handler and frees
+// its slot. handlers only store the reaper's tick into their timer when
+// bytes move; the reaper looks at it when the timer fires and re-arms it
+// from there, so activity never touches the wheel or its lock
+
+// one per connection, registered while the handler thread runs
+struct ConnectionTimer {
+    TimerEntry entry;                       // reaper's, under its lock
+    std::atomic<uint64_t> lastActivity;     // reaper tick of the last progress
+    std::atomic<bool> busy;                 // mid-transfer, stall timeout applies
+    Socket* socket;
+    uint32_t clientId;
+
+    ConnectionTimer() : lastActivity(0), busy(false), socket(nullptr), clientId(0) {
+        entry.owner = this;
+    }
+};
+
+class ConnectionReaper {
+public:
+    // timeouts in seconds, 0 turns that check off
+    ConnectionReaper(uint32_t idleTimeoutSeconds, uint32_t stallTimeoutSeconds);
+    ~ConnectionReaper();
+
+    ConnectionReaper(const ConnectionReaper&) = delete;
+    ConnectionReaper& operator=(const ConnectionReaper&) = delete;
+
+    bool start();
+    void stop();
+
+    void add(ConnectionTimer* timer);
+    // once this returns the reaper no longer touches timer or its socket
+    void remove(ConnectionTimer* timer);
+
+    // lock-free, what handlers stamp into lastActivity
+    uint64_t now() const { return m_tick.load(std::memory_order_relaxed); }
+    void touch(ConnectionTimer* timer) const {
+        timer->lastActivity.store(now(), std::memory_order_relaxed);
+    }
+
+    void printStats();
+
+    static const uint32_t TICK_MS = 100;
+
+private:
+    static ThreadReturn THREAD_CALL reaperThreadFunction(void* arg);
+    void reaperThreadMain();
+    void expire(ConnectionTimer* timer);
+
+    uint64_t m_idleTicks;
+    uint64_t m_stallTicks;
+    uint64_t m_checkTicks;      // shortest enabled timeout, the longest gap between checks
+    std::atomic<uint64_t> m_tick;
+    bool m_running;
+
+    Mutex m_mutex;
+    ConditionVariable m_stopCond;
+    TimerWheel m_wheel;
+    std::vector<TimerEntry*> m_expired;
+    Thread m_thread;
+
+    // guarded by m_mutex
+    uint64_t m_idleReaped;
+    uint64_t m_stallReaped;
+};
+
+#endif
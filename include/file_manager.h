@@ -3,9 +3,14 @@
 
 #include "platform_wrapper.h"
 #include "protocol.h"
+#include "metadata_snapshot.h"
+#include "upload_writer.h"
+#include "mapped_file.h"
 #include <string>
 #include <vector>
 #include <fstream>
+#include <atomic>
+#include <unordered_map>
 #include <sys/stat.h>
 
 #ifdef _WIN32
@@ -17,26 +22,102 @@
     #include <sys/types.h>
 #endif
 
+// on-disk layout of the storage directory
+// flat keeps every file in the root, sharded spreads them over
+// two levels of 256 hash-prefix subdirectories (root/ab/cd/name)
+enum StorageLayout {
+    LAYOUT_FLAT = 0,
+    LAYOUT_SHARDED = 1
+};
+
 class FileManager {
 public:
-    FileManager(const std::string& storageDir);
+    FileManager(const std::string& storageDir, StorageLayout layout = LAYOUT_FLAT);
     ~FileManager();
-    
+
     std::vector<Protocol::FileInfo> getFileList();
     bool fileExists(const std::string& filename);
     bool deleteFile(const std::string& filename);
-    
+
     std::string getFilePath(const std::string& filename) const;
     bool openForReading(const std::string& filename, std::ifstream& file);
+    // zero-copy variant, hands out views of the mapped file
+    bool openForReading(const std::string& filename, MappedFileReader& reader);
+    // raw descriptor for the io_uring path, caller closes it
+    bool openForReading(const std::string& filename, int& fd, uint64_t& fileSize);
     bool openForWriting(const std::string& filename, std::ofstream& file);
-    
+    // write-behind variant for uploads, expectedSize is preallocated
+    bool openForWriting(const std::string& filename, UploadWriter& writer, uint64_t expectedSize,
+                        const UploadWriterOptions& options);
+
     std::string getStorageDir() const { return m_storageDir; }
-    
+    StorageLayout getLayout() const { return m_layout; }
+
+    // keeps file metadata in memory, seeded from the snapshot at
+    // snapshotPath and reconciled with the directory in the background,
+    // a snapshot is written every intervalSeconds and at shutdown
+    bool enableSnapshot(const std::string& snapshotPath, uint32_t intervalSeconds);
+    bool saveSnapshot();
+
+    // refreshes size/mtime after a write finished
+    void commitFile(const std::string& filename);
+
+    // "ab/cd" shard for a filename, shared with the migration tool
+    static std::string getShardSubdirectory(const std::string& filename);
+    static bool parseLayout(const std::string& name, StorageLayout& layout);
+    static const char* layoutName(StorageLayout layout);
+
 private:
+    // LOADING serves the mapped snapshot plus m_pendingChanges,
+    // BUILDING (no snapshot found) serves directory scans until the
+    // first reconcile finishes, READY serves m_index
+    enum IndexState {
+        INDEX_DISABLED,
+        INDEX_LOADING,
+        INDEX_BUILDING,
+        INDEX_READY
+    };
+
+    struct IndexEntry {
+        uint64_t fileSize;
+        uint64_t timestamp;
+        uint32_t epoch;      // last reconcile pass that saw or changed it
+    };
+
+    struct PendingChange {
+        bool deleted;
+        uint64_t fileSize;
+        uint64_t timestamp;
+    };
+
     void createStorageDirectory();
-    
+    bool createShardDirectories(const std::string& filename);
+    void listDirectory(const std::string& dirPath, std::vector<Protocol::FileInfo>& files);
+    void scanStorage(std::vector<Protocol::FileInfo>& files);
+    void collectFilenames(std::vector<std::string>& names);
+
+    static ThreadReturn THREAD_CALL indexThreadFunction(void* arg);
+    void indexThreadMain();
+    void loadIndexFromSnapshot();
+    void reconcileIndex();
+    void listFromSnapshot(std::vector<Protocol::FileInfo>& files);
+    void recordChange(const std::string& filename, bool deleted, uint64_t fileSize, uint64_t timestamp);
+    bool sleepUntilNextSnapshot();
+
     std::string m_storageDir;
+    StorageLayout m_layout;
     Mutex m_mutex;
+
+    IndexState m_indexState;
+    std::unordered_map<std::string, IndexEntry> m_index;
+    std::unordered_map<std::string, PendingChange> m_pendingChanges;
+    MetadataSnapshot m_snapshot;
+    std::string m_snapshotPath;
+    uint32_t m_snapshotInterval;
+    uint32_t m_epoch;
+    bool m_indexDirty;
+    std::atomic<bool> m_indexStop;
+    Thread m_indexThread;
 };
 
-#endif
\ No newline at end of file
+#endif
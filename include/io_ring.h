@@ -0,0 +1,104 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "platform_wrapper.h"
+#include <string>
+
+// io_uring submission/completion ring (Linux 5.6+)
+//
+// thin wrapper over the raw syscalls, no liburing needed. operations are
+// queued with the prep* calls and only reach the kernel on the next
+// waitFor()/submit(), so one io_uring_enter carries a whole batch.
+// every operation reports into an IoCompletion owned by the caller.
+// on other platforms and older kernels isSupported() is false and
+// callers stay on the blocking path
+
+enum IoBackend {
+    IO_BACKEND_BLOCKING = 0,
+    IO_BACKEND_URING = 1
+};
+
+struct IoCompletion {
+    int32_t result;     // bytes transferred or -errno
+    bool done;
+
+    IoCompletion() : result(0), done(false) {}
+    void reset() { result = 0; done = false; }
+};
+
+// fixed file table layout of a connection's ring
+enum RingFileSlot {
+    RING_FILE_SOCKET = 0,
+    RING_FILE_DATA = 1,
+    RING_FILE_COUNT = 2
+};
+
+class IoRing {
+public:
+    IoRing();
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // probes the kernel once (setup + opcode probe), cached afterwards
+    static bool isSupported();
+    static bool parseBackend(const std::string& name, IoBackend& backend);
+    static const char* backendName(IoBackend backend);
+
+    bool init(unsigned entries);
+    void close();
+    bool isReady() const { return m_fd >= 0; }
+
+    // every buffer has the same length, replaces any earlier registration
+    bool registerBuffers(uint8_t* const* buffers, size_t length, unsigned count);
+    bool unregisterBuffers();
+    // fds may contain -1 for slots filled later with updateFile
+    bool registerFiles(const int* fds, unsigned count);
+    bool updateFile(unsigned slot, int fd);
+
+    // link chains the operation to the next one, a failed or short
+    // link cancels the rest of the chain with -ECANCELED
+    bool prepRecv(unsigned fileSlot, void* buffer, size_t length, IoCompletion* completion);
+    bool prepSend(unsigned fileSlot, const void* buffer, size_t length, IoCompletion* completion, bool link);
+    bool prepReadFixed(unsigned fileSlot, void* buffer, size_t length, uint64_t offset,
+                       unsigned bufferIndex, IoCompletion* completion, bool link);
+    bool prepWriteFixed(unsigned fileSlot, const void* buffer, size_t length, uint64_t offset,
+                        unsigned bufferIndex, IoCompletion* completion);
+
+    // submits everything queued and blocks until completion is done,
+    // other completions that arrive meanwhile are filled in as well
+    bool waitFor(IoCompletion& completion);
+    bool submit();
+
+    uint64_t getEnterCalls() const { return m_enterCalls; }
+
+private:
+    void* nextSqe();
+    void reapCompletions();
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    int m_fd;
+    unsigned m_entries;
+    unsigned m_pending;             // queued, not yet handed to the kernel
+    bool m_buffersRegistered;
+    uint64_t m_enterCalls;
+
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    void* m_sqes;
+    size_t m_sqesSize;
+
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    void* m_cqes;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Asynchronous logger
+//
+// a thread formats its line into its own single-producer ring and goes
+// on, no lock and no I/O. one background thread drains every ring a few
+// times a second, orders the batch by time and writes it with one
+// fwrite and one flush. a full ring drops the line (and counts it)
+// rather than make a handler wait on a slow disk or terminal. before
+// start() and after stop() lines are written straight through
+
+enum LogLevel : uint8_t {
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+};
+
+// structured fields printed after the message, zero / -1 = not set
+struct LogFields {
+    uint32_t clientId;
+    uint8_t operation;      // protocol message type
+    int64_t bytes;
+    int64_t durationUs;
+
+    LogFields(uint32_t client = 0, uint8_t op = 0, int64_t byteCount = -1, int64_t duration = -1)
+        : clientId(client), operation(op), bytes(byteCount), durationUs(duration) {}
+};
+
+#if defined(__GNUC__)
+#define LOG_PRINTF_FORMAT(formatIndex, firstArg) __attribute__((format(printf, formatIndex, firstArg)))
+#else
+#define LOG_PRINTF_FORMAT(formatIndex, firstArg)
+#endif
+
+class Logger {
+public:
+    // path empty or "-" logs to stdout, otherwise appends to the file
+    static bool start(const std::string& path, LogLevel level);
+    // writes out everything still queued and closes the file
+    static void stop();
+
+    static bool enabled(LogLevel level) { return level >= s_level.load(std::memory_order_relaxed); }
+    static void setLevel(LogLevel level) { s_level.store(level, std::memory_order_relaxed); }
+    // "debug", "info", "warn" or "error"
+    static bool parseLevel(const std::string& text, LogLevel& level);
+
+    static void debug(const LogFields& fields, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+    static void info(const LogFields& fields, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+    static void warn(const LogFields& fields, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+    static void error(const LogFields& fields, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+
+    // lines lost to full rings since start()
+    static uint64_t getDropped();
+
+private:
+    static std::atomic<uint8_t> s_level;
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <QProgressBar>
 #include <QGroupBox>
 #include <QTimer>
+#include <QThread>
 #include "network_client.h"
 
 class MainWindow : public QMainWindow {
@@ -19,6 +20,15 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+signals:
+    // queued to m_client on m_networkThread, run there in this order
+    void connectRequested(const QString& host, uint16_t port, const QString& password);
+    void disconnectRequested();
+    void refreshRequested();
+    void uploadRequested(const QString& localPath);
+    void downloadRequested(const QString& remoteFilename, const QString& savePath);
+    void deleteRequested(const QString& filename);
+
 private slots:
     void onConnectClicked();
     void onDisconnectClicked();
@@ -67,7 +77,8 @@ private:
     // UI Components - Log
     QTextEdit* m_logEdit;
     
-    // Network client
+    // Network client, owned by and running on m_networkThread
+    QThread* m_networkThread;
     NetworkClient* m_client;
 };
 
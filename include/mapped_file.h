@@ -0,0 +1,58 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "platform_wrapper.h"
+#include <string>
+
+// Sequential mmap reader for downloads
+//
+// the file is mapped one window at a time and handed out as views into
+// the mapping, so nothing is copied on the way to the socket. each window
+// is marked sequential for aggressive readahead, and once the cursor
+// leaves a window it is unmapped and its pages are dropped from the page
+// cache, a multi-GB download does not push everything else out.
+// files that fit in one window keep their cached pages
+
+class MappedFileReader {
+public:
+    static const size_t DEFAULT_WINDOW_SIZE = 16 * 1024 * 1024;
+
+    MappedFileReader();
+    ~MappedFileReader();
+
+    MappedFileReader(const MappedFileReader&) = delete;
+    MappedFileReader& operator=(const MappedFileReader&) = delete;
+
+    // windowSize is rounded to the mapping granularity
+    bool open(const std::string& path, size_t windowSize = DEFAULT_WINDOW_SIZE);
+    void close();
+
+    // next view of at most maxLength bytes, valid until the next call,
+    // false at end of file or if the window cannot be mapped
+    bool next(size_t maxLength, const uint8_t*& data, size_t& length);
+
+    bool isOpen() const { return m_isOpen; }
+    uint64_t getSize() const { return m_size; }
+    uint64_t getPosition() const { return m_position; }
+
+private:
+    bool mapWindow(uint64_t offset);
+    void unmapWindow(bool dropPages);
+
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+    bool m_isOpen;
+    uint64_t m_size;
+    uint64_t m_position;
+    size_t m_windowSize;
+
+    uint8_t* m_window;
+    uint64_t m_windowOffset;
+    size_t m_windowLength;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef METADATA_SNAPSHOT_H
+#define METADATA_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compact on-disk image of the storage metadata index
+//
+// layout (host byte order, the file never leaves the machine):
+//   SnapshotHeader
+//   SnapshotRecord[count]   fixed size, sorted as written
+//   name bytes              referenced by offset/length from the records
+//
+// the file is mapped read-only so opening it costs the same for
+// 10 files or 10 million, records are only touched when read
+
+namespace SnapshotFormat {
+    const char MAGIC[8] = { 'F', 'S', 'S', 'N', 'A', 'P', '0', '1' };
+    const uint32_t VERSION = 1;
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;     // sizeof(SnapshotRecord), guards against ABI drift
+        uint64_t count;
+        uint64_t namesSize;
+        uint64_t createdAt;
+    };
+
+    struct SnapshotRecord {
+        uint64_t fileSize;
+        uint64_t timestamp;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+}
+
+class MetadataSnapshot {
+public:
+    MetadataSnapshot();
+    ~MetadataSnapshot();
+
+    MetadataSnapshot(const MetadataSnapshot&) = delete;
+    MetadataSnapshot& operator=(const MetadataSnapshot&) = delete;
+
+    // maps an existing snapshot, false if missing or malformed
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    uint64_t getCount() const { return m_count; }
+    uint64_t getCreatedAt() const { return m_createdAt; }
+
+    // zero-copy view of record i, name is not null terminated
+    bool getEntry(uint64_t index, const char*& name, size_t& nameLength,
+                  uint64_t& fileSize, uint64_t& timestamp) const;
+
+    // accumulates records in memory, then writes them atomically
+    class Builder {
+    public:
+        void reserve(size_t count, size_t namesSize);
+        bool add(const std::string& name, uint64_t fileSize, uint64_t timestamp);
+        size_t getCount() const { return m_records.size(); }
+
+        // writes to path.tmp, syncs and renames over path
+        bool writeTo(const std::string& path) const;
+
+    private:
+        std::vector<SnapshotFormat::SnapshotRecord> m_records;
+        std::vector<char> m_names;
+    };
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    uint64_t m_count;
+    uint64_t m_createdAt;
+    const SnapshotFormat::SnapshotRecord* m_records;
+    const char* m_names;
+    uint64_t m_namesSize;
+
+#ifdef _WIN32
+    std::vector<uint8_t> m_buffer;
+#endif
+};
+
+#endif
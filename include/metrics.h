@@ -0,0 +1,79 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Server metrics
+//
+// counters and histograms live in a few cache-line aligned stripes, each
+// thread adds to its own stripe with relaxed atomics, so recording is an
+// uncontended add of a few ns and never a lock. a scrape sums the stripes
+// and renders Prometheus text. histograms use power-of-two buckets, the
+// bucket is the bit length of the value
+
+class Metrics {
+public:
+    // request types with their own counter and latency histogram,
+    // anything else is counted as "other"
+    static const unsigned OP_COUNT = 9;
+    // 1 us .. 2^26 us (~67 s) latency, 1 KB/s .. 2^36 B/s (~64 GB/s) throughput
+    static const unsigned LATENCY_BUCKETS = 27;
+    static const unsigned THROUGHPUT_BUCKETS = 27;
+    static const unsigned THROUGHPUT_MIN_BITS = 10;
+    static const unsigned STRIPES = 16;
+
+    enum Direction { DOWNLOAD = 0, UPLOAD = 1 };
+
+    Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // handler side, any thread
+    void recordRequest(uint8_t messageType, uint64_t durationUs);
+    void recordTransfer(Direction direction, uint64_t bytes, uint64_t durationUs);
+    void addBytesIn(uint64_t bytes) { add(stripe().bytesIn, bytes); }
+    void addBytesOut(uint64_t bytes) { add(stripe().bytesOut, bytes); }
+    void authFailed() { add(stripe().authFailures, 1); }
+    void errorSent() { add(stripe().errors, 1); }
+
+    // accept loop side
+    void connectionOpened();
+    void connectionClosed() { m_active.fetch_sub(1, std::memory_order_relaxed); }
+    void queuedChanged(int64_t delta) { m_queued.fetch_add(delta, std::memory_order_relaxed); }
+    void connectionRejected() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+
+    // Prometheus text exposition format 0.0.4
+    void render(std::string& out) const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> requests[OP_COUNT];
+        std::atomic<uint64_t> latencySumUs[OP_COUNT];
+        std::atomic<uint64_t> latency[OP_COUNT][LATENCY_BUCKETS + 1];
+        std::atomic<uint64_t> throughputSum[2];     // bytes/s, the histogram's _sum
+        std::atomic<uint64_t> throughput[2][THROUGHPUT_BUCKETS + 1];
+        std::atomic<uint64_t> bytesIn;
+        std::atomic<uint64_t> bytesOut;
+        std::atomic<uint64_t> authFailures;
+        std::atomic<uint64_t> errors;
+    };
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.fetch_add(amount, std::memory_order_relaxed);
+    }
+    Stripe& stripe();
+    static unsigned opIndex(uint8_t messageType);
+    static const char* opName(unsigned index);
+
+    Stripe m_stripes[STRIPES];
+    std::atomic<unsigned> m_nextStripe;
+    std::atomic<int64_t> m_active;
+    std::atomic<int64_t> m_queued;
+    std::atomic<uint64_t> m_connections;
+    std::atomic<uint64_t> m_rejected;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef METRICS_ENDPOINT_H
+#define METRICS_ENDPOINT_H
+
+#include "platform_wrapper.h"
+#include "metrics.h"
+#include <atomic>
+#include <string>
+
+// Prometheus scrape endpoint
+//
+// a minimal HTTP/1.0 listener on its own thread: GET /metrics answers
+// with Metrics::render(), anything else with 404, one request per
+// connection. scrapes come every few seconds, so requests are served
+// one at a time and a client that does not send its request in time
+// is dropped
+
+class MetricsEndpoint {
+public:
+    explicit MetricsEndpoint(const Metrics* metrics);
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // address defaults to loopback, the numbers are not for everyone
+    bool start(const std::string& address, uint16_t port);
+    void stop();
+
+    // "[address:]port" as given to --metrics
+    static bool parseAddress(const std::string& text, std::string& address, uint16_t& port);
+
+private:
+    static ThreadReturn THREAD_CALL endpointThreadFunction(void* arg);
+    void serve();
+    void handleRequest(Socket* client);
+
+    const Metrics* m_metrics;
+    Socket m_listenSocket;
+    Thread m_thread;
+    std::atomic<bool> m_running;
+};
+
+#endif
@@ -5,9 +5,16 @@
 #include <QString>
 #include <QStringList>
 #include <QThread>
+#include <QElapsedTimer>
+#include <atomic>
 #include "platform_wrapper.h"
 #include "protocol.h"
 
+// lives on a worker QThread of its own (see MainWindow): the slots are
+// the command queue, invoked through queued connections they run one
+// after another on the worker, in the order they were asked for, and the
+// blocking socket loops never touch the GUI thread. the signals reach
+// the GUI queued as well
 class NetworkClient : public QObject {
     Q_OBJECT
 
@@ -15,9 +22,18 @@ public:
     explicit NetworkClient(QObject *parent = nullptr);
     ~NetworkClient();
     
-    bool connectToServer(const QString& host, uint16_t port, const QString& password);
+    // readable from any thread
+    bool isConnected() const { return m_connected.load(); }
+    // before the worker starts, used from the next connectToServer() on
+    void setSocketTuning(const SocketTuning& tuning) { m_tuning = tuning; }
+    // any thread: ends a running transfer and the connection with it, so
+    // the worker can be stopped without waiting for a large file
+    void cancel();
+
+public slots:
+    // host "unix:/path" reaches a server started with --unix on this machine
+    void connectToServer(const QString& host, uint16_t port, const QString& password);
     void disconnect();
-    bool isConnected() const { return m_connected; }
     
     void refreshFileList();
     void uploadFile(const QString& localPath);
@@ -29,15 +45,35 @@ signals:
     void disconnected();
     void error(const QString& errorMsg);
     void fileListReceived(const QStringList& files);
+    // at most PROGRESS_INTERVAL_MS apart, and only when the percentage moved
     void transferProgress(int percent);
     void transferComplete(const QString& message);
 
 private:
+    // a progress bar cannot show more than the screen's refresh rate
+    static const int PROGRESS_INTERVAL_MS = 33;
+    
     bool sendMessage(uint8_t messageType, const std::vector<uint8_t>& payload);
+    // more: queue only, the message leaves with the next one sent
+    bool sendMessage(uint8_t messageType, const uint8_t* payload, size_t length, bool more = false);
     bool receiveMessage(Protocol::MessageHeader& header, std::vector<uint8_t>& payload);
+    void beginProgress();
+    void reportProgress(int percent);
+    void dropConnection();
+    void connectionLost(const QString& reason);
     
     Socket m_socket;
-    bool m_connected;
+    // held to close or shut down m_socket, so cancel() never hits a
+    // descriptor number the worker already gave back
+    Mutex m_socketMutex;
+    std::atomic<bool> m_connected;
+    std::atomic<bool> m_cancelled;
+    SocketTuning m_tuning;
+    // reused across messages and transfers
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_sendBuffer;
+    QElapsedTimer m_progressTimer;
+    int m_lastPercent;
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define PLATFORM_WRAPPER_H
 
 #include <string>
+#include <vector>
 #include <cstdint>
 
 #ifdef _WIN32
@@ -13,6 +14,7 @@
     typedef SOCKET SocketHandle;
     typedef HANDLE ThreadHandle;
     typedef CRITICAL_SECTION MutexHandle;
+    typedef CONDITION_VARIABLE ConditionHandle;
     typedef DWORD ThreadReturn;
     
     #define INVALID_SOCKET_HANDLE INVALID_SOCKET
@@ -33,6 +35,7 @@
     typedef int SocketHandle;
     typedef pthread_t ThreadHandle;
     typedef pthread_mutex_t MutexHandle;
+    typedef pthread_cond_t ConditionHandle;
     typedef void* ThreadReturn;
     
     #define INVALID_SOCKET_HANDLE -1
@@ -43,6 +46,34 @@
 class Socket;
 class Thread;
 class Mutex;
+class ConditionVariable;
+
+// one piece of a gathered send
+struct SocketBuffer {
+    const void* data;
+    size_t length;
+};
+
+// per-connection TCP tuning, applied to accepted and connecting sockets.
+// zero leaves the system default. buffer sizes turn off the kernel's
+// autotuning and are capped by net.core.[rw]mem_max; they must be set
+// before connect()/listen() to affect the window scale
+struct SocketTuning {
+    bool noDelay;               // TCP_NODELAY, send small writes at once
+    int sendBuffer;             // SO_SNDBUF bytes
+    int receiveBuffer;          // SO_RCVBUF bytes
+    uint32_t keepAliveIdleS;    // keepalive probes after this much silence, 0 = off
+    uint32_t keepAliveIntervalS;
+    uint32_t keepAliveCount;    // unanswered probes before the peer counts as dead
+    uint32_t busyPollUs;        // SO_BUSY_POLL, spin on the NIC queue instead of sleeping (Linux)
+
+    SocketTuning() : noDelay(false), sendBuffer(0), receiveBuffer(0), keepAliveIdleS(0),
+                     keepAliveIntervalS(0), keepAliveCount(0), busyPollUs(0) {}
+
+    // "default" (system behaviour), "lan-latency" or "wan-bulk"
+    static bool fromProfile(const std::string& name, SocketTuning& tuning);
+    static const char* profileNames() { return "default, lan-latency, wan-bulk"; }
+};
 
 // use correct thread library
 #ifdef _WIN32
@@ -66,31 +97,89 @@ public:
     Socket(Socket&& other) noexcept;
     Socket& operator=(Socket&& other) noexcept;
     
+    // IPv6 with IPv4 mapped in where available, else IPv4
     bool create();
+    // "0.0.0.0", "::" or empty bind to every address of both families
     bool bind(uint16_t port, const std::string& address = "0.0.0.0");
     bool listen(int backlog = 5);
     Socket* accept();
+    // host is a name, an IPv4 or IPv6 address, or "unix:/path" for a Unix
+    // domain socket (port ignored). names go through the resolver cache
+    // and all their addresses are raced (happy eyeballs), so connect
+    // makes its own socket and the one from create() is replaced; tuning
+    // is applied to each TCP attempt before its handshake
     bool connect(const std::string& host, uint16_t port);
+    bool connect(const std::string& host, uint16_t port, const SocketTuning& tuning);
+    
+    // Unix domain stream socket, same host only: no TCP/IP stack, no
+    // checksums, and descriptors can be passed along. false on Windows
+    bool createUnix();
+    // a stale socket file left by a crashed server is removed first
+    bool bindUnix(const std::string& path);
+    static bool isUnixAddress(const std::string& host);
+    bool isUnix() const;
     
     int send(const void* data, size_t length);
+    // several buffers in one call (sendmsg/WSASend), so a small header
+    // and its payload leave together without being copied into one.
+    // at most MAX_SEND_PARTS are taken, the return counts bytes across them
+    static const size_t MAX_SEND_PARTS = 8;
+    int sendv(const SocketBuffer* parts, size_t count);
     int receive(void* buffer, size_t length);
+    // data plus one descriptor (SCM_RIGHTS) over a Unix domain socket,
+    // the receiver gets its own descriptor for the same open file.
+    // receiveFd sets fd to -1 when none came with the data
+    int sendFd(const void* data, size_t length, int fd);
+    int receiveFd(void* buffer, size_t length, int& fd);
     
     bool setNonBlocking(bool nonBlocking);
     bool setReuseAddr(bool reuse);
+    bool setNoDelay(bool noDelay);
+    bool setSendBufferSize(int bytes);
+    bool setReceiveBufferSize(int bytes);
+    // idle/interval/count are left to the system where not supported
+    bool setKeepAlive(bool enable, uint32_t idleS = 0, uint32_t intervalS = 0, uint32_t count = 0);
+    // false where unsupported or not permitted (may need CAP_NET_ADMIN)
+    bool setBusyPoll(uint32_t microseconds);
+    // every non-default field of tuning, false if any of them failed.
+    // Unix domain sockets only take the buffer sizes
+    bool applyTuning(const SocketTuning& tuning);
+    // SO_REUSEPORT, lets several sockets listen on one port and the kernel
+    // balance connections between them. false where unsupported
+    bool setReusePort(bool reuse);
+    // true once accept()/receive() would not block, false on timeout
+    bool waitReadable(uint32_t milliseconds);
     
+    // stops further sends/receives, wakes threads blocked on this socket
+    bool shutdown();
+    // sends FIN after what was written, receiving still works
+    bool shutdownSend();
     void close();
     bool isValid() const;
     
     SocketHandle getHandle() const { return m_socket; }
     std::string getLastError() const;
     
+    // "unix" and 0 for Unix domain connections
     std::string getPeerAddress() const;
     uint16_t getPeerPort() const;
     
     static bool initializeSockets();
     static void cleanupSockets();
     
+    struct ResolvedAddress {
+        sockaddr_storage address;   // port 0
+        socklen_t length;
+    };
+    // getaddrinfo behind a per-process cache (RESOLVER_TTL_MS in socket.cpp)
+    // so reconnecting to the same name skips the DNS round trip; thread-safe
+    static bool resolve(const std::string& host, std::vector<ResolvedAddress>& addresses);
+    static void forgetResolved(const std::string& host);
+    
 private:
+    bool createFamily(int family);
+    int getFamily() const;
+    
     SocketHandle m_socket;
     bool m_isValid;
     
@@ -98,6 +187,21 @@ private:
 };
 
 
+// placement and identity of a new thread, defaults inherit everything
+// from the creating thread like a plain start(). name, NUMA node and
+// priority are applied by the thread itself before func runs
+struct ThreadOptions {
+    std::string name;           // shown by top/perf, cut to 15 chars (Linux)
+    std::vector<int> cpus;      // affinity, empty = creator's
+    int numaNode;               // preferred memory node, -1 = none; also the
+                                // affinity when cpus is empty (Linux)
+    size_t stackSize;           // bytes, 0 = platform default (8 MB on Linux)
+    size_t guardSize;           // bytes below the stack, 0 = platform default
+    int priority;               // nice value, -20..19, 0 = inherit
+
+    ThreadOptions() : numaNode(-1), stackSize(0), guardSize(0), priority(0) {}
+};
+
 class Thread {
 public:
     Thread();
@@ -108,12 +212,16 @@ public:
     Thread& operator=(const Thread&) = delete;
     
     bool start(ThreadFunction func, void* arg);
+    bool start(ThreadFunction func, void* arg, const ThreadOptions& options);
     bool join();
     bool detach();
     
     bool isRunning() const { return m_running; }
     ThreadHandle getHandle() const { return m_thread; }
     
+    // same placement for the calling thread, false if any part failed
+    static bool applyToCurrent(const ThreadOptions& options);
+    
     static uint64_t getCurrentThreadId();
     static void sleep(uint32_t milliseconds);
     
@@ -144,6 +252,28 @@ private:
     bool m_initialized;
 };
 
+// condition variable paired with Mutex, caller holds the mutex
+// around wait and re-checks its predicate after waking
+class ConditionVariable {
+public:
+    ConditionVariable();
+    ~ConditionVariable();
+    
+    // no copying
+    ConditionVariable(const ConditionVariable&) = delete;
+    ConditionVariable& operator=(const ConditionVariable&) = delete;
+    
+    void wait(Mutex& mutex);
+    // false if the timeout expired
+    bool waitFor(Mutex& mutex, uint32_t milliseconds);
+    void notifyOne();
+    void notifyAll();
+    
+private:
+    ConditionHandle m_cond;
+    bool m_initialized;
+};
+
 // lockguard class for mutex
 class LockGuard {
 public:
@@ -169,6 +299,13 @@ namespace PlatformUtils {
     
     std::string getLastErrorString();
     
+    // CPU topology, Linux reads sysfs, elsewhere there is one node
+    int getCpuCount();
+    int getNumaNodeOfCpu(int cpu);              // -1 if unknown
+    bool getNumaNodeCpus(int node, std::vector<int>& cpus);
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+    bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    
     // network byte order conversion
     inline uint16_t hostToNetwork16(uint16_t value) { return htons(value); }
     inline uint32_t hostToNetwork32(uint32_t value) { return htonl(value); }
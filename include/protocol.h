@@ -29,6 +29,9 @@ namespace Protocol {
         MSG_DOWNLOAD_COMPLETE = 0x0A,
         MSG_DELETE_REQUEST = 0x0B,
         MSG_DELETE_RESPONSE = 0x0C,
+        MSG_SERVER_BUSY = 0x0D,         // sent instead of CONNECT_RESPONSE, client retries later
+        MSG_SHM_REQUEST = 0x0E,         // switch this Unix socket connection to shared memory
+        MSG_SHM_RESPONSE = 0x0F,        // status; the segment's descriptor rides along (SCM_RIGHTS)
         MSG_ERROR_RESPONSE = 0xFE,
         MSG_DISCONNECT = 0xFF
     };
@@ -215,6 +218,73 @@ public:
         
         return payload;
     }
+    
+    // MSG_FILE_LIST_RESPONSE: uint32 count, then one FileInfo per file.
+    // sized up front, so the payload is allocated once
+    static bool createFileListPayload(const std::vector<Protocol::FileInfo>& files, std::vector<uint8_t>& payload) {
+        size_t payloadSize = sizeof(uint32_t);
+        for (const auto& file : files) {
+            payloadSize += sizeof(uint32_t) + file.filename.length() + 2 * sizeof(uint64_t);
+        }
+        
+        payload.resize(payloadSize);
+        uint32_t fileCount = htonl(static_cast<uint32_t>(files.size()));
+        std::memcpy(payload.data(), &fileCount, sizeof(uint32_t));
+        size_t offset = sizeof(uint32_t);
+        
+        for (const auto& file : files) {
+            size_t written = serializeFileInfo(file, payload.data() + offset, payloadSize - offset);
+            if (written == 0) return false;
+            offset += written;
+        }
+        return true;
+    }
+    
+    // MSG_SERVER_BUSY: uint32 retry-after in ms, then a text reason
+    static std::vector<uint8_t> createBusyPayload(uint32_t retryAfterMs, const std::string& message) {
+        std::vector<uint8_t> payload(sizeof(uint32_t) * 2 + message.length());
+        uint32_t netRetry = htonl(retryAfterMs);
+        std::memcpy(payload.data(), &netRetry, sizeof(uint32_t));
+        serializeString(message, payload.data() + sizeof(uint32_t), payload.size() - sizeof(uint32_t));
+        return payload;
+    }
+    
+    static bool parseBusyPayload(const uint8_t* buffer, size_t bufferSize, uint32_t& retryAfterMs, std::string& message) {
+        if (bufferSize < sizeof(uint32_t)) return false;
+        uint32_t netRetry;
+        std::memcpy(&netRetry, buffer, sizeof(uint32_t));
+        retryAfterMs = ntohl(netRetry);
+        
+        size_t bytesRead;
+        if (!deserializeString(buffer + sizeof(uint32_t), bufferSize - sizeof(uint32_t), message, bytesRead)) {
+            message.clear();
+        }
+        return true;
+    }
+
+    // for logs and stats dumps
+    static const char* messageTypeName(uint8_t type) {
+        switch (type) {
+            case Protocol::MSG_CONNECT_REQUEST: return "CONNECT_REQUEST";
+            case Protocol::MSG_CONNECT_RESPONSE: return "CONNECT_RESPONSE";
+            case Protocol::MSG_LIST_FILES: return "LIST_FILES";
+            case Protocol::MSG_FILE_LIST_RESPONSE: return "FILE_LIST_RESPONSE";
+            case Protocol::MSG_UPLOAD_REQUEST: return "UPLOAD_REQUEST";
+            case Protocol::MSG_UPLOAD_DATA: return "UPLOAD_DATA";
+            case Protocol::MSG_UPLOAD_COMPLETE: return "UPLOAD_COMPLETE";
+            case Protocol::MSG_DOWNLOAD_REQUEST: return "DOWNLOAD_REQUEST";
+            case Protocol::MSG_DOWNLOAD_DATA: return "DOWNLOAD_DATA";
+            case Protocol::MSG_DOWNLOAD_COMPLETE: return "DOWNLOAD_COMPLETE";
+            case Protocol::MSG_DELETE_REQUEST: return "DELETE_REQUEST";
+            case Protocol::MSG_DELETE_RESPONSE: return "DELETE_RESPONSE";
+            case Protocol::MSG_SERVER_BUSY: return "SERVER_BUSY";
+            case Protocol::MSG_SHM_REQUEST: return "SHM_REQUEST";
+            case Protocol::MSG_SHM_RESPONSE: return "SHM_RESPONSE";
+            case Protocol::MSG_ERROR_RESPONSE: return "ERROR_RESPONSE";
+            case Protocol::MSG_DISCONNECT: return "DISCONNECT";
+            default: return "UNKNOWN";
+        }
+    }
 };
 
 // helper to handle authentication along protocol
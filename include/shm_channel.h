@@ -0,0 +1,75 @@
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include "platform_wrapper.h"
+#include <cstddef>
+#include <cstdint>
+
+// Shared-memory channel
+//
+// a byte stream between two processes on one host through a pair of
+// single-producer/single-consumer rings (client->server, server->client)
+// in one shared memory segment. send/receive behave like the socket's:
+// send blocks until at least one byte fits, receive until at least one
+// byte is there, both may move less than asked for. so the Protocol
+// frames the handler writes go through unchanged and no request handling
+// knows which transport it is on.
+//
+// the fast path is two loads, a copy and a store; a futex doorbell in the
+// segment is only rung when the other side sleeps. the server creates the
+// segment (memfd) and passes its descriptor over the Unix domain socket
+// the client connected on, that socket stays open as the liveness check:
+// a sleeping side looks at it every WAIT_SLICE_MS and gives up once it
+// is closed or shut down (peer gone, reaper, server stopping).
+//
+// Linux only, create() and attach() fail elsewhere
+
+struct ShmSegment;
+
+class ShmChannel {
+public:
+    static const size_t DEFAULT_RING_SIZE = 4 * 1024 * 1024;
+    static const size_t MIN_RING_SIZE = 64 * 1024;
+    static const uint32_t WAIT_SLICE_MS = 100;
+
+    ShmChannel();
+    ~ShmChannel();
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // server side: a new segment with two rings of ringSize (rounded up
+    // to a power of two) bytes each. fd is for passing to the client,
+    // the caller closes it after sending
+    bool create(size_t ringSize, Socket* control, int& fd);
+    // client side, fd received from the server; the channel keeps its
+    // own mapping, the caller closes fd
+    bool attach(int fd, Socket* control);
+
+    // -1 with errno EPROTO when the peer left the ring's indices in a
+    // state no correct peer can, the connection must be dropped
+    int send(const void* data, size_t length);
+    // 0 once the peer closed its side, -1 when the control socket is gone
+    // or the indices are corrupt as for send()
+    int receive(void* buffer, size_t length);
+
+    // marks our side closed and wakes a sleeping peer, then unmaps
+    void close();
+    bool isOpen() const { return m_segment != nullptr; }
+    size_t getRingSize() const { return m_ringSize; }
+
+private:
+    bool map(int fd, size_t size);
+    bool peerGone() const;
+    int corrupted();
+
+    ShmSegment* m_segment;
+    size_t m_mappedSize;
+    size_t m_ringSize;
+    bool m_server;
+    Socket* m_control;
+    uint8_t* m_sendData;
+    uint8_t* m_receiveData;
+};
+
+#endif
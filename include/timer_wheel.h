@@ -0,0 +1,61 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck)
+//
+// four levels of 64 slots, level n holds timers 64^n..64^(n+1) ticks
+// out. schedule and cancel only link/unlink an intrusive node, advancing
+// one tick empties one level 0 slot and, every 64 ticks, spreads one
+// higher slot over the level below, so every timer costs O(1) per tick
+// no matter how many are pending. not thread safe, the owner locks
+
+struct TimerEntry {
+    TimerEntry* prev;
+    TimerEntry* next;
+    uint64_t expiry;        // absolute tick
+    bool scheduled;
+    void* owner;            // the object the entry is embedded in
+
+    TimerEntry() : prev(nullptr), next(nullptr), expiry(0), scheduled(false), owner(nullptr) {}
+};
+
+class TimerWheel {
+public:
+    static const unsigned LEVELS = 4;
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS = 1u << SLOT_BITS;
+    // farthest a timer can be placed, later expiries are clamped
+    static const uint64_t MAX_DELAY = (1ull << (SLOT_BITS * LEVELS)) - 1;
+
+    TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // (re)schedules entry, an expiry not in the future fires next tick
+    void schedule(TimerEntry* entry, uint64_t expiry);
+    void cancel(TimerEntry* entry);
+
+    // moves time forward to tick, appending every timer that ran out
+    void advance(uint64_t tick, std::vector<TimerEntry*>& expired);
+
+    uint64_t getCurrentTick() const { return m_current; }
+    size_t getPendingCount() const { return m_pending; }
+
+private:
+    void place(TimerEntry* entry);
+    void cascade(unsigned level);
+    void link(TimerEntry* head, TimerEntry* entry);
+    void unlink(TimerEntry* entry);
+
+    uint64_t m_current;
+    size_t m_pending;
+    // sentinel heads of circular lists
+    TimerEntry m_slots[LEVELS][SLOTS];
+};
+
+#endif
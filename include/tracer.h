@@ -0,0 +1,70 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Request tracing
+//
+// one request in N is sampled. while a sampled request runs, its thread
+// records a span for every TraceSpan scope it passes through: lock
+// waits, opens, reads and sends in the handler, FileManager and Socket
+// layers, each with its duration and byte count. spans collect in a
+// small per-thread batch that is moved, when the request ends, into a
+// bounded buffer that keeps the newest spans. dump() writes that buffer
+// as Chrome trace event JSON for chrome://tracing or ui.perfetto.dev,
+// one track per client. an unsampled request costs a thread_local test
+// per span site, so tracing can stay on at a low rate
+
+class Tracer {
+public:
+    // samples one request in sampleEvery (1 = all), capacity is in spans
+    static bool start(const std::string& path, uint32_t sampleEvery, size_t capacity = 65536);
+    // no new samples, the buffer is kept for a last dump()
+    static void stop();
+    // spans written, or -1 when the file could not be written
+    static long dump();
+    static const std::string& getPath();
+
+    // around each request, true when this one is sampled
+    static bool beginRequest(uint32_t clientId);
+    static void endRequest(const char* name, uint64_t startUs, uint64_t durationUs);
+
+    static bool active() { return t_active; }
+    // steady clock, the same one the handler times requests with
+    static uint64_t nowUs();
+    static void record(const char* category, const char* name, uint64_t startUs, uint64_t durationUs,
+                       int64_t bytes);
+
+private:
+    static thread_local bool t_active;
+};
+
+// one span from construction to end() or scope exit, names are literals
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name)
+        : m_category(category), m_name(name), m_bytes(-1), m_open(Tracer::active()),
+          m_startUs(m_open ? Tracer::nowUs() : 0) {}
+    ~TraceSpan() { end(); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void setBytes(int64_t bytes) { m_bytes = bytes; }
+    void end() {
+        if (!m_open) return;
+        m_open = false;
+        Tracer::record(m_category, m_name, m_startUs, Tracer::nowUs() - m_startUs, m_bytes);
+    }
+
+private:
+    const char* m_category;
+    const char* m_name;
+    int64_t m_bytes;
+    bool m_open;
+    uint64_t m_startUs;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include "platform_wrapper.h"
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Traffic capture
+//
+// records every message clients send (arrival time, connection, type,
+// payload length) and each connection's open and close, so the replay
+// tool can drive the same load against another build. handlers append
+// to an in-memory buffer, a writer thread moves it to disk, a handler
+// never waits on the file. a capture that cannot keep up drops records
+// and counts them instead of growing without bound, one whose file
+// cannot be written reports it and stops capturing.
+//
+// payloads are kept for the requests themselves (file names), upload
+// data only with recordData, as its size otherwise. CONNECT_REQUEST
+// carries the password hash and is never kept, the replayer sends its own
+//
+// file: magic "FSCAPTR1", uint32 version, uint32 flags, uint64 start
+// time (wall clock, us), then records. all integers in network order
+
+struct CaptureRecord {
+    enum Kind : uint8_t {
+        KIND_MESSAGE = 0,
+        KIND_OPEN = 1,
+        KIND_CLOSE = 2
+    };
+
+    uint64_t timeUs;                // since the capture started
+    uint32_t connectionId;
+    uint8_t kind;
+    uint8_t messageType;
+    uint32_t payloadLength;         // as sent, also when the payload is not kept
+    std::vector<uint8_t> payload;   // empty unless kept
+};
+
+class TrafficCapture {
+public:
+    static const uint32_t VERSION = 1;
+    static const uint32_t FLAG_DATA = 1;        // upload data payloads kept
+
+    TrafficCapture();
+    ~TrafficCapture();
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+    bool start(const std::string& path, bool recordData);
+    // writes out what is buffered and closes the file
+    void stop();
+    // a write failed, the file ends before the failed batch
+    bool hasFailed() const { return m_failed.load(std::memory_order_relaxed); }
+
+    // handler side, any thread. timeUs is from nowUs()
+    void recordOpen(uint32_t connectionId);
+    void recordClose(uint32_t connectionId);
+    void recordMessage(uint32_t connectionId, uint64_t timeUs, uint8_t messageType,
+                       const std::vector<uint8_t>& payload);
+
+    uint64_t getRecords() const { return m_records.load(std::memory_order_relaxed); }
+    uint64_t getDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    static uint64_t nowUs();
+
+    // whole capture into memory, false on a missing or damaged file
+    static bool readFile(const std::string& path, uint32_t& flags, std::vector<CaptureRecord>& records);
+
+private:
+    void append(uint64_t timeUs, uint32_t connectionId, uint8_t kind, uint8_t messageType,
+                uint32_t payloadLength, const uint8_t* payload, size_t keptLength);
+
+    static ThreadReturn THREAD_CALL writerThreadFunction(void* arg);
+    void writerThreadMain();
+
+    FILE* m_file;
+    std::string m_path;
+    bool m_recordData;
+    uint64_t m_startUs;
+    bool m_running;
+
+    Mutex m_mutex;
+    ConditionVariable m_cond;
+    std::vector<uint8_t> m_buffer;      // guarded by m_mutex, swapped out by the writer
+    uint64_t m_bufferRecords;           // records in m_buffer, guarded by m_mutex
+    Thread m_thread;
+
+    std::atomic<uint64_t> m_records;    // written to the file
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_failed;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef UPLOAD_WRITER_H
+#define UPLOAD_WRITER_H
+
+#include "platform_wrapper.h"
+#include "io_ring.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Write-behind file writer for uploads
+//
+// the network thread copies received chunks into large aligned blocks,
+// full blocks go through a bounded single-producer/single-consumer ring
+// to a disk thread that writes them with pwrite. when the ring is full
+// write() blocks, so the handler stops reading the socket and TCP
+// flow control slows the client down instead of buffering without bound.
+// uploads that fit in one block skip the thread and write inline.
+// given an io_uring ring, full blocks are queued on it as fixed-buffer
+// writes instead and go to the kernel with the connection's next
+// socket receive, no disk thread at all
+
+struct UploadWriterOptions {
+    size_t blockSize;       // bytes per disk write, multiple of 4096
+    size_t queueDepth;      // blocks in flight between network and disk
+    bool directIO;          // O_DIRECT, bypasses the page cache (Linux)
+    IoRing* ring;           // connection's ring, owned and driven by the caller's thread
+
+    UploadWriterOptions() : blockSize(1024 * 1024), queueDepth(8), directIO(false), ring(nullptr) {}
+};
+
+class UploadWriter {
+public:
+    UploadWriter();
+    ~UploadWriter();
+
+    UploadWriter(const UploadWriter&) = delete;
+    UploadWriter& operator=(const UploadWriter&) = delete;
+
+    // creates/truncates path and preallocates expectedSize bytes
+    bool open(const std::string& path, uint64_t expectedSize, const UploadWriterOptions& options);
+    // queues data, blocks while the disk thread is a full ring behind
+    bool write(const uint8_t* data, size_t length);
+    // flushes everything, trims the file to the bytes written and closes,
+    // false if any write failed along the way
+    bool close();
+
+    bool isOpen() const { return m_fd >= 0; }
+    uint64_t getBytesQueued() const { return m_bytesQueued; }
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t length;
+        uint64_t offset;
+        IoCompletion completion;    // ring mode only
+    };
+
+    static ThreadReturn THREAD_CALL diskThreadFunction(void* arg);
+    void diskThreadMain();
+
+    bool waitForSpace();
+    bool submitCurrentBlock();
+    size_t padForDirectIO(const Block& block);
+    bool writeBlock(const Block& block);
+    bool attachRing(IoRing* ring);
+    void retireRingWrites();
+    void releaseBuffers();
+
+    int m_fd;
+    bool m_pipelined;
+    bool m_directIO;
+    size_t m_blockSize;
+    uint64_t m_bytesQueued;
+    size_t m_fill;                     // bytes in the block being filled
+    IoRing* m_ringIo;                  // set when writes go through io_uring
+
+    // ring of blocks, slot = index % size, head/tail only ever grow
+    std::vector<Block> m_ring;
+    std::atomic<uint64_t> m_head;      // next slot the producer fills
+    std::atomic<uint64_t> m_tail;      // next slot the disk thread writes
+    std::atomic<bool> m_closing;
+    std::atomic<bool> m_failed;
+
+    // only used to sleep when the ring is full/empty, never on the fast path
+    Mutex m_waitMutex;
+    ConditionVariable m_spaceCond;
+    ConditionVariable m_dataCond;
+    std::atomic<bool> m_producerWaiting;
+    std::atomic<bool> m_consumerWaiting;
+
+    Thread m_diskThread;
+};
+
+#endif
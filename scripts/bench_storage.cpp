@@ -0,0 +1,88 @@
+#include "platform_wrapper.h"
+#include "file_manager.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Storage layout benchmark: open, stat and list latency for flat vs sharded
+// g++ -std=c++17 -O2 -pthread -Iinclude -o bench_storage scripts/bench_storage.cpp
+//     src/file_manager.cpp src/metadata_snapshot.cpp src/upload_writer.cpp src/mapped_file.cpp
+//     src/thread.cpp src/mutex.cpp src/condition_variable.cpp src/socket.cpp src/platform_utils.cpp
+// ./bench_storage /tmp/bench_storage 1000000
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedUs(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static std::string makeName(size_t i) {
+    return "file_" + std::to_string(i) + ".dat";
+}
+
+static void populate(FileManager& manager, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        std::ofstream file;
+        if (!manager.openForWriting(makeName(i), file)) {
+            std::cerr << "Failed to create " << makeName(i) << std::endl;
+            return;
+        }
+        file << 'x';
+        file.close();
+
+        if ((i + 1) % 100000 == 0) {
+            std::cout << "  created " << (i + 1) << " files" << std::endl;
+        }
+    }
+}
+
+static void runBenchmark(const std::string& dir, StorageLayout layout, size_t count, size_t samples) {
+    std::cout << "\n== " << FileManager::layoutName(layout) << " layout, "
+              << count << " files ==" << std::endl;
+
+    FileManager manager(dir, layout);
+    populate(manager, count);
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < samples; i++) {
+        std::ifstream file;
+        manager.openForReading(makeName(pick(rng)), file);
+    }
+    std::cout << "open: " << elapsedUs(start) / samples << " us/op" << std::endl;
+
+    start = Clock::now();
+    for (size_t i = 0; i < samples; i++) {
+        manager.fileExists(makeName(pick(rng)));
+    }
+    std::cout << "stat: " << elapsedUs(start) / samples << " us/op" << std::endl;
+
+    start = Clock::now();
+    std::vector<Protocol::FileInfo> files = manager.getFileList();
+    std::cout << "list: " << elapsedUs(start) / 1000.0 << " ms (" << files.size() << " entries)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <scratch_dir> <file_count> [samples]" << std::endl;
+        return 1;
+    }
+
+    std::string baseDir = argv[1];
+    size_t count = std::strtoull(argv[2], nullptr, 10);
+    size_t samples = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 100000;
+    if (count == 0) return 1;
+
+#ifdef _WIN32
+    mkdir(baseDir.c_str());
+#else
+    mkdir(baseDir.c_str(), 0755);
+#endif
+
+    runBenchmark(baseDir + "/flat", LAYOUT_FLAT, count, samples);
+    runBenchmark(baseDir + "/sharded", LAYOUT_SHARDED, count, samples);
+    return 0;
+}
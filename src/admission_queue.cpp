@@ -0,0 +1,104 @@
+#include "../include/admission_queue.h"
+#include <algorithm>
+#include <chrono>
+
+// Admission queue implementation
+
+// retry hints stay within these bounds whatever the estimate says
+static const uint32_t MIN_RETRY_MS = 100;
+static const uint32_t MAX_RETRY_MS = 30000;
+// a turned-away peer gets this long to finish sending its request
+static const uint32_t LINGER_MS = 1000;
+
+AdmissionQueue::AdmissionQueue(size_t capacity, uint32_t maxWaitMs)
+    : m_capacity(capacity), m_maxWaitMs(maxWaitMs), m_averageSlotMs(1000.0) {
+}
+
+AdmissionQueue::~AdmissionQueue() {
+    clear();
+}
+
+uint64_t AdmissionQueue::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool AdmissionQueue::push(Socket* socket) {
+    if (m_waiting.size() >= m_capacity) return false;
+    m_waiting.push_back(Waiting{socket, nowMs()});
+    return true;
+}
+
+Socket* AdmissionQueue::pop() {
+    if (m_waiting.empty()) return nullptr;
+    Socket* socket = m_waiting.front().socket;
+    m_waiting.pop_front();
+    return socket;
+}
+
+// FIFO, so the expired ones are all at the front
+void AdmissionQueue::expire(std::vector<Socket*>& expired) {
+    uint64_t now = nowMs();
+    while (!m_waiting.empty() && now - m_waiting.front().enqueuedMs >= m_maxWaitMs) {
+        expired.push_back(m_waiting.front().socket);
+        m_waiting.pop_front();
+    }
+}
+
+void AdmissionQueue::clear() {
+    for (Waiting& waiting : m_waiting) {
+        delete waiting.socket;
+    }
+    m_waiting.clear();
+    for (Waiting& lingering : m_lingering) {
+        delete lingering.socket;
+    }
+    m_lingering.clear();
+}
+
+void AdmissionQueue::linger(Socket* socket) {
+    socket->setNonBlocking(true);
+    socket->shutdownSend();
+    m_lingering.push_back(Waiting{socket, nowMs()});
+    drainLingering();
+}
+
+// closes each one at EOF, on error or when it had its time
+void AdmissionQueue::drainLingering() {
+    uint64_t now = nowMs();
+    uint8_t discard[512];
+
+    for (size_t i = 0; i < m_lingering.size(); ) {
+        bool done = now - m_lingering[i].enqueuedMs >= LINGER_MS;
+        for (int reads = 0; !done && reads < 16; reads++) {
+            int r = m_lingering[i].socket->receive(discard, sizeof(discard));
+            if (r > 0) continue;
+#ifdef _WIN32
+            done = r == 0 || SOCKET_ERROR_CODE != WSAEWOULDBLOCK;
+#else
+            done = r == 0 || (SOCKET_ERROR_CODE != EAGAIN && SOCKET_ERROR_CODE != EWOULDBLOCK);
+#endif
+            break;
+        }
+
+        if (done) {
+            delete m_lingering[i].socket;
+            m_lingering[i] = m_lingering.back();
+            m_lingering.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void AdmissionQueue::recordSlotTime(uint64_t milliseconds) {
+    m_averageSlotMs += (static_cast<double>(milliseconds) - m_averageSlotMs) / 8;
+}
+
+// slots free up at about slots / averageSlotMs per ms, a client asked to
+// come back should find the queue ahead of it (plus itself) drained
+uint32_t AdmissionQueue::retryAfterMs(size_t slots) const {
+    double estimate = m_averageSlotMs * static_cast<double>(m_waiting.size() + 1) /
+                      static_cast<double>(std::max<size_t>(slots, 1));
+    return static_cast<uint32_t>(std::min<double>(MAX_RETRY_MS, std::max<double>(MIN_RETRY_MS, estimate)));
+}
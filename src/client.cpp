@@ -2,95 +2,123 @@
 #include "../include/protocol.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
 
 
 // Command-line client API implementation
 
+// one line of a shell or batch session: "download a.bin out/a.bin"
+struct Command {
+    std::string name;
+    std::vector<std::string> args;
+    int line;
+};
+
+enum CommandResult {
+    RESULT_OK,
+    RESULT_FAILED,      // the command did not work, the connection is fine
+    RESULT_BROKEN       // the connection is gone, nothing more can run on it
+};
+
 class SimpleClient {
 public:
     SimpleClient() : m_connected(false) {}
     
+    // applied to every socket connect() creates
+    void setTuning(const SocketTuning& tuning) { m_tuning = tuning; }
+    
+    // a busy server names its retry time, wait that long (with jitter so
+    // clients turned away together do not return together) and try again
     bool connect(const std::string& host, uint16_t port, const std::string& passwordHash) {
-        if (!m_socket.create()) {
-            std::cerr << "Failed to create socket: " << m_socket.getLastError() << std::endl;
-            return false;
-        }
-        
-        std::cout << "Connecting to " << host << ":" << port << "..." << std::endl;
-        
-        if (!m_socket.connect(host, port)) {
-            std::cerr << "Failed to connect: " << m_socket.getLastError() << std::endl;
-            return false;
-        }
-        
-        std::cout << "Connected!" << std::endl;
-        m_connected = true;
-        
-        auto payload = ProtocolHelper::createTextPayload(passwordHash);
-        if (!sendMessage(Protocol::MSG_CONNECT_REQUEST, payload)) {
-            return false;
-        }
-        
-        Protocol::MessageHeader header;
-        std::vector<uint8_t> responsePayload;
-        if (!receiveMessage(header, responsePayload)) {
-            return false;
-        }
-        
-        if (header.messageType == Protocol::MSG_CONNECT_RESPONSE) {
-            std::string welcomeMsg;
-            size_t bytesRead;
-            ProtocolHelper::deserializeString(responsePayload.data(), responsePayload.size(), 
-                                            welcomeMsg, bytesRead);
-            std::cout << "Server: " << welcomeMsg << std::endl;
-            return true;
-        } else if (header.messageType == Protocol::MSG_ERROR_RESPONSE) {
-            std::cerr << "Authentication failed!" << std::endl;
-            return false;
+        for (int attempt = 0; ; attempt++) {
+            uint32_t retryAfterMs = 0;
+            if (tryConnect(host, port, passwordHash, retryAfterMs)) return true;
+            if (retryAfterMs == 0 || attempt + 1 >= MAX_BUSY_RETRIES) return false;
+            
+            uint32_t delayMs = retryAfterMs + static_cast<uint32_t>(std::rand() % (retryAfterMs / 2 + 1));
+            std::cout << "Retrying in " << delayMs << " ms..." << std::endl;
+            Thread::sleep(delayMs);
         }
-        
-        return false;
     }
     
-
     void disconnect() {
         if (m_connected) {
-            sendMessage(Protocol::MSG_DISCONNECT, {});
+            sendMessage(Protocol::MSG_DISCONNECT, nullptr, 0);
             m_socket.close();
             m_connected = false;
             std::cout << "Disconnected" << std::endl;
         }
     }
     
-
-    void listFiles() {
-        if (!m_connected) {
-            std::cerr << "Not connected" << std::endl;
-            return;
+    bool isConnected() const { return m_connected; }
+    
+    // list, download and delete are a request and a response each, the
+    // server answers in order, so several can be sent before the first
+    // answer is read. an upload waits for the server's go-ahead before
+    // its data and runs on its own
+    static bool isPipelinable(const Command& command) {
+        return command.name != "upload";
+    }
+    
+    CommandResult sendRequest(const Command& command) {
+        if (!m_connected) return RESULT_BROKEN;
+        
+        bool sent = true;
+        if (command.name == "list") {
+            sent = sendMessage(Protocol::MSG_LIST_FILES, nullptr, 0);
+        } else if (command.name == "download") {
+            sent = sendText(Protocol::MSG_DOWNLOAD_REQUEST, command.args[0]);
+        } else if (command.name == "delete") {
+            sent = sendText(Protocol::MSG_DELETE_REQUEST, command.args[0]);
         }
         
-        std::cout << "\nRequesting file list..." << std::endl;
-        
-        if (!sendMessage(Protocol::MSG_LIST_FILES, {})) {
-            std::cerr << "Failed to send list request" << std::endl;
-            return;
+        if (!sent) {
+            std::cerr << "Failed to send " << command.name << " request" << std::endl;
+            return broken();
         }
+        return RESULT_OK;
+    }
+    
+    // reads the answer to a request sendRequest() sent; an upload does all
+    // of its work here
+    CommandResult finishCommand(const Command& command) {
+        if (!m_connected) return RESULT_BROKEN;
+        
+        if (command.name == "list") return finishList();
+        if (command.name == "upload") return uploadFile(command.args[0]);
+        if (command.name == "download") return finishDownload(command.args[0], command.args[1]);
+        return finishDelete(command.args[0]);
+    }
+    
+    CommandResult run(const Command& command) {
+        CommandResult result = sendRequest(command);
+        return result == RESULT_OK ? finishCommand(command) : result;
+    }
+    
+    // send and receive implementations just client side
+private:
+    static const int MAX_BUSY_RETRIES = 5;
+    
+    CommandResult finishList() {
+        std::cout << "\nRequesting file list..." << std::endl;
         
         Protocol::MessageHeader header;
-        std::vector<uint8_t> payload;
-        if (!receiveMessage(header, payload)) {
+        if (!receiveMessage(header, m_payload)) {
             std::cerr << "Failed to receive file list" << std::endl;
-            return;
+            return broken();
         }
         
-        if (header.messageType != Protocol::MSG_FILE_LIST_RESPONSE) {
-            std::cerr << "Unexpected response" << std::endl;
-            return;
+        if (header.messageType != Protocol::MSG_FILE_LIST_RESPONSE || m_payload.size() < sizeof(uint32_t)) {
+            reportError(header, "Unexpected response");
+            return RESULT_FAILED;
         }
         
         uint32_t netFileCount;
-        std::memcpy(&netFileCount, payload.data(), sizeof(uint32_t));
+        std::memcpy(&netFileCount, m_payload.data(), sizeof(uint32_t));
         uint32_t fileCount = ntohl(netFileCount);
         
         std::cout << "\nFiles on server (" << fileCount << "):" << std::endl;
@@ -100,25 +128,21 @@ public:
         for (uint32_t i = 0; i < fileCount; i++) {
             Protocol::FileInfo fileInfo;
             size_t bytesRead;
-            if (ProtocolHelper::deserializeFileInfo(payload.data() + offset, payload.size() - offset, fileInfo, bytesRead)) {
+            if (ProtocolHelper::deserializeFileInfo(m_payload.data() + offset, m_payload.size() - offset, fileInfo, bytesRead)) {
                 std::cout << fileInfo.filename << " (" << fileInfo.fileSize << " bytes)" << std::endl;
                 offset += bytesRead;
             }
         }
         std::cout << "----------------------------------------" << std::endl;
+        return RESULT_OK;
     }
     
     
-    void uploadFile(const std::string& filepath) {
-        if (!m_connected) {
-            std::cerr << "Not connected" << std::endl;
-            return;
-        }
-        
+    CommandResult uploadFile(const std::string& filepath) {
         std::ifstream file(filepath, std::ios::binary | std::ios::ate);
         if (!file.is_open()) {
             std::cerr << "Failed to open file: " << filepath << std::endl;
-            return;
+            return RESULT_FAILED;
         }
         
         std::streamsize fileSize = file.tellg();
@@ -139,37 +163,38 @@ public:
         offset += ProtocolHelper::serializeString(filename, payload.data() + offset, payloadSize - offset);
         ProtocolHelper::serializeUint64(fileSize, payload.data() + offset);
         
-        if (!sendMessage(Protocol::MSG_UPLOAD_REQUEST, payload)) {
+        if (!sendMessage(Protocol::MSG_UPLOAD_REQUEST, payload.data(), payload.size())) {
             std::cerr << "Failed to send upload request" << std::endl;
-            return;
+            return broken();
         }
         
         // waits for OK response
         Protocol::MessageHeader header;
-        std::vector<uint8_t> responsePayload;
-        if (!receiveMessage(header, responsePayload)) {
+        if (!receiveMessage(header, m_payload)) {
             std::cerr << "Failed to receive response" << std::endl;
-            return;
+            return broken();
         }
         
-        if (responsePayload[0] != Protocol::STATUS_OK) {
-            std::cerr << "Server rejected upload" << std::endl;
-            return;
+        if (m_payload.empty() || m_payload[0] != Protocol::STATUS_OK) {
+            reportError(header, "Server rejected upload");
+            return RESULT_FAILED;
         }
         
         // send file data in chunks
         const size_t CHUNK_SIZE = 4096;
-        std::vector<uint8_t> buffer(CHUNK_SIZE);
+        m_chunk.resize(CHUNK_SIZE);
         size_t totalSent = 0;
         
-        while (totalSent < fileSize) {
-            size_t toRead = std::min(CHUNK_SIZE, static_cast<size_t>(fileSize - totalSent));
-            file.read(reinterpret_cast<char*>(buffer.data()), toRead);
+        while (totalSent < static_cast<size_t>(fileSize)) {
+            size_t toRead = std::min(CHUNK_SIZE, static_cast<size_t>(fileSize) - totalSent);
+            file.read(reinterpret_cast<char*>(m_chunk.data()), toRead);
             
-            std::vector<uint8_t> chunk(buffer.begin(), buffer.begin() + toRead);
-            if (!sendMessage(Protocol::MSG_UPLOAD_DATA, chunk)) {
+            // the last chunk waits for the complete message, sent alone that
+            // one would sit out the server's delayed ACK
+            bool last = totalSent + toRead == static_cast<size_t>(fileSize);
+            if (!sendMessage(Protocol::MSG_UPLOAD_DATA, m_chunk.data(), toRead, last)) {
                 std::cerr << "Failed to send chunk" << std::endl;
-                return;
+                return broken();
             }
             
             totalSent += toRead;
@@ -180,134 +205,214 @@ public:
         
         file.close();
         
-        sendMessage(Protocol::MSG_UPLOAD_COMPLETE, {});
-        
-        std::cout << "\nUpload complete!" << std::endl;
-    }
-    
-    void downloadFile(const std::string& filename, const std::string& savePath) {
-        if (!m_connected) {
-            std::cerr << "Not connected" << std::endl;
-            return;
+        if (!sendMessage(Protocol::MSG_UPLOAD_COMPLETE, nullptr, 0)) {
+            std::cerr << "\nFailed to complete upload" << std::endl;
+            return broken();
         }
         
-        std::cout << "\nDownloading: " << filename << std::endl;
-        
-        auto payload = ProtocolHelper::createTextPayload(filename);
-        if (!sendMessage(Protocol::MSG_DOWNLOAD_REQUEST, payload)) {
-            std::cerr << "Failed to send download request" << std::endl;
-            return;
+        // server acks once the file is stored (synced in durable mode)
+        if (!receiveMessage(header, m_payload)) {
+            std::cerr << "\nFailed to receive upload confirmation" << std::endl;
+            return broken();
         }
         
-        std::ofstream file(savePath, std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Failed to create file: " << savePath << std::endl;
-            return;
+        if (header.messageType != Protocol::MSG_UPLOAD_COMPLETE ||
+            m_payload.empty() || m_payload[0] != Protocol::STATUS_OK) {
+            std::cerr << "\nServer failed to store upload" << std::endl;
+            return RESULT_FAILED;
         }
         
-        // receive file in chunks
+        std::cout << "\nUpload complete!" << std::endl;
+        return RESULT_OK;
+    }
+    
+    // the local file is only created once the server has the one asked for
+    CommandResult finishDownload(const std::string& filename, const std::string& savePath) {
+        std::cout << "\nDownloading: " << filename << std::endl;
+        
+        std::ofstream file;
         size_t totalReceived = 0;
         while (true) {
             Protocol::MessageHeader header;
-            std::vector<uint8_t> chunkPayload;
-            
-            if (!receiveMessage(header, chunkPayload)) {
+            if (!receiveMessage(header, m_payload)) {
                 std::cerr << "Failed to receive chunk" << std::endl;
-                break;
+                return broken();
             }
             
-            if (header.messageType == Protocol::MSG_DOWNLOAD_COMPLETE) {
-                std::cout << "\nDownload complete! Saved to: " << savePath << std::endl;
-                break;
+            if (header.messageType == Protocol::MSG_ERROR_RESPONSE) {
+                reportError(header, "Server error during download");
+                return RESULT_FAILED;
             }
             
-            if (header.messageType == Protocol::MSG_ERROR_RESPONSE) {
-                std::cerr << "Server error during download" << std::endl;
-                break;
+            if (!file.is_open()) {
+                file.open(savePath, std::ios::binary);
+                if (!file.is_open()) {
+                    // the rest of the file still has to be read off the connection
+                    std::cerr << "Failed to create file: " << savePath << std::endl;
+                    while (header.messageType == Protocol::MSG_DOWNLOAD_DATA) {
+                        if (!receiveMessage(header, m_payload)) return broken();
+                    }
+                    return RESULT_FAILED;
+                }
+            }
+            
+            if (header.messageType == Protocol::MSG_DOWNLOAD_COMPLETE) {
+                std::cout << "\nDownload complete! Saved to: " << savePath << std::endl;
+                return RESULT_OK;
             }
             
             if (header.messageType == Protocol::MSG_DOWNLOAD_DATA) {
-                file.write(reinterpret_cast<char*>(chunkPayload.data()), chunkPayload.size());
-                totalReceived += chunkPayload.size();
+                file.write(reinterpret_cast<char*>(m_payload.data()), m_payload.size());
+                totalReceived += m_payload.size();
                 std::cout << "\rReceived: " << totalReceived << " bytes" << std::flush;
             }
         }
+    }
+    
+    
+    CommandResult finishDelete(const std::string& filename) {
+        std::cout << "\nDeleting: " << filename << std::endl;
         
-        file.close();
+        Protocol::MessageHeader header;
+        if (!receiveMessage(header, m_payload)) {
+            std::cerr << "Failed to receive delete response" << std::endl;
+            return broken();
+        }
+        
+        if (header.messageType == Protocol::MSG_DELETE_RESPONSE && !m_payload.empty() &&
+            m_payload[0] == Protocol::STATUS_OK) {
+            std::cout << "File deleted successfully" << std::endl;
+            return RESULT_OK;
+        }
+        std::cout << "Failed to delete file" << std::endl;
+        return RESULT_FAILED;
     }
     
-
-    void deleteFile(const std::string& filename) {
-        if (!m_connected) {
-            std::cerr << "Not connected" << std::endl;
-            return;
+    // prints the server's reason when the response is an error
+    void reportError(const Protocol::MessageHeader& header, const char* fallback) {
+        std::string reason;
+        size_t bytesRead;
+        if (header.messageType == Protocol::MSG_ERROR_RESPONSE && m_payload.size() > 1 &&
+            ProtocolHelper::deserializeString(m_payload.data() + 1, m_payload.size() - 1, reason, bytesRead)) {
+            std::cerr << fallback << ": " << reason << std::endl;
+        } else {
+            std::cerr << fallback << std::endl;
+        }
+    }
+    
+    CommandResult broken() {
+        m_socket.close();
+        m_connected = false;
+        return RESULT_BROKEN;
+    }
+    
+    bool tryConnect(const std::string& host, uint16_t port, const std::string& passwordHash,
+                    uint32_t& retryAfterMs) {
+        if (Socket::isUnixAddress(host)) {
+            std::cout << "Connecting to " << host << "..." << std::endl;
+        } else {
+            std::cout << "Connecting to " << host << ":" << port << "..." << std::endl;
         }
         
-        std::cout << "\nDeleting: " << filename << std::endl;
+        // tuning is best effort, a refused option does not stop the connection
+        if (!m_socket.connect(host, port, m_tuning)) {
+            std::cerr << "Failed to connect: " << m_socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        std::cout << "Connected!" << std::endl;
+        m_connected = true;
         
-        auto payload = ProtocolHelper::createTextPayload(filename);
-        if (!sendMessage(Protocol::MSG_DELETE_REQUEST, payload)) {
-            std::cerr << "Failed to send delete request" << std::endl;
-            return;
+        if (!sendText(Protocol::MSG_CONNECT_REQUEST, passwordHash)) {
+            return false;
         }
         
         Protocol::MessageHeader header;
         std::vector<uint8_t> responsePayload;
-        if (receiveMessage(header, responsePayload)) {
-            if (header.messageType == Protocol::MSG_DELETE_RESPONSE) {
-                if (responsePayload[0] == Protocol::STATUS_OK) {
-                    std::cout << "File deleted successfully" << std::endl;
-                } else {
-                    std::cout << "Failed to delete file" << std::endl;
-                }
-            }
+        if (!receiveMessage(header, responsePayload)) {
+            return false;
         }
-    }
-    
-    // send and receive implementations just client side
-private:
-    bool sendMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
-        Protocol::MessageHeader header(messageType, static_cast<uint32_t>(payload.size()));
         
-        uint8_t headerBuffer[8];
-        if (!ProtocolHelper::serializeHeader(header, headerBuffer, sizeof(headerBuffer))) {
+        if (header.messageType == Protocol::MSG_CONNECT_RESPONSE) {
+            std::string welcomeMsg;
+            size_t bytesRead;
+            ProtocolHelper::deserializeString(responsePayload.data(), responsePayload.size(),
+                                            welcomeMsg, bytesRead);
+            std::cout << "Server: " << welcomeMsg << std::endl;
+            return true;
+        } else if (header.messageType == Protocol::MSG_ERROR_RESPONSE) {
+            std::cerr << "Authentication failed!" << std::endl;
+            return false;
+        } else if (header.messageType == Protocol::MSG_SERVER_BUSY) {
+            std::string reason;
+            ProtocolHelper::parseBusyPayload(responsePayload.data(), responsePayload.size(),
+                                             retryAfterMs, reason);
+            std::cerr << "Server: " << reason << std::endl;
+            m_socket.close();
+            m_connected = false;
             return false;
         }
         
-        if (m_socket.send(headerBuffer, sizeof(headerBuffer)) != sizeof(headerBuffer)) {
+        return false;
+    }
+    
+    bool sendText(uint8_t messageType, const std::string& text) {
+        std::vector<uint8_t> payload = ProtocolHelper::createTextPayload(text);
+        return sendMessage(messageType, payload.data(), payload.size());
+    }
+    
+    // header and payload go out in one send: split, a small request's
+    // payload would wait in Nagle's buffer for the header's delayed ACK.
+    // with more the message stays queued and leaves with the next one
+    bool sendMessage(uint8_t messageType, const uint8_t* payload, size_t length, bool more = false) {
+        Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
+        
+        size_t start = m_sendBuffer.size();
+        m_sendBuffer.resize(start + 8 + length);
+        if (!ProtocolHelper::serializeHeader(header, m_sendBuffer.data() + start, 8)) {
+            m_sendBuffer.resize(start);
             return false;
         }
-        
-        if (!payload.empty()) {
-            if (m_socket.send(payload.data(), payload.size()) != static_cast<int>(payload.size())) {
+        if (length) std::memcpy(m_sendBuffer.data() + start + 8, payload, length);
+        if (more) return true;
+        
+        size_t sent = 0;
+        while (sent < m_sendBuffer.size()) {
+            int r = m_socket.send(m_sendBuffer.data() + sent, m_sendBuffer.size() - sent);
+            if (r <= 0) {
+                m_sendBuffer.clear();
                 return false;
             }
+            sent += r;
         }
-        
+        m_sendBuffer.clear();
         return true;
     }
     
     bool receiveMessage(Protocol::MessageHeader& header, std::vector<uint8_t>& payload) {
         uint8_t headerBuffer[8];
         
-        int received = m_socket.receive(headerBuffer, sizeof(headerBuffer));
-        if (received != sizeof(headerBuffer)) {
-            return false;
+        // the header can arrive split when large chunks are streaming
+        size_t received = 0;
+        while (received < sizeof(headerBuffer)) {
+            int r = m_socket.receive(headerBuffer + received, sizeof(headerBuffer) - received);
+            if (r <= 0) return false;
+            received += r;
         }
         
         if (!ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header)) {
             return false;
         }
         
-        if (header.payloadLength > 0) {
-            payload.resize(header.payloadLength);
-            int totalReceived = 0;
-            while (totalReceived < header.payloadLength) {
-                int r = m_socket.receive(payload.data() + totalReceived, 
-                                        header.payloadLength - totalReceived);
-                if (r <= 0) return false;
-                totalReceived += r;
-            }
+        // resize keeps the capacity, the buffers grow to the largest
+        // message once and stay there
+        payload.resize(header.payloadLength);
+        size_t totalReceived = 0;
+        while (totalReceived < header.payloadLength) {
+            int r = m_socket.receive(payload.data() + totalReceived,
+                                    header.payloadLength - totalReceived);
+            if (r <= 0) return false;
+            totalReceived += r;
         }
         
         return true;
@@ -315,16 +420,182 @@ private:
     
     Socket m_socket;
     bool m_connected;
+    SocketTuning m_tuning;
+    // reused by every command of a session
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_chunk;
+    std::vector<uint8_t> m_sendBuffer;
 };
 
+// at most this many requests are out before the oldest answer is read.
+// requests are small, so together they fit in the socket buffers and
+// sending them never blocks while the server is blocked sending to us
+static const size_t PIPELINE_DEPTH = 32;
+
+// a known command with the right number of arguments
+static bool checkCommand(const Command& command, std::string& error) {
+    size_t needed;
+    if (command.name == "list") {
+        needed = 0;
+    } else if (command.name == "upload" || command.name == "delete") {
+        needed = 1;
+    } else if (command.name == "download") {
+        needed = 2;
+    } else {
+        error = "unknown command '" + command.name + "'";
+        return false;
+    }
+    if (command.args.size() != needed) {
+        error = command.name + " takes " + std::to_string(needed) + " argument(s)";
+        return false;
+    }
+    return true;
+}
+
+// words split on blanks, "double quotes" keep a name with spaces together
+static bool parseCommand(const std::string& text, int line, Command& command, std::string& error) {
+    std::vector<std::string> words;
+    std::string word;
+    bool quoted = false, inWord = false;
+    for (char c : text) {
+        if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if (inWord) words.push_back(word);
+            word.clear();
+            inWord = false;
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (quoted) {
+        error = "unterminated quote";
+        return false;
+    }
+    if (inWord) words.push_back(word);
+    
+    command.line = line;
+    command.name = words.empty() ? "" : words[0];
+    command.args.assign(words.size() > 1 ? words.begin() + 1 : words.end(), words.end());
+    return checkCommand(command, error);
+}
+
+// blank lines and # comments are skipped
+static bool isBlank(const std::string& line) {
+    size_t first = line.find_first_not_of(" \t\r");
+    return first == std::string::npos || line[first] == '#';
+}
+
+// runs every command of the script on the one connection, pipelined up
+// to PIPELINE_DEPTH; a failed command is reported and the rest still
+// run, a broken connection ends the batch. false if anything failed
+static bool runBatch(SimpleClient& client, std::istream& input) {
+    std::vector<Command> commands;
+    std::string text;
+    int lineNumber = 0;
+    size_t invalid = 0;
+    while (std::getline(input, text)) {
+        lineNumber++;
+        if (isBlank(text)) continue;
+        Command command;
+        std::string error;
+        if (!parseCommand(text, lineNumber, command, error)) {
+            std::cerr << "line " << lineNumber << ": " << error << std::endl;
+            invalid++;
+            continue;
+        }
+        commands.push_back(command);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    size_t sent = 0, done = 0, failed = 0;
+    bool broken = false;
+    while (done < commands.size() && !broken) {
+        if (sent == done && !SimpleClient::isPipelinable(commands[done])) {
+            sent++;
+        } else {
+            while (sent < commands.size() && sent - done < PIPELINE_DEPTH &&
+                   SimpleClient::isPipelinable(commands[sent])) {
+                if (client.sendRequest(commands[sent]) != RESULT_OK) {
+                    broken = true;
+                    break;
+                }
+                sent++;
+            }
+        }
+        // what was sent still gets its answers read
+        while (done < sent) {
+            CommandResult result = client.finishCommand(commands[done]);
+            if (result == RESULT_BROKEN) {
+                broken = true;
+                break;
+            }
+            if (result == RESULT_FAILED) {
+                std::cerr << "line " << commands[done].line << ": " << commands[done].name << " failed" << std::endl;
+                failed++;
+            }
+            done++;
+            // keep the window full rather than draining it
+            if (!broken && sent < commands.size() && SimpleClient::isPipelinable(commands[sent])) break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    if (broken) {
+        std::cerr << "Connection lost, " << commands.size() - done << " command(s) not run" << std::endl;
+    }
+    std::cout << "\nBatch: " << done << " of " << commands.size() << " command(s) run, " << failed << " failed, "
+              << invalid << " invalid line(s), " << seconds << " s" << std::endl;
+    return !broken && failed == 0 && invalid == 0;
+}
+
+// one command at a time, typed at a prompt
+static void runShell(SimpleClient& client) {
+    std::string text;
+    int lineNumber = 0;
+    while (client.isConnected()) {
+        std::cout << "fs> " << std::flush;
+        if (!std::getline(std::cin, text)) break;
+        lineNumber++;
+        if (isBlank(text)) continue;
+        
+        std::istringstream words(text);
+        std::string first;
+        words >> first;
+        if (first == "quit" || first == "exit") break;
+        if (first == "help") {
+            std::cout << "list | upload <filepath> | download <filename> <savepath> | delete <filename> | quit"
+                      << std::endl;
+            continue;
+        }
+        
+        Command command;
+        std::string error;
+        if (!parseCommand(text, lineNumber, command, error)) {
+            std::cerr << error << std::endl;
+            continue;
+        }
+        if (client.run(command) == RESULT_BROKEN) {
+            std::cerr << "Connection lost" << std::endl;
+        }
+    }
+}
+
 void printUsage(const char* progName) {
     std::cout << "Usage:" << std::endl;
-    std::cout << "  " << progName << " <host> <port> <command> [args]" << std::endl;
+    std::cout << "  " << progName << " [--profile <name>] <host> <port> <command> [args]" << std::endl;
+    std::cout << "  --profile: socket tuning, " << SocketTuning::profileNames() << " (default: default)" << std::endl;
+    std::cout << "  host unix:<path> connects to the server's --unix socket, port is then ignored" << std::endl;
     std::cout << "\nCommands:" << std::endl;
     std::cout << "  list                    - List files on server" << std::endl;
     std::cout << "  upload <filepath>       - Upload file to server" << std::endl;
     std::cout << "  download <filename> <savepath> - Download file from server" << std::endl;
     std::cout << "  delete <filename>       - Delete file from server" << std::endl;
+    std::cout << "  shell                   - Prompt for commands, all on one connection" << std::endl;
+    std::cout << "  batch [file]            - Run the commands in file (default: the lines after the" << std::endl;
+    std::cout << "                            password on stdin) on one connection, pipelined" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -332,6 +603,21 @@ int main(int argc, char* argv[]) {
         std::cerr << "Failed to initialize platform" << std::endl;
         return 1;
     }
+    // busy-retry jitter
+    std::srand(static_cast<unsigned>(std::time(nullptr)) ^ static_cast<unsigned>(Thread::getCurrentThreadId()));
+    
+    SocketTuning tuning;
+    if (argc >= 3 && std::string(argv[1]) == "--profile") {
+        if (!SocketTuning::fromProfile(argv[2], tuning)) {
+            std::cerr << "Unknown socket profile: " << argv[2] << std::endl;
+            PlatformUtils::cleanup();
+            return 1;
+        }
+        // the rest reads as if the option was not there
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
     
     if (argc < 4) {
         printUsage(argv[0]);
@@ -343,33 +629,55 @@ int main(int argc, char* argv[]) {
     uint16_t port = static_cast<uint16_t>(std::atoi(argv[2]));
     std::string command = argv[3];
     
+    // a single command is checked before the password is asked for
+    Command single;
+    if (command != "shell" && command != "batch") {
+        single.name = command;
+        single.args.assign(argv + 4, argv + argc);
+        single.line = 0;
+        std::string error;
+        if (!checkCommand(single, error)) {
+            std::cerr << "Invalid command or missing arguments" << std::endl;
+            printUsage(argv[0]);
+            PlatformUtils::cleanup();
+            return 1;
+        }
+    }
+    
+    std::ifstream script;
+    if (command == "batch" && argc >= 5) {
+        script.open(argv[4]);
+        if (!script.is_open()) {
+            std::cerr << "Cannot open " << argv[4] << std::endl;
+            PlatformUtils::cleanup();
+            return 1;
+        }
+    }
+    
     std::string password;
     std::cout << "Enter password: ";
     std::getline(std::cin, password);
     std::string passwordHash = SecurityHelper::hashPassword(password);
-
+    
     SimpleClient client;
+    client.setTuning(tuning);
     
     if (!client.connect(host, port, passwordHash)) {
         PlatformUtils::cleanup();
         return 1;
     }
     
-    if (command == "list") {
-        client.listFiles();
-    } else if (command == "upload" && argc >= 5) {
-        client.uploadFile(argv[4]);
-    } else if (command == "download" && argc >= 6) {
-        client.downloadFile(argv[4], argv[5]);
-    } else if (command == "delete" && argc >= 5) {
-        client.deleteFile(argv[4]);
+    bool ok = true;
+    if (command == "shell") {
+        runShell(client);
+    } else if (command == "batch") {
+        ok = runBatch(client, script.is_open() ? static_cast<std::istream&>(script) : std::cin);
     } else {
-        std::cerr << "Invalid command or missing arguments" << std::endl;
-        printUsage(argv[0]);
+        ok = client.run(single) == RESULT_OK;
     }
     
     client.disconnect();
     
     PlatformUtils::cleanup();
-    return 0;
-}
\ No newline at end of file
+    return ok ? 0 : 1;
+}
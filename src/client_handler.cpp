@@ -1,106 +1,268 @@
 #include "../include/client_handler.h"
 #include "../include/file_manager.h"
-#include <iostream>
+#include "../include/commit_queue.h"
+#include "../include/logger.h"
+#include "../include/tracer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 
 
 // CLient Hndler for API implementation 
 
+static bool readFully(int fd, uint8_t* buffer, size_t length, uint64_t offset) {
+    while (length > 0) {
+#ifdef _WIN32
+        if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+        int r = _read(fd, buffer, static_cast<unsigned int>(length));
+#else
+        ssize_t r = pread(fd, buffer, length, static_cast<off_t>(offset));
+        if (r < 0 && errno == EINTR) continue;
+#endif
+        if (r <= 0) return false;
+        buffer += r;
+        length -= r;
+        offset += r;
+    }
+    return true;
+}
+
+static uint64_t monotonicUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
+static void closeDescriptor(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// receive buffer used while an upload streams in, many small
+// UPLOAD_DATA messages arrive per socket read
+static const size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+// io_uring backend: submission queue size per connection and the shape
+// of a download batch, CHUNKS_PER_BATCH read+send pairs per enter
+static const unsigned RING_ENTRIES = 64;
+static const size_t RING_CHUNK_SIZE = 64 * 1024;
+static const unsigned CHUNKS_PER_BATCH = 16;
+// small replies collect in the send buffer until the request is done,
+// a message that would take it past this goes out from the caller's
+// memory with the queued ones in front
+static const size_t SEND_BUFFER_SIZE = 4 * 1024;
 
+
+// counts as running from creation, otherwise the accept loop can
+// join a thread that has not started yet and stall until it ends
 ClientHandler::ClientHandler(Socket* clientSocket, FileManager* fileManager, uint32_t clientId,
-    const std::string& passwordHash)
-    : m_clientSocket(clientSocket), m_fileManager(fileManager), m_clientId(clientId),
-      m_running(false), m_uploadExpectedSize(0), m_uploadReceivedSize(0),
+    const std::string& passwordHash, const HandlerOptions& options, ConnectionStats* stats)
+    : m_clientSocket(clientSocket), m_fileManager(fileManager), m_options(options), m_clientId(clientId),
+      m_running(true), m_ring(nullptr), m_ringUnavailable(false), m_shm(nullptr), m_recvStart(0), m_recvEnd(0), m_stats(stats), m_operationStartUs(0),
+      m_uploadExpectedSize(0), m_uploadReceivedSize(0),
       m_serverPasswordHash(passwordHash), m_authenticated(false), m_failedAttempts(0) {
-    m_lastActivity = time(nullptr);
+    m_timer.socket = m_clientSocket;
+    m_timer.clientId = m_clientId;
 }
 
-// also deletes client socket with handler
+// also deletes client socket with handler, the ring goes first
+// since its fixed file table holds a reference to the socket
 ClientHandler::~ClientHandler() {
-    if (m_uploadFile.is_open()) {
-        m_uploadFile.close();
+    if (m_uploadWriter.isOpen()) {
+        m_uploadWriter.close();
     }
+    delete m_ring;
+    delete m_shm;
     delete m_clientSocket;
 }
 
 
+// the active gauge follows the handler rather than the slot: a finished
+// slot is only reaped on the next accept, which can be a long time off
 void ClientHandler::run() {
     m_running = true;
-    std::cout << "[Client " << m_clientId << "] Handler started" << std::endl;
+    Logger::debug(LogFields(m_clientId), "Handler started");
+    if (m_options.metrics) m_options.metrics->connectionOpened();
+    if (m_options.reaper) m_options.reaper->add(&m_timer);
+    if (m_options.capture) m_options.capture->recordOpen(m_clientId);
     handleClient();
+    if (m_options.capture) m_options.capture->recordClose(m_clientId);
+    if (m_options.reaper) m_options.reaper->remove(&m_timer);
+    if (m_options.metrics) m_options.metrics->connectionClosed();
     m_running = false;
-    std::cout << "[Client " << m_clientId << "] Handler finished" << std::endl;
+    Logger::debug(LogFields(m_clientId), "Handler finished");
+}
+
+
+void ClientHandler::stop() {
+    m_clientSocket->shutdown();
 }
 
 
 // main function along with handleMessage
 void ClientHandler::handleClient() {
     uint8_t headerBuffer[8];
+    // reused across messages so upload chunks do not allocate each time
+    std::vector<uint8_t> payload;
     
     while (true) {
-        // message header
-        int bytesReceived = m_clientSocket->receive(headerBuffer, sizeof(headerBuffer));
+        // message header, TCP may hand it over in pieces
+        int bytesReceived = receiveFully(headerBuffer, sizeof(headerBuffer));
         if (bytesReceived <= 0) {
-            std::cout << "[Client " << m_clientId << "] Disconnected (no data)" << std::endl;
+            Logger::info(LogFields(m_clientId), "Disconnected (no data)");
             break;
         }
         
         if (bytesReceived != sizeof(headerBuffer)) {
-            std::cerr << "[Client " << m_clientId << "] Incomplete header received" << std::endl;
+            Logger::warn(LogFields(m_clientId), "Incomplete header received");
             break;
         }
         
+        // from here until the reply is out a quiet peer counts as stalled
+        setBusy(true);
+        uint64_t arrivedUs = m_options.capture ? TrafficCapture::nowUs() : 0;
+        
         Protocol::MessageHeader header;
         if (!ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header)) {
-            std::cerr << "[Client " << m_clientId << "] Invalid header received" << std::endl;
+            Logger::warn(LogFields(m_clientId), "Invalid header received");
             sendErrorResponse("Invalid message header");
+            flushSends();
             break;
         }
         
-        std::cout << "[Client " << m_clientId << "] Received message type: 0x" << std::hex 
-                  << (int)header.messageType << std::dec << ", payload: " 
-                  << header.payloadLength << " bytes" << std::endl;
+        Logger::debug(LogFields(m_clientId, header.messageType, header.payloadLength), "Received message");
+        beginOperation(header.messageType);
         
         // get payload if present
-        std::vector<uint8_t> payload;
-        if (header.payloadLength > 0) {
-            payload.resize(header.payloadLength);
-            int totalReceived = 0;
-            while (totalReceived < header.payloadLength) {
-                int received = m_clientSocket->receive(payload.data() + totalReceived, 
-                                                      header.payloadLength - totalReceived);
-                if (received <= 0) {
-                    std::cerr << "[Client " << m_clientId << "] Failed to receive payload" << std::endl;
-                    return;
-                }
-                totalReceived += received;
-            }
+        payload.resize(header.payloadLength);
+        if (header.payloadLength > 0 &&
+            receiveFully(payload.data(), header.payloadLength) != static_cast<int>(header.payloadLength)) {
+            Logger::warn(LogFields(m_clientId, header.messageType), "Failed to receive payload");
+            return;
+        }
+        if (m_options.capture) {
+            m_options.capture->recordMessage(m_clientId, arrivedUs, header.messageType, payload);
         }
         
         bool shouldContinue = handleMessage(header.messageType, payload);
         if (!shouldContinue) {
             break;
         }
+        
+        // an open upload keeps the connection busy between data messages
+        setBusy(m_uploadWriter.isOpen());
+        endOperation();
+        if (!m_uploadWriter.isOpen()) {
+            releaseReceiveBuffer();
+        }
     }
 }
 
-// handle client's message to server
-bool ClientHandler::handleMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
-    updateActivity();
+// serves reads from the receive buffer first and refills it for small
+// reads, anything larger than the buffer goes straight to the caller
+int ClientHandler::receiveFully(uint8_t* buffer, size_t length) {
+    size_t received = 0;
+    
+    while (received < length) {
+        if (m_recvStart < m_recvEnd) {
+            size_t n = std::min(length - received, m_recvEnd - m_recvStart);
+            std::memcpy(buffer + received, m_recvBuffer.data() + m_recvStart, n);
+            m_recvStart += n;
+            received += n;
+            continue;
+        }
         
-    // checks time with handler
-    if (checkTimeout()) {
-        std::cout << "[Client " << m_clientId << "] Timeout - disconnecting" << std::endl;
+        int r;
+        if (!m_recvBuffer.empty() && length - received < m_recvBuffer.size()) {
+            r = receiveSome(m_recvBuffer.data(), m_recvBuffer.size());
+            m_recvStart = 0;
+            m_recvEnd = r > 0 ? r : 0;
+        } else {
+            r = receiveSome(buffer + received, length - received);
+            if (r > 0) received += r;
+        }
+        if (r <= 0) break;
+    }
+    
+    return static_cast<int>(received);
+}
+
+int ClientHandler::receiveSome(uint8_t* buffer, size_t length) {
+    if (m_shm) {
+        int r = m_shm->receive(buffer, length);
+        if (r > 0) countReceived(r);
+        if (r < 0 && errno == EPROTO) {
+            Logger::warn(LogFields(m_clientId), "shared memory ring indices out of range, dropping client");
+        }
+        return r;
+    }
+    if (m_ring) {
+        // this enter also carries the upload writes queued since the last one
+        if (!m_ring->prepRecv(RING_FILE_SOCKET, buffer, length, &m_recvCompletion) ||
+            !m_ring->waitFor(m_recvCompletion)) {
+            return -1;
+        }
+        if (m_recvCompletion.result > 0) countReceived(m_recvCompletion.result);
+        return m_recvCompletion.result;
+    }
+    int r = m_clientSocket->receive(buffer, length);
+    if (r > 0) countReceived(r);
+    return r;
+}
+
+// idle connections should not keep 64 KB around
+void ClientHandler::releaseReceiveBuffer() {
+    if (m_recvBuffer.empty() || m_recvStart < m_recvEnd) return;
+    std::vector<uint8_t>().swap(m_recvBuffer);
+    m_recvStart = 0;
+    m_recvEnd = 0;
+}
+
+bool ClientHandler::ensureRing() {
+    if (m_ring) return true;
+    if (m_options.ioBackend != IO_BACKEND_URING || m_ringUnavailable || m_shm) return false;
+    
+    IoRing* ring = new IoRing();
+    int files[RING_FILE_COUNT] = { static_cast<int>(m_clientSocket->getHandle()), -1 };
+    if (!ring->init(RING_ENTRIES) || !ring->registerFiles(files, RING_FILE_COUNT)) {
+        Logger::warn(LogFields(m_clientId), "io_uring setup failed, using blocking I/O");
+        delete ring;
+        m_ringUnavailable = true;
         return false;
     }
     
+    m_ring = ring;
+    return true;
+}
+
+bool ClientHandler::handleMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
+    bool traced = Tracer::beginRequest(m_clientId);
+    if (!m_options.metrics && !traced) {
+        bool keepGoing = dispatchMessage(messageType, payload);
+        return flushSends() && keepGoing;
+    }
+    
+    uint64_t startUs = monotonicUs();
+    bool keepGoing = dispatchMessage(messageType, payload);
+    // an error reply still goes out before the connection is dropped
+    keepGoing = flushSends() && keepGoing;
+    uint64_t durationUs = monotonicUs() - startUs;
+    if (m_options.metrics) m_options.metrics->recordRequest(messageType, durationUs);
+    if (traced) Tracer::endRequest(ProtocolHelper::messageTypeName(messageType), startUs, durationUs);
+    return keepGoing;
+}
+
+// handle client's message to server
+bool ClientHandler::dispatchMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
     switch (messageType) {
         case Protocol::MSG_CONNECT_REQUEST:
             return handleAuthentication(payload);
             
         case Protocol::MSG_DISCONNECT:
-            std::cout << "[Client " << m_clientId << "] Requested disconnect" << std::endl;
+            Logger::info(LogFields(m_clientId), "Requested disconnect");
             return false;
             
         // ALL these operations require Authentication from user
@@ -110,6 +272,7 @@ bool ClientHandler::handleMessage(uint8_t messageType, const std::vector<uint8_t
         case Protocol::MSG_UPLOAD_DATA:
         case Protocol::MSG_UPLOAD_COMPLETE:
         case Protocol::MSG_DELETE_REQUEST:
+        case Protocol::MSG_SHM_REQUEST:
             if (!checkAuthenticated()) {
                 sendErrorResponse("Not authenticated - password required");
                 return false;
@@ -118,8 +281,7 @@ bool ClientHandler::handleMessage(uint8_t messageType, const std::vector<uint8_t
             break;
             
         default:
-            std::cerr << "[Client " << m_clientId << "] Unknown message type: 0x" 
-                    << std::hex << (int)messageType << std::dec << std::endl;
+            Logger::warn(LogFields(m_clientId), "Unknown message type: 0x%x", messageType);
             sendErrorResponse("Unknown message type");
             return true;
     }
@@ -138,6 +300,8 @@ bool ClientHandler::handleMessage(uint8_t messageType, const std::vector<uint8_t
             return handleUploadComplete(payload);
         case Protocol::MSG_DELETE_REQUEST:
             return handleDeleteRequest(payload);
+        case Protocol::MSG_SHM_REQUEST:
+            return handleShmRequest();
         default:
             return true;
     }
@@ -159,16 +323,16 @@ bool ClientHandler::handleAuthentication(const std::vector<uint8_t>& payload) {
         m_authenticated = true;
         m_failedAttempts = 0;
         
-        std::cout << "[Client " << m_clientId << "] Authentication successful" << std::endl;
+        Logger::info(LogFields(m_clientId), "Authentication successful");
         
         std::string welcomeMsg = "Authentication successful - Welcome to File Server";
         auto responsePayload = ProtocolHelper::createTextPayload(welcomeMsg);
         return sendMessage(Protocol::MSG_CONNECT_RESPONSE, responsePayload);
     } else {
         m_failedAttempts++;
+        if (m_options.metrics) m_options.metrics->authFailed();
         
-        std::cout << "[Client " << m_clientId << "] Authentication FAILED (attempt " 
-                  << m_failedAttempts << ")" << std::endl;
+        Logger::warn(LogFields(m_clientId), "Authentication FAILED (attempt %d)", m_failedAttempts);
         
         if (m_failedAttempts >= 3) {
             sendErrorResponse("Too many failed attempts - disconnecting");
@@ -184,14 +348,46 @@ bool ClientHandler::checkAuthenticated() {
     return m_authenticated;
 }
 
-void ClientHandler::updateActivity() {
-    m_lastActivity = time(nullptr);
+// relaxed stores only, no clock read and no lock
+void ClientHandler::countReceived(size_t bytes) {
+    if (m_options.reaper) m_options.reaper->touch(&m_timer);
+    if (m_stats) ConnectionStats::add(m_stats->bytesIn, bytes);
+    if (m_options.metrics) m_options.metrics->addBytesIn(bytes);
+}
+
+void ClientHandler::countSent(size_t bytes) {
+    if (m_options.reaper) m_options.reaper->touch(&m_timer);
+    if (m_stats) ConnectionStats::add(m_stats->bytesOut, bytes);
+    if (m_options.metrics) m_options.metrics->addBytesOut(bytes);
+}
+
+void ClientHandler::setBusy(bool busy) {
+    m_timer.busy.store(busy, std::memory_order_relaxed);
+}
+
+// an upload is one operation from its request to its last data message
+void ClientHandler::beginOperation(uint8_t messageType) {
+    bool uploading = m_uploadWriter.isOpen() && (messageType == Protocol::MSG_UPLOAD_DATA ||
+                                                 messageType == Protocol::MSG_UPLOAD_COMPLETE);
+    if (!uploading) m_operationStartUs = monotonicUs();
+    
+    if (!m_stats) return;
+    ConnectionStats::add(m_stats->operations, 1);
+    if (!uploading) {
+        m_stats->operationStartMs.store(ClientRegistry::nowMs(), std::memory_order_relaxed);
+        m_stats->currentOperation.store(messageType, std::memory_order_relaxed);
+    }
 }
 
-// uses time(nullptr) to get seconds, feeds into protocol timeout
-bool ClientHandler::checkTimeout() {
-    time_t now = time(nullptr);
-    return (now - m_lastActivity) > Protocol::CONNECTION_TIMEOUT_SECONDS;
+int64_t ClientHandler::operationDurationUs() const {
+    return static_cast<int64_t>(monotonicUs() - m_operationStartUs);
+}
+
+void ClientHandler::endOperation() {
+    if (!m_stats) return;
+    if (!m_uploadWriter.isOpen()) {
+        m_stats->currentOperation.store(0, std::memory_order_relaxed);
+    }
 }
 
 
@@ -203,7 +399,7 @@ bool ClientHandler::handleConnectRequest(const std::vector<uint8_t>& payload) {
         ProtocolHelper::deserializeString(payload.data(), payload.size(), clientName, bytesRead);
     }
     
-    std::cout << "[Client " << m_clientId << "] Connect request from: " << clientName << std::endl;
+    Logger::info(LogFields(m_clientId), "Connect request from: %s", clientName.c_str());
     
     std::string welcomeMsg = "Welcome to Multi-Threaded File Server";
     auto responsePayload = ProtocolHelper::createTextPayload(welcomeMsg);
@@ -211,38 +407,18 @@ bool ClientHandler::handleConnectRequest(const std::vector<uint8_t>& payload) {
 }
 
 bool ClientHandler::handleListFiles() {
-    std::cout << "[Client " << m_clientId << "] List files request" << std::endl;
+    Logger::debug(LogFields(m_clientId), "List files request");
     
     std::vector<Protocol::FileInfo> files = m_fileManager->getFileList();
     
-    // get payload size
-    size_t payloadSize = sizeof(uint32_t);
-    for (const auto& file : files) {
-        payloadSize += sizeof(uint32_t) + file.filename.length();
-        payloadSize += sizeof(uint64_t);
-        payloadSize += sizeof(uint64_t);
-    }
-    
-    // build payload
-    std::vector<uint8_t> payload(payloadSize);
-    size_t offset = 0;
-    
-    uint32_t fileCount = htonl(static_cast<uint32_t>(files.size()));
-    std::memcpy(payload.data() + offset, &fileCount, sizeof(uint32_t));
-    offset += sizeof(uint32_t);
-    
-    // write each file
-    for (const auto& file : files) {
-        size_t written = ProtocolHelper::serializeFileInfo(file, payload.data() + offset, 
-                                                           payloadSize - offset);
-        if (written == 0) {
-            sendErrorResponse("Failed to serialize file list");
-            return true;
-        }
-        offset += written;
+    std::vector<uint8_t> payload;
+    if (!ProtocolHelper::createFileListPayload(files, payload)) {
+        sendErrorResponse("Failed to serialize file list");
+        return true;
     }
     
-    std::cout << "[Client " << m_clientId << "] Sending list of " << files.size() << " files" << std::endl;
+    Logger::info(LogFields(m_clientId, Protocol::MSG_LIST_FILES, static_cast<int64_t>(payload.size()),
+                           operationDurationUs()), "Sending list of %zu files", files.size());
     return sendMessage(Protocol::MSG_FILE_LIST_RESPONSE, payload);
 }
 
@@ -258,52 +434,189 @@ bool ClientHandler::handleDownloadRequest(const std::vector<uint8_t>& payload) {
     // use security handler to validate filename
     if (!SecurityHelper::isValidFilename(filename)) {
         sendErrorResponse("Invalid filename");
-        std::cout << "[Client " << m_clientId << "] SECURITY ALERT: Rejected filename: " 
-                  << filename << std::endl;
-        return true;
-    }
-    
-    std::cout << "[Client " << m_clientId << "] Download request for: " << filename << std::endl;
-    
-    std::ifstream file;
-    if (!m_fileManager->openForReading(filename, file)) {
-        sendErrorResponse("File not found");
+        Logger::warn(LogFields(m_clientId), "SECURITY ALERT: Rejected filename: %s", filename.c_str());
         return true;
     }
     
-    file.seekg(0, std::ios::end);
-    std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    Logger::debug(LogFields(m_clientId), "Download request for: %s", filename.c_str());
     
-    // send file data in chunks
-    const size_t CHUNK_SIZE = 4096;
-    std::vector<uint8_t> buffer(CHUNK_SIZE);
-    size_t totalSent = 0;
+    uint64_t fileSize = 0;
+    auto completePayload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK);
+    bool completeSent = false;
     
-    while (totalSent < fileSize) {
-        size_t toRead = std::min(CHUNK_SIZE, static_cast<size_t>(fileSize - totalSent));
-        file.read(reinterpret_cast<char*>(buffer.data()), toRead);
+    // an open upload owns the ring's data file slot, stay off the ring then
+    if (!m_uploadWriter.isOpen() && ensureRing()) {
+        int fd;
+        if (!m_fileManager->openForReading(filename, fd, fileSize)) {
+            sendErrorResponse("File not found");
+            return true;
+        }
         
-        if (!sendMessage(Protocol::MSG_DOWNLOAD_DATA, 
-                       std::vector<uint8_t>(buffer.begin(), buffer.begin() + toRead))) {
-            std::cerr << "[Client " << m_clientId << "] Failed to send file chunk" << std::endl;
-            file.close();
+        // the ring sends all but the last chunk, that one leaves in the
+        // same send as the complete message
+        uint64_t tailLength = fileSize % RING_CHUNK_SIZE;
+        if (tailLength == 0) tailLength = std::min<uint64_t>(fileSize, RING_CHUNK_SIZE);
+        uint64_t tailOffset = fileSize - tailLength;
+        bool sent = tailOffset == 0 || sendFileThroughRing(fd, tailOffset);
+        if (sent && tailLength > 0) {
+            TraceSpan chunkSpan("handler", "chunk");
+            chunkSpan.setBytes(static_cast<int64_t>(tailLength));
+            std::vector<uint8_t> tail(static_cast<size_t>(tailLength));
+            sent = readFully(fd, tail.data(), tail.size(), tailOffset) &&
+                   sendMessageThen(Protocol::MSG_DOWNLOAD_DATA, tail.data(), tail.size(),
+                                   Protocol::MSG_DOWNLOAD_COMPLETE, completePayload);
+            completeSent = true;
+        }
+        closeDescriptor(fd);
+        if (!sent) {
+            Logger::warn(LogFields(m_clientId, Protocol::MSG_DOWNLOAD_REQUEST), "Failed to send file chunk");
             return false;
         }
+    } else {
+        MappedFileReader file;
+        if (!m_fileManager->openForReading(filename, file)) {
+            sendErrorResponse("File not found");
+            return true;
+        }
+        
+        fileSize = file.getSize();
         
-        totalSent += toRead;
+        // send file data in chunks, straight out of the mapping
+        const size_t CHUNK_SIZE = 64 * 1024;
+        const uint8_t* chunk;
+        size_t chunkLength;
+        
+        // the disk reads happen as page faults inside the chunk's sends.
+        // a chunk is too large to be queued, the span times its send
+        while (file.next(CHUNK_SIZE, chunk, chunkLength)) {
+            TraceSpan chunkSpan("handler", "chunk");
+            chunkSpan.setBytes(static_cast<int64_t>(chunkLength));
+            completeSent = file.getPosition() == fileSize;
+            bool sent = completeSent
+                ? sendMessageThen(Protocol::MSG_DOWNLOAD_DATA, chunk, chunkLength,
+                                  Protocol::MSG_DOWNLOAD_COMPLETE, completePayload)
+                : sendMessage(Protocol::MSG_DOWNLOAD_DATA, chunk, chunkLength);
+            if (!sent) {
+                Logger::warn(LogFields(m_clientId, Protocol::MSG_DOWNLOAD_REQUEST), "Failed to send file chunk");
+                return false;
+            }
+        }
+        
+        if (file.getPosition() != fileSize) {
+            Logger::error(LogFields(m_clientId), "Failed to map %s", filename.c_str());
+            sendErrorResponse("Failed to read file");
+            return true;
+        }
     }
     
-    file.close();
-    
-    auto completePayload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK);
-    sendMessage(Protocol::MSG_DOWNLOAD_COMPLETE, completePayload);
+    // an empty file has no last chunk to take it along
+    if (!completeSent) {
+        sendMessage(Protocol::MSG_DOWNLOAD_COMPLETE, completePayload);
+    }
     
-    std::cout << "[Client " << m_clientId << "] Download complete: " << filename 
-              << " (" << fileSize << " bytes)" << std::endl;
+    Logger::info(LogFields(m_clientId, Protocol::MSG_DOWNLOAD_REQUEST, static_cast<int64_t>(fileSize),
+                           operationDurationUs()), "Download complete: %s", filename.c_str());
+    if (m_options.metrics) {
+        m_options.metrics->recordTransfer(Metrics::DOWNLOAD, fileSize, operationDurationUs());
+    }
     return true;
 }
 
+// each chunk's message header sits in front of its data in a registered
+// buffer, chunks go out as linked READ_FIXED -> SEND pairs and a whole
+// batch of them is one io_uring_enter. whatever the ring did not finish
+// (short send, a chain cut short, no registered buffers, a full queue
+// that could not be submitted) is completed with pread/send in order
+// before the next batch
+bool ClientHandler::sendFileThroughRing(int fd, uint64_t fileSize) {
+    const size_t slotSize = 8 + RING_CHUNK_SIZE;
+    std::vector<uint8_t> storage(CHUNKS_PER_BATCH * slotSize);
+    uint8_t* slots[CHUNKS_PER_BATCH];
+    for (unsigned i = 0; i < CHUNKS_PER_BATCH; i++) {
+        slots[i] = storage.data() + i * slotSize;
+    }
+    
+    bool registered = m_ring->registerBuffers(slots, slotSize, CHUNKS_PER_BATCH);
+    if (registered && !m_ring->updateFile(RING_FILE_DATA, fd)) {
+        m_ring->unregisterBuffers();
+        registered = false;
+    }
+    
+    IoCompletion reads[CHUNKS_PER_BATCH];
+    IoCompletion sends[CHUNKS_PER_BATCH];
+    bool readQueued[CHUNKS_PER_BATCH];
+    bool sendQueued[CHUNKS_PER_BATCH];
+    size_t lengths[CHUNKS_PER_BATCH];
+    uint64_t offsets[CHUNKS_PER_BATCH];
+    uint64_t offset = 0;
+    bool ok = true;
+    
+    while (ok && offset < fileSize) {
+        TraceSpan batchSpan("handler", "ring_batch");
+        batchSpan.setBytes(static_cast<int64_t>(std::min<uint64_t>(CHUNKS_PER_BATCH * RING_CHUNK_SIZE,
+                                                                   fileSize - offset)));
+        unsigned count = 0;
+        // once an entry cannot be queued the rest of the batch goes the
+        // fallback way, a later entry would join the chain left open
+        bool queueing = registered;
+        while (count < CHUNKS_PER_BATCH && offset < fileSize) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(RING_CHUNK_SIZE, fileSize - offset));
+            Protocol::MessageHeader header(Protocol::MSG_DOWNLOAD_DATA, static_cast<uint32_t>(length));
+            ProtocolHelper::serializeHeader(header, slots[count], 8);
+            lengths[count] = length;
+            offsets[count] = offset;
+            reads[count].reset();
+            sends[count].reset();
+            readQueued[count] = false;
+            sendQueued[count] = false;
+            offset += length;
+            
+            if (queueing) {
+                bool last = (count + 1 == CHUNKS_PER_BATCH || offset >= fileSize);
+                readQueued[count] = m_ring->prepReadFixed(RING_FILE_DATA, slots[count] + 8, length, offsets[count],
+                                                          count, &reads[count], true);
+                sendQueued[count] = readQueued[count] &&
+                    m_ring->prepSend(RING_FILE_SOCKET, slots[count], length + 8, &sends[count], !last);
+                queueing = sendQueued[count];
+            }
+            count++;
+        }
+        
+        // the buffers are reused next batch, so every entry must be back.
+        // waiting submits whatever is still queued
+        for (unsigned i = 0; i < count; i++) {
+            if ((readQueued[i] && !m_ring->waitFor(reads[i])) ||
+                (sendQueued[i] && !m_ring->waitFor(sends[i]))) {
+                ok = false;
+                break;
+            }
+            if (sendQueued[i] && sends[i].result > 0) countSent(sends[i].result);
+        }
+        
+        for (unsigned i = 0; ok && i < count; i++) {
+            size_t total = lengths[i] + 8;
+            if (sendQueued[i] && sends[i].result == static_cast<int32_t>(total)) continue;
+            
+            size_t sent = (sendQueued[i] && sends[i].result > 0) ? sends[i].result : 0;
+            if (!readQueued[i] || reads[i].result != static_cast<int32_t>(lengths[i])) {
+                TraceSpan readSpan("file", "read");
+                readSpan.setBytes(static_cast<int64_t>(lengths[i]));
+                if (!readFully(fd, slots[i] + 8, lengths[i], offsets[i])) {
+                    ok = false;
+                    break;
+                }
+            }
+            ok = sendAll(slots[i] + sent, total - sent);
+        }
+    }
+    
+    if (registered) {
+        m_ring->updateFile(RING_FILE_DATA, -1);
+        m_ring->unregisterBuffers();
+    }
+    return ok;
+}
+
 bool ClientHandler::handleUploadRequest(const std::vector<uint8_t>& payload) {
     std::string filename;
     size_t bytesRead;
@@ -315,8 +628,7 @@ bool ClientHandler::handleUploadRequest(const std::vector<uint8_t>& payload) {
     // Use security to validate filename
     if (!SecurityHelper::isValidFilename(filename)) {
         sendErrorResponse("Invalid filename - may contain path traversal or illegal characters");
-        std::cout << "[Client " << m_clientId << "] SECURITY ALERT: Rejected filename: " 
-                  << filename << std::endl;
+        Logger::warn(LogFields(m_clientId), "SECURITY ALERT: Rejected filename: %s", filename.c_str());
         return true;
     }
 
@@ -325,21 +637,33 @@ bool ClientHandler::handleUploadRequest(const std::vector<uint8_t>& payload) {
     // Use security to validate filesize
     if (!SecurityHelper::isValidFileSize(fileSize)) {
         sendErrorResponse("File too large - maximum 1GB allowed");
-        std::cout << "[Client " << m_clientId << "] SECURITY ALERT: Rejected large file: " 
-                  << fileSize << " bytes" << std::endl;
+        Logger::warn(LogFields(m_clientId, Protocol::MSG_UPLOAD_REQUEST, static_cast<int64_t>(fileSize)),
+                     "SECURITY ALERT: Rejected large file");
         return true;
     }
 
 
-    std::cout << "[Client " << m_clientId << "] Upload request for: " << filename 
-              << " (" << fileSize << " bytes)" << std::endl;
+    Logger::debug(LogFields(m_clientId, Protocol::MSG_UPLOAD_REQUEST, static_cast<int64_t>(fileSize)),
+                  "Upload request for: %s", filename.c_str());
     
-    if (!m_fileManager->openForWriting(filename, m_uploadFile)) {
+    if (m_uploadWriter.isOpen()) {
+        // a new request abandons the previous, never completed upload
+        m_uploadWriter.close();
+    }
+    UploadWriterOptions uploadOptions = m_options.upload;
+    if (ensureRing()) {
+        uploadOptions.ring = m_ring;
+    }
+    
+    if (!m_fileManager->openForWriting(filename, m_uploadWriter, fileSize, uploadOptions)) {
         sendErrorResponse("Cannot create file");
         return true;
     }
     
-    // store upload state
+    // store upload state, data messages are read through the receive buffer
+    if (m_recvBuffer.empty()) {
+        m_recvBuffer.resize(RECEIVE_BUFFER_SIZE);
+    }
     m_uploadFilename = filename;
     m_uploadExpectedSize = fileSize;
     m_uploadReceivedSize = 0;
@@ -347,28 +671,57 @@ bool ClientHandler::handleUploadRequest(const std::vector<uint8_t>& payload) {
     auto okPayload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK);
     sendMessage(Protocol::MSG_CONNECT_RESPONSE, okPayload);
     
-    std::cout << "[Client " << m_clientId << "] Ready to receive upload data..." << std::endl;
+    Logger::debug(LogFields(m_clientId), "Ready to receive upload data...");
     return true;
 }
 
-// writes chunks to file
+// queues chunks for the disk writer, blocks here (and so stops reading
+// the socket) while the writer is a full queue behind
 bool ClientHandler::handleUploadData(const std::vector<uint8_t>& payload) {
-    if (!m_uploadFile.is_open()) {
+    if (!m_uploadWriter.isOpen()) {
         sendErrorResponse("No active upload");
         return true;
     }
     
-    m_uploadFile.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    TraceSpan writeSpan("file", "write");
+    writeSpan.setBytes(static_cast<int64_t>(payload.size()));
+    // a failed write is reported when the client completes the upload
+    m_uploadWriter.write(payload.data(), payload.size());
+    writeSpan.end();
     m_uploadReceivedSize += payload.size();
     
     return true;
 }
 
+// acknowledges the upload once the data is where we promised,
+// in durable mode that means synced to disk by the commit queue
 bool ClientHandler::handleUploadComplete(const std::vector<uint8_t>& payload) {
-    if (m_uploadFile.is_open()) {
-        m_uploadFile.close();
-        std::cout << "[Client " << m_clientId << "] Upload complete: " << m_uploadFilename 
-                  << " (" << m_uploadReceivedSize << " bytes received)" << std::endl;
+    if (!m_uploadWriter.isOpen()) {
+        sendErrorResponse("No active upload");
+        return true;
+    }
+    
+    TraceSpan closeSpan("file", "close");
+    bool success = m_uploadWriter.close();
+    closeSpan.end();
+    
+    if (success && m_options.commitQueue) {
+        success = m_options.commitQueue->commit(m_fileManager->getFilePath(m_uploadFilename));
+    }
+    m_fileManager->commitFile(m_uploadFilename);
+    
+    if (success) {
+        Logger::info(LogFields(m_clientId, Protocol::MSG_UPLOAD_REQUEST, static_cast<int64_t>(m_uploadReceivedSize),
+                               operationDurationUs()), "Upload complete: %s", m_uploadFilename.c_str());
+        if (m_options.metrics) {
+            m_options.metrics->recordTransfer(Metrics::UPLOAD, m_uploadReceivedSize, operationDurationUs());
+        }
+        auto okPayload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK);
+        sendMessage(Protocol::MSG_UPLOAD_COMPLETE, okPayload);
+    } else {
+        Logger::error(LogFields(m_clientId, Protocol::MSG_UPLOAD_REQUEST), "Upload failed to persist: %s",
+                      m_uploadFilename.c_str());
+        sendErrorResponse("Failed to store file");
     }
     
     // clear upload state
@@ -389,17 +742,17 @@ bool ClientHandler::handleDeleteRequest(const std::vector<uint8_t>& payload) {
 
     if (!SecurityHelper::isValidFilename(filename)) {
         sendErrorResponse("Invalid filename");
-        std::cout << "[Client " << m_clientId << "] SECURITY ALERT: Rejected filename: " 
-                  << filename << std::endl;
+        Logger::warn(LogFields(m_clientId), "SECURITY ALERT: Rejected filename: %s", filename.c_str());
         return true;
     }
     
-    std::cout << "[Client " << m_clientId << "] Delete request for: " << filename << std::endl;
+    Logger::debug(LogFields(m_clientId), "Delete request for: %s", filename.c_str());
     
     if (m_fileManager->deleteFile(filename)) {
         auto okPayload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK, "File deleted");
         sendMessage(Protocol::MSG_DELETE_RESPONSE, okPayload);
-        std::cout << "[Client " << m_clientId << "] File deleted: " << filename << std::endl;
+        Logger::info(LogFields(m_clientId, Protocol::MSG_DELETE_REQUEST, -1, operationDurationUs()),
+                     "File deleted: %s", filename.c_str());
     } else {
         sendErrorResponse("Failed to delete file");
     }
@@ -407,28 +760,156 @@ bool ClientHandler::handleDeleteRequest(const std::vector<uint8_t>& payload) {
     return true;
 }
 
+// the response carries the segment's descriptor, the client maps it and
+// both sides move over before anything else is sent
+bool ClientHandler::handleShmRequest() {
+    if (!m_options.shmRingSize || m_shm || !m_clientSocket->isUnix() || m_uploadWriter.isOpen()) {
+        sendErrorResponse("Shared memory transport not available on this connection");
+        return true;
+    }
+    
+    ShmChannel* channel = new ShmChannel();
+    int fd;
+    if (!channel->create(m_options.shmRingSize, m_clientSocket, fd)) {
+        delete channel;
+        Logger::warn(LogFields(m_clientId), "Failed to create shared memory segment");
+        sendErrorResponse("Failed to create shared memory segment");
+        return true;
+    }
+    
+    auto payload = ProtocolHelper::createStatusPayload(Protocol::STATUS_OK);
+    std::vector<uint8_t> message(8 + payload.size());
+    Protocol::MessageHeader header(Protocol::MSG_SHM_RESPONSE, static_cast<uint32_t>(payload.size()));
+    ProtocolHelper::serializeHeader(header, message.data(), 8);
+    std::memcpy(message.data() + 8, payload.data(), payload.size());
+    
+    int sent = m_clientSocket->sendFd(message.data(), message.size(), fd);
+    closeDescriptor(fd);
+    if (sent <= 0 || !sendAll(message.data() + sent, message.size() - sent)) {
+        delete channel;
+        return false;
+    }
+    countSent(sent);
+    
+    m_shm = channel;
+    Logger::info(LogFields(m_clientId), "Switched to shared memory transport (2 x %zu KB rings)",
+                 channel->getRingSize() / 1024);
+    return true;
+}
+
 bool ClientHandler::sendMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
-    Protocol::MessageHeader header(messageType, static_cast<uint32_t>(payload.size()));
+    return sendMessage(messageType, payload.data(), payload.size());
+}
+
+// a reply leaves in one write: with Nagle on (the default profile) every
+// small write after the first, a payload behind its header or the status
+// behind a download's last chunk, waited for the client's delayed ACK.
+// small ones are queued until the request is done, larger ones go out
+// from the caller's memory (a mapped file view) with the queue in front
+bool ClientHandler::sendMessage(uint8_t messageType, const uint8_t* payload, size_t length) {
+    Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
     
     uint8_t headerBuffer[8];
     if (!ProtocolHelper::serializeHeader(header, headerBuffer, sizeof(headerBuffer))) {
         return false;
     }
+    if (m_sendBuffer.size() + sizeof(headerBuffer) + length <= SEND_BUFFER_SIZE) {
+        m_sendBuffer.insert(m_sendBuffer.end(), headerBuffer, headerBuffer + sizeof(headerBuffer));
+        m_sendBuffer.insert(m_sendBuffer.end(), payload, payload + length);
+        return true;
+    }
     
-    if (m_clientSocket->send(headerBuffer, sizeof(headerBuffer)) != sizeof(headerBuffer)) {
+    SocketBuffer parts[] = { { m_sendBuffer.data(), m_sendBuffer.size() }, { headerBuffer, sizeof(headerBuffer) },
+                             { payload, length } };
+    bool sent = sendParts(parts, 3);
+    m_sendBuffer.clear();
+    return sent;
+}
+
+// a download's last chunk, the complete message rides along
+bool ClientHandler::sendMessageThen(uint8_t messageType, const uint8_t* payload, size_t length,
+                                    uint8_t nextType, const std::vector<uint8_t>& nextPayload) {
+    Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
+    Protocol::MessageHeader nextHeader(nextType, static_cast<uint32_t>(nextPayload.size()));
+    
+    uint8_t headerBuffer[8];
+    uint8_t nextHeaderBuffer[8];
+    if (!ProtocolHelper::serializeHeader(header, headerBuffer, sizeof(headerBuffer)) ||
+        !ProtocolHelper::serializeHeader(nextHeader, nextHeaderBuffer, sizeof(nextHeaderBuffer))) {
         return false;
     }
     
-    if (!payload.empty()) {
-        if (m_clientSocket->send(payload.data(), payload.size()) != static_cast<int>(payload.size())) {
-            return false;
+    SocketBuffer parts[] = { { m_sendBuffer.data(), m_sendBuffer.size() }, { headerBuffer, sizeof(headerBuffer) },
+                             { payload, length }, { nextHeaderBuffer, sizeof(nextHeaderBuffer) },
+                             { nextPayload.data(), nextPayload.size() } };
+    bool sent = sendParts(parts, 5);
+    m_sendBuffer.clear();
+    return sent;
+}
+
+bool ClientHandler::flushSends() {
+    if (m_sendBuffer.empty()) return true;
+    // the queued replies' send, their sendMessage() only copied
+    TraceSpan flushSpan("handler", "flush");
+    flushSpan.setBytes(static_cast<int64_t>(m_sendBuffer.size()));
+    bool sent = sendAll(m_sendBuffer.data(), m_sendBuffer.size());
+    m_sendBuffer.clear();
+    return sent;
+}
+
+// one gathered send per call, advanced over whatever it took. the shm
+// rings have no Nagle to dodge, the parts go in one after another
+bool ClientHandler::sendParts(SocketBuffer* parts, size_t count) {
+    if (m_shm) {
+        for (size_t i = 0; i < count; i++) {
+            if (!sendAll(static_cast<const uint8_t*>(parts[i].data), parts[i].length)) return false;
         }
+        return true;
     }
     
+    size_t first = 0;
+    while (first < count) {
+        if (parts[first].length == 0) {
+            first++;
+            continue;
+        }
+        int sent = m_clientSocket->sendv(parts + first, count - first);
+        if (sent <= 0) {
+            return false;
+        }
+        countSent(sent);
+        size_t left = static_cast<size_t>(sent);
+        while (first < count && left >= parts[first].length) {
+            left -= parts[first].length;
+            first++;
+        }
+        if (left > 0) {
+            parts[first].data = static_cast<const uint8_t*>(parts[first].data) + left;
+            parts[first].length -= left;
+        }
+    }
+    return true;
+}
+
+// send() may take less than asked for on big payloads
+bool ClientHandler::sendAll(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        int sent = m_shm ? m_shm->send(data, length) : m_clientSocket->send(data, length);
+        if (sent <= 0) {
+            if (m_shm && sent < 0 && errno == EPROTO) {
+                Logger::warn(LogFields(m_clientId), "shared memory ring indices out of range, dropping client");
+            }
+            return false;
+        }
+        countSent(sent);
+        data += sent;
+        length -= sent;
+    }
     return true;
 }
 
 void ClientHandler::sendErrorResponse(const std::string& errorMsg) {
     auto payload = ProtocolHelper::createStatusPayload(Protocol::STATUS_ERROR, errorMsg);
     sendMessage(Protocol::MSG_ERROR_RESPONSE, payload);
+    if (m_options.metrics) m_options.metrics->errorSent();
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "../include/client_registry.h"
+#include <chrono>
+
+// Client registry implementation
+
+const uint32_t ClientRegistry::NO_SLOT;
+
+void ConnectionStats::reset(uint64_t nowMs) {
+    bytesIn.store(0, std::memory_order_relaxed);
+    bytesOut.store(0, std::memory_order_relaxed);
+    operations.store(0, std::memory_order_relaxed);
+    connectedMs.store(nowMs, std::memory_order_relaxed);
+    operationStartMs.store(nowMs, std::memory_order_relaxed);
+    currentOperation.store(0, std::memory_order_relaxed);
+}
+
+ClientRegistry::ClientRegistry(const std::vector<size_t>& shardCapacities) : m_nextId(0) {
+    for (size_t s = 0; s < shardCapacities.size(); s++) {
+        Shard* shard = new Shard(shardCapacities[s]);
+        // popped from the back, so the lowest slot goes out first
+        for (size_t i = shard->slots.size(); i > 0; i--) {
+            ClientSlot& slot = shard->slots[i - 1];
+            slot.registry = this;
+            slot.shard = static_cast<unsigned>(s);
+            slot.index = static_cast<uint32_t>(i - 1);
+            shard->freeSlots.push_back(slot.index);
+        }
+        m_shards.push_back(shard);
+    }
+}
+
+ClientRegistry::~ClientRegistry() {
+    for (Shard* shard : m_shards) {
+        delete shard;
+    }
+}
+
+uint64_t ClientRegistry::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the id is published last, a reader that sees it also sees the reset
+ClientSlot* ClientRegistry::acquire(unsigned shard, uint32_t clientId) {
+    Shard& owner = *m_shards[shard];
+    if (owner.freeSlots.empty()) return nullptr;
+
+    ClientSlot* slot = &owner.slots[owner.freeSlots.back()];
+    owner.freeSlots.pop_back();
+    slot->stats.reset(nowMs());
+    slot->clientId.store(clientId, std::memory_order_release);
+    return slot;
+}
+
+// the id goes first, so a snapshot racing with the next acquire() sees
+// the id change and drops what it copied
+void ClientRegistry::release(ClientSlot* slot) {
+    slot->clientId.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->handler = nullptr;
+    slot->thread = nullptr;
+    m_shards[slot->shard]->freeSlots.push_back(slot->index);
+}
+
+size_t ClientRegistry::getActiveCount(unsigned shard) const {
+    return m_shards[shard]->slots.size() - m_shards[shard]->freeSlots.size();
+}
+
+void ClientRegistry::markFinished(ClientSlot* slot) {
+    std::atomic<uint32_t>& head = m_shards[slot->shard]->finishedHead;
+    uint32_t next = head.load(std::memory_order_relaxed);
+    do {
+        slot->nextFinished = next;
+    } while (!head.compare_exchange_weak(next, slot->index, std::memory_order_release,
+                                         std::memory_order_relaxed));
+}
+
+// the one consumer takes the whole stack at once, so there is no ABA
+void ClientRegistry::takeFinished(unsigned shard, std::vector<ClientSlot*>& finished) {
+    Shard& owner = *m_shards[shard];
+    uint32_t index = owner.finishedHead.exchange(NO_SLOT, std::memory_order_acquire);
+    while (index != NO_SLOT) {
+        finished.push_back(&owner.slots[index]);
+        index = owner.slots[index].nextFinished;
+    }
+}
+
+void ClientRegistry::getActive(unsigned shard, std::vector<ClientSlot*>& active) {
+    for (ClientSlot& slot : m_shards[shard]->slots) {
+        if (slot.clientId.load(std::memory_order_relaxed) != 0) {
+            active.push_back(&slot);
+        }
+    }
+}
+
+// seqlock style, the client id is the sequence number: copy the stats
+// between two reads of it and keep the copy only if both match
+void ClientRegistry::snapshot(std::vector<ConnectionSnapshot>& connections) const {
+    for (size_t s = 0; s < m_shards.size(); s++) {
+        for (const ClientSlot& slot : m_shards[s]->slots) {
+            uint32_t clientId = slot.clientId.load(std::memory_order_acquire);
+            if (clientId == 0) continue;
+
+            ConnectionSnapshot connection;
+            connection.clientId = clientId;
+            connection.shard = static_cast<unsigned>(s);
+            connection.bytesIn = slot.stats.bytesIn.load(std::memory_order_relaxed);
+            connection.bytesOut = slot.stats.bytesOut.load(std::memory_order_relaxed);
+            connection.operations = slot.stats.operations.load(std::memory_order_relaxed);
+            connection.connectedMs = slot.stats.connectedMs.load(std::memory_order_relaxed);
+            connection.operationStartMs = slot.stats.operationStartMs.load(std::memory_order_relaxed);
+            connection.currentOperation = slot.stats.currentOperation.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.clientId.load(std::memory_order_relaxed) == clientId) {
+                connections.push_back(connection);
+            }
+        }
+    }
+}
@@ -0,0 +1,236 @@
+#include "../include/commit_queue.h"
+#include "../include/logger.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+// Group commit implementation
+
+// batches are capped so one huge burst cannot hold everyone back
+static const size_t MAX_BATCH_SIZE = 512;
+
+CommitQueue::CommitQueue(uint32_t windowMs, const std::string& storageRoot)
+    : m_windowMs(windowMs), m_rootPrefix(storageRoot), m_running(false), m_batches(0), m_files(0),
+      m_maxBatch(0), m_totalLatencyUs(0), m_maxLatencyUs(0) {
+    while (m_rootPrefix.size() > 1 && m_rootPrefix.back() == '/') {
+        m_rootPrefix.pop_back();
+    }
+    if (m_rootPrefix.empty() || m_rootPrefix.back() != '/') m_rootPrefix += '/';
+}
+
+CommitQueue::~CommitQueue() {
+    stop();
+}
+
+bool CommitQueue::start() {
+    m_running = true;
+    if (!m_thread.start(commitThreadFunction, this)) {
+        m_running = false;
+        return false;
+    }
+    return true;
+}
+
+void CommitQueue::stop() {
+    {
+        LockGuard lock(m_mutex);
+        if (!m_running) return;
+        m_running = false;
+        m_pendingCond.notifyAll();
+    }
+    m_thread.join();
+}
+
+uint64_t CommitQueue::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool CommitQueue::commit(const std::string& path) {
+    Request request;
+    request.path = path;
+    request.enqueuedUs = nowUs();
+    request.done = false;
+    request.success = false;
+
+    LockGuard lock(m_mutex);
+    if (!m_running) {
+        // queue already shut down, sync inline rather than lose durability
+        std::vector<std::string> directories;
+        collectDirectories(path, directories);
+        bool ok = syncFile(path);
+        for (const auto& dir : directories) {
+            ok = syncDirectory(dir) && ok;
+        }
+        return ok;
+    }
+
+    m_pending.push_back(&request);
+    m_pendingCond.notifyOne();
+
+    while (!request.done) {
+        m_doneCond.wait(m_mutex);
+    }
+    return request.success;
+}
+
+ThreadReturn THREAD_CALL CommitQueue::commitThreadFunction(void* arg) {
+    static_cast<CommitQueue*>(arg)->commitThreadMain();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+void CommitQueue::commitThreadMain() {
+    std::vector<Request*> batch;
+
+    m_mutex.lock();
+    while (true) {
+        while (m_running && m_pending.empty()) {
+            m_pendingCond.wait(m_mutex);
+        }
+        if (m_pending.empty()) break;   // stopped and drained
+
+        // the window opens with the first request, later arrivals ride along
+        uint64_t windowEnd = m_pending.front()->enqueuedUs + m_windowMs * 1000ULL;
+        while (m_running && m_pending.size() < MAX_BATCH_SIZE) {
+            uint64_t now = nowUs();
+            if (now >= windowEnd) break;
+            m_pendingCond.waitFor(m_mutex, static_cast<uint32_t>((windowEnd - now + 999) / 1000));
+        }
+
+        size_t take = std::min(m_pending.size(), MAX_BATCH_SIZE);
+        batch.assign(m_pending.begin(), m_pending.begin() + take);
+        m_pending.erase(m_pending.begin(), m_pending.begin() + take);
+
+        m_mutex.unlock();
+        syncBatch(batch);
+        m_mutex.lock();
+
+        uint64_t finishedUs = nowUs();
+        uint64_t oldestUs = finishedUs;
+        for (Request* request : batch) {
+            oldestUs = std::min(oldestUs, request->enqueuedUs);
+            request->done = true;
+        }
+
+        uint64_t latencyUs = finishedUs - oldestUs;
+        m_batches++;
+        m_files += batch.size();
+        m_maxBatch = std::max<uint64_t>(m_maxBatch, batch.size());
+        m_totalLatencyUs += latencyUs;
+        m_maxLatencyUs = std::max(m_maxLatencyUs, latencyUs);
+
+        Logger::debug(LogFields(0, 0, -1, static_cast<int64_t>(latencyUs)),
+                      "[Commit] Batch of %zu file(s) durable", batch.size());
+
+        m_doneCond.notifyAll();
+        batch.clear();
+    }
+    m_mutex.unlock();
+}
+
+// the file's parent and every directory above it up to the storage root,
+// each ending in '/'. whether an upload created its shard directories
+// is not known here: a second upload into a new shard can find them made
+// by the first before the first is synced, so both sync the whole chain
+void CommitQueue::collectDirectories(const std::string& path, std::vector<std::string>& directories) const {
+    std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    directories.push_back(dir);
+    while (true) {
+        // compared without trailing slashes, "root//" is the root
+        size_t last = dir.find_last_not_of('/');
+        if (last == std::string::npos || last + 1 < m_rootPrefix.size() ||
+            dir.compare(0, m_rootPrefix.size(), m_rootPrefix) != 0) {
+            break;
+        }
+        dir = dir.substr(0, dir.find_last_of('/', last) + 1);
+        directories.push_back(dir);
+    }
+}
+
+// files first, then each directory once so the new entries are durable too
+void CommitQueue::syncBatch(std::vector<Request*>& batch) {
+    std::set<std::string> directories;
+    std::set<std::string> failedDirectories;
+    std::vector<std::string> chain;
+
+    for (Request* request : batch) {
+        request->success = syncFile(request->path);
+        chain.clear();
+        collectDirectories(request->path, chain);
+        directories.insert(chain.begin(), chain.end());
+    }
+
+    // deepest first, a new shard directory is synced before the entry for
+    // it in its parent
+    for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+        if (!syncDirectory(*it)) {
+            failedDirectories.insert(*it);
+        }
+    }
+
+    if (failedDirectories.empty()) return;
+    for (Request* request : batch) {
+        chain.clear();
+        collectDirectories(request->path, chain);
+        for (const auto& dir : chain) {
+            if (failedDirectories.count(dir)) {
+                request->success = false;
+                break;
+            }
+        }
+    }
+}
+
+bool CommitQueue::syncFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(handle) != 0;
+    CloseHandle(handle);
+    return ok;
+#else
+    // any descriptor flushes the file's dirty pages, not just the writer's
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+#ifdef __linux__
+    bool ok = fdatasync(fd) == 0;
+#else
+    bool ok = fsync(fd) == 0;
+#endif
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// path may be a file (its parent is synced) or a directory ending in '/'
+bool CommitQueue::syncDirectory(const std::string& path) {
+#ifdef _WIN32
+    // NTFS journals directory entries, nothing to do
+    return true;
+#else
+    std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    if (dir.empty()) dir = ".";
+
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+void CommitQueue::printStats() {
+    LockGuard lock(m_mutex);
+    if (m_batches == 0) return;
+
+    Logger::info(LogFields(), "[Commit] %llu files in %llu batches, avg batch %.1f, max batch %llu, "
+                 "avg latency %.3f ms, max latency %.3f ms",
+                 static_cast<unsigned long long>(m_files), static_cast<unsigned long long>(m_batches),
+                 static_cast<double>(m_files) / m_batches, static_cast<unsigned long long>(m_maxBatch),
+                 m_totalLatencyUs / 1000.0 / m_batches, m_maxLatencyUs / 1000.0);
+}
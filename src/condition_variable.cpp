@@ -0,0 +1,92 @@
+#include "../include/platform_wrapper.h"
+#include <time.h>
+
+#ifdef __APPLE__
+    #include <sys/time.h>
+#endif
+
+// ConditionVariable implementation
+
+ConditionVariable::ConditionVariable() : m_initialized(false) {
+#ifdef _WIN32
+    InitializeConditionVariable(&m_cond);
+    m_initialized = true;
+#elif defined(__APPLE__)
+    m_initialized = (pthread_cond_init(&m_cond, nullptr) == 0);
+#else
+    // timed waits use the monotonic clock so clock changes cannot stretch them
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    m_initialized = (pthread_cond_init(&m_cond, &attr) == 0);
+    pthread_condattr_destroy(&attr);
+#endif
+}
+
+ConditionVariable::~ConditionVariable() {
+#ifndef _WIN32
+    if (m_initialized) {
+        pthread_cond_destroy(&m_cond);
+    }
+#endif
+}
+
+
+void ConditionVariable::wait(Mutex& mutex) {
+    if (!m_initialized) return;
+    
+#ifdef _WIN32
+    SleepConditionVariableCS(&m_cond, &mutex.getHandle(), INFINITE);
+#else
+    pthread_cond_wait(&m_cond, &mutex.getHandle());
+#endif
+}
+
+
+bool ConditionVariable::waitFor(Mutex& mutex, uint32_t milliseconds) {
+    if (!m_initialized) return false;
+    
+#ifdef _WIN32
+    return SleepConditionVariableCS(&m_cond, &mutex.getHandle(), milliseconds) != 0;
+#else
+    struct timespec deadline;
+#ifdef __APPLE__
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    deadline.tv_sec = now.tv_sec;
+    deadline.tv_nsec = now.tv_usec * 1000;
+#else
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+#endif
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    return pthread_cond_timedwait(&m_cond, &mutex.getHandle(), &deadline) == 0;
+#endif
+}
+
+
+void ConditionVariable::notifyOne() {
+    if (!m_initialized) return;
+    
+#ifdef _WIN32
+    WakeConditionVariable(&m_cond);
+#else
+    pthread_cond_signal(&m_cond);
+#endif
+}
+
+
+void ConditionVariable::notifyAll() {
+    if (!m_initialized) return;
+    
+#ifdef _WIN32
+    WakeAllConditionVariable(&m_cond);
+#else
+    pthread_cond_broadcast(&m_cond);
+#endif
+}
\ No newline at end of file
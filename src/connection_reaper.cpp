@@ -0,0 +1,120 @@
+#include "../include/connection_reaper.h"
+#include "../include/logger.h"
+#include <algorithm>
+#include <chrono>
+
+// Idle and stalled connection reaper implementation
+
+const uint32_t ConnectionReaper::TICK_MS;
+
+static uint64_t secondsToTicks(uint32_t seconds) {
+    return static_cast<uint64_t>(seconds) * 1000 / ConnectionReaper::TICK_MS;
+}
+
+ConnectionReaper::ConnectionReaper(uint32_t idleTimeoutSeconds, uint32_t stallTimeoutSeconds)
+    : m_idleTicks(secondsToTicks(idleTimeoutSeconds)), m_stallTicks(secondsToTicks(stallTimeoutSeconds)),
+      m_checkTicks(0), m_tick(0), m_running(false), m_idleReaped(0), m_stallReaped(0) {
+    if (m_idleTicks && m_stallTicks) {
+        m_checkTicks = std::min(m_idleTicks, m_stallTicks);
+    } else {
+        m_checkTicks = std::max(m_idleTicks, m_stallTicks);
+    }
+    if (m_checkTicks == 0) m_checkTicks = TimerWheel::MAX_DELAY;
+}
+
+ConnectionReaper::~ConnectionReaper() {
+    stop();
+}
+
+bool ConnectionReaper::start() {
+    m_running = true;
+    if (!m_thread.start(reaperThreadFunction, this)) {
+        m_running = false;
+        return false;
+    }
+    return true;
+}
+
+void ConnectionReaper::stop() {
+    {
+        LockGuard lock(m_mutex);
+        if (!m_running) return;
+        m_running = false;
+        m_stopCond.notifyAll();
+    }
+    m_thread.join();
+}
+
+void ConnectionReaper::add(ConnectionTimer* timer) {
+    LockGuard lock(m_mutex);
+    timer->lastActivity.store(now(), std::memory_order_relaxed);
+    m_wheel.schedule(&timer->entry, m_wheel.getCurrentTick() + m_checkTicks);
+}
+
+void ConnectionReaper::remove(ConnectionTimer* timer) {
+    LockGuard lock(m_mutex);
+    m_wheel.cancel(&timer->entry);
+}
+
+ThreadReturn THREAD_CALL ConnectionReaper::reaperThreadFunction(void* arg) {
+    static_cast<ConnectionReaper*>(arg)->reaperThreadMain();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+void ConnectionReaper::reaperThreadMain() {
+    // ticks count from start so a late wakeup catches up instead of drifting
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    LockGuard lock(m_mutex);
+    while (m_running) {
+        m_stopCond.waitFor(m_mutex, TICK_MS);
+        if (!m_running) break;
+
+        uint64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        m_tick.store(elapsedMs / TICK_MS, std::memory_order_relaxed);
+
+        m_wheel.advance(now(), m_expired);
+        for (TimerEntry* entry : m_expired) {
+            expire(static_cast<ConnectionTimer*>(entry->owner));
+        }
+        m_expired.clear();
+    }
+}
+
+// a fired timer is only a hint, the connection may have moved since it
+// was armed. re-arm from its last activity unless the limit really passed,
+// a whole tick over it since activity is stamped with the tick it fell in
+void ConnectionReaper::expire(ConnectionTimer* timer) {
+    uint64_t current = m_wheel.getCurrentTick();
+    uint64_t last = std::min(timer->lastActivity.load(std::memory_order_relaxed), current);
+    bool busy = timer->busy.load(std::memory_order_relaxed);
+    uint64_t limit = busy ? m_stallTicks : m_idleTicks;
+
+    if (limit && current - last > limit) {
+        Logger::info(LogFields(timer->clientId), "[Reaper] %s for %llu s, disconnecting", busy ? "Stalled" : "Idle",
+                     static_cast<unsigned long long>((current - last) * TICK_MS / 1000));
+        timer->socket->shutdown();
+        if (busy) {
+            m_stallReaped++;
+        } else {
+            m_idleReaped++;
+        }
+        return;
+    }
+
+    // busy may flip to the shorter limit, so never wait longer than that
+    uint64_t next = current + m_checkTicks;
+    if (limit) next = std::min(next, last + limit + 1);
+    m_wheel.schedule(&timer->entry, next);
+}
+
+void ConnectionReaper::printStats() {
+    LockGuard lock(m_mutex);
+    Logger::info(LogFields(), "[Reaper] %llu idle, %llu stalled connection(s) closed",
+                 static_cast<unsigned long long>(m_idleReaped), static_cast<unsigned long long>(m_stallReaped));
+}
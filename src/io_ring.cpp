@@ -0,0 +1,340 @@
+#include "../include/io_ring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define HAVE_IO_URING 1
+    #endif
+#endif
+
+#ifdef HAVE_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+#endif
+
+// io_uring ring implementation
+
+IoRing::IoRing()
+    : m_fd(-1), m_entries(0), m_pending(0), m_buffersRegistered(false), m_enterCalls(0),
+      m_sqRing(nullptr), m_sqRingSize(0), m_cqRing(nullptr), m_cqRingSize(0),
+      m_sqes(nullptr), m_sqesSize(0), m_sqHead(nullptr), m_sqTail(nullptr),
+      m_sqMask(nullptr), m_sqArray(nullptr), m_cqHead(nullptr), m_cqTail(nullptr),
+      m_cqMask(nullptr), m_cqes(nullptr) {
+}
+
+IoRing::~IoRing() {
+    close();
+}
+
+bool IoRing::parseBackend(const std::string& name, IoBackend& backend) {
+    if (name == "blocking") {
+        backend = IO_BACKEND_BLOCKING;
+        return true;
+    }
+    if (name == "uring") {
+        backend = IO_BACKEND_URING;
+        return true;
+    }
+    return false;
+}
+
+const char* IoRing::backendName(IoBackend backend) {
+    return backend == IO_BACKEND_URING ? "uring" : "blocking";
+}
+
+#ifdef HAVE_IO_URING
+
+static int ringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+bool IoRing::isSupported() {
+    // -1 unknown, 0 no, 1 yes
+    static std::atomic<int> supported(-1);
+    int cached = supported.load();
+    if (cached >= 0) return cached == 1;
+
+    bool ok = false;
+    IoRing ring;
+    if (ring.init(4)) {
+        // seccomp or an old kernel may still lack the opcodes we use
+        size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+        struct io_uring_probe* probe = static_cast<struct io_uring_probe*>(calloc(1, probeSize));
+        if (probe && ringRegister(ring.m_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+            const unsigned ops[] = { IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ_FIXED,
+                                     IORING_OP_WRITE_FIXED };
+            ok = true;
+            for (unsigned op : ops) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    ok = false;
+                }
+            }
+        }
+        free(probe);
+    }
+
+    supported.store(ok ? 1 : 0);
+    return ok;
+}
+
+bool IoRing::init(unsigned entries) {
+    close();
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = ringSetup(entries, &params);
+    if (fd < 0) return false;
+
+    m_fd = fd;
+    m_entries = params.sq_entries;
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        close();
+        return false;
+    }
+
+    if (singleMap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            close();
+            return false;
+        }
+    }
+
+    m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        close();
+        return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(m_sqRing);
+    uint8_t* cq = static_cast<uint8_t*>(m_cqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+
+    m_pending = 0;
+    m_buffersRegistered = false;
+    return true;
+}
+
+void IoRing::close() {
+    if (m_fd < 0) return;
+
+    if (m_sqes) munmap(m_sqes, m_sqesSize);
+    if (m_cqRing && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing) munmap(m_sqRing, m_sqRingSize);
+    // closing the ring fd drops registered buffers and files with it
+    ::close(m_fd);
+
+    m_fd = -1;
+    m_sqRing = m_cqRing = m_sqes = nullptr;
+    m_pending = 0;
+    m_buffersRegistered = false;
+}
+
+bool IoRing::registerBuffers(uint8_t* const* buffers, size_t length, unsigned count) {
+    if (m_fd < 0) return false;
+    if (m_buffersRegistered) unregisterBuffers();
+
+    std::vector<struct iovec> iovecs(count);
+    for (unsigned i = 0; i < count; i++) {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = length;
+    }
+
+    m_buffersRegistered = ringRegister(m_fd, IORING_REGISTER_BUFFERS, iovecs.data(), count) == 0;
+    return m_buffersRegistered;
+}
+
+bool IoRing::unregisterBuffers() {
+    if (m_fd < 0 || !m_buffersRegistered) return false;
+    m_buffersRegistered = false;
+    return ringRegister(m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0) == 0;
+}
+
+bool IoRing::registerFiles(const int* fds, unsigned count) {
+    if (m_fd < 0) return false;
+    return ringRegister(m_fd, IORING_REGISTER_FILES, fds, count) == 0;
+}
+
+bool IoRing::updateFile(unsigned slot, int fd) {
+    if (m_fd < 0) return false;
+
+    struct io_uring_files_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    return ringRegister(m_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+}
+
+// a full submission queue is flushed to the kernel first
+void* IoRing::nextSqe() {
+    if (m_fd < 0) return nullptr;
+
+    unsigned tail = *m_sqTail;
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_entries) {
+        if (!submit()) return nullptr;
+        if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_entries) return nullptr;
+    }
+
+    unsigned index = tail & *m_sqMask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(m_sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    // published now, consumed by the kernel on the next enter
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_pending++;
+    return sqe;
+}
+
+static void prepare(struct io_uring_sqe* sqe, uint8_t opcode, unsigned fileSlot, const void* buffer,
+                    size_t length, uint64_t offset, IoCompletion* completion, bool link) {
+    sqe->opcode = opcode;
+    sqe->flags = IOSQE_FIXED_FILE | (link ? IOSQE_IO_LINK : 0);
+    sqe->fd = static_cast<int32_t>(fileSlot);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = offset;
+    sqe->user_data = reinterpret_cast<uint64_t>(completion);
+    completion->reset();
+}
+
+bool IoRing::prepRecv(unsigned fileSlot, void* buffer, size_t length, IoCompletion* completion) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+    if (!sqe) return false;
+    prepare(sqe, IORING_OP_RECV, fileSlot, buffer, length, 0, completion, false);
+    return true;
+}
+
+bool IoRing::prepSend(unsigned fileSlot, const void* buffer, size_t length, IoCompletion* completion, bool link) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+    if (!sqe) return false;
+    prepare(sqe, IORING_OP_SEND, fileSlot, buffer, length, 0, completion, link);
+    // retried in the kernel until everything is sent (5.19+), older
+    // kernels may still complete short and callers handle that
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    return true;
+}
+
+bool IoRing::prepReadFixed(unsigned fileSlot, void* buffer, size_t length, uint64_t offset,
+                           unsigned bufferIndex, IoCompletion* completion, bool link) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+    if (!sqe) return false;
+    prepare(sqe, IORING_OP_READ_FIXED, fileSlot, buffer, length, offset, completion, link);
+    sqe->buf_index = static_cast<uint16_t>(bufferIndex);
+    return true;
+}
+
+bool IoRing::prepWriteFixed(unsigned fileSlot, const void* buffer, size_t length, uint64_t offset,
+                            unsigned bufferIndex, IoCompletion* completion) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+    if (!sqe) return false;
+    prepare(sqe, IORING_OP_WRITE_FIXED, fileSlot, buffer, length, offset, completion, false);
+    sqe->buf_index = static_cast<uint16_t>(bufferIndex);
+    return true;
+}
+
+int IoRing::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    while (true) {
+        m_enterCalls++;
+        int ret = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr, 0));
+        if (ret >= 0 || errno != EINTR) return ret;
+    }
+}
+
+bool IoRing::submit() {
+    if (m_fd < 0) return false;
+    if (m_pending == 0) return true;
+
+    int submitted = enter(m_pending, 0, 0);
+    if (submitted < 0) return false;
+    m_pending -= std::min<unsigned>(m_pending, static_cast<unsigned>(submitted));
+    return true;
+}
+
+void IoRing::reapCompletions() {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(m_cqes) + (head & *m_cqMask);
+        IoCompletion* completion = reinterpret_cast<IoCompletion*>(cqe->user_data);
+        if (completion) {
+            completion->result = cqe->res;
+            completion->done = true;
+        }
+        head++;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+bool IoRing::waitFor(IoCompletion& completion) {
+    if (m_fd < 0) return false;
+
+    reapCompletions();
+    while (!completion.done) {
+        int submitted = enter(m_pending, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) return false;
+        m_pending -= std::min<unsigned>(m_pending, static_cast<unsigned>(submitted));
+        reapCompletions();
+    }
+    return true;
+}
+
+#else
+
+// no io_uring on this platform, everything reports failure
+
+bool IoRing::isSupported() { return false; }
+bool IoRing::init(unsigned) { return false; }
+void IoRing::close() {}
+bool IoRing::registerBuffers(uint8_t* const*, size_t, unsigned) { return false; }
+bool IoRing::unregisterBuffers() { return false; }
+bool IoRing::registerFiles(const int*, unsigned) { return false; }
+bool IoRing::updateFile(unsigned, int) { return false; }
+void* IoRing::nextSqe() { return nullptr; }
+bool IoRing::prepRecv(unsigned, void*, size_t, IoCompletion*) { return false; }
+bool IoRing::prepSend(unsigned, const void*, size_t, IoCompletion*, bool) { return false; }
+bool IoRing::prepReadFixed(unsigned, void*, size_t, uint64_t, unsigned, IoCompletion*, bool) { return false; }
+bool IoRing::prepWriteFixed(unsigned, const void*, size_t, uint64_t, unsigned, IoCompletion*) { return false; }
+bool IoRing::waitFor(IoCompletion&) { return false; }
+bool IoRing::submit() { return false; }
+void IoRing::reapCompletions() {}
+int IoRing::enter(unsigned, unsigned, unsigned) { return -1; }
+
+#endif
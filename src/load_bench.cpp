@@ -0,0 +1,701 @@
+#include "../include/platform_wrapper.h"
+#include "../include/protocol.h"
+#include "../include/shm_channel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Load generator
+// N client threads, each on its own authenticated connection, issue a
+// weighted mix of list, upload, download and delete for a fixed time.
+// closed loop: a client sends its next request when the last one is
+// answered. open loop (--rate): requests follow a Poisson schedule and
+// latency counts from the scheduled start, so a server that falls
+// behind is charged for the queueing it caused. every latency is kept,
+// percentiles are exact
+
+namespace {
+
+enum Operation { OP_LIST = 0, OP_UPLOAD, OP_DOWNLOAD, OP_DELETE, OP_KINDS };
+
+const char* const OPERATION_NAMES[OP_KINDS] = { "list", "upload", "download", "delete" };
+
+const size_t CHUNK_SIZE = 64 * 1024;
+const int MAX_BUSY_RETRIES = 20;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "4096", "64K", "1M", "1G"
+bool parseSize(const std::string& text, uint64_t& size) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) return false;
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k") value *= 1024;
+    else if (suffix == "M" || suffix == "m") value *= 1024 * 1024;
+    else if (suffix == "G" || suffix == "g") value *= 1024.0 * 1024 * 1024;
+    else if (!suffix.empty()) return false;
+    size = static_cast<uint64_t>(value);
+    return true;
+}
+
+// upload sizes: "64K" fixed, "1K-1M" uniform, "exp:256K" exponential
+// around a mean, cut at the protocol's limit
+struct SizeDistribution {
+    enum Kind { FIXED, UNIFORM, EXPONENTIAL } kind;
+    uint64_t low;
+    uint64_t high;
+
+    SizeDistribution() : kind(FIXED), low(64 * 1024), high(64 * 1024) {}
+
+    bool parse(const std::string& text) {
+        size_t dash = text.find('-');
+        if (text.compare(0, 4, "exp:") == 0) {
+            kind = EXPONENTIAL;
+            return parseSize(text.substr(4), low) && low > 0;
+        }
+        if (dash != std::string::npos) {
+            kind = UNIFORM;
+            return parseSize(text.substr(0, dash), low) && parseSize(text.substr(dash + 1), high) && low <= high;
+        }
+        kind = FIXED;
+        return parseSize(text, low);
+    }
+
+    uint64_t sample(std::mt19937_64& random) const {
+        uint64_t size = low;
+        if (kind == UNIFORM) {
+            size = std::uniform_int_distribution<uint64_t>(low, high)(random);
+        } else if (kind == EXPONENTIAL) {
+            size = static_cast<uint64_t>(std::exponential_distribution<double>(1.0 / low)(random));
+        }
+        return std::max<uint64_t>(1, std::min<uint64_t>(size, Protocol::MAX_FILE_SIZE));
+    }
+
+    std::string describe() const {
+        if (kind == UNIFORM) return "uniform " + std::to_string(low) + "-" + std::to_string(high);
+        if (kind == EXPONENTIAL) return "exponential mean " + std::to_string(low);
+        return "fixed " + std::to_string(low);
+    }
+};
+
+struct BenchConfig {
+    std::string host;
+    uint16_t port;
+    std::string passwordHash;
+    unsigned clients;
+    unsigned durationS;
+    unsigned weights[OP_KINDS];
+    SizeDistribution sizes;
+    unsigned seedFiles;         // downloaded by everyone, uploaded before the clock starts
+    double rate;                // total requests/s, 0 = closed loop
+    uint64_t seed;
+    std::string jsonPath;       // "-" = stdout
+    bool sharedMemory;          // move each connection to the server's shm rings after login
+    std::string socketProfile;
+    SocketTuning socketTuning;
+
+    BenchConfig() : port(0), clients(16), durationS(10), weights{1, 1, 4, 1}, seedFiles(8), rate(0),
+                    seed(1), sharedMemory(false), socketProfile("default") {}
+};
+
+// one thread's results, merged after the run
+struct ClientResult {
+    std::vector<uint32_t> latencyUs[OP_KINDS];
+    uint64_t bytes[OP_KINDS];
+    uint64_t errors[OP_KINDS];
+    uint64_t connects;
+
+    ClientResult() : bytes{}, errors{}, connects(0) {}
+};
+
+// one connection speaking the protocol, without the CLI client's printing
+class BenchConnection {
+public:
+    BenchConnection() : m_connected(false) {}
+
+    bool connect(const BenchConfig& config) {
+        for (int attempt = 0; attempt < MAX_BUSY_RETRIES; attempt++) {
+            close();
+            // tuning is best effort like the server's, a refused busy poll still benchmarks
+            if (!m_socket.connect(config.host, config.port, config.socketTuning)) return false;
+            m_connected = true;
+
+            Protocol::MessageHeader header;
+            std::vector<uint8_t> payload;
+            if (!send(Protocol::MSG_CONNECT_REQUEST, ProtocolHelper::createTextPayload(config.passwordHash)) ||
+                !receive(header, payload)) {
+                return false;
+            }
+            if (header.messageType == Protocol::MSG_CONNECT_RESPONSE) {
+                return !config.sharedMemory || switchToSharedMemory();
+            }
+            if (header.messageType != Protocol::MSG_SERVER_BUSY) return false;
+
+            uint32_t retryAfterMs = 0;
+            std::string reason;
+            ProtocolHelper::parseBusyPayload(payload.data(), payload.size(), retryAfterMs, reason);
+            Thread::sleep(retryAfterMs + static_cast<uint32_t>(std::rand() % (retryAfterMs / 2 + 1)));
+        }
+        return false;
+    }
+
+    void close() {
+        if (m_connected) {
+            send(Protocol::MSG_DISCONNECT, std::vector<uint8_t>());
+            m_shm.close();
+            m_socket.close();
+            m_connected = false;
+        }
+    }
+
+    bool isConnected() const { return m_connected; }
+
+    bool list(uint64_t& bytes) {
+        Protocol::MessageHeader header;
+        if (!send(Protocol::MSG_LIST_FILES, std::vector<uint8_t>()) || !receive(header, m_payload)) return false;
+        bytes = m_payload.size();
+        return header.messageType == Protocol::MSG_FILE_LIST_RESPONSE;
+    }
+
+    bool upload(const std::string& name, uint64_t size, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> request(sizeof(uint32_t) + name.size() + sizeof(uint64_t));
+        size_t offset = ProtocolHelper::serializeString(name, request.data(), request.size());
+        ProtocolHelper::serializeUint64(size, request.data() + offset);
+
+        Protocol::MessageHeader header;
+        if (!send(Protocol::MSG_UPLOAD_REQUEST, request) || !receive(header, m_payload)) return false;
+        if (m_payload.empty() || m_payload[0] != Protocol::STATUS_OK) return false;
+
+        for (uint64_t sent = 0; sent < size; ) {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, size - sent));
+            sent += length;
+            // the last chunk shares a send with the complete message
+            if (!send(Protocol::MSG_UPLOAD_DATA, data.data(), length, sent == size)) return false;
+        }
+
+        if (!send(Protocol::MSG_UPLOAD_COMPLETE, std::vector<uint8_t>()) || !receive(header, m_payload)) {
+            return false;
+        }
+        return header.messageType == Protocol::MSG_UPLOAD_COMPLETE && !m_payload.empty() &&
+               m_payload[0] == Protocol::STATUS_OK;
+    }
+
+    bool download(const std::string& name, uint64_t& bytes) {
+        if (!send(Protocol::MSG_DOWNLOAD_REQUEST, ProtocolHelper::createTextPayload(name))) return false;
+        bytes = 0;
+        Protocol::MessageHeader header;
+        while (receive(header, m_payload)) {
+            if (header.messageType == Protocol::MSG_DOWNLOAD_COMPLETE) return true;
+            if (header.messageType != Protocol::MSG_DOWNLOAD_DATA) return false;
+            bytes += m_payload.size();
+        }
+        return false;
+    }
+
+    bool remove(const std::string& name) {
+        Protocol::MessageHeader header;
+        if (!send(Protocol::MSG_DELETE_REQUEST, ProtocolHelper::createTextPayload(name)) ||
+            !receive(header, m_payload)) {
+            return false;
+        }
+        return header.messageType == Protocol::MSG_DELETE_RESPONSE && !m_payload.empty() &&
+               m_payload[0] == Protocol::STATUS_OK;
+    }
+
+    // a failed exchange leaves the stream out of step, start over
+    void drop() {
+        m_shm.close();
+        m_socket.close();
+        m_connected = false;
+    }
+
+private:
+    // the response's first bytes carry the segment's descriptor
+    bool switchToSharedMemory() {
+        if (!send(Protocol::MSG_SHM_REQUEST, std::vector<uint8_t>())) return false;
+
+        uint8_t headerBuffer[8];
+        int fd = -1;
+        int received = m_socket.receiveFd(headerBuffer, sizeof(headerBuffer), fd);
+        Protocol::MessageHeader header;
+        bool ok = received > 0 &&
+                  receiveAll(headerBuffer + received, sizeof(headerBuffer) - received) &&
+                  ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header);
+        if (ok) {
+            m_payload.resize(header.payloadLength);
+            ok = (header.payloadLength == 0 || receiveAll(m_payload.data(), header.payloadLength)) &&
+                 header.messageType == Protocol::MSG_SHM_RESPONSE && !m_payload.empty() &&
+                 m_payload[0] == Protocol::STATUS_OK && fd >= 0 && m_shm.attach(fd, &m_socket);
+        }
+        if (fd >= 0) ::close(fd);
+        return ok;
+    }
+
+    bool send(uint8_t messageType, const std::vector<uint8_t>& payload) {
+        return send(messageType, payload.data(), payload.size());
+    }
+
+    // header and payload in one send, a lone header would sit in Nagle's
+    // buffer until the server's delayed ACK and cost every request 40 ms.
+    // more keeps the message for the next send
+    bool send(uint8_t messageType, const uint8_t* payload, size_t length, bool more = false) {
+        size_t start = m_sendBuffer.size();
+        m_sendBuffer.resize(start + 8 + length);
+        Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
+        ProtocolHelper::serializeHeader(header, m_sendBuffer.data() + start, 8);
+        if (length > 0) std::memcpy(m_sendBuffer.data() + start + 8, payload, length);
+        if (more) return true;
+        bool sent = sendAll(m_sendBuffer.data(), m_sendBuffer.size());
+        m_sendBuffer.clear();
+        return sent;
+    }
+
+    bool sendAll(const uint8_t* data, size_t length) {
+        while (length > 0) {
+            int sent = m_shm.isOpen() ? m_shm.send(data, length) : m_socket.send(data, length);
+            if (sent <= 0) return false;
+            data += sent;
+            length -= sent;
+        }
+        return true;
+    }
+
+    bool receiveAll(uint8_t* data, size_t length) {
+        while (length > 0) {
+            int received = m_shm.isOpen() ? m_shm.receive(data, length) : m_socket.receive(data, length);
+            if (received <= 0) return false;
+            data += received;
+            length -= received;
+        }
+        return true;
+    }
+
+    bool receive(Protocol::MessageHeader& header, std::vector<uint8_t>& payload) {
+        uint8_t headerBuffer[8];
+        if (!receiveAll(headerBuffer, sizeof(headerBuffer)) ||
+            !ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header)) {
+            return false;
+        }
+        payload.resize(header.payloadLength);
+        return header.payloadLength == 0 || receiveAll(payload.data(), header.payloadLength);
+    }
+
+    Socket m_socket;
+    ShmChannel m_shm;
+    bool m_connected;
+    std::vector<uint8_t> m_payload;
+    std::vector<uint8_t> m_sendBuffer;
+};
+
+struct ClientContext {
+    const BenchConfig* config;
+    unsigned index;
+    const std::vector<uint8_t>* data;
+    const std::atomic<bool>* running;
+    uint64_t startUs;
+    ClientResult result;
+    Thread thread;
+};
+
+std::string seedFileName(unsigned index) {
+    return "bench_seed_" + std::to_string(index) + ".bin";
+}
+
+ThreadReturn THREAD_CALL clientThreadFunction(void* arg) {
+    ClientContext* context = static_cast<ClientContext*>(arg);
+    const BenchConfig& config = *context->config;
+    ClientResult& result = context->result;
+    std::mt19937_64 random(config.seed * 7919 + context->index);
+
+    unsigned totalWeight = 0;
+    for (unsigned weight : config.weights) totalWeight += weight;
+    std::uniform_int_distribution<unsigned> pickOperation(0, totalWeight - 1);
+    std::uniform_int_distribution<unsigned> pickSeed(0, config.seedFiles ? config.seedFiles - 1 : 0);
+    // each client's share of the open-loop rate
+    std::exponential_distribution<double> interarrivalS(config.rate > 0 ? config.rate / config.clients : 1);
+
+    // files this client uploaded and has not deleted yet
+    std::vector<std::string> ownFiles;
+    uint64_t uploads = 0;
+    uint64_t scheduledUs = context->startUs;
+
+    BenchConnection connection;
+    while (*context->running) {
+        if (config.rate > 0) {
+            scheduledUs += static_cast<uint64_t>(interarrivalS(random) * 1e6);
+            uint64_t now = nowUs();
+            if (scheduledUs > now) Thread::sleep(static_cast<uint32_t>((scheduledUs - now) / 1000));
+            if (!*context->running) break;
+        }
+
+        unsigned pick = pickOperation(random);
+        Operation op = OP_LIST;
+        for (unsigned kind = 0; kind < OP_KINDS; kind++) {
+            if (pick < config.weights[kind]) {
+                op = static_cast<Operation>(kind);
+                break;
+            }
+            pick -= config.weights[kind];
+        }
+        // nothing of our own to delete yet, so make something
+        if (op == OP_DELETE && ownFiles.empty()) op = OP_UPLOAD;
+        if (op == OP_DOWNLOAD && config.seedFiles == 0) op = OP_LIST;
+
+        uint64_t startUs = config.rate > 0 ? scheduledUs : nowUs();
+        if (!connection.isConnected()) {
+            if (!connection.connect(config)) {
+                result.errors[op]++;
+                connection.drop();
+                Thread::sleep(100);
+                continue;
+            }
+            result.connects++;
+        }
+
+        bool ok = false;
+        uint64_t bytes = 0;
+        if (op == OP_LIST) {
+            ok = connection.list(bytes);
+        } else if (op == OP_UPLOAD) {
+            std::string name = "bench_" + std::to_string(context->index) + "_" + std::to_string(uploads++) + ".bin";
+            bytes = config.sizes.sample(random);
+            ok = connection.upload(name, bytes, *context->data);
+            if (ok) ownFiles.push_back(name);
+        } else if (op == OP_DOWNLOAD) {
+            ok = connection.download(seedFileName(pickSeed(random)), bytes);
+        } else {
+            size_t victim = std::uniform_int_distribution<size_t>(0, ownFiles.size() - 1)(random);
+            ok = connection.remove(ownFiles[victim]);
+            ownFiles[victim] = ownFiles.back();
+            ownFiles.pop_back();
+        }
+
+        if (!ok) {
+            result.errors[op]++;
+            connection.drop();
+            continue;
+        }
+        uint64_t latency = nowUs() - startUs;
+        result.latencyUs[op].push_back(static_cast<uint32_t>(std::min<uint64_t>(latency, UINT32_MAX)));
+        result.bytes[op] += bytes;
+    }
+
+    // leave the server as we found it, apart from the seed files
+    for (const std::string& name : ownFiles) {
+        if (!connection.isConnected() && !connection.connect(config)) break;
+        if (!connection.remove(name)) connection.drop();
+    }
+    connection.close();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+struct OperationReport {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes;
+    double opsPerSecond;
+    double megabytesPerSecond;
+    double meanUs;
+    uint32_t p50Us, p99Us, p999Us, maxUs;
+};
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+OperationReport summarize(std::vector<uint32_t>& latencies, uint64_t bytes, uint64_t errors, double seconds) {
+    std::sort(latencies.begin(), latencies.end());
+    OperationReport report;
+    report.count = latencies.size();
+    report.errors = errors;
+    report.bytes = bytes;
+    report.opsPerSecond = report.count / seconds;
+    report.megabytesPerSecond = bytes / seconds / (1024.0 * 1024.0);
+    double sum = 0;
+    for (uint32_t latency : latencies) sum += latency;
+    report.meanUs = latencies.empty() ? 0 : sum / latencies.size();
+    report.p50Us = percentile(latencies, 0.50);
+    report.p99Us = percentile(latencies, 0.99);
+    report.p999Us = percentile(latencies, 0.999);
+    report.maxUs = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+void printReport(const BenchConfig& config, const OperationReport* reports, const OperationReport& total,
+                 double seconds) {
+    std::printf("\n%u client(s), %.1f s, %s loop%s, upload sizes %s, %s sockets%s\n", config.clients, seconds,
+                config.rate > 0 ? "open" : "closed",
+                config.rate > 0 ? (" at " + std::to_string(static_cast<long>(config.rate)) + " req/s").c_str() : "",
+                config.sizes.describe().c_str(), config.socketProfile.c_str(), config.sharedMemory ? ", shared memory" : "");
+    std::printf("%-10s %10s %10s %10s %10s %10s %10s %10s %8s\n", "operation", "count", "ops/s", "MB/s",
+                "mean ms", "p50 ms", "p99 ms", "p999 ms", "errors");
+    for (unsigned op = 0; op <= OP_KINDS; op++) {
+        const OperationReport& r = op < OP_KINDS ? reports[op] : total;
+        if (op < OP_KINDS && r.count == 0 && r.errors == 0) continue;
+        std::printf("%-10s %10llu %10.1f %10.2f %10.3f %10.3f %10.3f %10.3f %8llu\n",
+                    op < OP_KINDS ? OPERATION_NAMES[op] : "total", static_cast<unsigned long long>(r.count),
+                    r.opsPerSecond, r.megabytesPerSecond, r.meanUs / 1000.0, r.p50Us / 1000.0, r.p99Us / 1000.0,
+                    r.p999Us / 1000.0, static_cast<unsigned long long>(r.errors));
+    }
+}
+
+void writeOperationJson(FILE* out, const OperationReport& r) {
+    std::fprintf(out, "{\"count\": %llu, \"errors\": %llu, \"bytes\": %llu, \"ops_per_sec\": %.3f, "
+                      "\"mb_per_sec\": %.3f, \"latency_us\": {\"mean\": %.1f, \"p50\": %u, \"p99\": %u, "
+                      "\"p999\": %u, \"max\": %u}}",
+                 static_cast<unsigned long long>(r.count), static_cast<unsigned long long>(r.errors),
+                 static_cast<unsigned long long>(r.bytes), r.opsPerSecond, r.megabytesPerSecond, r.meanUs,
+                 r.p50Us, r.p99Us, r.p999Us, r.maxUs);
+}
+
+bool writeJson(const BenchConfig& config, const OperationReport* reports, const OperationReport& total,
+               double seconds, uint64_t connects) {
+    FILE* out = config.jsonPath == "-" ? stdout : std::fopen(config.jsonPath.c_str(), "w");
+    if (!out) return false;
+    std::fprintf(out, "{\n  \"config\": {\"host\": \"%s\", \"port\": %u, \"clients\": %u, \"duration_s\": %u, "
+                      "\"mix\": {\"list\": %u, \"upload\": %u, \"download\": %u, \"delete\": %u}, "
+                      "\"sizes\": \"%s\", \"seed_files\": %u, \"rate\": %.1f, \"loop\": \"%s\", \"seed\": %llu, "
+                      "\"transport\": \"%s\", \"profile\": \"%s\"},\n",
+                 config.host.c_str(), config.port, config.clients, config.durationS, config.weights[OP_LIST],
+                 config.weights[OP_UPLOAD], config.weights[OP_DOWNLOAD], config.weights[OP_DELETE],
+                 config.sizes.describe().c_str(), config.seedFiles, config.rate, config.rate > 0 ? "open" : "closed",
+                 static_cast<unsigned long long>(config.seed), config.sharedMemory ? "shm" : "socket",
+                 config.socketProfile.c_str());
+    std::fprintf(out, "  \"elapsed_s\": %.3f,\n  \"connections\": %llu,\n  \"operations\": {", seconds,
+                 static_cast<unsigned long long>(connects));
+    for (unsigned op = 0; op < OP_KINDS; op++) {
+        std::fprintf(out, "%s\n    \"%s\": ", op ? "," : "", OPERATION_NAMES[op]);
+        writeOperationJson(out, reports[op]);
+    }
+    std::fprintf(out, "\n  },\n  \"total\": ");
+    writeOperationJson(out, total);
+    std::fprintf(out, "\n}\n");
+    return out == stdout ? std::fflush(out) == 0 : std::fclose(out) == 0;
+}
+
+// "list=1,upload=1,download=4,delete=1", missing operations keep their weight
+bool parseMix(const std::string& text, unsigned* weights) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(start, end - start);
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) return false;
+        std::string name = item.substr(0, equals);
+        unsigned kind = 0;
+        while (kind < OP_KINDS && name != OPERATION_NAMES[kind]) kind++;
+        if (kind == OP_KINDS) return false;
+        weights[kind] = static_cast<unsigned>(std::atoi(item.c_str() + equals + 1));
+        start = end + 1;
+    }
+    unsigned total = 0;
+    for (unsigned kind = 0; kind < OP_KINDS; kind++) total += weights[kind];
+    return total > 0;
+}
+
+void printUsage(const char* progName) {
+    std::cout << "Usage: " << progName << " <host> <port> <password> [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --clients <n>           - Concurrent connections (default: 16)" << std::endl;
+    std::cout << "  --duration <s>          - Measured run time (default: 10)" << std::endl;
+    std::cout << "  --mix <op=w,...>        - Weights of list, upload, download, delete (default: 1,1,4,1)" << std::endl;
+    std::cout << "  --size <dist>           - Upload sizes: 64K, 1K-1M (uniform) or exp:256K (default: 64K)" << std::endl;
+    std::cout << "  --seed-files <n>        - Files uploaded first for the downloads (default: 8)" << std::endl;
+    std::cout << "  --rate <req/s>          - Open loop at this total rate (default: closed loop)" << std::endl;
+    std::cout << "  --seed <n>              - Random seed, same seed same request sequence (default: 1)" << std::endl;
+    std::cout << "  --json <path>           - Also write the results as JSON, - for stdout" << std::endl;
+    std::cout << "  --profile <name>        - Socket tuning: " << SocketTuning::profileNames() << " (default: default)" << std::endl;
+    std::cout << "  --transport <socket|shm> - shm: unix:<path> host, then shared memory rings" << std::endl;
+    std::cout << "                            (server started with --unix and --shm-ring)" << std::endl;
+}
+
+bool parseArguments(int argc, char* argv[], BenchConfig& config) {
+    if (argc < 4) return false;
+    config.host = argv[1];
+    config.port = static_cast<uint16_t>(std::atoi(argv[2]));
+    config.passwordHash = SecurityHelper::hashPassword(argv[3]);
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--clients") {
+            config.clients = static_cast<unsigned>(std::atoi(value.c_str()));
+        } else if (arg == "--duration") {
+            config.durationS = static_cast<unsigned>(std::atoi(value.c_str()));
+        } else if (arg == "--mix") {
+            if (!parseMix(value, config.weights)) {
+                std::cerr << "Bad mix: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--size") {
+            if (!config.sizes.parse(value)) {
+                std::cerr << "Bad size distribution: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--seed-files") {
+            config.seedFiles = static_cast<unsigned>(std::atoi(value.c_str()));
+        } else if (arg == "--rate") {
+            config.rate = std::atof(value.c_str());
+        } else if (arg == "--seed") {
+            config.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--json") {
+            config.jsonPath = value;
+        } else if (arg == "--profile") {
+            if (!SocketTuning::fromProfile(value, config.socketTuning)) {
+                std::cerr << "Unknown socket profile: " << value << std::endl;
+                return false;
+            }
+            config.socketProfile = value;
+        } else if (arg == "--transport") {
+            if (value != "socket" && value != "shm") {
+                std::cerr << "Unknown transport: " << value << std::endl;
+                return false;
+            }
+            config.sharedMemory = value == "shm";
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (config.sharedMemory && !Socket::isUnixAddress(config.host)) {
+        std::cerr << "--transport shm needs a unix:<path> host" << std::endl;
+        return false;
+    }
+    return (config.port != 0 || Socket::isUnixAddress(config.host)) && config.clients > 0 && config.durationS > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!PlatformUtils::initialize()) {
+        std::cerr << "Failed to initialize platform" << std::endl;
+        return 1;
+    }
+
+    BenchConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        PlatformUtils::cleanup();
+        return 1;
+    }
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    std::srand(static_cast<unsigned>(config.seed));
+
+    // upload bodies are slices of one random block
+    std::vector<uint8_t> data(CHUNK_SIZE);
+    std::mt19937_64 random(config.seed);
+    for (uint8_t& byte : data) byte = static_cast<uint8_t>(random());
+
+    // the files every download picks from
+    BenchConnection setup;
+    if (!setup.connect(config)) {
+        std::cerr << "Cannot connect to " << config.host << ":" << config.port << std::endl;
+        PlatformUtils::cleanup();
+        return 1;
+    }
+    for (unsigned i = 0; i < config.seedFiles; i++) {
+        if (!setup.upload(seedFileName(i), config.sizes.sample(random), data)) {
+            std::cerr << "Cannot upload " << seedFileName(i) << std::endl;
+            PlatformUtils::cleanup();
+            return 1;
+        }
+    }
+    setup.close();
+
+    std::atomic<bool> running(true);
+    std::vector<ClientContext*> contexts;
+    uint64_t startUs = nowUs();
+    for (unsigned i = 0; i < config.clients; i++) {
+        ClientContext* context = new ClientContext();
+        context->config = &config;
+        context->index = i;
+        context->data = &data;
+        context->running = &running;
+        context->startUs = startUs;
+        ThreadOptions options;
+        options.name = "bench-" + std::to_string(i);
+        if (!context->thread.start(clientThreadFunction, context, options)) {
+            std::cerr << "Cannot start client thread " << i << std::endl;
+            delete context;
+            break;
+        }
+        contexts.push_back(context);
+    }
+
+    Thread::sleep(config.durationS * 1000);
+    running = false;
+    double seconds = (nowUs() - startUs) / 1e6;
+    for (ClientContext* context : contexts) {
+        context->thread.join();
+    }
+
+    std::vector<uint32_t> latencies[OP_KINDS];
+    std::vector<uint32_t> allLatencies;
+    uint64_t bytes[OP_KINDS] = {};
+    uint64_t errors[OP_KINDS] = {};
+    uint64_t connects = 0;
+    for (ClientContext* context : contexts) {
+        for (unsigned op = 0; op < OP_KINDS; op++) {
+            const std::vector<uint32_t>& own = context->result.latencyUs[op];
+            latencies[op].insert(latencies[op].end(), own.begin(), own.end());
+            allLatencies.insert(allLatencies.end(), own.begin(), own.end());
+            bytes[op] += context->result.bytes[op];
+            errors[op] += context->result.errors[op];
+        }
+        connects += context->result.connects;
+        delete context;
+    }
+
+    OperationReport reports[OP_KINDS];
+    uint64_t totalBytes = 0, totalErrors = 0;
+    for (unsigned op = 0; op < OP_KINDS; op++) {
+        reports[op] = summarize(latencies[op], bytes[op], errors[op], seconds);
+        totalBytes += bytes[op];
+        totalErrors += errors[op];
+    }
+    OperationReport total = summarize(allLatencies, totalBytes, totalErrors, seconds);
+
+    BenchConnection cleanup;
+    if (cleanup.connect(config)) {
+        for (unsigned i = 0; i < config.seedFiles; i++) {
+            if (!cleanup.remove(seedFileName(i))) break;
+        }
+        cleanup.close();
+    }
+
+    printReport(config, reports, total, seconds);
+    bool ok = true;
+    if (!config.jsonPath.empty() && !writeJson(config, reports, total, seconds, connects)) {
+        std::cerr << "Cannot write " << config.jsonPath << std::endl;
+        ok = false;
+    }
+
+    PlatformUtils::cleanup();
+    return ok && totalErrors == 0 ? 0 : 2;
+}
@@ -0,0 +1,377 @@
+#include "../include/logger.h"
+#include "../include/platform_wrapper.h"
+#include "../include/protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+// Asynchronous logger implementation
+
+// per thread. a thread that logs a line or two only ever touches the
+// first page, so idle connections do not pay for the rest
+static const size_t RING_BYTES = 16 * 1024;
+// longer messages are cut
+static const size_t MAX_TEXT = 480;
+static const uint32_t DRAIN_INTERVAL_MS = 20;
+// level of the filler record that skips the end of a ring before it wraps
+static const uint8_t LEVEL_PADDING = 0xFF;
+
+std::atomic<uint8_t> Logger::s_level(LOG_INFO);
+
+namespace {
+
+struct RecordHeader {
+    uint32_t size;          // header plus text, rounded up to 8
+    uint8_t level;
+    uint8_t operation;
+    uint16_t textLength;
+    uint32_t clientId;
+    uint64_t timeUs;        // wall clock
+    int64_t bytes;
+    int64_t durationUs;
+};
+
+// single producer (the owning thread), single consumer (the drain thread)
+struct LogRing {
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<bool> orphaned;     // owner exited, free once drained
+    LogRing* nextIncoming;
+    uint8_t* data;
+
+    LogRing() : tail(0), dropped(0), head(0), orphaned(false), nextIncoming(nullptr),
+                data(static_cast<uint8_t*>(std::malloc(RING_BYTES))) {}
+    ~LogRing() { std::free(data); }
+};
+
+// marks the thread's ring orphaned when the thread exits
+struct RingOwner {
+    LogRing* ring;
+
+    RingOwner() : ring(nullptr) {}
+    ~RingOwner() {
+        if (ring) ring->orphaned.store(true, std::memory_order_release);
+    }
+};
+
+struct BatchEntry {
+    uint64_t timeUs;
+    size_t offset;
+    size_t length;
+};
+
+}
+
+static thread_local RingOwner t_ring;
+
+static std::atomic<bool> g_running(false);
+// rings of threads that logged for the first time, the drain thread adopts them
+static std::atomic<LogRing*> g_incoming(nullptr);
+
+// drain thread's
+static std::vector<LogRing*> g_rings;
+static std::vector<BatchEntry> g_batch;
+static std::string g_text;
+static std::string g_output;
+static uint64_t g_droppedByExited = 0;
+static uint64_t g_droppedReported = 0;
+static std::atomic<uint64_t> g_droppedTotal(0);
+
+static FILE* g_out = nullptr;
+static bool g_ownsFile = false;
+static Mutex g_mutex;
+static ConditionVariable g_wake;
+static bool g_stopping = false;
+static Thread g_thread;
+
+static uint64_t wallClockUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const char* levelName(uint8_t level) {
+    switch (level) {
+        case LOG_DEBUG: return "DEBUG";
+        case LOG_INFO: return "INFO";
+        case LOG_WARN: return "WARN";
+        default: return "ERROR";
+    }
+}
+
+// 2026-01-01 12:00:00.123456 INFO  [Client 5] Download complete: a.bin op=DOWNLOAD_REQUEST bytes=1024 duration_us=310
+static void formatRecord(const RecordHeader& header, const char* text, std::string& out) {
+    time_t seconds = static_cast<time_t>(header.timeUs / 1000000);
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%s.%06u %-5s ", stamp,
+                  static_cast<unsigned>(header.timeUs % 1000000), levelName(header.level));
+    out += buffer;
+    if (header.clientId) {
+        std::snprintf(buffer, sizeof(buffer), "[Client %u] ", header.clientId);
+        out += buffer;
+    }
+    out.append(text, header.textLength);
+    if (header.operation) {
+        out += " op=";
+        out += ProtocolHelper::messageTypeName(header.operation);
+    }
+    if (header.bytes >= 0) {
+        std::snprintf(buffer, sizeof(buffer), " bytes=%lld", static_cast<long long>(header.bytes));
+        out += buffer;
+    }
+    if (header.durationUs >= 0) {
+        std::snprintf(buffer, sizeof(buffer), " duration_us=%lld", static_cast<long long>(header.durationUs));
+        out += buffer;
+    }
+    out += '\n';
+}
+
+static LogRing* currentRing() {
+    if (!t_ring.ring) {
+        LogRing* ring = new LogRing();
+        LogRing* head = g_incoming.load(std::memory_order_relaxed);
+        do {
+            ring->nextIncoming = head;
+        } while (!g_incoming.compare_exchange_weak(head, ring, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+        t_ring.ring = ring;
+    }
+    return t_ring.ring;
+}
+
+// a record never wraps, if it does not fit before the end a filler
+// takes the rest and the record starts over at offset 0
+static void pushRecord(LogRing* ring, RecordHeader& header, const char* text) {
+    header.size = static_cast<uint32_t>((sizeof(RecordHeader) + header.textLength + 7) & ~static_cast<size_t>(7));
+
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    size_t offset = static_cast<size_t>(tail & (RING_BYTES - 1));
+    size_t toEnd = RING_BYTES - offset;
+    size_t needed = header.size <= toEnd ? header.size : toEnd + header.size;
+
+    if (RING_BYTES - (tail - head) < needed) {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (header.size > toEnd) {
+        uint32_t fillerSize = static_cast<uint32_t>(toEnd);
+        std::memcpy(ring->data + offset, &fillerSize, sizeof(fillerSize));
+        ring->data[offset + offsetof(RecordHeader, level)] = LEVEL_PADDING;
+        tail += toEnd;
+        offset = 0;
+    }
+
+    std::memcpy(ring->data + offset, &header, sizeof(header));
+    std::memcpy(ring->data + offset + sizeof(header), text, header.textLength);
+    ring->tail.store(tail + header.size, std::memory_order_release);
+}
+
+static void writeRecord(LogLevel level, const LogFields& fields, const char* format, va_list args) {
+    char text[MAX_TEXT + 1];
+    int length = std::vsnprintf(text, sizeof(text), format, args);
+
+    RecordHeader header;
+    header.size = 0;
+    header.level = level;
+    header.operation = fields.operation;
+    header.textLength = static_cast<uint16_t>(std::min<size_t>(length > 0 ? length : 0, MAX_TEXT));
+    header.clientId = fields.clientId;
+    header.timeUs = wallClockUs();
+    header.bytes = fields.bytes;
+    header.durationUs = fields.durationUs;
+
+    if (g_running.load(std::memory_order_acquire)) {
+        pushRecord(currentRing(), header, text);
+        return;
+    }
+
+    // not started (or stopped), straight through
+    std::string line;
+    formatRecord(header, text, line);
+    std::fwrite(line.data(), 1, line.size(), stdout);
+    std::fflush(stdout);
+}
+
+static void drainRing(LogRing* ring) {
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+    while (head < tail) {
+        const uint8_t* record = ring->data + (head & (RING_BYTES - 1));
+        uint32_t size;
+        std::memcpy(&size, record, sizeof(size));
+        if (record[offsetof(RecordHeader, level)] != LEVEL_PADDING) {
+            RecordHeader header;
+            std::memcpy(&header, record, sizeof(header));
+            size_t start = g_text.size();
+            formatRecord(header, reinterpret_cast<const char*>(record + sizeof(header)), g_text);
+            g_batch.push_back(BatchEntry{header.timeUs, start, g_text.size() - start});
+        }
+        head += size;
+    }
+    ring->head.store(head, std::memory_order_release);
+}
+
+// one pass over every ring, written out in time order with one write
+static void drainAll() {
+    LogRing* added = g_incoming.exchange(nullptr, std::memory_order_acquire);
+    while (added) {
+        g_rings.push_back(added);
+        added = added->nextIncoming;
+    }
+
+    g_batch.clear();
+    g_text.clear();
+    uint64_t dropped = g_droppedByExited;
+    for (size_t i = 0; i < g_rings.size(); ) {
+        LogRing* ring = g_rings[i];
+        // read before draining, whatever the owner wrote is in by then
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+        drainRing(ring);
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+        if (orphaned) {
+            g_droppedByExited += ring->dropped.load(std::memory_order_relaxed);
+            delete ring;
+            g_rings[i] = g_rings.back();
+            g_rings.pop_back();
+        } else {
+            i++;
+        }
+    }
+    g_droppedTotal.store(dropped, std::memory_order_relaxed);
+
+    if (g_batch.empty() && dropped == g_droppedReported) return;
+
+    std::stable_sort(g_batch.begin(), g_batch.end(), [](const BatchEntry& a, const BatchEntry& b) {
+        return a.timeUs < b.timeUs;
+    });
+    g_output.clear();
+    for (const BatchEntry& entry : g_batch) {
+        g_output.append(g_text, entry.offset, entry.length);
+    }
+    if (dropped != g_droppedReported) {
+        g_output += "[Logger] " + std::to_string(dropped - g_droppedReported) +
+                    " line(s) dropped, log rings were full\n";
+        g_droppedReported = dropped;
+    }
+    std::fwrite(g_output.data(), 1, g_output.size(), g_out);
+    std::fflush(g_out);
+}
+
+static ThreadReturn THREAD_CALL drainThreadFunction(void*) {
+    LockGuard lock(g_mutex);
+    while (!g_stopping) {
+        g_wake.waitFor(g_mutex, DRAIN_INTERVAL_MS);
+        drainAll();
+    }
+    // stop() has cleared g_running, nothing new is queued after this
+    drainAll();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+bool Logger::start(const std::string& path, LogLevel level) {
+    setLevel(level);
+    if (g_running.load()) return true;
+
+    if (path.empty() || path == "-") {
+        g_out = stdout;
+        g_ownsFile = false;
+    } else {
+        g_out = std::fopen(path.c_str(), "a");
+        if (!g_out) return false;
+        g_ownsFile = true;
+    }
+
+    g_stopping = false;
+    g_running.store(true, std::memory_order_release);
+    ThreadOptions options;
+    options.name = "fs-log";
+    if (!g_thread.start(drainThreadFunction, nullptr, options)) {
+        g_running.store(false);
+        if (g_ownsFile) std::fclose(g_out);
+        g_out = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Logger::stop() {
+    if (!g_running.load()) return;
+    g_running.store(false, std::memory_order_release);
+    {
+        LockGuard lock(g_mutex);
+        g_stopping = true;
+        g_wake.notifyAll();
+    }
+    g_thread.join();
+
+    if (g_ownsFile) std::fclose(g_out);
+    g_out = nullptr;
+    g_ownsFile = false;
+}
+
+bool Logger::parseLevel(const std::string& text, LogLevel& level) {
+    if (text == "debug") level = LOG_DEBUG;
+    else if (text == "info") level = LOG_INFO;
+    else if (text == "warn") level = LOG_WARN;
+    else if (text == "error") level = LOG_ERROR;
+    else return false;
+    return true;
+}
+
+uint64_t Logger::getDropped() {
+    return g_droppedTotal.load(std::memory_order_relaxed);
+}
+
+void Logger::debug(const LogFields& fields, const char* format, ...) {
+    if (!enabled(LOG_DEBUG)) return;
+    va_list args;
+    va_start(args, format);
+    writeRecord(LOG_DEBUG, fields, format, args);
+    va_end(args);
+}
+
+void Logger::info(const LogFields& fields, const char* format, ...) {
+    if (!enabled(LOG_INFO)) return;
+    va_list args;
+    va_start(args, format);
+    writeRecord(LOG_INFO, fields, format, args);
+    va_end(args);
+}
+
+void Logger::warn(const LogFields& fields, const char* format, ...) {
+    if (!enabled(LOG_WARN)) return;
+    va_list args;
+    va_start(args, format);
+    writeRecord(LOG_WARN, fields, format, args);
+    va_end(args);
+}
+
+void Logger::error(const LogFields& fields, const char* format, ...) {
+    if (!enabled(LOG_ERROR)) return;
+    va_list args;
+    va_start(args, format);
+    writeRecord(LOG_ERROR, fields, format, args);
+    va_end(args);
+}
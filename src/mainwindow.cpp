@@ -9,12 +9,19 @@
 
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), m_client(nullptr) {
+    : QMainWindow(parent), m_networkThread(nullptr), m_client(nullptr) {
     
     setWindowTitle("File Sharing Client");
     resize(800, 600);
     
-    m_client = new NetworkClient(this);
+    // socket calls block, on the GUI thread a transfer would freeze the
+    // window until it ends. the client gets a thread of its own and every
+    // connection to it below is queued
+    qRegisterMetaType<uint16_t>("uint16_t");
+    m_networkThread = new QThread(this);
+    m_client = new NetworkClient();
+    m_client->moveToThread(m_networkThread);
+    connect(m_networkThread, &QThread::finished, m_client, &QObject::deleteLater);
     
     setupUI();
     
@@ -32,10 +39,23 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_client, &NetworkClient::transferProgress, this, &MainWindow::onTransferProgress);
     connect(m_client, &NetworkClient::transferComplete, this, &MainWindow::onTransferComplete);
     
+    connect(this, &MainWindow::connectRequested, m_client, &NetworkClient::connectToServer);
+    connect(this, &MainWindow::disconnectRequested, m_client, &NetworkClient::disconnect);
+    connect(this, &MainWindow::refreshRequested, m_client, &NetworkClient::refreshFileList);
+    connect(this, &MainWindow::uploadRequested, m_client, &NetworkClient::uploadFile);
+    connect(this, &MainWindow::downloadRequested, m_client, &NetworkClient::downloadFile);
+    connect(this, &MainWindow::deleteRequested, m_client, &NetworkClient::deleteFile);
+    
     setConnectedState(false);
+    m_networkThread->start();
 }
 
 MainWindow::~MainWindow() {
+    // a transfer still running would hold the thread until it ends;
+    // cancel() breaks it off, the client is deleted as the thread finishes
+    m_client->cancel();
+    m_networkThread->quit();
+    m_networkThread->wait();
 }
 
 void MainWindow::setupUI() {
@@ -143,21 +163,20 @@ void MainWindow::onConnectClicked() {
     
     log(QString("Connecting to %1:%2...").arg(host).arg(port));
     
-    if (m_client->connectToServer(host, port, password)) {
-        log("Connection successful!");
-    }
+    // until connected() or error() comes back
+    m_connectButton->setEnabled(false);
+    emit connectRequested(host, port, password);
 }
 
 
 void MainWindow::onDisconnectClicked() {
-    m_client->disconnect();
-    log("Disconnected from server");
+    emit disconnectRequested();
 }
 
 
 void MainWindow::onRefreshClicked() {
     log("Refreshing file list...");
-    m_client->refreshFileList();
+    emit refreshRequested();
 }
 
 
@@ -169,7 +188,7 @@ void MainWindow::onUploadClicked() {
     
     log(QString("Uploading: %1").arg(filePath));
     m_progressBar->setValue(0);
-    m_client->uploadFile(filePath);
+    emit uploadRequested(filePath);
 }
 
 
@@ -190,7 +209,7 @@ void MainWindow::onDownloadClicked() {
     
     log(QString("Downloading: %1").arg(filename));
     m_progressBar->setValue(0);
-    m_client->downloadFile(filename, savePath);
+    emit downloadRequested(filename, savePath);
 }
 
 
@@ -210,10 +229,7 @@ void MainWindow::onDeleteClicked() {
     
     if (reply == QMessageBox::Yes) {
         log(QString("Deleting: %1").arg(filename));
-        m_client->deleteFile(filename);
-        
-        // refresh list after delete
-        QTimer::singleShot(500, this, &MainWindow::onRefreshClicked);
+        emit deleteRequested(filename);
     }
 }
 
@@ -228,10 +244,13 @@ void MainWindow::onConnected() {
 void MainWindow::onDisconnected() {
     setConnectedState(false);
     m_fileList->clear();
+    log("Disconnected from server");
 }
 
 void MainWindow::onError(const QString& error) {
     log(QString("ERROR: %1").arg(error));
+    // a failed connect leaves the Connect button disabled otherwise
+    setConnectedState(m_client->isConnected());
     QMessageBox::critical(this, "Error", error);
 }
 
@@ -252,8 +271,9 @@ void MainWindow::onTransferComplete(const QString& message) {
     log(message);
     m_progressBar->setValue(0);
     
-    // refresh file list after upload/delete
-    QTimer::singleShot(500, this, &MainWindow::onRefreshClicked);
+    // refresh file list after upload/delete. the worker runs commands in
+    // order, the list is asked for after the change has been made
+    onRefreshClicked();
 }
 
 
@@ -0,0 +1,160 @@
+#include "../include/mapped_file.h"
+#include <algorithm>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// Sequential mmap reader implementation
+
+const size_t MappedFileReader::DEFAULT_WINDOW_SIZE;
+
+static size_t mappingGranularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+MappedFileReader::MappedFileReader()
+#ifdef _WIN32
+    : m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr),
+#else
+    : m_fd(-1),
+#endif
+      m_isOpen(false), m_size(0), m_position(0), m_windowSize(DEFAULT_WINDOW_SIZE),
+      m_window(nullptr), m_windowOffset(0), m_windowLength(0) {
+}
+
+MappedFileReader::~MappedFileReader() {
+    close();
+}
+
+bool MappedFileReader::open(const std::string& path, size_t windowSize) {
+    close();
+
+    size_t granularity = mappingGranularity();
+    m_windowSize = std::max(granularity, windowSize / granularity * granularity);
+
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    m_size = static_cast<uint64_t>(size.QuadPart);
+
+    // empty files cannot be mapped, they simply have no views
+    if (m_size > 0) {
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+            return false;
+        }
+    }
+#else
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    m_position = 0;
+    m_isOpen = true;
+    return true;
+}
+
+void MappedFileReader::close() {
+    if (!m_isOpen) return;
+
+    unmapWindow(m_size > m_windowSize);
+#ifdef _WIN32
+    if (m_mapping) CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    ::close(m_fd);
+    m_fd = -1;
+#endif
+
+    m_isOpen = false;
+    m_size = 0;
+    m_position = 0;
+}
+
+bool MappedFileReader::next(size_t maxLength, const uint8_t*& data, size_t& length) {
+    if (!m_isOpen || m_position >= m_size || maxLength == 0) return false;
+
+    uint64_t windowEnd = m_windowOffset + m_windowLength;
+    if (!m_window || m_position >= windowEnd) {
+        if (!mapWindow(m_position / m_windowSize * m_windowSize)) return false;
+        windowEnd = m_windowOffset + m_windowLength;
+    }
+
+    // views never straddle two windows
+    length = static_cast<size_t>(std::min<uint64_t>(maxLength, windowEnd - m_position));
+    data = m_window + (m_position - m_windowOffset);
+    m_position += length;
+    return true;
+}
+
+bool MappedFileReader::mapWindow(uint64_t offset) {
+    unmapWindow(m_size > m_windowSize);
+
+    size_t length = static_cast<size_t>(std::min<uint64_t>(m_windowSize, m_size - offset));
+
+#ifdef _WIN32
+    void* view = MapViewOfFile(m_mapping, FILE_MAP_READ, static_cast<DWORD>(offset >> 32),
+                               static_cast<DWORD>(offset & 0xFFFFFFFF), length);
+    if (!view) return false;
+#else
+    void* view = mmap(nullptr, length, PROT_READ, MAP_SHARED, m_fd, static_cast<off_t>(offset));
+    if (view == MAP_FAILED) return false;
+    madvise(view, length, MADV_SEQUENTIAL);
+#endif
+
+    m_window = static_cast<uint8_t*>(view);
+    m_windowOffset = offset;
+    m_windowLength = length;
+    return true;
+}
+
+void MappedFileReader::unmapWindow(bool dropPages) {
+    if (!m_window) return;
+
+#ifdef _WIN32
+    (void)dropPages;
+    UnmapViewOfFile(m_window);
+#else
+    munmap(m_window, m_windowLength);
+#ifdef POSIX_FADV_DONTNEED
+    if (dropPages) {
+        posix_fadvise(m_fd, static_cast<off_t>(m_windowOffset), static_cast<off_t>(m_windowLength),
+                      POSIX_FADV_DONTNEED);
+    }
+#else
+    (void)dropPages;
+#endif
+#endif
+
+    m_window = nullptr;
+    m_windowOffset = 0;
+    m_windowLength = 0;
+}
@@ -0,0 +1,183 @@
+#include "../include/metadata_snapshot.h"
+#include "../include/platform_wrapper.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// Metadata snapshot reader/writer
+
+using namespace SnapshotFormat;
+
+MetadataSnapshot::MetadataSnapshot()
+    : m_data(nullptr), m_size(0), m_count(0), m_createdAt(0),
+      m_records(nullptr), m_names(nullptr), m_namesSize(0) {
+}
+
+MetadataSnapshot::~MetadataSnapshot() {
+    close();
+}
+
+bool MetadataSnapshot::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    // no mmap here, reading it in is still one sequential pass
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+
+    std::streamsize size = file.tellg();
+    if (size < static_cast<std::streamsize>(sizeof(SnapshotHeader))) return false;
+    file.seekg(0, std::ios::beg);
+
+    m_buffer.resize(static_cast<size_t>(size));
+    if (!file.read(reinterpret_cast<char*>(m_buffer.data()), size)) return false;
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    m_data = static_cast<const uint8_t*>(mapped);
+    m_size = st.st_size;
+#endif
+
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(m_data);
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                 header->version == VERSION &&
+                 header->recordSize == sizeof(SnapshotRecord) &&
+                 header->count <= (m_size - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord) &&
+                 sizeof(SnapshotHeader) + header->count * sizeof(SnapshotRecord) + header->namesSize == m_size;
+
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_count = header->count;
+    m_createdAt = header->createdAt;
+    m_namesSize = header->namesSize;
+    m_records = reinterpret_cast<const SnapshotRecord*>(m_data + sizeof(SnapshotHeader));
+    m_names = reinterpret_cast<const char*>(m_records + m_count);
+
+#ifndef _WIN32
+    // records are consumed front to back by the loader
+    madvise(const_cast<uint8_t*>(m_data), m_size, MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void MetadataSnapshot::close() {
+    if (!m_data) return;
+
+#ifdef _WIN32
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+#else
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_records = nullptr;
+    m_names = nullptr;
+    m_namesSize = 0;
+}
+
+bool MetadataSnapshot::getEntry(uint64_t index, const char*& name, size_t& nameLength,
+                                uint64_t& fileSize, uint64_t& timestamp) const {
+    if (index >= m_count) return false;
+
+    const SnapshotRecord& record = m_records[index];
+    if (static_cast<uint64_t>(record.nameOffset) + record.nameLength > m_namesSize) {
+        return false;
+    }
+
+    name = m_names + record.nameOffset;
+    nameLength = record.nameLength;
+    fileSize = record.fileSize;
+    timestamp = record.timestamp;
+    return true;
+}
+
+
+void MetadataSnapshot::Builder::reserve(size_t count, size_t namesSize) {
+    m_records.reserve(count);
+    m_names.reserve(namesSize);
+}
+
+bool MetadataSnapshot::Builder::add(const std::string& name, uint64_t fileSize, uint64_t timestamp) {
+    // offsets are 32 bit, 4GB of names is far past MAX_FILENAME_LENGTH * any sane count
+    if (m_names.size() + name.length() > UINT32_MAX) return false;
+
+    SnapshotRecord record;
+    record.fileSize = fileSize;
+    record.timestamp = timestamp;
+    record.nameOffset = static_cast<uint32_t>(m_names.size());
+    record.nameLength = static_cast<uint32_t>(name.length());
+
+    m_records.push_back(record);
+    m_names.insert(m_names.end(), name.begin(), name.end());
+    return true;
+}
+
+bool MetadataSnapshot::Builder::writeTo(const std::string& path) const {
+    std::string tmpPath = path + ".tmp";
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.recordSize = sizeof(SnapshotRecord);
+    header.count = m_records.size();
+    header.namesSize = m_names.size();
+    header.createdAt = static_cast<uint64_t>(time(nullptr));
+
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_records.data()),
+                   m_records.size() * sizeof(SnapshotRecord));
+        file.write(m_names.data(), m_names.size());
+        file.close();
+        if (file.fail()) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+
+#ifndef _WIN32
+    // data must be on disk before the rename makes it the live snapshot
+    int fd = ::open(tmpPath.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    std::remove(path.c_str());
+#endif
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
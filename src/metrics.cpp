@@ -0,0 +1,222 @@
+#include "../include/metrics.h"
+#include "../include/platform_wrapper.h"
+#include "../include/protocol.h"
+#include "../include/logger.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+// Server metrics implementation
+
+const unsigned Metrics::OP_COUNT;
+const unsigned Metrics::LATENCY_BUCKETS;
+const unsigned Metrics::THROUGHPUT_BUCKETS;
+const unsigned Metrics::THROUGHPUT_MIN_BITS;
+const unsigned Metrics::STRIPES;
+
+static const unsigned NO_STRIPE = ~0u;
+static thread_local unsigned t_stripe = NO_STRIPE;
+
+// number of significant bits, 0 for 0
+static unsigned bitLength(uint64_t value) {
+#if defined(__GNUC__)
+    return value ? 64 - __builtin_clzll(value) : 0;
+#else
+    unsigned bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+#endif
+}
+
+static void zero(std::atomic<uint64_t>* counters, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+Metrics::Metrics() : m_nextStripe(0), m_active(0), m_queued(0), m_connections(0), m_rejected(0) {
+    for (Stripe& stripe : m_stripes) {
+        zero(stripe.requests, OP_COUNT);
+        zero(stripe.latencySumUs, OP_COUNT);
+        zero(&stripe.latency[0][0], OP_COUNT * (LATENCY_BUCKETS + 1));
+        zero(stripe.throughputSum, 2);
+        zero(&stripe.throughput[0][0], 2 * (THROUGHPUT_BUCKETS + 1));
+        zero(&stripe.bytesIn, 1);
+        zero(&stripe.bytesOut, 1);
+        zero(&stripe.authFailures, 1);
+        zero(&stripe.errors, 1);
+    }
+}
+
+// threads are dealt stripes round-robin on first use
+Metrics::Stripe& Metrics::stripe() {
+    if (t_stripe == NO_STRIPE) {
+        t_stripe = m_nextStripe.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    }
+    return m_stripes[t_stripe];
+}
+
+unsigned Metrics::opIndex(uint8_t messageType) {
+    switch (messageType) {
+        case Protocol::MSG_CONNECT_REQUEST: return 0;
+        case Protocol::MSG_LIST_FILES: return 1;
+        case Protocol::MSG_UPLOAD_REQUEST: return 2;
+        case Protocol::MSG_UPLOAD_DATA: return 3;
+        case Protocol::MSG_UPLOAD_COMPLETE: return 4;
+        case Protocol::MSG_DOWNLOAD_REQUEST: return 5;
+        case Protocol::MSG_DELETE_REQUEST: return 6;
+        case Protocol::MSG_DISCONNECT: return 7;
+        default: return 8;
+    }
+}
+
+const char* Metrics::opName(unsigned index) {
+    static const char* const names[OP_COUNT] = {
+        "connect", "list_files", "upload_request", "upload_data", "upload_complete",
+        "download", "delete", "disconnect", "other"
+    };
+    return names[index];
+}
+
+void Metrics::recordRequest(uint8_t messageType, uint64_t durationUs) {
+    Stripe& own = stripe();
+    unsigned op = opIndex(messageType);
+    unsigned bucket = bitLength(durationUs);
+    if (bucket > LATENCY_BUCKETS) bucket = LATENCY_BUCKETS;
+
+    add(own.requests[op], 1);
+    add(own.latencySumUs[op], durationUs);
+    add(own.latency[op][bucket], 1);
+}
+
+void Metrics::recordTransfer(Direction direction, uint64_t bytes, uint64_t durationUs) {
+    Stripe& own = stripe();
+    uint64_t bytesPerSecond = bytes * 1000000 / (durationUs ? durationUs : 1);
+    unsigned bits = bitLength(bytesPerSecond);
+    unsigned bucket = bits > THROUGHPUT_MIN_BITS ? bits - THROUGHPUT_MIN_BITS : 0;
+    if (bucket > THROUGHPUT_BUCKETS) bucket = THROUGHPUT_BUCKETS;
+
+    add(own.throughputSum[direction], bytesPerSecond);
+    add(own.throughput[direction][bucket], 1);
+}
+
+void Metrics::connectionOpened() {
+    m_active.fetch_add(1, std::memory_order_relaxed);
+    m_connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void appendf(std::string& out, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+
+static void appendf(std::string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) out.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+static void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void appendCounter(std::string& out, const char* name, const char* type, const char* help,
+                          unsigned long long value) {
+    appendHeader(out, name, type, help);
+    appendf(out, "%s %llu\n", name, value);
+}
+
+// the stripes are summed counter by counter, a scrape racing with
+// recording may be a few events behind in one series, never torn
+void Metrics::render(std::string& out) const {
+    uint64_t requests[OP_COUNT] = {};
+    uint64_t latencySumUs[OP_COUNT] = {};
+    uint64_t latency[OP_COUNT][LATENCY_BUCKETS + 1] = {};
+    uint64_t throughputSum[2] = {};
+    uint64_t throughput[2][THROUGHPUT_BUCKETS + 1] = {};
+    uint64_t bytesIn = 0, bytesOut = 0, authFailures = 0, errors = 0;
+
+    for (const Stripe& stripe : m_stripes) {
+        for (unsigned op = 0; op < OP_COUNT; op++) {
+            requests[op] += stripe.requests[op].load(std::memory_order_relaxed);
+            latencySumUs[op] += stripe.latencySumUs[op].load(std::memory_order_relaxed);
+            for (unsigned b = 0; b <= LATENCY_BUCKETS; b++) {
+                latency[op][b] += stripe.latency[op][b].load(std::memory_order_relaxed);
+            }
+        }
+        for (unsigned d = 0; d < 2; d++) {
+            throughputSum[d] += stripe.throughputSum[d].load(std::memory_order_relaxed);
+            for (unsigned b = 0; b <= THROUGHPUT_BUCKETS; b++) {
+                throughput[d][b] += stripe.throughput[d][b].load(std::memory_order_relaxed);
+            }
+        }
+        bytesIn += stripe.bytesIn.load(std::memory_order_relaxed);
+        bytesOut += stripe.bytesOut.load(std::memory_order_relaxed);
+        authFailures += stripe.authFailures.load(std::memory_order_relaxed);
+        errors += stripe.errors.load(std::memory_order_relaxed);
+    }
+
+    appendHeader(out, "fileserver_requests_total", "counter", "Requests handled, by message type.");
+    for (unsigned op = 0; op < OP_COUNT; op++) {
+        appendf(out, "fileserver_requests_total{op=\"%s\"} %llu\n", opName(op),
+                static_cast<unsigned long long>(requests[op]));
+    }
+
+    // the count is the +Inf bucket, so a histogram is never ahead of itself
+    appendHeader(out, "fileserver_request_duration_seconds", "histogram",
+                 "Time from a request's header to the end of its reply.");
+    for (unsigned op = 0; op < OP_COUNT; op++) {
+        uint64_t cumulative = 0;
+        for (unsigned b = 0; b < LATENCY_BUCKETS; b++) {
+            cumulative += latency[op][b];
+            appendf(out, "fileserver_request_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n", opName(op),
+                    static_cast<double>(1ull << b) / 1e6, static_cast<unsigned long long>(cumulative));
+        }
+        cumulative += latency[op][LATENCY_BUCKETS];
+        appendf(out, "fileserver_request_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", opName(op),
+                static_cast<unsigned long long>(cumulative));
+        appendf(out, "fileserver_request_duration_seconds_sum{op=\"%s\"} %g\n", opName(op),
+                static_cast<double>(latencySumUs[op]) / 1e6);
+        appendf(out, "fileserver_request_duration_seconds_count{op=\"%s\"} %llu\n", opName(op),
+                static_cast<unsigned long long>(cumulative));
+    }
+
+    appendHeader(out, "fileserver_transfer_throughput_bytes_per_second", "histogram",
+                 "Average rate of each completed download or upload.");
+    for (unsigned d = 0; d < 2; d++) {
+        const char* direction = d == DOWNLOAD ? "download" : "upload";
+        uint64_t cumulative = 0;
+        for (unsigned b = 0; b < THROUGHPUT_BUCKETS; b++) {
+            cumulative += throughput[d][b];
+            appendf(out, "fileserver_transfer_throughput_bytes_per_second_bucket{direction=\"%s\",le=\"%llu\"} %llu\n",
+                    direction, 1ull << (b + THROUGHPUT_MIN_BITS), static_cast<unsigned long long>(cumulative));
+        }
+        cumulative += throughput[d][THROUGHPUT_BUCKETS];
+        appendf(out, "fileserver_transfer_throughput_bytes_per_second_bucket{direction=\"%s\",le=\"+Inf\"} %llu\n",
+                direction, static_cast<unsigned long long>(cumulative));
+        appendf(out, "fileserver_transfer_throughput_bytes_per_second_sum{direction=\"%s\"} %llu\n",
+                direction, static_cast<unsigned long long>(throughputSum[d]));
+        appendf(out, "fileserver_transfer_throughput_bytes_per_second_count{direction=\"%s\"} %llu\n",
+                direction, static_cast<unsigned long long>(cumulative));
+    }
+
+    appendCounter(out, "fileserver_received_bytes_total", "counter", "Bytes read from client sockets.", bytesIn);
+    appendCounter(out, "fileserver_sent_bytes_total", "counter", "Bytes written to client sockets.", bytesOut);
+    appendCounter(out, "fileserver_auth_failures_total", "counter", "Rejected passwords.", authFailures);
+    appendCounter(out, "fileserver_error_responses_total", "counter", "ERROR_RESPONSE messages sent.", errors);
+    appendCounter(out, "fileserver_connections_total", "counter", "Connections given a client slot.",
+                  m_connections.load(std::memory_order_relaxed));
+    appendCounter(out, "fileserver_connections_rejected_total", "counter",
+                  "Connections turned away with SERVER_BUSY.", m_rejected.load(std::memory_order_relaxed));
+    appendHeader(out, "fileserver_connections_active", "gauge", "Connections being served by a handler.");
+    appendf(out, "fileserver_connections_active %lld\n",
+            static_cast<long long>(m_active.load(std::memory_order_relaxed)));
+    appendHeader(out, "fileserver_connections_queued", "gauge", "Connections waiting for a client slot.");
+    appendf(out, "fileserver_connections_queued %lld\n",
+            static_cast<long long>(m_queued.load(std::memory_order_relaxed)));
+    appendCounter(out, "fileserver_log_dropped_lines_total", "counter", "Log lines lost to full log rings.",
+                  Logger::getDropped());
+}
@@ -0,0 +1,124 @@
+#include "../include/metrics_endpoint.h"
+#include "../include/logger.h"
+#include <cstdlib>
+
+// Prometheus scrape endpoint implementation
+
+// a scraper that has not sent its request by then is dropped
+static const uint32_t REQUEST_TIMEOUT_MS = 2000;
+static const size_t MAX_REQUEST_SIZE = 8 * 1024;
+
+MetricsEndpoint::MetricsEndpoint(const Metrics* metrics) : m_metrics(metrics), m_running(false) {
+}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    stop();
+}
+
+bool MetricsEndpoint::parseAddress(const std::string& text, std::string& address, uint16_t& port) {
+    size_t colon = text.rfind(':');
+    std::string portText = colon == std::string::npos ? text : text.substr(colon + 1);
+    address = colon == std::string::npos ? "127.0.0.1" : text.substr(0, colon);
+    // [::1]:9100
+    if (address.size() > 2 && address.front() == '[' && address.back() == ']') {
+        address = address.substr(1, address.size() - 2);
+    }
+
+    char* end = nullptr;
+    long value = std::strtol(portText.c_str(), &end, 10);
+    if (portText.empty() || *end != '\0' || value <= 0 || value > 65535 || address.empty()) {
+        return false;
+    }
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+bool MetricsEndpoint::start(const std::string& address, uint16_t port) {
+    if (!m_listenSocket.create()) return false;
+    m_listenSocket.setReuseAddr(true);
+    if (!m_listenSocket.bind(port, address) || !m_listenSocket.listen(16)) {
+        Logger::error(LogFields(), "[Metrics] Cannot listen on %s:%u: %s", address.c_str(), port,
+                      m_listenSocket.getLastError().c_str());
+        m_listenSocket.close();
+        return false;
+    }
+
+    m_running = true;
+    ThreadOptions options;
+    options.name = "fs-metrics";
+    if (!m_thread.start(endpointThreadFunction, this, options)) {
+        m_running = false;
+        m_listenSocket.close();
+        return false;
+    }
+    return true;
+}
+
+void MetricsEndpoint::stop() {
+    if (!m_running.exchange(false)) return;
+    m_listenSocket.shutdown();
+    m_thread.join();
+    m_listenSocket.close();
+}
+
+ThreadReturn THREAD_CALL MetricsEndpoint::endpointThreadFunction(void* arg) {
+    static_cast<MetricsEndpoint*>(arg)->serve();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+void MetricsEndpoint::serve() {
+    while (m_running) {
+        Socket* client = m_listenSocket.accept();
+        if (!client) continue;      // shut down, or a signal
+        handleRequest(client);
+        delete client;
+    }
+}
+
+void MetricsEndpoint::handleRequest(Socket* client) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+        if (request.size() > MAX_REQUEST_SIZE || !client->waitReadable(REQUEST_TIMEOUT_MS)) return;
+        int received = client->receive(buffer, sizeof(buffer));
+        if (received <= 0) return;
+        request.append(buffer, received);
+    }
+
+    // "GET /metrics HTTP/1.1", the query string is ignored
+    std::string status = "404 Not Found";
+    std::string body = "not found, try /metrics\n";
+    std::string contentType = "text/plain";
+    size_t methodEnd = request.find(' ');
+    size_t pathEnd = methodEnd == std::string::npos ? methodEnd : request.find_first_of(" ?", methodEnd + 1);
+    if (methodEnd != std::string::npos && pathEnd != std::string::npos) {
+        std::string method = request.substr(0, methodEnd);
+        std::string path = request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+        if (method != "GET") {
+            status = "405 Method Not Allowed";
+            body = "only GET\n";
+        } else if (path == "/metrics") {
+            status = "200 OK";
+            contentType = "text/plain; version=0.0.4";
+            body.clear();
+            m_metrics->render(body);
+        }
+    }
+
+    std::string response = "HTTP/1.0 " + status + "\r\nContent-Type: " + contentType +
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+    const char* data = response.data();
+    size_t remaining = response.size();
+    while (remaining > 0) {
+        int sent = client->send(data, remaining);
+        if (sent <= 0) return;
+        data += sent;
+        remaining -= sent;
+    }
+    client->shutdownSend();
+}
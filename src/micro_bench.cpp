@@ -0,0 +1,516 @@
+#include "../include/platform_wrapper.h"
+#include "../include/protocol.h"
+#include "../include/file_manager.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the protocol codec, list payloads, FileManager
+// listings and Mutex. each benchmark is calibrated until one run takes
+// --min-time, then repeated; the median ns/op of the repetitions is the
+// result and the min..max spread says how far to trust it. inputs come
+// from fixed seeds, so two builds measure the same work. --json writes
+// the results and --compare reads an earlier file and prints the change
+
+namespace {
+
+// keeps the compiler from proving a result unused
+template <typename T>
+inline void keep(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// runs `iterations` operations and returns the time they took in ns,
+// setup that should not count is done before the clock starts. setup
+// that fails says why on stderr and returns BENCH_FAILED
+typedef std::function<uint64_t(uint64_t iterations)> BenchFunction;
+const uint64_t BENCH_FAILED = ~0ull;
+
+struct Benchmark {
+    std::string name;
+    BenchFunction run;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;         // median
+    double minNsPerOp;
+    double maxNsPerOp;
+};
+
+struct Options {
+    uint32_t minTimeMs;
+    unsigned repetitions;
+    std::string filter;
+    std::string jsonPath;
+    std::string comparePath;
+    std::string workDir;
+    int cpu;                // -1 = unpinned
+
+    Options() : minTimeMs(200), repetitions(5), workDir("micro_bench_files"), cpu(-1) {}
+};
+
+// grows the iteration count until a run lasts minTimeMs, false if a run
+// failed
+bool measure(const Benchmark& benchmark, const Options& options, Result& result) {
+    uint64_t minTimeNs = static_cast<uint64_t>(options.minTimeMs) * 1000000;
+    uint64_t iterations = 1;
+    for (;;) {
+        uint64_t elapsed = benchmark.run(iterations);
+        if (elapsed == BENCH_FAILED) return false;
+        if (elapsed >= minTimeNs || iterations >= (1ull << 40)) break;
+        double scale = elapsed ? 1.4 * minTimeNs / elapsed : 10;
+        iterations = static_cast<uint64_t>(iterations * std::min(10.0, std::max(2.0, scale)));
+    }
+
+    std::vector<double> samples;
+    for (unsigned i = 0; i < options.repetitions; i++) {
+        uint64_t elapsed = benchmark.run(iterations);
+        if (elapsed == BENCH_FAILED) return false;
+        samples.push_back(static_cast<double>(elapsed) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.nsPerOp = samples[samples.size() / 2];
+    result.minNsPerOp = samples.front();
+    result.maxNsPerOp = samples.back();
+    return true;
+}
+
+std::string randomName(std::mt19937_64& random, size_t length) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+    std::string name(length, 'a');
+    for (char& c : name) c = alphabet[random() % (sizeof(alphabet) - 1)];
+    return name + ".bin";
+}
+
+std::vector<Protocol::FileInfo> syntheticFiles(size_t count, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<Protocol::FileInfo> files;
+    files.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        files.emplace_back(randomName(random, 8 + random() % 24), random() % (1ull << 30),
+                           1700000000 + random() % 100000000);
+    }
+    return files;
+}
+
+// Protocol codec
+
+void addProtocolBenchmarks(std::vector<Benchmark>& benchmarks) {
+    benchmarks.push_back({"protocol/serialize_header", [](uint64_t n) {
+        uint8_t buffer[8];
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            Protocol::MessageHeader header(Protocol::MSG_DOWNLOAD_DATA, static_cast<uint32_t>(i));
+            ProtocolHelper::serializeHeader(header, buffer, sizeof(buffer));
+            keep(buffer);
+        }
+        return nowNs() - start;
+    }});
+
+    benchmarks.push_back({"protocol/deserialize_header", [](uint64_t n) {
+        uint8_t buffer[8];
+        ProtocolHelper::serializeHeader(Protocol::MessageHeader(Protocol::MSG_DOWNLOAD_DATA, 65536), buffer,
+                                        sizeof(buffer));
+        Protocol::MessageHeader header;
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            keep(buffer);
+            ProtocolHelper::deserializeHeader(buffer, sizeof(buffer), header);
+            keep(header);
+        }
+        return nowNs() - start;
+    }});
+
+    benchmarks.push_back({"protocol/serialize_string_32", [](uint64_t n) {
+        std::mt19937_64 random(1);
+        std::string text = randomName(random, 28);
+        uint8_t buffer[64];
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            keep(text);
+            keep(ProtocolHelper::serializeString(text, buffer, sizeof(buffer)));
+            keep(buffer);
+        }
+        return nowNs() - start;
+    }});
+
+    benchmarks.push_back({"protocol/deserialize_string_32", [](uint64_t n) {
+        std::mt19937_64 random(1);
+        uint8_t buffer[64];
+        size_t length = ProtocolHelper::serializeString(randomName(random, 28), buffer, sizeof(buffer));
+        std::string text;
+        size_t bytesRead;
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            keep(buffer);
+            ProtocolHelper::deserializeString(buffer, length, text, bytesRead);
+            keep(text);
+        }
+        return nowNs() - start;
+    }});
+
+    benchmarks.push_back({"protocol/serialize_file_info", [](uint64_t n) {
+        std::vector<Protocol::FileInfo> files = syntheticFiles(1024, 2);
+        uint8_t buffer[128];
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            keep(ProtocolHelper::serializeFileInfo(files[i & 1023], buffer, sizeof(buffer)));
+            keep(buffer);
+        }
+        return nowNs() - start;
+    }});
+
+    benchmarks.push_back({"protocol/deserialize_file_info", [](uint64_t n) {
+        std::vector<Protocol::FileInfo> files = syntheticFiles(1024, 2);
+        std::vector<uint8_t> payload;
+        ProtocolHelper::createFileListPayload(files, payload);
+        std::vector<size_t> offsets;
+        for (size_t offset = sizeof(uint32_t), i = 0; i < files.size(); i++) {
+            offsets.push_back(offset);
+            offset += sizeof(uint32_t) + files[i].filename.size() + 2 * sizeof(uint64_t);
+        }
+        Protocol::FileInfo info;
+        size_t bytesRead;
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < n; i++) {
+            size_t offset = offsets[i & 1023];
+            ProtocolHelper::deserializeFileInfo(payload.data() + offset, payload.size() - offset, info, bytesRead);
+            keep(info);
+        }
+        return nowNs() - start;
+    }});
+}
+
+// what handleListFiles builds, one op = one whole payload
+void addListPayloadBenchmarks(std::vector<Benchmark>& benchmarks) {
+    for (size_t count : {10000, 100000, 1000000}) {
+        benchmarks.push_back({"list_payload/" + std::to_string(count), [count](uint64_t n) {
+            std::vector<Protocol::FileInfo> files = syntheticFiles(count, 3);
+            uint64_t start = nowNs();
+            for (uint64_t i = 0; i < n; i++) {
+                std::vector<uint8_t> payload;
+                ProtocolHelper::createFileListPayload(files, payload);
+                keep(payload);
+            }
+            return nowNs() - start;
+        }});
+    }
+}
+
+// FileManager listings
+
+bool writeEmptyFile(const std::string& path, uint64_t size) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    if (size) {
+        std::fseek(file, static_cast<long>(size - 1), SEEK_SET);
+        std::fputc(0, file);
+    }
+    return std::fclose(file) == 0;
+}
+
+void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// count files with fixed names and sizes under dir in the given layout,
+// reused when a previous run left them there
+bool populate(const std::string& dir, StorageLayout layout, size_t count) {
+    std::string marker = dir + ".complete";
+    struct stat st;
+    if (stat(marker.c_str(), &st) == 0) return true;
+
+    makeDirectory(dir);
+    std::mt19937_64 random(4);
+    for (size_t i = 0; i < count; i++) {
+        std::string name = "file_" + std::to_string(i) + ".bin";
+        std::string path = dir + "/" + name;
+        if (layout == LAYOUT_SHARDED) {
+            std::string shard = FileManager::getShardSubdirectory(name);
+            makeDirectory(dir + "/" + shard.substr(0, 2));
+            makeDirectory(dir + "/" + shard);
+            path = dir + "/" + shard + "/" + name;
+        }
+        if (!writeEmptyFile(path, random() % 4096)) {
+            std::cerr << "Cannot create " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    if (!writeEmptyFile(marker, 0)) {
+        std::cerr << "Cannot create " << marker << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const uint64_t SNAPSHOT_TIMEOUT_NS = 30ull * 1000000000;
+
+void addFileManagerBenchmarks(std::vector<Benchmark>& benchmarks, const Options& options) {
+    for (size_t count : {1000, 10000}) {
+        for (StorageLayout layout : {LAYOUT_FLAT, LAYOUT_SHARDED}) {
+            std::string dir = options.workDir + "/" + FileManager::layoutName(layout) + "_" + std::to_string(count);
+            benchmarks.push_back({"file_manager/scan_" + std::string(FileManager::layoutName(layout)) + "/" +
+                                  std::to_string(count), [dir, layout, count](uint64_t n) {
+                if (!populate(dir, layout, count)) return BENCH_FAILED;
+                FileManager manager(dir, layout);
+                uint64_t start = nowNs();
+                for (uint64_t i = 0; i < n; i++) {
+                    keep(manager.getFileList());
+                }
+                return nowNs() - start;
+            }});
+        }
+
+        // served from the in-memory index once it is built
+        std::string dir = options.workDir + "/flat_" + std::to_string(count);
+        benchmarks.push_back({"file_manager/index/" + std::to_string(count), [dir, count](uint64_t n) {
+            if (!populate(dir, LAYOUT_FLAT, count)) return BENCH_FAILED;
+            std::string snapshot = dir + ".snapshot";
+            std::remove(snapshot.c_str());
+            FileManager manager(dir, LAYOUT_FLAT);
+            manager.enableSnapshot(snapshot, 3600);
+            // false until the background index build is done, or when the
+            // write failed
+            uint64_t deadline = nowNs() + SNAPSHOT_TIMEOUT_NS;
+            while (!manager.saveSnapshot()) {
+                if (nowNs() >= deadline) {
+                    std::cerr << "No snapshot of " << dir << " after " << SNAPSHOT_TIMEOUT_NS / 1000000000
+                              << " s" << std::endl;
+                    return BENCH_FAILED;
+                }
+                Thread::sleep(5);
+            }
+            uint64_t start = nowNs();
+            for (uint64_t i = 0; i < n; i++) {
+                keep(manager.getFileList());
+            }
+            return nowNs() - start;
+        }});
+    }
+}
+
+// Mutex / LockGuard
+
+struct LockWorker {
+    Mutex* mutex;
+    uint64_t* counter;
+    uint64_t iterations;
+    std::atomic<bool>* go;
+    Thread thread;
+};
+
+ThreadReturn THREAD_CALL lockWorkerFunction(void* arg) {
+    LockWorker* worker = static_cast<LockWorker*>(arg);
+    while (!worker->go->load(std::memory_order_acquire)) {}
+    for (uint64_t i = 0; i < worker->iterations; i++) {
+        LockGuard lock(*worker->mutex);
+        (*worker->counter)++;
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+// one op = one lock/unlock pair, summed over all threads
+void addMutexBenchmarks(std::vector<Benchmark>& benchmarks) {
+    for (unsigned threads : {1, 2, 4, 8}) {
+        benchmarks.push_back({"mutex/lock_guard/" + std::to_string(threads) + "_threads", [threads](uint64_t n) {
+            Mutex mutex;
+            uint64_t counter = 0;
+            std::atomic<bool> go(false);
+            std::vector<LockWorker> workers(threads);
+            for (LockWorker& worker : workers) {
+                worker.mutex = &mutex;
+                worker.counter = &counter;
+                worker.iterations = n / threads + 1;
+                worker.go = &go;
+                worker.thread.start(lockWorkerFunction, &worker);
+            }
+            uint64_t start = nowNs();
+            go.store(true, std::memory_order_release);
+            for (LockWorker& worker : workers) {
+                worker.thread.join();
+            }
+            uint64_t elapsed = nowNs() - start;
+            keep(counter);
+            return elapsed;
+        }});
+    }
+}
+
+// ns/op by name from a file written by --json
+std::map<std::string, double> readResults(const std::string& path) {
+    std::map<std::string, double> results;
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) return results;
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        char name[256];
+        double nsPerOp;
+        if (std::sscanf(line, " {\"name\": \"%255[^\"]\", \"ns_per_op\": %lf", name, &nsPerOp) == 2) {
+            results[name] = nsPerOp;
+        }
+    }
+    std::fclose(file);
+    return results;
+}
+
+bool writeJson(const std::string& path, const Options& options, const std::vector<Result>& results) {
+    FILE* out = path == "-" ? stdout : std::fopen(path.c_str(), "w");
+    if (!out) return false;
+    std::fprintf(out, "{\n  \"min_time_ms\": %u,\n  \"repetitions\": %u,\n  \"cpu\": %d,\n  \"benchmarks\": [\n",
+                 options.minTimeMs, options.repetitions, options.cpu);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::fprintf(out, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+                          "\"max_ns_per_op\": %.3f, \"iterations\": %llu}%s\n",
+                     r.name.c_str(), r.nsPerOp, r.minNsPerOp, r.maxNsPerOp,
+                     static_cast<unsigned long long>(r.iterations), i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    return out == stdout ? std::fflush(out) == 0 : std::fclose(out) == 0;
+}
+
+void printUsage(const char* progName) {
+    std::cout << "Usage: " << progName << " [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --filter <text>         - Only benchmarks whose name contains text" << std::endl;
+    std::cout << "  --min-time <ms>         - Length of one calibrated run (default: 200)" << std::endl;
+    std::cout << "  --repetitions <n>       - Runs per benchmark, the median is reported (default: 5)" << std::endl;
+    std::cout << "  --cpu <n>               - Pin the benchmark thread to one CPU" << std::endl;
+    std::cout << "  --dir <path>            - Scratch directory for the FileManager trees (default: micro_bench_files)" << std::endl;
+    std::cout << "  --json <path>           - Write the results as JSON, - for stdout" << std::endl;
+    std::cout << "  --compare <path>        - Print the change against an earlier --json file" << std::endl;
+    std::cout << "  --list                  - Print the benchmark names and exit" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    bool listOnly = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            listOnly = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--min-time") {
+            options.minTimeMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--cpu") {
+            options.cpu = std::atoi(value.c_str());
+        } else if (arg == "--dir") {
+            options.workDir = value;
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+        } else if (arg == "--compare") {
+            options.comparePath = value;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+    addProtocolBenchmarks(benchmarks);
+    addListPayloadBenchmarks(benchmarks);
+    addFileManagerBenchmarks(benchmarks, options);
+    addMutexBenchmarks(benchmarks);
+
+    if (listOnly) {
+        for (const Benchmark& benchmark : benchmarks) std::cout << benchmark.name << std::endl;
+        return 0;
+    }
+
+    // the lock workers are pinned along with it, contention then means
+    // sharing one CPU, which is the point of a 1-CPU baseline
+    if (options.cpu >= 0) {
+        ThreadOptions pin;
+        pin.cpus.push_back(options.cpu);
+        if (!Thread::applyToCurrent(pin)) {
+            std::cerr << "Cannot pin to CPU " << options.cpu << std::endl;
+        }
+    }
+    makeDirectory(options.workDir);
+    // FileManager reports its index work on std::cout, results go to stdout
+    std::cout.rdbuf(nullptr);
+
+    std::map<std::string, double> baseline;
+    if (!options.comparePath.empty()) {
+        baseline = readResults(options.comparePath);
+        if (baseline.empty()) std::cerr << "No results in " << options.comparePath << std::endl;
+    }
+
+    std::vector<Result> results;
+    int failed = 0;
+    std::printf("%-36s %14s %14s %22s %s\n", "benchmark", "iterations", "ns/op", "min..max", baseline.empty() ? "" : "  change");
+    for (const Benchmark& benchmark : benchmarks) {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) continue;
+        Result result;
+        if (!measure(benchmark, options, result)) {
+            std::printf("%-36s %14s\n", benchmark.name.c_str(), "FAILED");
+            std::fflush(stdout);
+            failed++;
+            continue;
+        }
+        results.push_back(result);
+
+        // same precision as ns/op, the median must read as inside its range
+        char spread[48];
+        std::snprintf(spread, sizeof(spread), "%.2f..%.2f", result.minNsPerOp, result.maxNsPerOp);
+        std::printf("%-36s %14llu %14.2f %22s", result.name.c_str(),
+                    static_cast<unsigned long long>(result.iterations), result.nsPerOp, spread);
+        auto previous = baseline.find(result.name);
+        if (previous != baseline.end() && previous->second > 0) {
+            std::printf("  %+7.1f%%", (result.nsPerOp / previous->second - 1) * 100);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath, options, results)) {
+        std::cerr << "Cannot write " << options.jsonPath << std::endl;
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,387 @@
+#include "../include/platform_wrapper.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Network impairment proxy
+// listens on a local port and forwards every connection to the target,
+// delaying each direction like a WAN link would: a bandwidth cap
+// (serialization time), a one-way delay with jitter, and loss, modelled
+// as the retransmission stall it causes on a TCP stream (nothing is
+// actually dropped, the bytes arrive one stall late, and so does all
+// that follows). order is kept, jitter never reorders. a bounded queue
+// per direction stands for the bottleneck buffer; when it is full the
+// proxy stops reading and TCP pushes back on the sender.
+// one thread per direction, so a link costs two threads
+
+namespace {
+
+const size_t READ_SIZE = 16 * 1024;
+const size_t PACKET_SIZE = 1448;        // payload of one Ethernet-sized TCP segment
+const uint32_t REAP_INTERVAL_MS = 1000;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ImpairConfig {
+    uint16_t listenPort;
+    std::string targetHost;
+    uint16_t targetPort;
+    uint32_t delayMs;           // one way, each direction
+    uint32_t jitterMs;          // +- uniform around the delay
+    double bandwidthMbit;       // per direction, 0 = unlimited
+    double lossPercent;         // per packet
+    uint32_t stallMs;           // what one loss costs, about TCP's minimum RTO
+    size_t queueBytes;          // bottleneck buffer per direction
+    uint64_t seed;
+
+    ImpairConfig()
+        : listenPort(0), targetPort(0), delayMs(0), jitterMs(0), bandwidthMbit(0), lossPercent(0),
+          stallMs(200), queueBytes(1024 * 1024), seed(1) {}
+};
+
+volatile sig_atomic_t g_stop = 0;
+
+struct Chunk {
+    uint64_t releaseUs;
+    std::vector<uint8_t> data;
+};
+
+struct Link;
+
+// one direction of a link: reads from source, writes to destination
+struct Direction {
+    Link* link;
+    Socket* source;
+    Socket* destination;
+    const char* name;
+    uint64_t seed;
+    uint64_t bytes;
+    uint64_t stalls;
+    Thread thread;
+};
+
+struct Link {
+    const ImpairConfig* config;
+    unsigned id;
+    Socket client;
+    Socket server;
+    Direction up;               // client -> server
+    Direction down;             // server -> client
+    std::atomic<int> running;   // directions not finished yet
+};
+
+bool sendAll(Socket* socket, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        int sent = socket->send(data, length);
+        if (sent <= 0) return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// a chunk leaves the bottleneck once the ones before it are through
+// (bandwidth), then takes the delay plus jitter to arrive; a lost packet
+// in it holds it back by a stall
+void forward(Direction& direction) {
+    const ImpairConfig& config = *direction.link->config;
+    std::mt19937_64 random(direction.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double bytesPerUs = config.bandwidthMbit * 1e6 / 8 / 1e6;
+    double packetLoss = config.lossPercent / 100.0;
+
+    std::deque<Chunk> queue;
+    size_t queued = 0;
+    uint64_t linkFreeUs = 0;
+    uint64_t lastReleaseUs = 0;
+    bool eof = false;
+    bool failed = false;
+    std::vector<uint8_t> buffer(READ_SIZE);
+
+    // stopping drops whatever is still in flight
+    while (!failed && !g_stop && (!eof || !queue.empty())) {
+        uint64_t now = nowUs();
+        while (!queue.empty() && queue.front().releaseUs <= now) {
+            if (!sendAll(direction.destination, queue.front().data.data(), queue.front().data.size())) {
+                failed = true;
+                break;
+            }
+            direction.bytes += queue.front().data.size();
+            queued -= queue.front().data.size();
+            queue.pop_front();
+        }
+        if (failed) break;
+
+        uint32_t waitMs = REAP_INTERVAL_MS;
+        if (!queue.empty()) {
+            uint64_t dueUs = queue.front().releaseUs;
+            waitMs = dueUs > now ? static_cast<uint32_t>((dueUs - now + 999) / 1000) : 0;
+        }
+        if (eof || queued >= config.queueBytes) {
+            Thread::sleep(waitMs);
+            continue;
+        }
+        if (!direction.source->waitReadable(waitMs)) continue;
+
+        int received = direction.source->receive(buffer.data(), buffer.size());
+        if (received <= 0) {
+            eof = true;
+            if (received < 0) failed = true;
+            continue;
+        }
+
+        now = nowUs();
+        uint64_t departUs = now;
+        if (bytesPerUs > 0) {
+            departUs = std::max(now, linkFreeUs) + static_cast<uint64_t>(received / bytesPerUs);
+            linkFreeUs = departUs;
+        }
+        double jitterUs = config.jitterMs ? (uniform(random) * 2 - 1) * config.jitterMs * 1000.0 : 0;
+        uint64_t releaseUs = departUs + static_cast<uint64_t>(std::max(0.0, config.delayMs * 1000.0 + jitterUs));
+        if (packetLoss > 0) {
+            double packets = std::ceil(static_cast<double>(received) / PACKET_SIZE);
+            if (uniform(random) < 1 - std::pow(1 - packetLoss, packets)) {
+                releaseUs += config.stallMs * 1000ULL;
+                direction.stalls++;
+            }
+        }
+        // TCP delivers in order, a late chunk holds up the ones behind it
+        releaseUs = std::max(releaseUs, lastReleaseUs);
+        lastReleaseUs = releaseUs;
+
+        Chunk chunk;
+        chunk.releaseUs = releaseUs;
+        chunk.data.assign(buffer.begin(), buffer.begin() + received);
+        queued += received;
+        queue.push_back(std::move(chunk));
+    }
+
+    if (failed || g_stop) {
+        // the other direction is blocked in its own socket calls
+        direction.source->shutdown();
+        direction.destination->shutdown();
+    } else {
+        direction.destination->shutdownSend();
+    }
+}
+
+ThreadReturn THREAD_CALL directionThreadFunction(void* arg) {
+    Direction* direction = static_cast<Direction*>(arg);
+    forward(*direction);
+    direction->link->running.fetch_sub(1);
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+bool startDirection(Link* link, Direction& direction, Socket* source, Socket* destination, const char* name,
+                    uint64_t seed) {
+    direction.link = link;
+    direction.source = source;
+    direction.destination = destination;
+    direction.name = name;
+    direction.seed = seed;
+    direction.bytes = 0;
+    direction.stalls = 0;
+    ThreadOptions options;
+    options.name = std::string("impair-") + name;
+    options.stackSize = 128 * 1024;
+    return direction.thread.start(directionThreadFunction, &direction, options);
+}
+
+void finishLink(Link* link) {
+    link->up.thread.join();
+    link->down.thread.join();
+    std::printf("[%u] closed: %llu B up (%llu stalls), %llu B down (%llu stalls)\n", link->id,
+                static_cast<unsigned long long>(link->up.bytes), static_cast<unsigned long long>(link->up.stalls),
+                static_cast<unsigned long long>(link->down.bytes),
+                static_cast<unsigned long long>(link->down.stalls));
+    std::fflush(stdout);
+    delete link;
+}
+
+void reapLinks(std::vector<Link*>& links, bool all) {
+    for (size_t i = 0; i < links.size(); ) {
+        if (all || links[i]->running.load() == 0) {
+            if (all) {
+                links[i]->client.shutdown();
+                links[i]->server.shutdown();
+            }
+            finishLink(links[i]);
+            links[i] = links.back();
+            links.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void signalHandler(int) {
+    g_stop = 1;
+}
+
+// "20" Mbit/s, also "512k", "1g"
+bool parseBandwidth(const std::string& text, double& mbit) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) return false;
+    std::string unit(end);
+    if (unit.empty() || unit == "m" || unit == "M" || unit == "mbit") {
+        mbit = value;
+    } else if (unit == "k" || unit == "K" || unit == "kbit") {
+        mbit = value / 1000;
+    } else if (unit == "g" || unit == "G" || unit == "gbit") {
+        mbit = value * 1000;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char* progName) {
+    std::cout << "Usage: " << progName << " <listen_port> <target_host> <target_port> [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --delay <ms>            - One-way delay in each direction, RTT is twice this (default: 0)" << std::endl;
+    std::cout << "  --jitter <ms>           - Delay varies uniformly by up to this much (default: 0)" << std::endl;
+    std::cout << "  --bandwidth <rate>      - Per direction, Mbit/s or with k/m/g suffix, e.g. 20 or 512k (default: unlimited)" << std::endl;
+    std::cout << "  --loss <percent>        - Packets lost, each costs the stream a stall (default: 0)" << std::endl;
+    std::cout << "  --stall <ms>            - Retransmission stall per loss (default: 200)" << std::endl;
+    std::cout << "  --queue <KB>            - Bottleneck buffer per direction (default: 1024)" << std::endl;
+    std::cout << "  --seed <n>              - Random seed for jitter and loss (default: 1)" << std::endl;
+}
+
+bool parseArguments(int argc, char* argv[], ImpairConfig& config) {
+    if (argc < 4) return false;
+    config.listenPort = static_cast<uint16_t>(std::atoi(argv[1]));
+    config.targetHost = argv[2];
+    config.targetPort = static_cast<uint16_t>(std::atoi(argv[3]));
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--delay") {
+            config.delayMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+        } else if (arg == "--jitter") {
+            config.jitterMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+        } else if (arg == "--bandwidth") {
+            if (!parseBandwidth(value, config.bandwidthMbit)) {
+                std::cerr << "Bad bandwidth: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--loss") {
+            config.lossPercent = std::atof(value.c_str());
+            if (config.lossPercent < 0 || config.lossPercent > 100) {
+                std::cerr << "Loss must be between 0 and 100 percent" << std::endl;
+                return false;
+            }
+        } else if (arg == "--stall") {
+            config.stallMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+        } else if (arg == "--queue") {
+            config.queueBytes = static_cast<size_t>(std::max(1, std::atoi(value.c_str()))) * 1024;
+        } else if (arg == "--seed") {
+            config.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return config.listenPort != 0 && (config.targetPort != 0 || Socket::isUnixAddress(config.targetHost));
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!PlatformUtils::initialize()) {
+        std::cerr << "Failed to initialize platform" << std::endl;
+        return 1;
+    }
+
+    ImpairConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        PlatformUtils::cleanup();
+        return 1;
+    }
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    Socket listener;
+    if (!listener.create() || !listener.setReuseAddr(true) || !listener.bind(config.listenPort) ||
+        !listener.listen(64)) {
+        std::cerr << "Cannot listen on port " << config.listenPort << ": " << listener.getLastError() << std::endl;
+        PlatformUtils::cleanup();
+        return 1;
+    }
+
+    char bandwidth[32] = "unlimited";
+    if (config.bandwidthMbit > 0) std::snprintf(bandwidth, sizeof(bandwidth), "%g Mbit/s", config.bandwidthMbit);
+    std::printf("Forwarding :%u -> %s:%u, delay %u ms +- %u ms each way, bandwidth %s, loss %g%% "
+                "(%u ms stall), queue %zu KB\n", config.listenPort, config.targetHost.c_str(), config.targetPort,
+                config.delayMs, config.jitterMs, bandwidth, config.lossPercent, config.stallMs,
+                config.queueBytes / 1024);
+    std::fflush(stdout);
+
+    std::vector<Link*> links;
+    unsigned nextId = 1;
+    while (!g_stop) {
+        reapLinks(links, false);
+        if (!listener.waitReadable(REAP_INTERVAL_MS)) continue;
+        Socket* accepted = listener.accept();
+        if (!accepted) continue;
+
+        Link* link = new Link();
+        link->config = &config;
+        link->id = nextId++;
+        link->client = std::move(*accepted);
+        delete accepted;
+        if (!link->server.connect(config.targetHost, config.targetPort)) {
+            std::printf("[%u] cannot reach %s:%u\n", link->id, config.targetHost.c_str(), config.targetPort);
+            delete link;
+            continue;
+        }
+
+        // the proxy adds only what it was told to, no Nagle batching of its own
+        link->client.setNoDelay(true);
+        link->server.setNoDelay(true);
+
+        link->running = 2;
+        uint64_t seed = config.seed * 7919 + link->id * 2;
+        if (!startDirection(link, link->up, &link->client, &link->server, "up", seed)) {
+            delete link;
+            continue;
+        }
+        if (!startDirection(link, link->down, &link->server, &link->client, "down", seed + 1)) {
+            link->client.shutdown();
+            link->server.shutdown();
+            link->up.thread.join();
+            delete link;
+            continue;
+        }
+        links.push_back(link);
+    }
+
+    reapLinks(links, true);
+    PlatformUtils::cleanup();
+    return 0;
+}
@@ -1,36 +1,40 @@
 #include "../include/network_client.h"
 #include <QFileInfo>
 #include <QFile>
+#include <algorithm>
 #include <cstring>
 
 // Qt client API implementation
-// uses same functions as client.cpp but with QObjects
+// uses same functions as client.cpp but with QObjects; everything below
+// the constructor runs on the worker thread except cancel()
 
 
 NetworkClient::NetworkClient(QObject *parent)
-    : QObject(parent), m_connected(false) {
+    : QObject(parent), m_connected(false), m_cancelled(false), m_lastPercent(-1) {
 }
 
 NetworkClient::~NetworkClient() {
     disconnect();
 }
 
-bool NetworkClient::connectToServer(const QString& host, uint16_t port, const QString& password) {
+void NetworkClient::connectToServer(const QString& host, uint16_t port, const QString& password) {
     if (m_connected) {
         emit error("Already connected");
-        return false;
-    }
-    
-    if (!m_socket.create()) {
-        emit error(QString("Failed to create socket: %1")
-                  .arg(QString::fromStdString(m_socket.getLastError())));
-        return false;
+        return;
     }
+    m_cancelled = false;
     
-    if (!m_socket.connect(host.toStdString(), port)) {
+    // tuning is best effort, a refused option does not stop the connection.
+    // names are resolved once and then served from the resolver cache
+    Socket socket;
+    if (!socket.connect(host.toStdString(), port, m_tuning)) {
         emit error(QString("Failed to connect: %1")
-                  .arg(QString::fromStdString(m_socket.getLastError())));
-        return false;
+                  .arg(QString::fromStdString(socket.getLastError())));
+        return;
+    }
+    {
+        LockGuard lock(m_socketMutex);
+        m_socket = std::move(socket);
     }
     
     // hash password
@@ -39,42 +43,85 @@ bool NetworkClient::connectToServer(const QString& host, uint16_t port, const QS
     
     if (!sendMessage(Protocol::MSG_CONNECT_REQUEST, payload)) {
         emit error("Failed to send authentication");
-        m_socket.close();
-        return false;
+        dropConnection();
+        return;
     }
     
     Protocol::MessageHeader header;
     std::vector<uint8_t> responsePayload;
     if (!receiveMessage(header, responsePayload)) {
         emit error("Failed to receive authentication response");
-        m_socket.close();
-        return false;
+        dropConnection();
+        return;
     }
     
     if (header.messageType == Protocol::MSG_CONNECT_RESPONSE) {
         m_connected = true;
         emit connected();
-        return true;
+        return;
     } else if (header.messageType == Protocol::MSG_ERROR_RESPONSE) {
         emit error("Authentication failed - incorrect password");
-        m_socket.close();
-        return false;
+        dropConnection();
+        return;
+    } else if (header.messageType == Protocol::MSG_SERVER_BUSY) {
+        uint32_t retryAfterMs = 0;
+        std::string reason;
+        ProtocolHelper::parseBusyPayload(responsePayload.data(), responsePayload.size(), retryAfterMs, reason);
+        emit error(QString("Server busy, try again in %1 s").arg((retryAfterMs + 999) / 1000));
+        dropConnection();
+        return;
     }
     
     emit error("Invalid server response");
-    m_socket.close();
-    return false;
+    dropConnection();
 }
 
 void NetworkClient::disconnect() {
     if (m_connected) {
-        sendMessage(Protocol::MSG_DISCONNECT, {});
-        m_socket.close();
-        m_connected = false;
+        sendMessage(Protocol::MSG_DISCONNECT, nullptr, 0);
+        dropConnection();
         emit disconnected();
     }
 }
 
+void NetworkClient::cancel() {
+    m_cancelled = true;
+    LockGuard lock(m_socketMutex);
+    // wakes a send or receive blocked on it, the worker then sees the flag
+    m_socket.shutdown();
+}
+
+void NetworkClient::dropConnection() {
+    LockGuard lock(m_socketMutex);
+    m_socket.close();
+    m_connected = false;
+}
+
+// the connection is in an unknown state after a failed send or receive
+// halfway through a command, there is no resynchronising the stream.
+// after cancel() the GUI asked for it and gets no error for it
+void NetworkClient::connectionLost(const QString& reason) {
+    bool wasConnected = m_connected;
+    dropConnection();
+    if (!m_cancelled) emit error(reason);
+    if (wasConnected) emit disconnected();
+}
+
+void NetworkClient::beginProgress() {
+    m_lastPercent = -1;
+    m_progressTimer.start();
+}
+
+// the GUI thread repaints for every signal it gets, a transfer at link
+// speed would keep it busy with progress alone
+void NetworkClient::reportProgress(int percent) {
+    if (percent == m_lastPercent) return;
+    if (m_lastPercent >= 0 && percent < 100 && m_progressTimer.elapsed() < PROGRESS_INTERVAL_MS) return;
+    m_lastPercent = percent;
+    m_progressTimer.restart();
+    emit transferProgress(percent);
+}
+
 
 void NetworkClient::refreshFileList() {
     if (!m_connected) {
@@ -82,19 +129,19 @@ void NetworkClient::refreshFileList() {
         return;
     }
     
-    if (!sendMessage(Protocol::MSG_LIST_FILES, {})) {
-        emit error("Failed to send list request");
+    if (!sendMessage(Protocol::MSG_LIST_FILES, nullptr, 0)) {
+        connectionLost("Failed to send list request");
         return;
     }
     
     Protocol::MessageHeader header;
-    std::vector<uint8_t> payload;
+    std::vector<uint8_t>& payload = m_payload;
     if (!receiveMessage(header, payload)) {
-        emit error("Failed to receive file list");
+        connectionLost("Failed to receive file list");
         return;
     }
     
-    if (header.messageType != Protocol::MSG_FILE_LIST_RESPONSE) {
+    if (header.messageType != Protocol::MSG_FILE_LIST_RESPONSE || payload.size() < sizeof(uint32_t)) {
         emit error("Unexpected response from server");
         return;
     }
@@ -147,7 +194,7 @@ void NetworkClient::uploadFile(const QString& localPath) {
     ProtocolHelper::serializeUint64(fileSize, payload.data() + offset);
     
     if (!sendMessage(Protocol::MSG_UPLOAD_REQUEST, payload)) {
-        emit error("Failed to send upload request");
+        connectionLost("Failed to send upload request");
         file.close();
         return;
     }
@@ -156,7 +203,7 @@ void NetworkClient::uploadFile(const QString& localPath) {
     Protocol::MessageHeader header;
     std::vector<uint8_t> responsePayload;
     if (!receiveMessage(header, responsePayload)) {
-        emit error("Failed to receive upload response");
+        connectionLost("Failed to receive upload response");
         file.close();
         return;
     }
@@ -167,31 +214,56 @@ void NetworkClient::uploadFile(const QString& localPath) {
         return;
     }
     
-    // send file data in chunks
-    const int CHUNK_SIZE = 4096;
-    QByteArray buffer;
+    // send file data in chunks, read into one buffer reused for all of them
+    const qint64 CHUNK_SIZE = 64 * 1024;
+    m_payload.resize(CHUNK_SIZE);
     qint64 totalSent = 0;
-    
-    while (!file.atEnd()) {
-        buffer = file.read(CHUNK_SIZE);
-        std::vector<uint8_t> chunk(buffer.begin(), buffer.end());
+    beginProgress();
+    
+    while (totalSent < fileSize) {
+        qint64 bytesRead = file.read(reinterpret_cast<char*>(m_payload.data()),
+                                     std::min(CHUNK_SIZE, fileSize - totalSent));
+        if (bytesRead <= 0) {
+            // the server expects fileSize bytes, the stream cannot be resumed
+            connectionLost(QString("Failed to read file: %1").arg(localPath));
+            file.close();
+            return;
+        }
         
-        if (!sendMessage(Protocol::MSG_UPLOAD_DATA, chunk)) {
-            emit error("Failed to send file chunk");
+        // the last chunk is held back for the complete message below
+        bool last = totalSent + bytesRead == fileSize;
+        if (!sendMessage(Protocol::MSG_UPLOAD_DATA, m_payload.data(), static_cast<size_t>(bytesRead), last)) {
+            connectionLost("Failed to send file chunk");
             file.close();
             return;
         }
         
-        totalSent += buffer.size();
-        int percent = (totalSent * 100) / fileSize;
-        emit transferProgress(percent);
+        totalSent += bytesRead;
+        reportProgress(static_cast<int>((totalSent * 100) / fileSize));
     }
     
     file.close();
     
-    sendMessage(Protocol::MSG_UPLOAD_COMPLETE, {});
+    if (!sendMessage(Protocol::MSG_UPLOAD_COMPLETE, nullptr, 0)) {
+        connectionLost("Failed to finish upload");
+        return;
+    }
+    
+    // server acks once the file is stored (synced in durable mode)
+    Protocol::MessageHeader ackHeader;
+    std::vector<uint8_t> ackPayload;
+    if (!receiveMessage(ackHeader, ackPayload)) {
+        connectionLost("Failed to receive upload confirmation");
+        return;
+    }
+    
+    if (ackHeader.messageType != Protocol::MSG_UPLOAD_COMPLETE ||
+        ackPayload.empty() || ackPayload[0] != Protocol::STATUS_OK) {
+        emit error(QString("Server failed to store upload: %1").arg(filename));
+        return;
+    }
     
-    emit transferProgress(100);
+    reportProgress(100);
     emit transferComplete(QString("Upload complete: %1").arg(filename));
 }
 
@@ -204,28 +276,31 @@ void NetworkClient::downloadFile(const QString& remoteFilename, const QString& s
     
     // Send download request
     auto payload = ProtocolHelper::createTextPayload(remoteFilename.toStdString());
-    if (!sendMessage(Protocol::MSG_DOWNLOAD_REQUEST, payload)) {
-        emit error("Failed to send download request");
-        return;
-    }
-    
-    // Open file for writing
+    // Open file for writing before asking, a refused path leaves no
+    // unread chunks behind on the connection
     QFile file(savePath);
     if (!file.open(QIODevice::WriteOnly)) {
         emit error(QString("Failed to create file: %1").arg(savePath));
         return;
     }
     
+    if (!sendMessage(Protocol::MSG_DOWNLOAD_REQUEST, payload)) {
+        connectionLost("Failed to send download request");
+        file.close();
+        return;
+    }
+    
     // receive file chunks
     qint64 totalReceived = 0;
     qint64 estimatedSize = 1; // will be updated
+    std::vector<uint8_t>& chunkPayload = m_payload;
+    beginProgress();
     
     while (true) {
         Protocol::MessageHeader header;
-        std::vector<uint8_t> chunkPayload;
         
         if (!receiveMessage(header, chunkPayload)) {
-            emit error("Failed to receive chunk");
+            connectionLost("Failed to receive chunk");
             file.close();
             return;
         }
@@ -248,13 +323,13 @@ void NetworkClient::downloadFile(const QString& remoteFilename, const QString& s
                 estimatedSize = totalReceived * 2;
             }
             int percent = std::min(99, (int)((totalReceived * 100) / estimatedSize));
-            emit transferProgress(percent);
+            reportProgress(percent);
         }
     }
     
     file.close();
     
-    emit transferProgress(100);
+    reportProgress(100);
     emit transferComplete(QString("Download complete: %1 (%2 bytes)").arg(remoteFilename).arg(totalReceived));
 }
 
@@ -267,42 +342,55 @@ void NetworkClient::deleteFile(const QString& filename) {
     
     auto payload = ProtocolHelper::createTextPayload(filename.toStdString());
     if (!sendMessage(Protocol::MSG_DELETE_REQUEST, payload)) {
-        emit error("Failed to send delete request");
+        connectionLost("Failed to send delete request");
         return;
     }
     
     Protocol::MessageHeader header;
     std::vector<uint8_t> responsePayload;
-    if (receiveMessage(header, responsePayload)) {
-        if (header.messageType == Protocol::MSG_DELETE_RESPONSE) {
-            if (!responsePayload.empty() && responsePayload[0] == Protocol::STATUS_OK) {
-                emit transferComplete(QString("File deleted: %1").arg(filename));
-            } else {
-                emit error("Failed to delete file");
-            }
+    if (!receiveMessage(header, responsePayload)) {
+        connectionLost("Failed to receive delete response");
+        return;
+    }
+    
+    if (header.messageType == Protocol::MSG_DELETE_RESPONSE) {
+        if (!responsePayload.empty() && responsePayload[0] == Protocol::STATUS_OK) {
+            emit transferComplete(QString("File deleted: %1").arg(filename));
+        } else {
+            emit error("Failed to delete file");
         }
     }
 }
 
 
 bool NetworkClient::sendMessage(uint8_t messageType, const std::vector<uint8_t>& payload) {
-    Protocol::MessageHeader header(messageType, static_cast<uint32_t>(payload.size()));
-    
-    uint8_t headerBuffer[8];
-    if (!ProtocolHelper::serializeHeader(header, headerBuffer, sizeof(headerBuffer))) {
-        return false;
-    }
-    
-    if (m_socket.send(headerBuffer, sizeof(headerBuffer)) != sizeof(headerBuffer)) {
+    return sendMessage(messageType, payload.data(), payload.size());
+}
+
+// header and payload leave in one send, a chunk is not split into two
+// segments with a delayed ACK in between
+bool NetworkClient::sendMessage(uint8_t messageType, const uint8_t* payload, size_t length, bool more) {
+    Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
+    
+    size_t start = m_sendBuffer.size();
+    m_sendBuffer.resize(start + 8 + length);
+    if (!ProtocolHelper::serializeHeader(header, m_sendBuffer.data() + start, 8)) {
+        m_sendBuffer.resize(start);
         return false;
     }
-    
-    if (!payload.empty()) {
-        if (m_socket.send(payload.data(), payload.size()) != static_cast<int>(payload.size())) {
+    if (length) std::memcpy(m_sendBuffer.data() + start + 8, payload, length);
+    if (more) return true;
+    
+    size_t sent = 0;
+    while (sent < m_sendBuffer.size()) {
+        int r = m_socket.send(m_sendBuffer.data() + sent, m_sendBuffer.size() - sent);
+        if (r <= 0) {
+            m_sendBuffer.clear();
             return false;
         }
+        sent += r;
     }
-    
+    m_sendBuffer.clear();
     return true;
 }
 
@@ -310,17 +398,22 @@ bool NetworkClient::sendMessage(uint8_t messageType, const std::vector<uint8_t>&
 bool NetworkClient::receiveMessage(Protocol::MessageHeader& header, std::vector<uint8_t>& payload) {
     uint8_t headerBuffer[8];
     
-    int received = m_socket.receive(headerBuffer, sizeof(headerBuffer));
-    if (received != sizeof(headerBuffer)) {
-        return false;
+    // the header can arrive split when large chunks are streaming
+    size_t received = 0;
+    while (received < sizeof(headerBuffer)) {
+        int r = m_socket.receive(headerBuffer + received, sizeof(headerBuffer) - received);
+        if (r <= 0) return false;
+        received += r;
     }
     
     if (!ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header)) {
         return false;
     }
     
+    // payload may be a reused buffer, an empty message must not leave the
+    // previous one in it
+    payload.resize(header.payloadLength);
     if (header.payloadLength > 0) {
-        payload.resize(header.payloadLength);
         int totalReceived = 0;
         while (totalReceived < header.payloadLength) {
             int r = m_socket.receive(payload.data() + totalReceived, 
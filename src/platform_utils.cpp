@@ -1,5 +1,7 @@
 #include "../include/platform_wrapper.h"
 #include <cstring>
+#include <cstdlib>
+#include <fstream>
 
 // Initialize for platform wrapper
 // handles socket creation and cleanup both platforms
@@ -38,4 +40,78 @@ std::string getLastErrorString() {
 #endif
 }
 
-}
\ No newline at end of file
+int getCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<int>(info.dwNumberOfProcessors);
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? static_cast<int>(count) : 1;
+#endif
+}
+
+int getNumaNodeOfCpu(int cpu) {
+#ifdef __linux__
+    // nodes without CPUs are skipped, the highest node id is far below this
+    for (int node = 0; node < 1024; node++) {
+        std::vector<int> cpus;
+        if (!getNumaNodeCpus(node, cpus)) {
+            if (node == 0) return -1;   // no NUMA information at all
+            continue;
+        }
+        for (int nodeCpu : cpus) {
+            if (nodeCpu == cpu) return node;
+        }
+    }
+    return -1;
+#else
+    return cpu >= 0 && cpu < getCpuCount() ? 0 : -1;
+#endif
+}
+
+bool getNumaNodeCpus(int node, std::vector<int>& cpus) {
+    cpus.clear();
+    if (node < 0) return false;
+#ifdef __linux__
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string text;
+    if (!std::getline(file, text)) return false;
+    return parseCpuList(text, cpus);
+#else
+    if (node != 0) return false;
+    for (int i = 0; i < getCpuCount(); i++) cpus.push_back(i);
+    return true;
+#endif
+}
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string range = text.substr(pos, end - pos);
+        pos = end + 1;
+        
+        while (!range.empty() && (range.back() == '\n' || range.back() == ' ')) range.pop_back();
+        if (range.empty()) continue;
+        
+        char* rest = nullptr;
+        long first = std::strtol(range.c_str(), &rest, 10);
+        long last = first;
+        if (*rest == '-') {
+            last = std::strtol(rest + 1, &rest, 10);
+        }
+        if (rest == range.c_str() || *rest != '\0' || first < 0 || last < first || last >= 1024) {
+            cpus.clear();
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus.empty();
+}
+
+}
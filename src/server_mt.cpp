@@ -2,16 +2,84 @@
 #include "../include/protocol.h"
 #include "../include/file_manager.h"
 #include "../include/client_handler.h"
+#include "../include/commit_queue.h"
+#include "../include/connection_reaper.h"
+#include "../include/admission_queue.h"
+#include "../include/client_registry.h"
+#include "../include/logger.h"
+#include "../include/metrics_endpoint.h"
+#include "../include/tracer.h"
+#include "../include/traffic_capture.h"
 #include <iostream>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
 
 // Multi-threaded server
 
-// thread entry point wrapper
+// set by SIGINT/SIGTERM so run() can return and destructors
+// get to flush state (metadata snapshot) before exit
+static volatile sig_atomic_t g_shutdownRequested = 0;
+static SocketHandle g_listenHandles[64];
+static volatile sig_atomic_t g_listenCount = 0;
+
+void handleShutdownSignal(int) {
+    g_shutdownRequested = 1;
+    // shutdown() is async-signal-safe and wakes the blocking accept()s
+    for (int i = 0; i < g_listenCount; i++) {
+#ifdef _WIN32
+        ::shutdown(g_listenHandles[i], SD_BOTH);
+#else
+        ::shutdown(g_listenHandles[i], SHUT_RDWR);
+#endif
+    }
+}
+
+void installSignalHandlers() {
+#ifdef _WIN32
+    signal(SIGINT, handleShutdownSignal);
+    signal(SIGTERM, handleShutdownSignal);
+#else
+    // no SA_RESTART, accept() has to return EINTR
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = handleShutdownSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // SIGUSR1 dumps connection stats, SIGUSR2 the trace. blocked here,
+    // before any thread exists, so every thread inherits that and only the
+    // stats thread's sigwait() takes them, no blocking call elsewhere sees EINTR
+    sigset_t statsSignal;
+    sigemptyset(&statsSignal);
+    sigaddset(&statsSignal, SIGUSR1);
+    sigaddset(&statsSignal, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &statsSignal, nullptr);
+
+    // a client vanishing mid-transfer must fail send(), not kill the server
+    signal(SIGPIPE, SIG_IGN);
+#endif
+}
+
+// on SIGUSR2 and at exit
+static void dumpTrace() {
+    long spans = Tracer::dump();
+    if (spans < 0) {
+        Logger::error(LogFields(), "[Trace] Cannot write %s", Tracer::getPath().c_str());
+    } else {
+        Logger::info(LogFields(), "[Trace] Wrote %ld span(s) to %s", spans, Tracer::getPath().c_str());
+    }
+}
+
+// thread entry point wrapper, the slot is handed back for cleanup
+// as the thread's last step
 ThreadReturn THREAD_CALL clientThreadFunction(void* arg) {
-    ClientHandler* handler = static_cast<ClientHandler*>(arg);
-    handler->run();
+    ClientSlot* slot = static_cast<ClientSlot*>(arg);
+    slot->handler->run();
+    slot->registry->markFinished(slot);
     
 #ifdef _WIN32
     return 0;
@@ -20,98 +88,315 @@ ThreadReturn THREAD_CALL clientThreadFunction(void* arg) {
 #endif
 }
 
+// startup settings, positional args first then --options
+struct ServerConfig {
+    uint16_t port;
+    std::string storageDir;
+    int maxClients;
+    std::string password;
+    StorageLayout layout;
+    std::string snapshotPath;
+    uint32_t snapshotInterval;
+    bool durable;
+    uint32_t commitWindowMs;
+    UploadWriterOptions upload;
+    IoBackend ioBackend;
+    unsigned acceptors;
+    std::string unixPath;               // also listen on this Unix domain socket, empty = TCP only
+    size_t shmRingSize;                 // bytes per direction offered to Unix socket clients, 0 = off
+    std::string socketProfile;          // SocketTuning profile for client connections
+    SocketTuning socketTuning;
+    size_t admissionQueue;              // connections waiting for a slot, 0 = reject at once
+    uint32_t admissionWaitMs;           // longest wait before "busy, retry after"
+    std::vector<int> acceptorCpus;      // acceptor i runs on acceptorCpus[i % n]
+    std::vector<int> workerCpus;        // client thread k on workerCpus[k % n]
+    size_t handlerStackSize;            // 0 = platform default
+    uint32_t idleTimeout;               // seconds, 0 = never
+    uint32_t stallTimeout;
+    std::string logFile;                // empty = stdout
+    LogLevel logLevel;
+    std::string metricsAddress;
+    uint16_t metricsPort;               // 0 = no metrics endpoint
+    uint32_t traceSample;               // trace one request in n, 0 = off
+    std::string traceFile;
+    std::string capturePath;            // empty = no traffic capture
+    bool captureData;                   // upload data too, not only its size
+
+    ServerConfig()
+        : port(8080), storageDir("server_files"), maxClients(10),
+          password("admin123"), layout(LAYOUT_FLAT), snapshotInterval(300),
+          durable(false), commitWindowMs(0), ioBackend(IO_BACKEND_BLOCKING),
+          acceptors(1), shmRingSize(0), socketProfile("default"), admissionQueue(64), admissionWaitMs(3000), handlerStackSize(0),
+          idleTimeout(Protocol::CONNECTION_TIMEOUT_SECONDS), stallTimeout(60), logLevel(LOG_INFO),
+          metricsPort(0), traceSample(0), traceFile("trace.json"), captureData(false) {}
+};
+
 class MultiThreadedServer {
 public:
-    MultiThreadedServer(uint16_t port, const std::string& storageDir, int maxClients = 10, const std::string& password = "admin123")
-        : m_port(port), m_fileManager(storageDir), m_running(false), 
-          m_maxClients(maxClients), m_nextClientId(1),
-          m_passwordHash(SecurityHelper::hashPassword(password)) {
+    MultiThreadedServer(const ServerConfig& config)
+        : m_passwordHash(SecurityHelper::hashPassword(config.password)),
+          m_port(config.port), m_fileManager(config.storageDir, config.layout),
+          m_running(false), m_maxClients(config.maxClients), m_acceptorCount(config.acceptors),
+          m_unixPath(config.unixPath), m_socketProfile(config.socketProfile), m_socketTuning(config.socketTuning),
+          m_tuningRefused(false),
+          m_admissionQueue(config.admissionQueue), m_admissionWaitMs(config.admissionWaitMs),
+          m_acceptorCpus(config.acceptorCpus), m_workerCpus(config.workerCpus),
+          m_handlerStackSize(config.handlerStackSize),
+          m_snapshotPath(config.snapshotPath), m_snapshotInterval(config.snapshotInterval),
+          m_durable(config.durable), m_commitWindowMs(config.commitWindowMs), m_commitQueue(nullptr),
+          m_idleTimeout(config.idleTimeout), m_stallTimeout(config.stallTimeout), m_reaper(nullptr),
+          m_registry(nullptr),
+          m_metricsAddress(config.metricsAddress), m_metricsPort(config.metricsPort),
+          m_metrics(nullptr), m_metricsEndpoint(nullptr),
+          m_capturePath(config.capturePath), m_captureData(config.captureData), m_capture(nullptr),
+          m_statsThreadStarted(false) {
+        m_handlerOptions.upload = config.upload;
+        m_handlerOptions.ioBackend = config.ioBackend;
+        m_handlerOptions.shmRingSize = config.shmRingSize;
     }
     
     ~MultiThreadedServer() {
         stop();
+        for (Acceptor* acceptor : m_acceptors) {
+            delete acceptor;
+        }
+        delete m_registry;
+        // the endpoint reads the metrics and handlers (all gone now) write them
+        delete m_metricsEndpoint;
+        delete m_metrics;
+        if (m_capture) {
+            m_capture->stop();
+            if (m_capture->hasFailed()) {
+                Logger::warn(LogFields(), "[Capture] %s is incomplete, a write failed", m_capturePath.c_str());
+            }
+            Logger::info(LogFields(), "[Capture] %llu record(s) written to %s, %llu dropped",
+                         static_cast<unsigned long long>(m_capture->getRecords()), m_capturePath.c_str(),
+                         static_cast<unsigned long long>(m_capture->getDropped()));
+            delete m_capture;
+        }
+        if (m_commitQueue) {
+            m_commitQueue->stop();
+            m_commitQueue->printStats();
+            delete m_commitQueue;
+        }
+        // handlers unregister from it, so it goes after them
+        if (m_reaper) {
+            m_reaper->stop();
+            m_reaper->printStats();
+            delete m_reaper;
+        }
     }
     
     bool start() {
-        if (!m_serverSocket.create()) {
-            std::cerr << "Failed to create server socket: " << m_serverSocket.getLastError() << std::endl;
+        if (!m_snapshotPath.empty() &&
+            !m_fileManager.enableSnapshot(m_snapshotPath, m_snapshotInterval)) {
+            std::cerr << "Failed to enable metadata snapshot" << std::endl;
             return false;
         }
         
-        m_serverSocket.setReuseAddr(true);
+        if (m_handlerOptions.ioBackend == IO_BACKEND_URING && !IoRing::isSupported()) {
+            std::cerr << "io_uring is not available on this kernel, using blocking I/O" << std::endl;
+            m_handlerOptions.ioBackend = IO_BACKEND_BLOCKING;
+        }
         
-        if (!m_serverSocket.bind(m_port)) {
-            std::cerr << "Failed to bind to port " << m_port << ": " << m_serverSocket.getLastError() << std::endl;
-            return false;
+        if (m_durable) {
+            m_commitQueue = new CommitQueue(m_commitWindowMs, m_fileManager.getStorageDir());
+            if (!m_commitQueue->start()) {
+                std::cerr << "Failed to start commit thread" << std::endl;
+                return false;
+            }
+            m_handlerOptions.commitQueue = m_commitQueue;
         }
         
-        if (!m_serverSocket.listen(m_maxClients)) {
-            std::cerr << "Failed to listen: " << m_serverSocket.getLastError() << std::endl;
-            return false;
+        if (m_idleTimeout || m_stallTimeout) {
+            m_reaper = new ConnectionReaper(m_idleTimeout, m_stallTimeout);
+            if (!m_reaper->start()) {
+                std::cerr << "Failed to start reaper thread" << std::endl;
+                return false;
+            }
+            m_handlerOptions.reaper = m_reaper;
+        }
+        
+        if (m_metricsPort) {
+            m_metrics = new Metrics();
+            m_metricsEndpoint = new MetricsEndpoint(m_metrics);
+            if (!m_metricsEndpoint->start(m_metricsAddress, m_metricsPort)) {
+                std::cerr << "Failed to start metrics endpoint" << std::endl;
+                return false;
+            }
+            m_handlerOptions.metrics = m_metrics;
+        }
+        
+        if (!m_capturePath.empty()) {
+            m_capture = new TrafficCapture();
+            if (!m_capture->start(m_capturePath, m_captureData)) {
+                std::cerr << "Cannot write capture file " << m_capturePath << std::endl;
+                return false;
+            }
+            m_handlerOptions.capture = m_capture;
+        }
+        
+        // a pinned thread on a missing CPU would fail to start
+        int cpuCount = PlatformUtils::getCpuCount();
+        for (const std::vector<int>* cpus : {&m_acceptorCpus, &m_workerCpus}) {
+            for (int cpu : *cpus) {
+                if (cpu >= cpuCount) {
+                    std::cerr << "CPU " << cpu << " is not online (" << cpuCount << " CPUs)" << std::endl;
+                    return false;
+                }
+            }
+        }
+        
+        // every acceptor needs at least one client slot
+        unsigned count = std::max(1u, std::min(m_acceptorCount, static_cast<unsigned>(std::max(1, m_maxClients))));
+        count = std::min(count, MAX_ACCEPTORS - (m_unixPath.empty() ? 0 : 1));
+        
+        // asked once up front, so the single acceptor left gets all of
+        // max_clients and the queue rather than its share of them
+        if (count > 1) {
+            Socket probe;
+            if (!probe.create() || !probe.setReusePort(true)) {
+                std::cerr << "SO_REUSEPORT not available, using one acceptor" << std::endl;
+                count = 1;
+            }
+        }
+        
+        for (unsigned i = 0; i < count; i++) {
+            // max_clients and the queue are split evenly, the first ones take the remainder
+            size_t queueShare = m_admissionQueue / count + (i < m_admissionQueue % count ? 1 : 0);
+            Acceptor* acceptor = new Acceptor(this, i, queueShare, m_admissionWaitMs);
+            acceptor->maxClients = m_maxClients / static_cast<int>(count) +
+                                   (static_cast<int>(i) < m_maxClients % static_cast<int>(count) ? 1 : 0);
+            m_acceptors.push_back(acceptor);
+            
+            if (!openListenSocket(acceptor->listenSocket, count > 1, acceptor->maxClients)) {
+                return false;
+            }
+        }
+        
+        // same-host clients get an acceptor and max_clients of their own,
+        // a burst of local batch jobs cannot lock remote clients out
+        if (!m_unixPath.empty()) {
+            Acceptor* acceptor = new Acceptor(this, static_cast<unsigned>(m_acceptors.size()),
+                                              m_admissionQueue, m_admissionWaitMs);
+            acceptor->maxClients = m_maxClients;
+            m_acceptors.push_back(acceptor);
+            if (!openUnixSocket(acceptor->listenSocket, acceptor->maxClients)) {
+                return false;
+            }
+        }
+        
+        std::vector<size_t> shardCapacities;
+        for (Acceptor* acceptor : m_acceptors) {
+            shardCapacities.push_back(static_cast<size_t>(std::max(0, acceptor->maxClients)));
         }
+        m_registry = new ClientRegistry(shardCapacities);
         
         std::cout << "========================================" << std::endl;
         std::cout << "Multi-Threaded File Server Started" << std::endl;
         std::cout << "========================================" << std::endl;
         std::cout << "Port: " << m_port << std::endl;
+        if (!m_unixPath.empty()) {
+            std::cout << "Unix Socket: " << m_unixPath << std::endl;
+        }
+        if (m_handlerOptions.shmRingSize) {
+            std::cout << "Shared Memory Transport: 2 x " << m_handlerOptions.shmRingSize / 1024
+                      << " KB rings per connection" << std::endl;
+        }
         std::cout << "Storage Directory: " << m_fileManager.getStorageDir() << std::endl;
+        std::cout << "Storage Layout: " << FileManager::layoutName(m_fileManager.getLayout()) << std::endl;
         std::cout << "Max Concurrent Clients: " << m_maxClients << std::endl;
+        std::cout << "Acceptors: " << m_acceptors.size() << std::endl;
+        std::cout << "Socket Profile: " << m_socketProfile << std::endl;
+        std::cout << "Admission Queue: " << m_admissionQueue << " waiting, up to "
+                  << m_admissionWaitMs << " ms" << std::endl;
+        if (!m_acceptorCpus.empty()) {
+            std::cout << "Acceptor CPUs: " << formatCpus(m_acceptorCpus) << std::endl;
+        }
+        if (m_handlerStackSize) {
+            std::cout << "Handler Stack: " << m_handlerStackSize / 1024 << " KB" << std::endl;
+        }
+        if (!m_workerCpus.empty()) {
+            std::cout << "Worker CPUs: " << formatCpus(m_workerCpus) << std::endl;
+        }
+        if (m_durable) {
+            std::cout << "Durable Uploads: on (commit window " << m_commitWindowMs << " ms)" << std::endl;
+        }
+        std::cout << "Idle Timeout: " << formatTimeout(m_idleTimeout)
+                  << ", Stall Timeout: " << formatTimeout(m_stallTimeout) << std::endl;
+        if (m_metricsEndpoint) {
+            bool ipv6 = m_metricsAddress.find(':') != std::string::npos;
+            std::cout << "Metrics: http://" << (ipv6 ? "[" : "") << m_metricsAddress << (ipv6 ? "]" : "") << ":"
+                      << m_metricsPort << "/metrics" << std::endl;
+        }
+        std::cout << "I/O Backend: " << IoRing::backendName(m_handlerOptions.ioBackend) << std::endl;
+        std::cout << "Upload Writes: " << (m_handlerOptions.upload.directIO ? "direct" : "buffered")
+                  << ", " << m_handlerOptions.upload.queueDepth << " x "
+                  << m_handlerOptions.upload.blockSize / 1024 << " KB in flight" << std::endl;
         std::cout << "========================================" << std::endl;
+#ifndef _WIN32
+        std::cout << "kill -USR1 " << getpid() << " prints per-connection stats" << std::endl;
+#endif
         std::cout << "Waiting for connections..." << std::endl;
         
+        for (size_t i = 0; i < m_acceptors.size(); i++) {
+            g_listenHandles[i] = m_acceptors[i]->listenSocket.getHandle();
+        }
+        g_listenCount = static_cast<int>(m_acceptors.size());
         m_running = true;
         return true;
     }
     
+    // acceptor 0 runs on the calling thread, the others get their own
     void run() {
-        while (m_running) {
-            Socket* clientSocket = m_serverSocket.accept();
-            if (!clientSocket) {
-                std::cerr << "Failed to accept connection" << std::endl;
-                continue;
-            }
-            
-            cleanupFinishedClients();
-            
-            {
-                LockGuard lock(m_clientsMutex);
-                if (m_clients.size() >= static_cast<size_t>(m_maxClients)) {
-                    std::cerr << "Maximum clients reached, rejecting connection from " 
-                            << clientSocket->getPeerAddress() << std::endl;
-                    delete clientSocket;
-                    continue;
-                }
-            }
-            
-            uint32_t clientId = m_nextClientId++;
-            
-            std::cout << "\n[Server] New connection from " << clientSocket->getPeerAddress() 
-                    << ":" << clientSocket->getPeerPort() 
-                    << " (Client ID: " << clientId << ")" << std::endl;
-            
-            ClientHandler* handler = new ClientHandler(clientSocket, &m_fileManager, 
-                                                    clientId, m_passwordHash);
-            
-            Thread* clientThread = new Thread();
-            if (clientThread->start(clientThreadFunction, handler)) {
-                LockGuard lock(m_clientsMutex);
-                m_clients[clientId] = ClientInfo{handler, clientThread};
-                std::cout << "[Server] Active clients: " << m_clients.size() << std::endl;
-            } else {
-                std::cerr << "[Server] Failed to create thread for client " << clientId << std::endl;
-                delete handler;
-                delete clientThread;
+#ifndef _WIN32
+        ThreadOptions statsOptions;
+        statsOptions.name = "fs-stats";
+        m_statsThreadStarted = m_statsThread.start(statsThreadFunction, this, statsOptions);
+#endif
+        for (size_t i = 1; i < m_acceptors.size(); i++) {
+            if (!m_acceptors[i]->thread.start(acceptorThreadFunction, m_acceptors[i],
+                                              acceptorThreadOptions(static_cast<unsigned>(i)))) {
+                Logger::error(LogFields(), "[Server] Failed to start acceptor %zu", i);
+                m_acceptors[i]->listenSocket.close();
             }
         }
         
-        std::cout << "\n[Server] Shutting down..." << std::endl;
+        // the main thread keeps its name, pkill/top still find the process
+        ThreadOptions mainOptions = acceptorThreadOptions(0);
+        mainOptions.name.clear();
+        if (!Thread::applyToCurrent(mainOptions)) {
+            Logger::warn(LogFields(), "[Server] Could not pin acceptor 0");
+        }
+        acceptLoop(*m_acceptors[0]);
+        
+        Logger::info(LogFields(), "[Server] Shutting down...");
+        m_running = false;
+        closeListenSockets();
+        uint64_t rejected = m_acceptors[0]->rejected;
+        for (size_t i = 1; i < m_acceptors.size(); i++) {
+            m_acceptors[i]->thread.join();
+            rejected += m_acceptors[i]->rejected;
+        }
+        Logger::info(LogFields(), "[Server] %llu connection(s) turned away as busy",
+                     static_cast<unsigned long long>(rejected));
+        if (!m_unixPath.empty()) {
+            std::remove(m_unixPath.c_str());
+        }
+#ifndef _WIN32
+        if (m_statsThreadStarted) {
+            pthread_kill(m_statsThread.getHandle(), SIGUSR1);
+            m_statsThread.join();
+        }
+#endif
+        stopAllClients();
         waitForAllClients();
     }
     
     void stop() {
         if (m_running) {
             m_running = false;
-            m_serverSocket.close();
+            closeListenSockets();
             waitForAllClients();
         }
     }
@@ -119,62 +404,568 @@ public:
 private:
     std::string m_passwordHash;
 
-    struct ClientInfo {
-        ClientHandler* handler;
-        Thread* thread;
+    // one listening socket bound with SO_REUSEPORT plus the registry
+    // shard (same index) of the clients it accepted, the kernel spreads
+    // new connections over the acceptors so neither accept() nor the
+    // client slots are shared between them
+    struct Acceptor {
+        MultiThreadedServer* server;
+        unsigned index;
+        Socket listenSocket;
+        Thread thread;
+        int maxClients;
+        AdmissionQueue admission;
+        uint64_t rejected;
+        std::vector<ClientSlot*> finished;  // reused by each cleanup
+        
+        Acceptor(MultiThreadedServer* owner, unsigned acceptorIndex, size_t queueCapacity, uint32_t maxWaitMs)
+            : server(owner), index(acceptorIndex), maxClients(0),
+              admission(queueCapacity, maxWaitMs), rejected(0) {}
     };
     
-    void cleanupFinishedClients() {
-        LockGuard lock(m_clientsMutex);
-        
-        auto it = m_clients.begin();
-        while (it != m_clients.end()) {
-            if (!it->second.handler->isRunning()) {
-                std::cout << "[Server] Cleaning up client " << it->first << std::endl;
-                
-                it->second.thread->join();
-                
-                delete it->second.handler;
-                delete it->second.thread;
-                
-                it = m_clients.erase(it);
+    static const unsigned MAX_ACCEPTORS = 64;
+    // how often a loop with waiting connections looks for freed slots
+    static const uint32_t ADMISSION_POLL_MS = 20;
+    
+    bool openListenSocket(Socket& socket, bool reusePort, int backlog) {
+        if (!socket.create()) {
+            std::cerr << "Failed to create server socket: " << socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        socket.setReuseAddr(true);
+        if (reusePort && !socket.setReusePort(true)) {
+            std::cerr << "Failed to set SO_REUSEPORT: " << socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        // accepted sockets inherit the buffer sizes, which only count for
+        // the window scale when set before the handshake
+        if ((m_socketTuning.sendBuffer && !socket.setSendBufferSize(m_socketTuning.sendBuffer)) ||
+            (m_socketTuning.receiveBuffer && !socket.setReceiveBufferSize(m_socketTuning.receiveBuffer))) {
+            std::cerr << "Failed to set socket buffer sizes: " << socket.getLastError() << std::endl;
+        }
+        
+        if (!socket.bind(m_port)) {
+            std::cerr << "Failed to bind to port " << m_port << ": " << socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        if (!socket.listen(backlog)) {
+            std::cerr << "Failed to listen: " << socket.getLastError() << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    bool openUnixSocket(Socket& socket, int backlog) {
+        if (!socket.createUnix()) {
+            std::cerr << "Unix domain sockets are not available: " << socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        if (!socket.bindUnix(m_unixPath)) {
+            std::cerr << "Failed to bind to " << m_unixPath << ": " << socket.getLastError() << std::endl;
+            return false;
+        }
+        
+        if (!socket.listen(backlog)) {
+            std::cerr << "Failed to listen: " << socket.getLastError() << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    ThreadOptions acceptorThreadOptions(unsigned index) const {
+        ThreadOptions options;
+        options.name = "fs-accept-" + std::to_string(index);
+        if (!m_acceptorCpus.empty()) {
+            options.cpus.push_back(m_acceptorCpus[index % m_acceptorCpus.size()]);
+        }
+        return options;
+    }
+    
+    // worker k sits on one core and allocates its buffers from that core's
+    // node. threads it starts (upload disk writer) inherit both
+    ThreadOptions workerThreadOptions(uint32_t clientId) const {
+        ThreadOptions options;
+        options.name = "fs-client-" + std::to_string(clientId);
+        options.stackSize = m_handlerStackSize;
+        if (!m_workerCpus.empty()) {
+            int cpu = m_workerCpus[(clientId - 1) % m_workerCpus.size()];
+            options.cpus.push_back(cpu);
+            options.numaNode = PlatformUtils::getNumaNodeOfCpu(cpu);
+        } else if (!m_acceptorCpus.empty()) {
+            // don't inherit the acceptor's pinning
+            for (int cpu = 0; cpu < PlatformUtils::getCpuCount(); cpu++) {
+                options.cpus.push_back(cpu);
+            }
+        }
+        return options;
+    }
+    
+    static std::string formatTimeout(uint32_t seconds) {
+        return seconds ? std::to_string(seconds) + " s" : "off";
+    }
+    
+    static std::string formatCpus(const std::vector<int>& cpus) {
+        std::string text;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (i > 0) text += ",";
+            text += std::to_string(cpus[i]);
+        }
+        return text;
+    }
+    
+#ifndef _WIN32
+    static ThreadReturn THREAD_CALL statsThreadFunction(void* arg) {
+        static_cast<MultiThreadedServer*>(arg)->statsLoop();
+        return nullptr;
+    }
+    
+    void statsLoop() {
+        sigset_t statsSignal;
+        sigemptyset(&statsSignal);
+        sigaddset(&statsSignal, SIGUSR1);
+        sigaddset(&statsSignal, SIGUSR2);
+        int signal;
+        while (sigwait(&statsSignal, &signal) == 0 && m_running) {
+            if (signal == SIGUSR2) {
+                dumpTrace();
             } else {
-                ++it;
+                printConnectionStats();
+            }
+        }
+    }
+#endif
+    
+    // read straight from the registry, accept loops and handlers carry on
+    void printConnectionStats() {
+        std::vector<ConnectionSnapshot> connections;
+        m_registry->snapshot(connections);
+        uint64_t now = ClientRegistry::nowMs();
+        
+        Logger::info(LogFields(), "[Stats] %zu connection(s)", connections.size());
+        for (const ConnectionSnapshot& connection : connections) {
+            // in flight for how long, or idle
+            std::string current = "idle";
+            if (connection.currentOperation) {
+                current = std::string(ProtocolHelper::messageTypeName(connection.currentOperation)) + " for " +
+                          std::to_string(now - connection.operationStartMs) + " ms";
+            }
+            Logger::info(LogFields(connection.clientId), "[Stats] acceptor %u, up %llu s, %llu ops, "
+                         "%llu B in, %llu B out, %s", connection.shard,
+                         static_cast<unsigned long long>((now - connection.connectedMs) / 1000),
+                         static_cast<unsigned long long>(connection.operations),
+                         static_cast<unsigned long long>(connection.bytesIn),
+                         static_cast<unsigned long long>(connection.bytesOut), current.c_str());
+        }
+    }
+    
+    static ThreadReturn THREAD_CALL acceptorThreadFunction(void* arg) {
+        Acceptor* acceptor = static_cast<Acceptor*>(arg);
+        acceptor->server->acceptLoop(*acceptor);
+#ifdef _WIN32
+        return 0;
+#else
+        return nullptr;
+#endif
+    }
+    
+    // while connections wait for a slot the loop polls instead of blocking
+    // in accept(), so freed slots and expired waits are noticed in time
+    void acceptLoop(Acceptor& acceptor) {
+        while (m_running && !g_shutdownRequested) {
+            if (!acceptor.admission.idle() &&
+                !acceptor.listenSocket.waitReadable(ADMISSION_POLL_MS)) {
+                serviceAdmissionQueue(acceptor);
+                continue;
+            }
+            
+            Socket* clientSocket = acceptor.listenSocket.accept();
+            if (!clientSocket) {
+                if (g_shutdownRequested || !m_running) break;
+                Logger::warn(LogFields(), "Failed to accept connection");
+                continue;
+            }
+            
+            // whoever already waits goes first
+            serviceAdmissionQueue(acceptor);
+            
+            if (!acceptor.admission.empty() || !hasFreeSlot(acceptor)) {
+                if (acceptor.admission.push(clientSocket)) {
+                    if (m_metrics) m_metrics->queuedChanged(1);
+                    Logger::info(LogFields(), "[Server] Server full, queued connection from %s (%zu waiting)",
+                                 clientSocket->getPeerAddress().c_str(), acceptor.admission.size());
+                } else {
+                    rejectBusy(acceptor, clientSocket);
+                }
+                continue;
             }
+            
+            admitClient(acceptor, clientSocket);
+        }
+    }
+    
+    bool hasFreeSlot(Acceptor& acceptor) {
+        return m_registry->hasFreeSlot(acceptor.index);
+    }
+    
+    // hands freed slots to the oldest waiters, turns away the expired ones
+    void serviceAdmissionQueue(Acceptor& acceptor) {
+        cleanupFinishedClients(acceptor);
+        
+        while (!acceptor.admission.empty() && hasFreeSlot(acceptor)) {
+            admitClient(acceptor, acceptor.admission.pop());
+            if (m_metrics) m_metrics->queuedChanged(-1);
+        }
+        
+        std::vector<Socket*> expired;
+        acceptor.admission.expire(expired);
+        if (m_metrics) m_metrics->queuedChanged(-static_cast<int64_t>(expired.size()));
+        for (Socket* socket : expired) {
+            rejectBusy(acceptor, socket);
+        }
+        acceptor.admission.drainLingering();
+    }
+    
+    // a proper answer in place of the CONNECT_RESPONSE, so the client
+    // backs off for the hinted time instead of retrying a reset at once
+    void rejectBusy(Acceptor& acceptor, Socket* socket) {
+        uint32_t retryAfterMs = acceptor.admission.retryAfterMs(static_cast<size_t>(acceptor.maxClients));
+        Logger::warn(LogFields(), "[Server] Server busy, turning away %s (retry after %u ms)",
+                     socket->getPeerAddress().c_str(), retryAfterMs);
+        
+        auto payload = ProtocolHelper::createBusyPayload(retryAfterMs, "Server busy, retry after " +
+                                                         std::to_string(retryAfterMs) + " ms");
+        Protocol::MessageHeader header(Protocol::MSG_SERVER_BUSY, static_cast<uint32_t>(payload.size()));
+        std::vector<uint8_t> message(8);
+        ProtocolHelper::serializeHeader(header, message.data(), message.size());
+        message.insert(message.end(), payload.begin(), payload.end());
+        
+        socket->setNonBlocking(true);
+        socket->send(message.data(), message.size());
+        acceptor.admission.linger(socket);
+        acceptor.rejected++;
+        if (m_metrics) m_metrics->connectionRejected();
+    }
+    
+    // callers checked hasFreeSlot()
+    void admitClient(Acceptor& acceptor, Socket* clientSocket) {
+        // best effort, the connection is served either way
+        if (!clientSocket->applyTuning(m_socketTuning) && !m_tuningRefused.exchange(true)) {
+            Logger::warn(LogFields(), "[Server] Some %s socket options were refused: %s",
+                         m_socketProfile.c_str(), clientSocket->getLastError().c_str());
+        }
+        uint32_t clientId = m_registry->allocateId();
+        ClientSlot* slot = m_registry->acquire(acceptor.index, clientId);
+        std::string peer = clientSocket->getPeerAddress();
+        if (uint16_t peerPort = clientSocket->getPeerPort()) {
+            peer += ":" + std::to_string(peerPort);
+        }
+        
+        slot->handler = new ClientHandler(clientSocket, &m_fileManager, clientId, m_passwordHash,
+                                          m_handlerOptions, &slot->stats);
+        slot->thread = new Thread();
+        if (slot->thread->start(clientThreadFunction, slot, workerThreadOptions(clientId))) {
+            Logger::info(LogFields(clientId), "New connection from %s (%zu active)", peer.c_str(),
+                         m_registry->getActiveCount(acceptor.index));
+        } else {
+            Logger::error(LogFields(clientId), "Failed to create client thread");
+            delete slot->handler;
+            delete slot->thread;
+            m_registry->release(slot);
+        }
+    }
+    
+    // wakes every accept loop, also the ones the signal handler did not reach
+    void closeListenSockets() {
+        for (Acceptor* acceptor : m_acceptors) {
+            acceptor->listenSocket.shutdown();
+        }
+    }
+    
+    // only the handlers that ended since the last call, not every client
+    void cleanupFinishedClients(Acceptor& acceptor) {
+        acceptor.finished.clear();
+        m_registry->takeFinished(acceptor.index, acceptor.finished);
+        
+        for (ClientSlot* slot : acceptor.finished) {
+            Logger::debug(LogFields(slot->handler->getClientId()), "Cleaning up");
+            acceptor.admission.recordSlotTime(ClientRegistry::nowMs() -
+                                              slot->stats.connectedMs.load(std::memory_order_relaxed));
+            
+            slot->thread->join();
+            
+            delete slot->handler;
+            delete slot->thread;
+            m_registry->release(slot);
+        }
+    }
+    
+    // wakes handlers blocked in receive so the joins below finish,
+    // connections still waiting for a slot are simply closed.
+    // the accept loops have stopped, their shards are ours now
+    void stopAllClients() {
+        std::vector<ClientSlot*> active;
+        for (Acceptor* acceptor : m_acceptors) {
+            if (m_metrics) m_metrics->queuedChanged(-static_cast<int64_t>(acceptor->admission.size()));
+            acceptor->admission.clear();
+            m_registry->getActive(acceptor->index, active);
+        }
+        for (ClientSlot* slot : active) {
+            slot->handler->stop();
         }
     }
     
     void waitForAllClients() {
-        std::cout << "[Server] Waiting for all clients to disconnect..." << std::endl;
+        Logger::info(LogFields(), "[Server] Waiting for all clients to disconnect...");
         
-        LockGuard lock(m_clientsMutex);
-        for (auto& pair : m_clients) {
-            std::cout << "[Server] Waiting for client " << pair.first << std::endl;
-            pair.second.thread->join();
-            delete pair.second.handler;
-            delete pair.second.thread;
+        for (size_t i = 0; m_registry && i < m_acceptors.size(); i++) {
+            std::vector<ClientSlot*> active;
+            m_registry->takeFinished(static_cast<unsigned>(i), active);
+            active.clear();
+            m_registry->getActive(static_cast<unsigned>(i), active);
+            for (ClientSlot* slot : active) {
+                Logger::info(LogFields(slot->handler->getClientId()), "Waiting for client");
+                slot->thread->join();
+                delete slot->handler;
+                delete slot->thread;
+                m_registry->release(slot);
+            }
         }
-        m_clients.clear();
         
-        std::cout << "[Server] All clients disconnected" << std::endl;
+        Logger::info(LogFields(), "[Server] All clients disconnected");
     }
     
-    Socket m_serverSocket;
     uint16_t m_port;
     FileManager m_fileManager;
-    bool m_running;
+    std::atomic<bool> m_running;
     int m_maxClients;
-    uint32_t m_nextClientId;
-    
-    std::map<uint32_t, ClientInfo> m_clients;
-    Mutex m_clientsMutex;
+    unsigned m_acceptorCount;
+    std::string m_unixPath;
+    std::string m_socketProfile;
+    SocketTuning m_socketTuning;
+    std::atomic<bool> m_tuningRefused;  // warned once, not per connection
+    size_t m_admissionQueue;
+    uint32_t m_admissionWaitMs;
+    std::vector<Acceptor*> m_acceptors;
+    std::vector<int> m_acceptorCpus;
+    std::vector<int> m_workerCpus;
+    size_t m_handlerStackSize;
+    std::string m_snapshotPath;
+    uint32_t m_snapshotInterval;
+    bool m_durable;
+    uint32_t m_commitWindowMs;
+    CommitQueue* m_commitQueue;
+    uint32_t m_idleTimeout;
+    uint32_t m_stallTimeout;
+    ConnectionReaper* m_reaper;
+    ClientRegistry* m_registry;
+    std::string m_metricsAddress;
+    uint16_t m_metricsPort;
+    Metrics* m_metrics;
+    MetricsEndpoint* m_metricsEndpoint;
+    std::string m_capturePath;
+    bool m_captureData;
+    TrafficCapture* m_capture;
+    Thread m_statsThread;       // SIGUSR1 / SIGUSR2 dumps, not on Windows
+    bool m_statsThreadStarted;
+    HandlerOptions m_handlerOptions;
 };
 
+const unsigned MultiThreadedServer::MAX_ACCEPTORS;
+
 void printUsage(const char* progName) {
-    std::cout << "Usage: " << progName << " [port] [storage_dir] [max_clients]" << std::endl;
+    std::cout << "Usage: " << progName << " [port] [storage_dir] [max_clients] [password] [options]" << std::endl;
     std::cout << "  port        - Server port (default: 8080)" << std::endl;
     std::cout << "  storage_dir - Storage directory (default: server_files)" << std::endl;
     std::cout << "  max_clients - Maximum concurrent clients (default: 10)" << std::endl;
+    std::cout << "  password    - Server password (default: admin123)" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --layout <flat|sharded> - Storage directory layout (default: flat)" << std::endl;
+    std::cout << "  --snapshot <path>       - Keep a metadata index, persisted to path" << std::endl;
+    std::cout << "                            (use a path outside storage_dir)" << std::endl;
+    std::cout << "  --snapshot-interval <s> - Seconds between snapshots, 0 = shutdown only (default: 300)" << std::endl;
+    std::cout << "  --durable <window_ms>   - Sync uploads to disk before acknowledging them," << std::endl;
+    std::cout << "                            batching syncs over window_ms (e.g. 5)" << std::endl;
+    std::cout << "  --upload-io <buffered|direct> - Upload writes through the page cache or" << std::endl;
+    std::cout << "                            O_DIRECT where supported (default: buffered)" << std::endl;
+    std::cout << "  --upload-queue <blocks> - 1 MB blocks buffered per upload before the" << std::endl;
+    std::cout << "                            socket stops being read (default: 8)" << std::endl;
+    std::cout << "  --acceptors <n>         - Accept threads, each with its own SO_REUSEPORT" << std::endl;
+    std::cout << "                            listening socket and client set (default: 1)" << std::endl;
+    std::cout << "  --unix <path>           - Also listen on a Unix domain socket for same-host" << std::endl;
+    std::cout << "                            clients (unix:<path> as host), with its own max_clients" << std::endl;
+    std::cout << "  --socket-profile <name> - Tuning of client connections: default (system), lan-latency" << std::endl;
+    std::cout << "                            (TCP_NODELAY, keepalive, busy poll) or wan-bulk (TCP_NODELAY," << std::endl;
+    std::cout << "                            keepalive, 4 MB socket buffers)" << std::endl;
+    std::cout << "  --shm-ring <KB>         - Let --unix clients switch to shared memory rings" << std::endl;
+    std::cout << "                            of this size per direction (default: off)" << std::endl;
+    std::cout << "  --acceptor-cpus <list>  - Pin acceptor i to the i-th CPU of list (e.g. 0-1)" << std::endl;
+    std::cout << "  --worker-cpus <list>    - Pin client threads round-robin to list (e.g. 2-7,10)," << std::endl;
+    std::cout << "                            buffers come from each CPU's NUMA node" << std::endl;
+    std::cout << "  --handler-stack <KB>    - Stack per client thread, e.g. 64 to hold 10k idle" << std::endl;
+    std::cout << "                            connections in little memory (default: system, 8 MB)" << std::endl;
+    std::cout << "  --admission-queue <n>   - Connections over max_clients that wait for a slot" << std::endl;
+    std::cout << "                            before being told to retry (default: 64)" << std::endl;
+    std::cout << "  --admission-wait <ms>   - Longest wait for a slot (default: 3000)" << std::endl;
+    std::cout << "  --idle-timeout <s>      - Close connections silent between requests (default: 300, 0 = off)" << std::endl;
+    std::cout << "  --stall-timeout <s>     - Close transfers that make no progress (default: 60, 0 = off)" << std::endl;
+    std::cout << "  --log-file <path>       - Append the log to path instead of stdout" << std::endl;
+    std::cout << "  --log-level <level>     - debug, info, warn or error (default: info)" << std::endl;
+    std::cout << "  --metrics <[addr:]port> - Serve Prometheus metrics on /metrics (default address: 127.0.0.1)" << std::endl;
+    std::cout << "  --trace-sample <n>      - Trace one request in n, dumped on SIGUSR2 and at exit (default: 0 = off)" << std::endl;
+    std::cout << "  --trace-file <path>     - Chrome trace JSON written by the dumps (default: trace.json)" << std::endl;
+    std::cout << "  --capture <path>        - Record incoming traffic for linux_traffic_replay" << std::endl;
+    std::cout << "  --capture-mode <mode>   - sizes: upload data by size only, data: the bytes too (default: sizes)" << std::endl;
+    std::cout << "  --io-backend <blocking|uring> - Transfer I/O, uring batches socket and file" << std::endl;
+    std::cout << "                            I/O through io_uring where the kernel has it (default: blocking)" << std::endl;
+}
+
+// fills config from argv, returns false on a bad option
+bool parseArguments(int argc, char* argv[], ServerConfig& config) {
+    int position = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--", 0) == 0) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--layout") {
+                if (!FileManager::parseLayout(value, config.layout)) {
+                    std::cerr << "Unknown storage layout: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--snapshot") {
+                config.snapshotPath = value;
+            } else if (arg == "--snapshot-interval") {
+                config.snapshotInterval = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--durable") {
+                config.durable = true;
+                config.commitWindowMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--upload-io") {
+                if (value != "buffered" && value != "direct") {
+                    std::cerr << "Unknown upload I/O mode: " << value << std::endl;
+                    return false;
+                }
+                config.upload.directIO = (value == "direct");
+            } else if (arg == "--acceptors") {
+                int count = std::atoi(value.c_str());
+                if (count < 1 || count > 64) {
+                    std::cerr << "Acceptor count must be between 1 and 64" << std::endl;
+                    return false;
+                }
+                config.acceptors = static_cast<unsigned>(count);
+            } else if (arg == "--unix") {
+                config.unixPath = value;
+            } else if (arg == "--socket-profile") {
+                if (!SocketTuning::fromProfile(value, config.socketTuning)) {
+                    std::cerr << "Unknown socket profile: " << value << " (" << SocketTuning::profileNames()
+                              << ")" << std::endl;
+                    return false;
+                }
+                config.socketProfile = value;
+            } else if (arg == "--shm-ring") {
+                int kilobytes = std::atoi(value.c_str());
+                if (kilobytes < static_cast<int>(ShmChannel::MIN_RING_SIZE / 1024)) {
+                    std::cerr << "Shared memory rings need at least "
+                              << ShmChannel::MIN_RING_SIZE / 1024 << " KB" << std::endl;
+                    return false;
+                }
+                config.shmRingSize = static_cast<size_t>(kilobytes) * 1024;
+            } else if (arg == "--acceptor-cpus" || arg == "--worker-cpus") {
+                std::vector<int>& cpus = arg == "--acceptor-cpus" ? config.acceptorCpus : config.workerCpus;
+                if (!PlatformUtils::parseCpuList(value, cpus)) {
+                    std::cerr << "Bad CPU list: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--handler-stack") {
+                int kilobytes = std::atoi(value.c_str());
+                if (kilobytes <= 0 || static_cast<size_t>(kilobytes) * 1024 < ClientHandler::MIN_STACK_SIZE) {
+                    std::cerr << "Handler stack must be at least "
+                              << ClientHandler::MIN_STACK_SIZE / 1024 << " KB" << std::endl;
+                    return false;
+                }
+                config.handlerStackSize = static_cast<size_t>(kilobytes) * 1024;
+            } else if (arg == "--admission-queue") {
+                int capacity = std::atoi(value.c_str());
+                if (capacity < 0) {
+                    std::cerr << "Admission queue size cannot be negative" << std::endl;
+                    return false;
+                }
+                config.admissionQueue = static_cast<size_t>(capacity);
+            } else if (arg == "--admission-wait") {
+                config.admissionWaitMs = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--idle-timeout") {
+                config.idleTimeout = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--stall-timeout") {
+                config.stallTimeout = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--io-backend") {
+                if (!IoRing::parseBackend(value, config.ioBackend)) {
+                    std::cerr << "Unknown I/O backend: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--log-file") {
+                config.logFile = value;
+            } else if (arg == "--log-level") {
+                if (!Logger::parseLevel(value, config.logLevel)) {
+                    std::cerr << "Unknown log level: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--trace-sample") {
+                config.traceSample = static_cast<uint32_t>(std::atoi(value.c_str()));
+            } else if (arg == "--trace-file") {
+                config.traceFile = value;
+            } else if (arg == "--capture") {
+                config.capturePath = value;
+            } else if (arg == "--capture-mode") {
+                if (value != "sizes" && value != "data") {
+                    std::cerr << "Unknown capture mode: " << value << std::endl;
+                    return false;
+                }
+                config.captureData = value == "data";
+            } else if (arg == "--metrics") {
+                if (!MetricsEndpoint::parseAddress(value, config.metricsAddress, config.metricsPort)) {
+                    std::cerr << "Bad metrics address: " << value << std::endl;
+                    return false;
+                }
+            } else if (arg == "--upload-queue") {
+                int depth = std::atoi(value.c_str());
+                if (depth < 1) {
+                    std::cerr << "Upload queue needs at least one block" << std::endl;
+                    return false;
+                }
+                config.upload.queueDepth = static_cast<size_t>(depth);
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        switch (position++) {
+            case 0: config.port = static_cast<uint16_t>(std::atoi(arg.c_str())); break;
+            case 1: config.storageDir = arg; break;
+            case 2: config.maxClients = std::atoi(arg.c_str()); break;
+            case 3: config.password = arg; break;
+            default:
+                std::cerr << "Unexpected argument: " << arg << std::endl;
+                return false;
+        }
+    }
+
+    // the segment is handed over with SCM_RIGHTS, which needs the Unix socket
+    if (config.shmRingSize && config.unixPath.empty()) {
+        std::cerr << "--shm-ring needs --unix" << std::endl;
+        return false;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -183,35 +974,43 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    uint16_t port = 8080;
-    std::string storageDir = "server_files";
-    int maxClients = 10;
-    std::string password = "admin123";
-    
-    if (argc >= 2) {
-        port = static_cast<uint16_t>(std::atoi(argv[1]));
-    }
-    if (argc >= 3) {
-        storageDir = argv[2];
-    }
-    if (argc >= 4) {
-        maxClients = std::atoi(argv[3]);
-    }
-    if (argc >= 5) {
-        password = argv[4];
+    ServerConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        PlatformUtils::cleanup();
+        return 1;
     }
     
-    std::cout << "Server password hash: " << SecurityHelper::hashPassword(password) << std::endl;
+    std::cout << "Server password hash: " << SecurityHelper::hashPassword(config.password) << std::endl;
     std::cout << "IMPORTANT: Change default password for production use!" << std::endl;
-    MultiThreadedServer server(port, storageDir, maxClients, password);
-    
-    if (!server.start()) {
+    // first, the log thread has to inherit the signal mask
+    installSignalHandlers();
+    if (!Logger::start(config.logFile, config.logLevel)) {
+        std::cerr << "Cannot open log file " << config.logFile << std::endl;
         PlatformUtils::cleanup();
         return 1;
     }
     
-    server.run();
+    if (config.traceSample) {
+        Tracer::start(config.traceFile, config.traceSample);
+        std::cout << "Tracing: 1 in " << config.traceSample << " request(s) to " << config.traceFile << std::endl;
+    }
+    
+    bool started;
+    {
+        MultiThreadedServer server(config);
+        started = server.start();
+        if (started) {
+            server.run();
+        }
+    }
     
+    if (config.traceSample) {
+        Tracer::stop();
+        dumpTrace();
+    }
+    // after the server, whose teardown still logs
+    Logger::stop();
     PlatformUtils::cleanup();
-    return 0;
-}
\ No newline at end of file
+    return started ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+#include "../include/shm_channel.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+    #include <linux/futex.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+#endif
+
+// Shared-memory channel implementation
+
+static const uint32_t SEGMENT_MAGIC = 0x46534D31;     // "FSM1"
+static const size_t MAX_RING_SIZE = 1024 * 1024 * 1024;
+static const size_t HEADER_SIZE = 4096;               // the rings' data starts on its own page
+
+enum Side { SIDE_CLIENT = 0, SIDE_SERVER = 1 };
+
+// one direction. the producer writes only the first cache line, the
+// consumer only the second, so neither side's stores bounce the other's
+struct alignas(64) ShmRing {
+    std::atomic<uint64_t> head;                 // bytes ever written
+    std::atomic<uint32_t> dataSeq;              // doorbell, bumped after each write
+    std::atomic<uint32_t> producerWaiting;
+    char producerPad[64 - 16];
+    std::atomic<uint64_t> tail;                 // bytes ever read
+    std::atomic<uint32_t> spaceSeq;             // doorbell, bumped after each read
+    std::atomic<uint32_t> consumerWaiting;
+    char consumerPad[64 - 16];
+};
+
+struct ShmSegment {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t ringSize;
+    std::atomic<uint32_t> closed[2];            // by side
+    ShmRing rings[2];                           // 0 client->server, 1 server->client
+};
+
+static_assert(sizeof(ShmSegment) <= HEADER_SIZE, "segment header outgrew its page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+#ifdef __linux__
+// false when the wait ran out, true when woken or the word had moved on
+static bool futexWait(std::atomic<uint32_t>* word, uint32_t expected, uint32_t milliseconds) {
+    struct timespec timeout = { static_cast<time_t>(milliseconds / 1000),
+                                static_cast<long>(milliseconds % 1000) * 1000000 };
+    // not FUTEX_PRIVATE, the word is shared with another process
+    long result = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout,
+                          nullptr, 0);
+    return result == 0 || errno != ETIMEDOUT;
+}
+
+static void futexWake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+
+ShmChannel::ShmChannel()
+    : m_segment(nullptr), m_mappedSize(0), m_ringSize(0), m_server(false), m_control(nullptr),
+      m_sendData(nullptr), m_receiveData(nullptr) {
+}
+
+ShmChannel::~ShmChannel() {
+    close();
+}
+
+bool ShmChannel::create(size_t ringSize, Socket* control, int& fd) {
+    fd = -1;
+#ifdef __linux__
+    size_t size = MIN_RING_SIZE;
+    while (size < ringSize && size < MAX_RING_SIZE) size <<= 1;
+
+    fd = memfd_create("fs-shm-channel", MFD_CLOEXEC);
+    if (fd < 0) return false;
+
+    size_t total = HEADER_SIZE + 2 * size;
+    if (ftruncate(fd, static_cast<off_t>(total)) != 0 || !map(fd, total)) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // a fresh memfd reads as zeros, which is what every counter starts at
+    new (m_segment) ShmSegment();
+    m_segment->magic = SEGMENT_MAGIC;
+    m_segment->ringSize = size;
+
+    m_ringSize = size;
+    m_server = true;
+    m_control = control;
+    uint8_t* base = reinterpret_cast<uint8_t*>(m_segment) + HEADER_SIZE;
+    m_receiveData = base;
+    m_sendData = base + size;
+    return true;
+#else
+    (void)ringSize;
+    (void)control;
+    return false;
+#endif
+}
+
+bool ShmChannel::attach(int fd, Socket* control) {
+#ifdef __linux__
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE + 2 * MIN_RING_SIZE ||
+        !map(fd, static_cast<size_t>(info.st_size))) {
+        return false;
+    }
+
+    uint64_t size = m_segment->ringSize;
+    if (m_segment->magic != SEGMENT_MAGIC || size < MIN_RING_SIZE || (size & (size - 1)) != 0 ||
+        HEADER_SIZE + 2 * size != m_mappedSize) {
+        munmap(m_segment, m_mappedSize);
+        m_segment = nullptr;
+        return false;
+    }
+
+    m_ringSize = static_cast<size_t>(size);
+    m_server = false;
+    m_control = control;
+    uint8_t* base = reinterpret_cast<uint8_t*>(m_segment) + HEADER_SIZE;
+    m_sendData = base;
+    m_receiveData = base + m_ringSize;
+    return true;
+#else
+    (void)fd;
+    (void)control;
+    return false;
+#endif
+}
+
+bool ShmChannel::map(int fd, size_t size) {
+#ifdef __linux__
+    // populated up front, the transfer path should not take page faults
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (address == MAP_FAILED) return false;
+    m_segment = static_cast<ShmSegment*>(address);
+    m_mappedSize = size;
+    return true;
+#else
+    (void)fd;
+    (void)size;
+    return false;
+#endif
+}
+
+// the peer can write every index in the segment, a difference beyond the
+// ring cannot come from a well-behaved one and would send the copies
+// below past the ring. the local copy that passed is what gets used
+static bool usedBytes(uint64_t head, uint64_t tail, size_t ringSize, size_t& used) {
+    uint64_t difference = head - tail;
+    if (difference > ringSize) return false;
+    used = static_cast<size_t>(difference);
+    return true;
+}
+
+// once switched over, a healthy peer never writes to the control socket,
+// so it turning readable means EOF, an error or our own shutdown()
+bool ShmChannel::peerGone() const {
+    return m_control && m_control->waitReadable(0);
+}
+
+// waiting flag first, then the recheck, then the doorbell's old value as
+// the futex's expected value: a write that lands in between either shows
+// up in the recheck or has already moved the doorbell on.
+// indices out of range are a protocol error, -1 with errno EPROTO
+int ShmChannel::send(const void* data, size_t length) {
+#ifdef __linux__
+    if (!m_segment) return -1;
+    ShmRing& ring = m_segment->rings[m_server ? 1 : 0];
+    std::atomic<uint32_t>& peerClosed = m_segment->closed[m_server ? SIDE_CLIENT : SIDE_SERVER];
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    size_t used = 0;
+    if (!usedBytes(head, ring.tail.load(std::memory_order_acquire), m_ringSize, used)) return corrupted();
+    while (used == m_ringSize) {
+        if (peerClosed.load(std::memory_order_acquire)) return -1;
+        uint32_t seq = ring.spaceSeq.load(std::memory_order_acquire);
+        ring.producerWaiting.store(1);
+        bool valid = usedBytes(head, ring.tail.load(), m_ringSize, used);
+        if (valid && used == m_ringSize && !futexWait(&ring.spaceSeq, seq, WAIT_SLICE_MS) && peerGone()) {
+            ring.producerWaiting.store(0, std::memory_order_relaxed);
+            return -1;
+        }
+        ring.producerWaiting.store(0, std::memory_order_relaxed);
+        if (!valid || !usedBytes(head, ring.tail.load(std::memory_order_acquire), m_ringSize, used)) {
+            return corrupted();
+        }
+    }
+
+    size_t space = m_ringSize - used;
+    size_t n = std::min(std::min(length, space), static_cast<size_t>(INT_MAX));
+    size_t offset = static_cast<size_t>(head & (m_ringSize - 1));
+    size_t first = std::min(n, m_ringSize - offset);
+    std::memcpy(m_sendData + offset, data, first);
+    std::memcpy(m_sendData, static_cast<const uint8_t*>(data) + first, n - first);
+
+    ring.head.store(head + n, std::memory_order_release);
+    ring.dataSeq.fetch_add(1);
+    if (ring.consumerWaiting.load()) futexWake(&ring.dataSeq);
+    return static_cast<int>(n);
+#else
+    (void)data;
+    (void)length;
+    return -1;
+#endif
+}
+
+int ShmChannel::receive(void* buffer, size_t length) {
+#ifdef __linux__
+    if (!m_segment) return -1;
+    ShmRing& ring = m_segment->rings[m_server ? 0 : 1];
+    std::atomic<uint32_t>& peerClosed = m_segment->closed[m_server ? SIDE_CLIENT : SIDE_SERVER];
+
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    size_t available = 0;
+    if (!usedBytes(ring.head.load(std::memory_order_acquire), tail, m_ringSize, available)) return corrupted();
+    while (available == 0) {
+        // the peer may have written and closed since head was loaded, the
+        // closed flag orders its last bytes before this second look
+        if (peerClosed.load(std::memory_order_acquire)) {
+            if (!usedBytes(ring.head.load(std::memory_order_acquire), tail, m_ringSize, available)) {
+                return corrupted();
+            }
+            if (available == 0) return 0;
+            break;
+        }
+        uint32_t seq = ring.dataSeq.load(std::memory_order_acquire);
+        ring.consumerWaiting.store(1);
+        bool valid = usedBytes(ring.head.load(), tail, m_ringSize, available);
+        if (valid && available == 0 && !futexWait(&ring.dataSeq, seq, WAIT_SLICE_MS) && peerGone()) {
+            ring.consumerWaiting.store(0, std::memory_order_relaxed);
+            return -1;
+        }
+        ring.consumerWaiting.store(0, std::memory_order_relaxed);
+        if (!valid || !usedBytes(ring.head.load(std::memory_order_acquire), tail, m_ringSize, available)) {
+            return corrupted();
+        }
+    }
+
+    size_t n = std::min(std::min(length, available), static_cast<size_t>(INT_MAX));
+    size_t offset = static_cast<size_t>(tail & (m_ringSize - 1));
+    size_t first = std::min(n, m_ringSize - offset);
+    std::memcpy(buffer, m_receiveData + offset, first);
+    std::memcpy(static_cast<uint8_t*>(buffer) + first, m_receiveData, n - first);
+
+    ring.tail.store(tail + n, std::memory_order_release);
+    ring.spaceSeq.fetch_add(1);
+    if (ring.producerWaiting.load()) futexWake(&ring.spaceSeq);
+    return static_cast<int>(n);
+#else
+    (void)buffer;
+    (void)length;
+    return -1;
+#endif
+}
+
+int ShmChannel::corrupted() {
+    errno = EPROTO;
+    return -1;
+}
+
+void ShmChannel::close() {
+#ifdef __linux__
+    if (!m_segment) return;
+    m_segment->closed[m_server ? SIDE_SERVER : SIDE_CLIENT].store(1);
+    for (ShmRing& ring : m_segment->rings) {
+        ring.dataSeq.fetch_add(1);
+        ring.spaceSeq.fetch_add(1);
+        futexWake(&ring.dataSeq);
+        futexWake(&ring.spaceSeq);
+    }
+    munmap(m_segment, m_mappedSize);
+    m_segment = nullptr;
+    m_mappedSize = 0;
+#endif
+}
@@ -1,8 +1,35 @@
 #include "../include/platform_wrapper.h"
+#include "../include/tracer.h"
+#include <chrono>
 #include <cstring>
+#include <map>
+
+#ifndef _WIN32
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+#endif
+
+static const char UNIX_PREFIX[] = "unix:";
+// getaddrinfo does not pass the DNS TTL on, so lookups are kept this long
+static const uint64_t RESOLVER_TTL_MS = 60 * 1000;
+static const size_t RESOLVER_MAX_HOSTS = 256;
+// happy eyeballs (RFC 8305): how long an attempt gets before the next
+// address is tried alongside it
+static const uint32_t CONNECT_ATTEMPT_DELAY_MS = 250;
 
 bool Socket::s_initialized = false;
 
+// one place for the setsockopt casts Windows wants
+static bool setIntOption(SocketHandle socket, int level, int name, int value) {
+#ifdef _WIN32
+    return setsockopt(socket, level, name, (const char*)&value, sizeof(value)) == 0;
+#else
+    return setsockopt(socket, level, name, &value, sizeof(value)) == 0;
+#endif
+}
+
 // Socket function implementations
 
 Socket::Socket() : m_socket(INVALID_SOCKET_HANDLE), m_isValid(false) {
@@ -62,33 +89,166 @@ void Socket::cleanupSockets() {
 }
 
 
+// dual-stack where the host has IPv6: one socket binds and accepts both
+// IPv4 (as ::ffff:a.b.c.d) and IPv6, otherwise plain IPv4
 bool Socket::create() {
+    if (createFamily(AF_INET6)) {
+        setIntOption(m_socket, IPPROTO_IPV6, IPV6_V6ONLY, 0);
+        return true;
+    }
+    return createFamily(AF_INET);
+}
+
+
+bool Socket::createFamily(int family) {
     if (m_isValid) {
         close();
     }
     
-    m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    m_socket = socket(family, SOCK_STREAM, IPPROTO_TCP);
     m_isValid = (m_socket != INVALID_SOCKET_HANDLE);
     
     return m_isValid;
 }
 
 
-bool Socket::bind(uint16_t port, const std::string& address) {
-    if (!m_isValid) return false;
+int Socket::getFamily() const {
+    sockaddr_storage storage;
+    socklen_t addrLen = sizeof(storage);
+    if (!m_isValid || getsockname(m_socket, (sockaddr*)&storage, &addrLen) != 0) return AF_UNSPEC;
+    return storage.ss_family;
+}
+
+
+bool Socket::createUnix() {
+    if (m_isValid) {
+        close();
+    }
+    
+#ifdef _WIN32
+    return false;
+#else
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    m_isValid = (m_socket != INVALID_SOCKET_HANDLE);
     
-    sockaddr_in addr;
+    return m_isValid;
+#endif
+}
+
+
+bool Socket::isUnixAddress(const std::string& host) {
+    return host.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) == 0;
+}
+
+
+#ifndef _WIN32
+// false when the path does not fit sun_path
+static bool makeUnixAddress(const std::string& path, sockaddr_un& addr) {
     std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+#endif
+
+
+bool Socket::isUnix() const {
+    if (!m_isValid) return false;
+    
+    sockaddr_storage storage;
+    socklen_t addrLen = sizeof(storage);
+    return getsockname(m_socket, (sockaddr*)&storage, &addrLen) == 0 && storage.ss_family == AF_UNIX;
+}
+
+
+bool Socket::bindUnix(const std::string& path) {
+    if (!m_isValid) return false;
+    
+#ifdef _WIN32
+    (void)path;
+    return false;
+#else
+    sockaddr_un addr;
+    if (!makeUnixAddress(path, addr)) return false;
+    
+    // a socket file nobody listens on is left over, one that answers
+    // belongs to a running server and stays
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        Socket probe;
+        if (probe.connect(UNIX_PREFIX + path, 0)) {
+            errno = EADDRINUSE;
+            return false;
+        }
+        ::unlink(path.c_str());
+    }
+    
+    return ::bind(m_socket, (sockaddr*)&addr, sizeof(addr)) == 0;
+#endif
+}
+
+
+// an IPv4 address on a dual-stack socket becomes its v4-mapped IPv6 form
+static bool makeBindAddress(int family, const std::string& address, uint16_t port, sockaddr_storage& storage,
+                            socklen_t& length) {
+    std::memset(&storage, 0, sizeof(storage));
+    bool any = address.empty() || address == "0.0.0.0" || address == "::";
+    
+    if (family == AF_INET6) {
+        sockaddr_in6& addr = reinterpret_cast<sockaddr_in6&>(storage);
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(port);
+        length = sizeof(addr);
+        if (any) {
+            addr.sin6_addr = in6addr_any;
+            return true;
+        }
+        if (inet_pton(AF_INET6, address.c_str(), &addr.sin6_addr) == 1) return true;
+        in_addr v4;
+        if (inet_pton(AF_INET, address.c_str(), &v4) != 1) return false;
+        addr.sin6_addr.s6_addr[10] = 0xff;
+        addr.sin6_addr.s6_addr[11] = 0xff;
+        std::memcpy(&addr.sin6_addr.s6_addr[12], &v4, sizeof(v4));
+        return true;
+    }
+    
+    sockaddr_in& addr = reinterpret_cast<sockaddr_in&>(storage);
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
-    
-    if (address == "0.0.0.0" || address.empty()) {
+    length = sizeof(addr);
+    if (any) {
         addr.sin_addr.s_addr = INADDR_ANY;
-    } else {
-        addr.sin_addr.s_addr = inet_addr(address.c_str());
+        return true;
+    }
+    return inet_pton(AF_INET, address.c_str(), &addr.sin_addr) == 1;
+}
+
+
+bool Socket::bind(uint16_t port, const std::string& address) {
+    if (!m_isValid) return false;
+    
+    // a name (localhost) binds to the first address it resolves to
+    std::string numeric = address;
+    std::vector<ResolvedAddress> resolved;
+    sockaddr_storage addr;
+    socklen_t addrLen;
+    if (!makeBindAddress(getFamily(), numeric, port, addr, addrLen)) {
+        if (!resolve(address, resolved) || resolved.empty()) return false;
+        char text[INET6_ADDRSTRLEN];
+        const sockaddr* first = reinterpret_cast<const sockaddr*>(&resolved[0].address);
+        const void* raw = first->sa_family == AF_INET6
+            ? static_cast<const void*>(&reinterpret_cast<const sockaddr_in6*>(first)->sin6_addr)
+            : static_cast<const void*>(&reinterpret_cast<const sockaddr_in*>(first)->sin_addr);
+        if (!inet_ntop(first->sa_family, raw, text, sizeof(text))) return false;
+        numeric = text;
+        if (!makeBindAddress(getFamily(), numeric, port, addr, addrLen)) return false;
     }
     
-    int result = ::bind(m_socket, (sockaddr*)&addr, sizeof(addr));
+    int result = ::bind(m_socket, (sockaddr*)&addr, addrLen);
     return result == 0;
 }
 
@@ -105,7 +265,7 @@ bool Socket::listen(int backlog) {
 Socket* Socket::accept() {
     if (!m_isValid) return nullptr;
     
-    sockaddr_in clientAddr;
+    sockaddr_storage clientAddr;
     socklen_t clientAddrLen = sizeof(clientAddr);
     
     SocketHandle clientSocket = ::accept(m_socket, (sockaddr*)&clientAddr, &clientAddrLen);
@@ -118,49 +278,376 @@ Socket* Socket::accept() {
 }
 
 
-bool Socket::connect(const std::string& host, uint16_t port) {
-    if (!m_isValid) return false;
+static uint64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static int lastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+
+static void setLastSocketError(int error) {
+#ifdef _WIN32
+    WSASetLastError(error);
+#else
+    errno = error;
+#endif
+}
+
+
+namespace {
+
+struct ResolverEntry {
+    std::vector<Socket::ResolvedAddress> addresses;
+    uint64_t expiresMs;
+};
+
+// host -> addresses, shared by every Socket in the process. the lookup
+// itself runs outside the lock, two threads missing on the same host at
+// once both resolve it and the later one's answer stays
+Mutex s_resolverMutex;
+std::map<std::string, ResolverEntry> s_resolverCache;
+
+}
+
+
+bool Socket::resolve(const std::string& host, std::vector<ResolvedAddress>& addresses) {
+    addresses.clear();
+    
+    // literals need no lookup and are not worth a cache slot
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_NUMERICHOST;
+    addrinfo* result = nullptr;
+    bool numeric = getaddrinfo(host.c_str(), nullptr, &hints, &result) == 0;
+    
+    if (!numeric) {
+        uint64_t now = nowMs();
+        {
+            LockGuard lock(s_resolverMutex);
+            std::map<std::string, ResolverEntry>::iterator it = s_resolverCache.find(host);
+            if (it != s_resolverCache.end() && it->second.expiresMs > now) {
+                addresses = it->second.addresses;
+                return true;
+            }
+        }
+        
+        // only address families the host has a route for
+        hints.ai_flags = AI_ADDRCONFIG;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) return false;
+    }
     
-    sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
+    for (addrinfo* info = result; info; info = info->ai_next) {
+        if ((info->ai_family != AF_INET && info->ai_family != AF_INET6) ||
+            info->ai_addrlen > sizeof(sockaddr_storage)) {
+            continue;
+        }
+        ResolvedAddress address;
+        std::memset(&address.address, 0, sizeof(address.address));
+        std::memcpy(&address.address, info->ai_addr, info->ai_addrlen);
+        address.length = static_cast<socklen_t>(info->ai_addrlen);
+        addresses.push_back(address);
+    }
+    freeaddrinfo(result);
+    if (addresses.empty()) return false;
+    
+    if (!numeric) {
+        LockGuard lock(s_resolverMutex);
+        if (s_resolverCache.size() >= RESOLVER_MAX_HOSTS) s_resolverCache.clear();
+        ResolverEntry& entry = s_resolverCache[host];
+        entry.addresses = addresses;
+        entry.expiresMs = nowMs() + RESOLVER_TTL_MS;
+    }
+    return true;
+}
+
+
+void Socket::forgetResolved(const std::string& host) {
+    LockGuard lock(s_resolverMutex);
+    s_resolverCache.erase(host);
+}
+
+
+bool Socket::connect(const std::string& host, uint16_t port) {
+    return connect(host, port, SocketTuning());
+}
+
+
+// RFC 8305 order: families alternate, starting with the one the resolver
+// put first (getaddrinfo already sorts by RFC 6724 preference)
+static std::vector<Socket::ResolvedAddress> interleaveFamilies(const std::vector<Socket::ResolvedAddress>& addresses) {
+    std::vector<Socket::ResolvedAddress> first, second;
+    int firstFamily = addresses[0].address.ss_family;
+    for (const Socket::ResolvedAddress& address : addresses) {
+        (address.address.ss_family == firstFamily ? first : second).push_back(address);
+    }
     
-    // tries to use IP address first
-    addr.sin_addr.s_addr = inet_addr(host.c_str());
+    std::vector<Socket::ResolvedAddress> ordered;
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+        if (i < first.size()) ordered.push_back(first[i]);
+        if (i < second.size()) ordered.push_back(second[i]);
+    }
+    return ordered;
+}
+
+
+// happy eyeballs: the first address gets CONNECT_ATTEMPT_DELAY_MS on its
+// own, then the next one is started next to it, and so on; a refused
+// attempt starts the next right away. the first handshake to complete
+// wins, the others are closed. so a dead IPv6 route or a blackholed
+// address costs 250 ms instead of the kernel's connect timeout
+bool Socket::connect(const std::string& host, uint16_t port, const SocketTuning& tuning) {
+    if (isUnixAddress(host)) {
+#ifdef _WIN32
+        return false;
+#else
+        sockaddr_un addr;
+        if (!createUnix() || !makeUnixAddress(host.substr(sizeof(UNIX_PREFIX) - 1), addr)) return false;
+        return ::connect(m_socket, (sockaddr*)&addr, sizeof(addr)) == 0;
+#endif
+    }
     
-    // if not try DNS resolution
-    if (addr.sin_addr.s_addr == INADDR_NONE) {
-        struct hostent* he = gethostbyname(host.c_str());
-        if (he == nullptr) {
-            return false;
+    close();
+    std::vector<ResolvedAddress> resolved;
+    if (!resolve(host, resolved)) {
+        // getaddrinfo's own codes are not errno values, getLastError() says this instead
+#ifdef _WIN32
+        setLastSocketError(WSAHOST_NOT_FOUND);
+#else
+        setLastSocketError(EHOSTUNREACH);
+#endif
+        return false;
+    }
+    std::vector<ResolvedAddress> addresses = interleaveFamilies(resolved);
+    
+    std::vector<Socket> attempts;
+    size_t next = 0;
+    uint64_t nextStartMs = nowMs();
+    int lastError = 0;
+    
+    while (next < addresses.size() || !attempts.empty()) {
+        if (next < addresses.size() && (attempts.empty() || nowMs() >= nextStartMs)) {
+            ResolvedAddress& address = addresses[next++];
+            reinterpret_cast<sockaddr_in&>(address.address).sin_port = htons(port);  // same offset in sockaddr_in6
+            nextStartMs = nowMs() + CONNECT_ATTEMPT_DELAY_MS;
+            
+            Socket attempt;
+            // buffer sizes have to be there before the SYN
+            if (!attempt.createFamily(address.address.ss_family)) {
+                lastError = lastSocketError();
+                nextStartMs = nowMs();
+                continue;
+            }
+            attempt.applyTuning(tuning);
+            attempt.setNonBlocking(true);
+            if (::connect(attempt.m_socket, (sockaddr*)&address.address, address.length) == 0) {
+                attempt.setNonBlocking(false);
+                *this = std::move(attempt);
+                return true;
+            }
+            int error = lastSocketError();
+#ifdef _WIN32
+            bool inProgress = error == WSAEWOULDBLOCK;
+#else
+            bool inProgress = error == EINPROGRESS;
+#endif
+            if (inProgress) {
+                attempts.push_back(std::move(attempt));
+            } else {
+                lastError = error;
+                nextStartMs = nowMs();
+            }
+            continue;
+        }
+        
+        // wait for a handshake to finish, or until the next address is due
+        int timeoutMs = -1;
+        if (next < addresses.size()) {
+            uint64_t now = nowMs();
+            timeoutMs = nextStartMs > now ? static_cast<int>(nextStartMs - now) : 0;
+        }
+#ifdef _WIN32
+        std::vector<WSAPOLLFD> fds(attempts.size());
+#else
+        std::vector<pollfd> fds(attempts.size());
+#endif
+        for (size_t i = 0; i < attempts.size(); i++) {
+            fds[i].fd = attempts[i].m_socket;
+            fds[i].events = POLLOUT;
+            fds[i].revents = 0;
+        }
+#ifdef _WIN32
+        int ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeoutMs);
+#else
+        int ready = poll(fds.data(), fds.size(), timeoutMs);
+        if (ready < 0 && errno == EINTR) continue;
+#endif
+        if (ready < 0) {
+            lastError = lastSocketError();
+            break;
+        }
+        
+        for (size_t i = fds.size(); i-- > 0; ) {
+            if (!fds[i].revents) continue;
+            int error = 0;
+            socklen_t errorLen = sizeof(error);
+            getsockopt(attempts[i].m_socket, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLen);
+            if (error == 0 && (fds[i].revents & POLLOUT)) {
+                attempts[i].setNonBlocking(false);
+                *this = std::move(attempts[i]);
+                return true;
+            }
+            lastError = error ? error : lastError;
+            attempts.erase(attempts.begin() + i);
+            nextStartMs = nowMs();
         }
-        std::memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
     }
     
-    int result = ::connect(m_socket, (sockaddr*)&addr, sizeof(addr));
-    return result == 0;
+    // every address failed, the name may point somewhere else by now
+    forgetResolved(host);
+    setLastSocketError(lastError);
+    return false;
 }
 
 
 int Socket::send(const void* data, size_t length) {
     if (!m_isValid) return -1;
 
+    TraceSpan span("socket", "send");
+#ifdef _WIN32
+    int sent = ::send(m_socket, static_cast<const char*>(data), static_cast<int>(length), 0);
+#else
+    int sent = static_cast<int>(::send(m_socket, data, length, 0));
+#endif
+    span.setBytes(sent);
+    return sent;
+}
+
+int Socket::sendv(const SocketBuffer* parts, size_t count) {
+    if (!m_isValid) return -1;
+    if (count > MAX_SEND_PARTS) count = MAX_SEND_PARTS;
     
+    TraceSpan span("socket", "send");
 #ifdef _WIN32
-    return ::send(m_socket, static_cast<const char*>(data), static_cast<int>(length), 0);
+    WSABUF buffers[MAX_SEND_PARTS];
+    for (size_t i = 0; i < count; i++) {
+        buffers[i].buf = const_cast<char*>(static_cast<const char*>(parts[i].data));
+        buffers[i].len = static_cast<ULONG>(parts[i].length);
+    }
+    DWORD bytes = 0;
+    int sent = WSASend(m_socket, buffers, static_cast<DWORD>(count), &bytes, 0, nullptr, nullptr) == 0
+        ? static_cast<int>(bytes) : -1;
 #else
-    return ::send(m_socket, data, length, 0);
+    iovec iov[MAX_SEND_PARTS];
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<void*>(parts[i].data);
+        iov[i].iov_len = parts[i].length;
+    }
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+    int sent = static_cast<int>(::sendmsg(m_socket, &message, 0));
 #endif
+    span.setBytes(sent);
+    return sent;
 }
 
 int Socket::receive(void* buffer, size_t length) {
     if (!m_isValid) return -1;
     
+    TraceSpan span("socket", "recv");
+#ifdef _WIN32
+    int received = ::recv(m_socket, static_cast<char*>(buffer), static_cast<int>(length), 0);
+#else
+    int received = static_cast<int>(::recv(m_socket, buffer, length, 0));
+#endif
+    span.setBytes(received);
+    return received;
+}
+
+int Socket::sendFd(const void* data, size_t length, int fd) {
+    if (!m_isValid) return -1;
+    
+#ifdef _WIN32
+    (void)data; (void)length; (void)fd;
+    return -1;
+#else
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = length;
+    
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+    
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    
+    TraceSpan span("socket", "send_fd");
+    int sent = static_cast<int>(::sendmsg(m_socket, &message, 0));
+    span.setBytes(sent);
+    return sent;
+#endif
+}
+
+int Socket::receiveFd(void* buffer, size_t length, int& fd) {
+    fd = -1;
+    if (!m_isValid) return -1;
+    
 #ifdef _WIN32
-    return ::recv(m_socket, static_cast<char*>(buffer), static_cast<int>(length), 0);
+    (void)buffer; (void)length;
+    return -1;
 #else
-    return ::recv(m_socket, buffer, length, 0);
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = length;
+    
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr align;
+    } control;
+    
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    
+    TraceSpan span("socket", "recv_fd");
+    int received = static_cast<int>(::recvmsg(m_socket, &message, MSG_CMSG_CLOEXEC));
+    span.setBytes(received);
+    if (received < 0) return received;
+    
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return received;
 #endif
 }
 
@@ -199,6 +686,146 @@ bool Socket::setReuseAddr(bool reuse) {
     return result == 0;
 }
 
+bool Socket::setNoDelay(bool noDelay) {
+    if (!m_isValid) return false;
+    return setIntOption(m_socket, IPPROTO_TCP, TCP_NODELAY, noDelay ? 1 : 0);
+}
+
+bool Socket::setSendBufferSize(int bytes) {
+    if (!m_isValid) return false;
+    return setIntOption(m_socket, SOL_SOCKET, SO_SNDBUF, bytes);
+}
+
+bool Socket::setReceiveBufferSize(int bytes) {
+    if (!m_isValid) return false;
+    return setIntOption(m_socket, SOL_SOCKET, SO_RCVBUF, bytes);
+}
+
+bool Socket::setKeepAlive(bool enable, uint32_t idleS, uint32_t intervalS, uint32_t count) {
+    if (!m_isValid) return false;
+    if (!setIntOption(m_socket, SOL_SOCKET, SO_KEEPALIVE, enable ? 1 : 0)) return false;
+    if (!enable) return true;
+    
+    bool ok = true;
+#if defined(TCP_KEEPIDLE)
+    if (idleS) ok = setIntOption(m_socket, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(idleS)) && ok;
+#elif defined(TCP_KEEPALIVE)
+    // macOS names the idle time differently
+    if (idleS) ok = setIntOption(m_socket, IPPROTO_TCP, TCP_KEEPALIVE, static_cast<int>(idleS)) && ok;
+#endif
+#ifdef TCP_KEEPINTVL
+    if (intervalS) ok = setIntOption(m_socket, IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(intervalS)) && ok;
+#endif
+#ifdef TCP_KEEPCNT
+    if (count) ok = setIntOption(m_socket, IPPROTO_TCP, TCP_KEEPCNT, static_cast<int>(count)) && ok;
+#endif
+    (void)idleS; (void)intervalS; (void)count;
+    return ok;
+}
+
+bool Socket::setBusyPoll(uint32_t microseconds) {
+    if (!m_isValid) return false;
+    
+#ifdef SO_BUSY_POLL
+    return setIntOption(m_socket, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(microseconds));
+#else
+    (void)microseconds;
+    return false;
+#endif
+}
+
+bool Socket::applyTuning(const SocketTuning& tuning) {
+    if (!m_isValid) return false;
+    
+    bool ok = true;
+    if (tuning.sendBuffer) ok = setSendBufferSize(tuning.sendBuffer) && ok;
+    if (tuning.receiveBuffer) ok = setReceiveBufferSize(tuning.receiveBuffer) && ok;
+    if (isUnix()) return ok;
+    
+    if (tuning.noDelay) ok = setNoDelay(true) && ok;
+    if (tuning.keepAliveIdleS) {
+        ok = setKeepAlive(true, tuning.keepAliveIdleS, tuning.keepAliveIntervalS, tuning.keepAliveCount) && ok;
+    }
+    if (tuning.busyPollUs) ok = setBusyPoll(tuning.busyPollUs) && ok;
+    return ok;
+}
+
+// lan-latency: nothing waits in Nagle's buffer (each reply goes out in
+// one write, but a multi-chunk download ends in a short segment that Nagle
+// holds until the peer's delayed ACK), dead peers show up within a couple
+// of minutes, and
+// receives spin briefly where the NIC supports busy polling (raising it
+// above net.core.busy_read needs CAP_NET_ADMIN).
+// wan-bulk: 4 MB buffers, a bandwidth-delay product of ~200 Mbit/s at
+// 150 ms RTT, so one connection can fill a long fat pipe; same keepalive
+bool SocketTuning::fromProfile(const std::string& name, SocketTuning& tuning) {
+    tuning = SocketTuning();
+    if (name == "default") return true;
+    
+    tuning.noDelay = true;
+    tuning.keepAliveIdleS = 60;
+    tuning.keepAliveIntervalS = 10;
+    tuning.keepAliveCount = 6;
+    if (name == "lan-latency") {
+        tuning.busyPollUs = 50;
+        return true;
+    }
+    if (name == "wan-bulk") {
+        tuning.sendBuffer = 4 * 1024 * 1024;
+        tuning.receiveBuffer = 4 * 1024 * 1024;
+        return true;
+    }
+    return false;
+}
+
+bool Socket::setReusePort(bool reuse) {
+    if (!m_isValid) return false;
+    
+#ifdef SO_REUSEPORT
+    int optval = reuse ? 1 : 0;
+    return setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == 0;
+#else
+    (void)reuse;
+    return false;
+#endif
+}
+
+bool Socket::shutdownSend() {
+    if (!m_isValid) return false;
+
+#ifdef _WIN32
+    return ::shutdown(m_socket, SD_SEND) == 0;
+#else
+    return ::shutdown(m_socket, SHUT_WR) == 0;
+#endif
+}
+
+bool Socket::waitReadable(uint32_t milliseconds) {
+    if (!m_isValid) return false;
+    
+#ifdef _WIN32
+    WSAPOLLFD pfd = { m_socket, POLLRDNORM, 0 };
+    return WSAPoll(&pfd, 1, static_cast<INT>(milliseconds)) > 0;
+#else
+    struct pollfd pfd = { m_socket, POLLIN, 0 };
+    int result;
+    do {
+        result = poll(&pfd, 1, static_cast<int>(milliseconds));
+    } while (result < 0 && errno == EINTR);
+    return result > 0;
+#endif
+}
+
+bool Socket::shutdown() {
+    if (!m_isValid) return false;
+
+#ifdef _WIN32
+    return ::shutdown(m_socket, SD_BOTH) == 0;
+#else
+    return ::shutdown(m_socket, SHUT_RDWR) == 0;
+#endif
+}
+
 void Socket::close() {
     if (m_isValid) {
 #ifdef _WIN32
@@ -244,26 +871,32 @@ std::string Socket::getLastError() const {
 std::string Socket::getPeerAddress() const {
     if (!m_isValid) return "";
     
-    sockaddr_in addr;
-    socklen_t addrLen = sizeof(addr);
+    sockaddr_storage storage;
+    socklen_t addrLen = sizeof(storage);
     
-    if (getpeername(m_socket, (sockaddr*)&addr, &addrLen) == 0) {
-        return std::string(inet_ntoa(addr.sin_addr));
-    }
+    if (getpeername(m_socket, (sockaddr*)&storage, &addrLen) != 0) return "";
+    if (storage.ss_family == AF_UNIX) return "unix";
     
-    return "";
+    char text[INET6_ADDRSTRLEN];
+    if (storage.ss_family == AF_INET6) {
+        const in6_addr& addr = ((sockaddr_in6*)&storage)->sin6_addr;
+        // IPv4 clients of a dual-stack listener show as themselves
+        if (IN6_IS_ADDR_V4MAPPED(&addr)) return inet_ntop(AF_INET, &addr.s6_addr[12], text, sizeof(text)) ? text : "";
+        return inet_ntop(AF_INET6, &addr, text, sizeof(text)) ? text : "";
+    }
+    return inet_ntop(AF_INET, &((sockaddr_in*)&storage)->sin_addr, text, sizeof(text)) ? text : "";
 }
 
 
 uint16_t Socket::getPeerPort() const {
     if (!m_isValid) return 0;
     
-    sockaddr_in addr;
-    socklen_t addrLen = sizeof(addr);
+    sockaddr_storage storage;
+    socklen_t addrLen = sizeof(storage);
     
-    if (getpeername(m_socket, (sockaddr*)&addr, &addrLen) == 0) {
-        return ntohs(addr.sin_port);
-    }
+    if (getpeername(m_socket, (sockaddr*)&storage, &addrLen) != 0) return 0;
+    if (storage.ss_family == AF_INET6) return ntohs(((sockaddr_in6*)&storage)->sin6_port);
+    if (storage.ss_family == AF_INET) return ntohs(((sockaddr_in*)&storage)->sin_port);
     
     return 0;
 }
\ No newline at end of file
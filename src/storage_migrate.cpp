@@ -0,0 +1,174 @@
+#include "../include/platform_wrapper.h"
+#include "../include/file_manager.h"
+#include <iostream>
+#include <cstdio>
+#include <vector>
+
+// Offline migration between flat and sharded storage layouts
+// run this while the server is stopped, files are moved with rename()
+// so it never copies data and stays on the same filesystem
+
+static bool isDirectory(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR);
+}
+
+static void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+static void removeDirectory(const std::string& path) {
+#ifdef _WIN32
+    _rmdir(path.c_str());
+#else
+    rmdir(path.c_str());
+#endif
+}
+
+// lists regular files (wantDirs false) or subdirectories (wantDirs true)
+static std::vector<std::string> listEntries(const std::string& dirPath, bool wantDirs) {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    std::string searchPath = dirPath + "/*";
+    HANDLE hFind = FindFirstFileA(searchPath.c_str(), &findData);
+
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            std::string name = findData.cFileName;
+            bool isDir = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            if (name != "." && name != ".." && isDir == wantDirs) {
+                names.push_back(name);
+            }
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+    }
+#else
+    DIR* dir = opendir(dirPath.c_str());
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") continue;
+            if ((wantDirs && entry->d_type == DT_DIR) || (!wantDirs && entry->d_type == DT_REG)) {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    return names;
+}
+
+// moves one file, refusing to overwrite anything at the target
+static bool moveFile(const std::string& from, const std::string& to) {
+    struct stat st;
+    if (stat(to.c_str(), &st) == 0) {
+        std::cerr << "Skipping " << from << ": " << to << " already exists" << std::endl;
+        return false;
+    }
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        std::cerr << "Failed to move " << from << " -> " << to << ": "
+                  << PlatformUtils::getLastErrorString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int migrateToSharded(const std::string& storageDir, size_t& moved) {
+    int failures = 0;
+
+    for (const auto& name : listEntries(storageDir, false)) {
+        std::string shard = FileManager::getShardSubdirectory(name);
+        makeDirectory(storageDir + "/" + shard.substr(0, 2));
+        makeDirectory(storageDir + "/" + shard);
+
+        if (moveFile(storageDir + "/" + name, storageDir + "/" + shard + "/" + name)) {
+            if (++moved % 100000 == 0) {
+                std::cout << "  " << moved << " files moved" << std::endl;
+            }
+        } else {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+// one level of a shard path as getShardSubdirectory() names it, two
+// lowercase hex digits
+static bool isShardLevel(const std::string& name) {
+    if (name.size() != 2) return false;
+    for (char c : name) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+// other directories in the storage dir are not the server's, they stay
+static int migrateToFlat(const std::string& storageDir, size_t& moved) {
+    int failures = 0;
+
+    for (const auto& level1 : listEntries(storageDir, true)) {
+        if (!isShardLevel(level1)) continue;
+        std::string level1Path = storageDir + "/" + level1;
+        for (const auto& level2 : listEntries(level1Path, true)) {
+            if (!isShardLevel(level2)) continue;
+            std::string shardPath = level1Path + "/" + level2;
+            for (const auto& name : listEntries(shardPath, false)) {
+                if (moveFile(shardPath + "/" + name, storageDir + "/" + name)) {
+                    if (++moved % 100000 == 0) {
+                        std::cout << "  " << moved << " files moved" << std::endl;
+                    }
+                } else {
+                    failures++;
+                }
+            }
+            // only succeeds once the shard is empty
+            removeDirectory(shardPath);
+        }
+        removeDirectory(level1Path);
+    }
+
+    return failures;
+}
+
+void printUsage(const char* progName) {
+    std::cout << "Usage: " << progName << " <storage_dir> <flat|sharded>" << std::endl;
+    std::cout << "  Converts an existing storage directory to the given layout." << std::endl;
+    std::cout << "  The server must not be running on this directory." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string storageDir = argv[1];
+    StorageLayout target;
+    if (!FileManager::parseLayout(argv[2], target)) {
+        std::cerr << "Unknown storage layout: " << argv[2] << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!isDirectory(storageDir)) {
+        std::cerr << "Not a directory: " << storageDir << std::endl;
+        return 1;
+    }
+
+    std::cout << "Migrating " << storageDir << " to " << FileManager::layoutName(target)
+              << " layout..." << std::endl;
+
+    size_t moved = 0;
+    int failures = (target == LAYOUT_SHARDED) ? migrateToSharded(storageDir, moved)
+                                              : migrateToFlat(storageDir, moved);
+
+    std::cout << "Done: " << moved << " files moved, " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -1,7 +1,36 @@
 #include "../include/platform_wrapper.h"
+#include <algorithm>
+#include <climits>
+
+#ifdef __linux__
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+#endif
 
 // Thread implementation
 
+// handed to the new thread, which applies the options to itself
+struct ThreadStartContext {
+    ThreadFunction func;
+    void* arg;
+    ThreadOptions options;
+};
+
+static ThreadReturn THREAD_CALL threadTrampoline(void* param) {
+    ThreadStartContext* context = static_cast<ThreadStartContext*>(param);
+    ThreadFunction func = context->func;
+    void* arg = context->arg;
+    
+    // affinity was already set at creation
+    ThreadOptions options = context->options;
+    options.cpus.clear();
+    delete context;
+    
+    Thread::applyToCurrent(options);
+    return func(arg);
+}
+
 
 Thread::Thread() : m_running(false), m_detached(false) {
 #ifdef _WIN32
@@ -18,19 +47,123 @@ Thread::~Thread() {
 }
 
 bool Thread::start(ThreadFunction func, void* arg) {
+    return start(func, arg, ThreadOptions());
+}
+
+bool Thread::start(ThreadFunction func, void* arg, const ThreadOptions& options) {
     if (m_running) return false;
     
+    std::vector<int> cpus = options.cpus;
+    if (cpus.empty() && options.numaNode >= 0) {
+        PlatformUtils::getNumaNodeCpus(options.numaNode, cpus);
+    }
+    
+    // only go through the trampoline when the thread has work to do
+    ThreadStartContext* context = nullptr;
+    if (!options.name.empty() || options.numaNode >= 0 || options.priority != 0) {
+        context = new ThreadStartContext{func, arg, options};
+        func = threadTrampoline;
+        arg = context;
+    }
+    
 #ifdef _WIN32
-    m_thread = CreateThread(nullptr, 0, func, arg, 0, nullptr);
+    DWORD flags = options.stackSize ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0;
+    m_thread = CreateThread(nullptr, options.stackSize, func, arg, flags | CREATE_SUSPENDED, nullptr);
     m_running = (m_thread != nullptr);
+    if (m_running) {
+        DWORD_PTR mask = 0;
+        for (int cpu : cpus) {
+            if (cpu < static_cast<int>(sizeof(mask) * 8)) mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+        if (mask) SetThreadAffinityMask(m_thread, mask);
+        ResumeThread(m_thread);
+    }
 #else
-    int result = pthread_create(&m_thread, nullptr, func, arg);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (options.stackSize) {
+        pthread_attr_setstacksize(&attr, std::max<size_t>(options.stackSize, PTHREAD_STACK_MIN));
+    }
+    if (options.guardSize) {
+        pthread_attr_setguardsize(&attr, options.guardSize);
+    }
+#ifdef __linux__
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+#endif
+    int result = pthread_create(&m_thread, &attr, func, arg);
+    pthread_attr_destroy(&attr);
     m_running = (result == 0);
 #endif
     
+    if (!m_running) delete context;
     return m_running;
 }
 
+bool Thread::applyToCurrent(const ThreadOptions& options) {
+    bool ok = true;
+    
+#ifdef __linux__
+    std::vector<int> cpus = options.cpus;
+    if (cpus.empty() && options.numaNode >= 0) {
+        PlatformUtils::getNumaNodeCpus(options.numaNode, cpus);
+    }
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && ok;
+    }
+    
+    // MPOL_PREFERRED, first-touch pages of this thread land on the node
+    // and fall back to others when it is full. no libnuma needed
+    if (options.numaNode >= 0 && options.numaNode < static_cast<int>(sizeof(unsigned long) * 8)) {
+        const int MPOL_PREFERRED_MODE = 1;
+        unsigned long nodeMask = 1UL << options.numaNode;
+        ok = syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &nodeMask, sizeof(nodeMask) * 8) == 0 && ok;
+    }
+    
+    if (!options.name.empty()) {
+        ok = pthread_setname_np(pthread_self(), options.name.substr(0, 15).c_str()) == 0 && ok;
+    }
+    
+    // per-thread nice, negative values need CAP_SYS_NICE
+    if (options.priority != 0) {
+        ok = setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), options.priority) == 0 && ok;
+    }
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : options.cpus) {
+        if (cpu < static_cast<int>(sizeof(mask) * 8)) mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+    if (mask) ok = SetThreadAffinityMask(GetCurrentThread(), mask) != 0 && ok;
+    
+    if (options.priority != 0) {
+        int level = options.priority <= -10 ? THREAD_PRIORITY_HIGHEST :
+                    options.priority < 0 ? THREAD_PRIORITY_ABOVE_NORMAL :
+                    options.priority >= 10 ? THREAD_PRIORITY_LOWEST : THREAD_PRIORITY_BELOW_NORMAL;
+        ok = SetThreadPriority(GetCurrentThread(), level) != 0 && ok;
+    }
+#else
+    ok = options.cpus.empty() && options.numaNode < 0 && options.priority == 0;
+    if (!options.name.empty()) {
+#ifdef __APPLE__
+        pthread_setname_np(options.name.c_str());
+#endif
+    }
+#endif
+    
+    return ok;
+}
+
 bool Thread::join() {
     if (!m_running || m_detached) return false;
     
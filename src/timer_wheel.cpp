@@ -0,0 +1,107 @@
+#include "../include/timer_wheel.h"
+
+// Hierarchical timing wheel implementation
+
+const unsigned TimerWheel::LEVELS;
+const unsigned TimerWheel::SLOT_BITS;
+const unsigned TimerWheel::SLOTS;
+const uint64_t TimerWheel::MAX_DELAY;
+
+TimerWheel::TimerWheel() : m_current(0), m_pending(0) {
+    for (unsigned level = 0; level < LEVELS; level++) {
+        for (unsigned slot = 0; slot < SLOTS; slot++) {
+            m_slots[level][slot].prev = &m_slots[level][slot];
+            m_slots[level][slot].next = &m_slots[level][slot];
+        }
+    }
+}
+
+void TimerWheel::schedule(TimerEntry* entry, uint64_t expiry) {
+    if (entry->scheduled) unlink(entry);
+
+    if (expiry <= m_current) expiry = m_current + 1;
+    if (expiry - m_current > MAX_DELAY) expiry = m_current + MAX_DELAY;
+    entry->expiry = expiry;
+    place(entry);
+}
+
+void TimerWheel::cancel(TimerEntry* entry) {
+    if (entry->scheduled) unlink(entry);
+}
+
+void TimerWheel::advance(uint64_t tick, std::vector<TimerEntry*>& expired) {
+    while (m_current < tick) {
+        m_current++;
+        unsigned index = m_current & (SLOTS - 1);
+        if (index == 0) cascade(1);
+
+        TimerEntry* head = &m_slots[0][index];
+        while (head->next != head) {
+            TimerEntry* entry = head->next;
+            unlink(entry);
+            expired.push_back(entry);
+        }
+    }
+}
+
+// level n slot holds expiries whose distance is below 64^(n+1), indexed
+// by the expiry's n-th group of 6 bits. an expiry equal to the current
+// tick (only from a cascade) lands in the level 0 slot about to run
+void TimerWheel::place(TimerEntry* entry) {
+    uint64_t delta = entry->expiry - m_current;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    unsigned slot = (entry->expiry >> (SLOT_BITS * level)) & (SLOTS - 1);
+    link(&m_slots[level][slot], entry);
+}
+
+// spreads the slot of level that the current tick just reached over the
+// levels below, the level above goes first when this one wrapped as well
+void TimerWheel::cascade(unsigned level) {
+    if (level >= LEVELS) return;
+
+    unsigned index = (m_current >> (SLOT_BITS * level)) & (SLOTS - 1);
+    if (index == 0) cascade(level + 1);
+
+    TimerEntry* head = &m_slots[level][index];
+    TimerEntry list;
+    list.prev = &list;
+    list.next = &list;
+    if (head->next != head) {
+        // detach the whole slot first, place() may link into this level
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        head->next = head;
+        head->prev = head;
+    }
+
+    while (list.next != &list) {
+        TimerEntry* entry = list.next;
+        list.next = entry->next;
+        entry->next->prev = &list;
+        m_pending--;
+        place(entry);
+    }
+}
+
+void TimerWheel::link(TimerEntry* head, TimerEntry* entry) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+    entry->scheduled = true;
+    m_pending++;
+}
+
+void TimerWheel::unlink(TimerEntry* entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->prev = nullptr;
+    entry->next = nullptr;
+    entry->scheduled = false;
+    m_pending--;
+}
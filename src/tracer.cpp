@@ -0,0 +1,176 @@
+#include "../include/tracer.h"
+#include "../include/platform_wrapper.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+// Request tracing implementation
+
+// spans a thread holds before it has to take the buffer lock mid-request,
+// a 64 KB-chunk download fills it every ~40 chunks
+static const size_t BATCH_SPANS = 128;
+
+namespace {
+
+struct SpanRecord {
+    const char* category;
+    const char* name;
+    uint64_t startUs;
+    uint64_t durationUs;
+    int64_t bytes;
+    uint32_t clientId;
+};
+
+struct SpanBatch {
+    SpanRecord spans[BATCH_SPANS];
+    size_t count;
+    uint32_t clientId;
+
+    SpanBatch() : count(0), clientId(0) {}
+};
+
+// allocated on the thread's first sampled request, so the thousands of
+// threads that are never sampled carry a pointer of TLS and nothing more
+struct BatchOwner {
+    SpanBatch* batch;
+
+    BatchOwner() : batch(nullptr) {}
+    ~BatchOwner() { delete batch; }
+};
+
+}
+
+thread_local bool Tracer::t_active = false;
+static thread_local BatchOwner t_batch;
+
+// 0 = not running
+static std::atomic<uint32_t> g_sampleEvery(0);
+static std::atomic<uint64_t> g_requests(0);
+static std::string g_path;
+static uint64_t g_baseUs = 0;
+
+// newest spans, g_written counts every span ever stored
+static Mutex g_mutex;
+static std::vector<SpanRecord> g_spans;
+static uint64_t g_written = 0;
+
+static void flushBatch(SpanBatch* batch) {
+    if (batch->count == 0) return;
+    LockGuard lock(g_mutex);
+    for (size_t i = 0; i < batch->count; i++) {
+        g_spans[g_written % g_spans.size()] = batch->spans[i];
+        g_written++;
+    }
+    batch->count = 0;
+}
+
+uint64_t Tracer::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool Tracer::start(const std::string& path, uint32_t sampleEvery, size_t capacity) {
+    if (sampleEvery == 0 || capacity == 0 || path.empty()) return false;
+    {
+        LockGuard lock(g_mutex);
+        g_spans.assign(capacity, SpanRecord());
+        g_written = 0;
+    }
+    g_path = path;
+    g_baseUs = nowUs();
+    g_sampleEvery.store(sampleEvery, std::memory_order_release);
+    return true;
+}
+
+void Tracer::stop() {
+    g_sampleEvery.store(0, std::memory_order_release);
+}
+
+const std::string& Tracer::getPath() {
+    return g_path;
+}
+
+bool Tracer::beginRequest(uint32_t clientId) {
+    uint32_t every = g_sampleEvery.load(std::memory_order_relaxed);
+    if (every == 0 || g_requests.fetch_add(1, std::memory_order_relaxed) % every != 0) return false;
+
+    if (!t_batch.batch) t_batch.batch = new SpanBatch();
+    t_batch.batch->clientId = clientId;
+    t_active = true;
+    return true;
+}
+
+void Tracer::endRequest(const char* name, uint64_t startUs, uint64_t durationUs) {
+    if (!t_active) return;
+    record("request", name, startUs, durationUs, -1);
+    t_active = false;
+    flushBatch(t_batch.batch);
+}
+
+void Tracer::record(const char* category, const char* name, uint64_t startUs, uint64_t durationUs,
+                    int64_t bytes) {
+    SpanBatch* batch = t_batch.batch;
+    if (!batch) return;
+    if (batch->count == BATCH_SPANS) flushBatch(batch);
+
+    SpanRecord& span = batch->spans[batch->count++];
+    span.category = category;
+    span.name = name;
+    span.startUs = startUs;
+    span.durationUs = durationUs;
+    span.bytes = bytes;
+    span.clientId = batch->clientId;
+}
+
+// complete ("X") events, a request's spans nest inside it on the
+// client's track. written to a temporary file and renamed, so a viewer
+// never opens half a dump
+long Tracer::dump() {
+    std::vector<SpanRecord> spans;
+    {
+        LockGuard lock(g_mutex);
+        if (g_spans.empty()) return 0;
+        uint64_t first = g_written > g_spans.size() ? g_written - g_spans.size() : 0;
+        spans.reserve(static_cast<size_t>(g_written - first));
+        for (uint64_t i = first; i < g_written; i++) {
+            spans.push_back(g_spans[i % g_spans.size()]);
+        }
+    }
+
+    std::string temporary = g_path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file) return -1;
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fileserver\"}}");
+    std::set<uint32_t> clients;
+    for (const SpanRecord& span : spans) {
+        if (clients.insert(span.clientId).second) {
+            std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                               "\"args\":{\"name\":\"client %u\"}}", span.clientId, span.clientId);
+        }
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                           "\"ts\":%llu,\"dur\":%llu,\"args\":{\"client\":%u",
+                     span.name, span.category, span.clientId,
+                     static_cast<unsigned long long>(span.startUs - g_baseUs),
+                     static_cast<unsigned long long>(span.durationUs), span.clientId);
+        if (span.bytes >= 0) {
+            std::fprintf(file, ",\"bytes\":%lld", static_cast<long long>(span.bytes));
+        }
+        std::fprintf(file, "}}");
+    }
+    std::fprintf(file, "\n]}\n");
+
+    bool ok = std::fflush(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+#ifdef _WIN32
+    std::remove(g_path.c_str());
+#endif
+    if (!ok || std::rename(temporary.c_str(), g_path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return -1;
+    }
+    return static_cast<long>(spans.size());
+}
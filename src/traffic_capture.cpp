@@ -0,0 +1,201 @@
+#include "../include/traffic_capture.h"
+#include "../include/protocol.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// Traffic capture implementation
+
+static const char MAGIC[8] = { 'F', 'S', 'C', 'A', 'P', 'T', 'R', '1' };
+static const size_t FILE_HEADER_SIZE = 24;
+static const size_t RECORD_HEADER_SIZE = 24;
+static const uint32_t FLUSH_INTERVAL_MS = 50;
+// buffered and not yet written, beyond this records are dropped
+static const size_t MAX_BUFFERED = 64 * 1024 * 1024;
+
+const uint32_t TrafficCapture::VERSION;
+const uint32_t TrafficCapture::FLAG_DATA;
+
+static void putUint32(uint8_t* buffer, uint32_t value) {
+    uint32_t net = htonl(value);
+    std::memcpy(buffer, &net, sizeof(net));
+}
+
+static uint32_t getUint32(const uint8_t* buffer) {
+    uint32_t net;
+    std::memcpy(&net, buffer, sizeof(net));
+    return ntohl(net);
+}
+
+TrafficCapture::TrafficCapture()
+    : m_file(nullptr), m_recordData(false), m_startUs(0), m_running(false), m_bufferRecords(0),
+      m_records(0), m_dropped(0), m_failed(false) {
+}
+
+TrafficCapture::~TrafficCapture() {
+    stop();
+}
+
+uint64_t TrafficCapture::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool TrafficCapture::start(const std::string& path, bool recordData) {
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) return false;
+
+    uint8_t header[FILE_HEADER_SIZE];
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    putUint32(header + 8, VERSION);
+    putUint32(header + 12, recordData ? FLAG_DATA : 0);
+    ProtocolHelper::serializeUint64(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count(), header + 16);
+    if (std::fwrite(header, 1, sizeof(header), m_file) != sizeof(header)) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    m_path = path;
+    m_recordData = recordData;
+    m_startUs = nowUs();
+    m_running = true;
+    ThreadOptions options;
+    options.name = "fs-capture";
+    if (!m_thread.start(writerThreadFunction, this, options)) {
+        m_running = false;
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void TrafficCapture::stop() {
+    // the writer may have stopped the capture already, after a failed write
+    if (!m_file) return;
+    {
+        LockGuard lock(m_mutex);
+        m_running = false;
+        m_cond.notifyAll();
+    }
+    m_thread.join();
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+void TrafficCapture::recordOpen(uint32_t connectionId) {
+    append(nowUs(), connectionId, CaptureRecord::KIND_OPEN, 0, 0, nullptr, 0);
+}
+
+void TrafficCapture::recordClose(uint32_t connectionId) {
+    append(nowUs(), connectionId, CaptureRecord::KIND_CLOSE, 0, 0, nullptr, 0);
+}
+
+void TrafficCapture::recordMessage(uint32_t connectionId, uint64_t timeUs, uint8_t messageType,
+                                   const std::vector<uint8_t>& payload) {
+    bool keep = messageType != Protocol::MSG_CONNECT_REQUEST &&
+                (messageType != Protocol::MSG_UPLOAD_DATA || m_recordData);
+    append(timeUs, connectionId, CaptureRecord::KIND_MESSAGE, messageType, static_cast<uint32_t>(payload.size()),
+           payload.data(), keep ? payload.size() : 0);
+}
+
+void TrafficCapture::append(uint64_t timeUs, uint32_t connectionId, uint8_t kind, uint8_t messageType,
+                            uint32_t payloadLength, const uint8_t* payload, size_t keptLength) {
+    uint8_t header[RECORD_HEADER_SIZE] = {};
+    ProtocolHelper::serializeUint64(timeUs > m_startUs ? timeUs - m_startUs : 0, header);
+    putUint32(header + 8, connectionId);
+    header[12] = kind;
+    header[13] = messageType;
+    header[14] = keptLength ? 1 : 0;
+    putUint32(header + 16, payloadLength);
+
+    LockGuard lock(m_mutex);
+    if (!m_running || m_buffer.size() + sizeof(header) + keptLength > MAX_BUFFERED) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_buffer.insert(m_buffer.end(), header, header + sizeof(header));
+    if (keptLength) m_buffer.insert(m_buffer.end(), payload, payload + keptLength);
+    m_bufferRecords++;
+}
+
+ThreadReturn THREAD_CALL TrafficCapture::writerThreadFunction(void* arg) {
+    static_cast<TrafficCapture*>(arg)->writerThreadMain();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+// swaps the buffer out under the lock and writes it without, handlers
+// go on filling the fresh one meanwhile. a failed write ends the capture,
+// later records are dropped rather than buffered for a file that is gone
+void TrafficCapture::writerThreadMain() {
+    std::vector<uint8_t> batch;
+    uint64_t batchRecords = 0;
+    bool running = true;
+    while (running) {
+        {
+            LockGuard lock(m_mutex);
+            if (m_running) m_cond.waitFor(m_mutex, FLUSH_INTERVAL_MS);
+            running = m_running;
+            batch.swap(m_buffer);
+            batchRecords = m_bufferRecords;
+            m_bufferRecords = 0;
+        }
+        if (!batch.empty()) {
+            if (std::fwrite(batch.data(), 1, batch.size(), m_file) != batch.size() || std::fflush(m_file) != 0) {
+                std::cerr << "[Capture] Failed to write " << m_path << ": " << std::strerror(errno)
+                          << ", capture stopped" << std::endl;
+                m_failed.store(true, std::memory_order_relaxed);
+                LockGuard lock(m_mutex);
+                m_running = false;
+                m_dropped.fetch_add(batchRecords + m_bufferRecords, std::memory_order_relaxed);
+                m_buffer.clear();
+                m_bufferRecords = 0;
+                return;
+            }
+            m_records.fetch_add(batchRecords, std::memory_order_relaxed);
+            batch.clear();
+        }
+    }
+}
+
+bool TrafficCapture::readFile(const std::string& path, uint32_t& flags, std::vector<CaptureRecord>& records) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    uint8_t header[FILE_HEADER_SIZE];
+    if (std::fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || getUint32(header + 8) != VERSION) {
+        std::fclose(file);
+        return false;
+    }
+    flags = getUint32(header + 12);
+
+    // a capture cut short by a crash ends in a partial record, keep what
+    // came before it
+    uint8_t recordHeader[RECORD_HEADER_SIZE];
+    while (std::fread(recordHeader, 1, sizeof(recordHeader), file) == sizeof(recordHeader)) {
+        CaptureRecord record;
+        record.timeUs = ProtocolHelper::deserializeUint64(recordHeader);
+        record.connectionId = getUint32(recordHeader + 8);
+        record.kind = recordHeader[12];
+        record.messageType = recordHeader[13];
+        record.payloadLength = getUint32(recordHeader + 16);
+        if (recordHeader[14]) {
+            record.payload.resize(record.payloadLength);
+            if (record.payloadLength &&
+                std::fread(record.payload.data(), 1, record.payloadLength, file) != record.payloadLength) {
+                break;
+            }
+        }
+        records.push_back(std::move(record));
+    }
+    std::fclose(file);
+    return true;
+}
@@ -0,0 +1,509 @@
+#include "../include/platform_wrapper.h"
+#include "../include/protocol.h"
+#include "../include/traffic_capture.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Traffic replay
+// re-drives a capture written by the server's --capture against another
+// server. every captured connection becomes a connection of its own,
+// opened when the original was and sending each message at its recorded
+// offset divided by --speed, so the concurrency and the request mix are
+// the original ones. at --speed max nothing waits for the clock; a
+// connection opens as soon as the ones that had closed before the
+// original opened have finished, which keeps the concurrency at most
+// what was captured. uploads write and deletes remove files on the
+// target, replay against a copy of the captured storage directory
+
+namespace {
+
+const size_t REPLAY_STACK_SIZE = 256 * 1024;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// requests that get an answer, reported one line each
+enum Request { REQ_CONNECT = 0, REQ_LIST, REQ_UPLOAD_START, REQ_UPLOAD_END, REQ_DOWNLOAD, REQ_DELETE, REQ_KINDS };
+
+const char* const REQUEST_NAMES[REQ_KINDS] = {
+    "connect", "list", "upload_req", "upload_end", "download", "delete"
+};
+
+int requestOf(uint8_t messageType) {
+    switch (messageType) {
+        case Protocol::MSG_CONNECT_REQUEST: return REQ_CONNECT;
+        case Protocol::MSG_LIST_FILES: return REQ_LIST;
+        case Protocol::MSG_UPLOAD_REQUEST: return REQ_UPLOAD_START;
+        case Protocol::MSG_UPLOAD_COMPLETE: return REQ_UPLOAD_END;
+        case Protocol::MSG_DOWNLOAD_REQUEST: return REQ_DOWNLOAD;
+        case Protocol::MSG_DELETE_REQUEST: return REQ_DELETE;
+        default: return -1;
+    }
+}
+
+struct ReplayConfig {
+    std::string capturePath;
+    std::string host;
+    uint16_t port;
+    std::string passwordHash;
+    double speed;               // 0 = as fast as possible
+    std::string jsonPath;       // "-" = stdout
+
+    ReplayConfig() : port(0), speed(1.0) {}
+};
+
+// one captured connection, from its open to its close
+struct Session {
+    uint64_t openUs;
+    std::vector<const CaptureRecord*> messages;
+    size_t closedBefore;        // sessions closed in the capture before this one opened
+};
+
+struct SessionResult {
+    std::vector<uint32_t> latencyUs[REQ_KINDS];
+    uint64_t errors[REQ_KINDS];
+    uint64_t messages;
+    uint64_t bytesSent;
+    bool aborted;               // connection lost, the rest of the session skipped
+
+    SessionResult() : errors(), messages(0), bytesSent(0), aborted(false) {}
+};
+
+struct SessionContext {
+    const ReplayConfig* config;
+    const Session* session;
+    uint64_t startUs;
+    std::atomic<size_t>* finished;
+    SessionResult result;
+    Thread thread;
+    std::atomic<bool> done;     // the thread is about to return, join() will not wait
+
+    SessionContext() : config(nullptr), session(nullptr), startUs(0), finished(nullptr), done(false) {}
+};
+
+class ReplayConnection {
+public:
+    bool open(const std::string& host, uint16_t port) {
+        return m_socket.connect(host, port);
+    }
+
+    void close() {
+        m_socket.close();
+    }
+
+    // header and payload in one send, see load_bench; more keeps the
+    // message for the next send
+    bool send(uint8_t messageType, const uint8_t* payload, size_t length, bool more = false) {
+        size_t start = m_sendBuffer.size();
+        m_sendBuffer.resize(start + 8 + length);
+        Protocol::MessageHeader header(messageType, static_cast<uint32_t>(length));
+        ProtocolHelper::serializeHeader(header, m_sendBuffer.data() + start, 8);
+        if (length > 0) std::memcpy(m_sendBuffer.data() + start + 8, payload, length);
+        if (more) return true;
+        const uint8_t* data = m_sendBuffer.data();
+        size_t remaining = m_sendBuffer.size();
+        while (remaining > 0) {
+            int sent = m_socket.send(data, remaining);
+            if (sent <= 0) break;
+            data += sent;
+            remaining -= sent;
+        }
+        m_sendBuffer.clear();
+        return remaining == 0;
+    }
+
+    bool receive(Protocol::MessageHeader& header, std::vector<uint8_t>& payload) {
+        uint8_t headerBuffer[8];
+        if (!receiveAll(headerBuffer, sizeof(headerBuffer)) ||
+            !ProtocolHelper::deserializeHeader(headerBuffer, sizeof(headerBuffer), header)) {
+            return false;
+        }
+        payload.resize(header.payloadLength);
+        return header.payloadLength == 0 || receiveAll(payload.data(), header.payloadLength);
+    }
+
+private:
+    bool receiveAll(uint8_t* data, size_t length) {
+        while (length > 0) {
+            int received = m_socket.receive(data, length);
+            if (received <= 0) return false;
+            data += received;
+            length -= received;
+        }
+        return true;
+    }
+
+    Socket m_socket;
+    std::vector<uint8_t> m_sendBuffer;
+};
+
+// false when the stream is lost; a refused request is an error but the
+// session goes on
+bool awaitResponse(ReplayConnection& connection, uint8_t messageType, bool& ok) {
+    Protocol::MessageHeader header;
+    std::vector<uint8_t> payload;
+    if (messageType == Protocol::MSG_DOWNLOAD_REQUEST) {
+        while (connection.receive(header, payload)) {
+            if (header.messageType == Protocol::MSG_DOWNLOAD_COMPLETE) {
+                ok = true;
+                return true;
+            }
+            if (header.messageType != Protocol::MSG_DOWNLOAD_DATA) {
+                ok = false;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (!connection.receive(header, payload)) return false;
+    ok = header.messageType != Protocol::MSG_ERROR_RESPONSE && header.messageType != Protocol::MSG_SERVER_BUSY &&
+         (payload.empty() || messageType == Protocol::MSG_LIST_FILES || payload[0] == Protocol::STATUS_OK);
+    return true;
+}
+
+void replaySession(SessionContext& context) {
+    const ReplayConfig& config = *context.config;
+    SessionResult& result = context.result;
+    ReplayConnection connection;
+    if (!connection.open(config.host, config.port)) {
+        result.errors[REQ_CONNECT]++;
+        result.aborted = true;
+        return;
+    }
+
+    std::vector<uint8_t> payload;
+    // an upload the server refused gets no data and no complete
+    bool skipUpload = false;
+    const std::vector<const CaptureRecord*>& messages = context.session->messages;
+    for (size_t i = 0; i < messages.size(); i++) {
+        const CaptureRecord* record = messages[i];
+        uint8_t type = record->messageType;
+        // the replay stays on the socket, a switch to shared memory would
+        // need the segment's descriptor handled here
+        if (type == Protocol::MSG_SHM_REQUEST) continue;
+        if (type == Protocol::MSG_UPLOAD_DATA || type == Protocol::MSG_UPLOAD_COMPLETE) {
+            if (skipUpload) continue;
+        } else {
+            skipUpload = false;
+        }
+
+        if (config.speed > 0) {
+            uint64_t dueUs = context.startUs + static_cast<uint64_t>(record->timeUs / config.speed);
+            uint64_t now = nowUs();
+            if (dueUs > now + 1000) Thread::sleep(static_cast<uint32_t>((dueUs - now) / 1000));
+        }
+
+        if (type == Protocol::MSG_CONNECT_REQUEST) {
+            payload = ProtocolHelper::createTextPayload(config.passwordHash);
+        } else if (!record->payload.empty() || record->payloadLength == 0) {
+            payload = record->payload;
+        } else {
+            // kept by size only, the server sees the same amount of bytes
+            payload.assign(record->payloadLength, 0);
+        }
+
+        // the clients send an upload's last chunk with its complete message,
+        // apart the complete would sit out the server's delayed ACK
+        bool more = type == Protocol::MSG_UPLOAD_DATA && i + 1 < messages.size() &&
+                    messages[i + 1]->messageType == Protocol::MSG_UPLOAD_COMPLETE;
+        uint64_t sentUs = nowUs();
+        if (!connection.send(type, payload.data(), payload.size(), more)) {
+            result.aborted = true;
+            break;
+        }
+        result.messages++;
+        result.bytesSent += 8 + payload.size();
+        if (type == Protocol::MSG_DISCONNECT) break;
+
+        int request = requestOf(type);
+        if (request < 0) continue;
+        bool ok = false;
+        if (!awaitResponse(connection, type, ok)) {
+            result.errors[request]++;
+            result.aborted = true;
+            break;
+        }
+        if (ok) {
+            result.latencyUs[request].push_back(static_cast<uint32_t>(std::min<uint64_t>(nowUs() - sentUs, UINT32_MAX)));
+        } else {
+            result.errors[request]++;
+            if (type == Protocol::MSG_UPLOAD_REQUEST) skipUpload = true;
+            // refused login, the server closes the connection
+            if (type == Protocol::MSG_CONNECT_REQUEST) {
+                result.aborted = true;
+                break;
+            }
+        }
+    }
+    connection.close();
+}
+
+ThreadReturn THREAD_CALL sessionThreadFunction(void* arg) {
+    SessionContext* context = static_cast<SessionContext*>(arg);
+    replaySession(*context);
+    context->finished->fetch_add(1);
+    context->done.store(true, std::memory_order_release);
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+// sessions in the order they opened. a connection id seen again after its
+// close starts a new session; messages of a connection opened before the
+// capture started get a session of their own
+std::vector<Session> buildSessions(const std::vector<CaptureRecord>& records) {
+    std::vector<Session> sessions;
+    std::map<uint32_t, size_t> open;
+    std::vector<uint64_t> closeTimes;
+    for (const CaptureRecord& record : records) {
+        std::map<uint32_t, size_t>::iterator it = open.find(record.connectionId);
+        if (record.kind == CaptureRecord::KIND_CLOSE) {
+            if (it != open.end()) {
+                closeTimes.push_back(record.timeUs);
+                open.erase(it);
+            }
+            continue;
+        }
+        if (it == open.end() || record.kind == CaptureRecord::KIND_OPEN) {
+            Session session;
+            session.openUs = record.timeUs;
+            session.closedBefore = closeTimes.size();
+            sessions.push_back(session);
+            open[record.connectionId] = sessions.size() - 1;
+            it = open.find(record.connectionId);
+        }
+        if (record.kind == CaptureRecord::KIND_MESSAGE) sessions[it->second].messages.push_back(&record);
+    }
+    return sessions;
+}
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+struct RequestReport {
+    uint64_t count;
+    uint64_t errors;
+    double meanUs;
+    uint32_t p50Us, p99Us, p999Us, maxUs;
+};
+
+RequestReport summarize(std::vector<uint32_t>& latencies, uint64_t errors) {
+    std::sort(latencies.begin(), latencies.end());
+    RequestReport report;
+    report.count = latencies.size();
+    report.errors = errors;
+    double sum = 0;
+    for (uint32_t latency : latencies) sum += latency;
+    report.meanUs = latencies.empty() ? 0 : sum / latencies.size();
+    report.p50Us = percentile(latencies, 0.50);
+    report.p99Us = percentile(latencies, 0.99);
+    report.p999Us = percentile(latencies, 0.999);
+    report.maxUs = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+std::string describeSpeed(double speed) {
+    if (speed <= 0) return "max";
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%gx", speed);
+    return buffer;
+}
+
+bool writeJson(const ReplayConfig& config, const RequestReport* reports, size_t sessions, size_t aborted,
+               uint64_t messages, double capturedS, double elapsedS) {
+    FILE* out = config.jsonPath == "-" ? stdout : std::fopen(config.jsonPath.c_str(), "w");
+    if (!out) return false;
+    std::fprintf(out, "{\n  \"config\": {\"capture\": \"%s\", \"host\": \"%s\", \"port\": %u, \"speed\": \"%s\"},\n",
+                 config.capturePath.c_str(), config.host.c_str(), config.port, describeSpeed(config.speed).c_str());
+    std::fprintf(out, "  \"captured_s\": %.3f,\n  \"elapsed_s\": %.3f,\n  \"sessions\": %llu,\n"
+                      "  \"aborted\": %llu,\n  \"messages\": %llu,\n  \"requests\": {",
+                 capturedS, elapsedS, static_cast<unsigned long long>(sessions),
+                 static_cast<unsigned long long>(aborted), static_cast<unsigned long long>(messages));
+    for (unsigned request = 0; request < REQ_KINDS; request++) {
+        const RequestReport& r = reports[request];
+        std::fprintf(out, "%s\n    \"%s\": {\"count\": %llu, \"errors\": %llu, \"latency_us\": {\"mean\": %.1f, "
+                          "\"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}}",
+                     request ? "," : "", REQUEST_NAMES[request], static_cast<unsigned long long>(r.count),
+                     static_cast<unsigned long long>(r.errors), r.meanUs, r.p50Us, r.p99Us, r.p999Us, r.maxUs);
+    }
+    std::fprintf(out, "\n  }\n}\n");
+    return out == stdout ? std::fflush(out) == 0 : std::fclose(out) == 0;
+}
+
+// folds a session's numbers into the totals, then frees its thread and
+// context
+void collect(SessionContext* context, SessionResult& totals, size_t& aborted) {
+    context->thread.join();
+    for (unsigned request = 0; request < REQ_KINDS; request++) {
+        const std::vector<uint32_t>& own = context->result.latencyUs[request];
+        totals.latencyUs[request].insert(totals.latencyUs[request].end(), own.begin(), own.end());
+        totals.errors[request] += context->result.errors[request];
+    }
+    totals.messages += context->result.messages;
+    if (context->result.aborted) aborted++;
+    delete context;
+}
+
+// finished sessions are collected while later ones are still being
+// launched, a long capture must not hold every thread's stack until the end
+void collectFinished(std::vector<SessionContext*>& running, SessionResult& totals, size_t& aborted, bool all) {
+    for (size_t i = 0; i < running.size(); ) {
+        if (all || running[i]->done.load(std::memory_order_acquire)) {
+            collect(running[i], totals, aborted);
+            running[i] = running.back();
+            running.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void printUsage(const char* progName) {
+    std::cout << "Usage: " << progName << " <capture> <host> <port> <password> [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --speed <n|max>         - Replay n times faster, max: no waiting (default: 1)" << std::endl;
+    std::cout << "  --json <path>           - Also write the results as JSON, - for stdout" << std::endl;
+}
+
+bool parseArguments(int argc, char* argv[], ReplayConfig& config) {
+    if (argc < 5) return false;
+    config.capturePath = argv[1];
+    config.host = argv[2];
+    config.port = static_cast<uint16_t>(std::atoi(argv[3]));
+    config.passwordHash = SecurityHelper::hashPassword(argv[4]);
+
+    for (int i = 5; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--speed") {
+            config.speed = value == "max" ? 0 : std::atof(value.c_str());
+            if (value != "max" && config.speed <= 0) {
+                std::cerr << "Bad speed: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--json") {
+            config.jsonPath = value;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return config.port != 0 || Socket::isUnixAddress(config.host);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (!PlatformUtils::initialize()) {
+        std::cerr << "Failed to initialize platform" << std::endl;
+        return 1;
+    }
+
+    ReplayConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        PlatformUtils::cleanup();
+        return 1;
+    }
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    uint32_t flags = 0;
+    std::vector<CaptureRecord> records;
+    if (!TrafficCapture::readFile(config.capturePath, flags, records)) {
+        std::cerr << "Cannot read capture " << config.capturePath << std::endl;
+        PlatformUtils::cleanup();
+        return 1;
+    }
+    std::vector<Session> sessions = buildSessions(records);
+    double capturedS = records.empty() ? 0 : records.back().timeUs / 1e6;
+    std::cout << "Replaying " << sessions.size() << " connection(s), " << records.size() << " record(s), "
+              << capturedS << " s captured, upload data " << ((flags & TrafficCapture::FLAG_DATA) ? "kept" : "by size")
+              << ", speed " << describeSpeed(config.speed) << std::endl;
+
+    std::atomic<size_t> finished(0);
+    std::vector<SessionContext*> running;
+    SessionResult totals;
+    size_t aborted = 0;
+    uint64_t startUs = nowUs();
+    for (const Session& session : sessions) {
+        collectFinished(running, totals, aborted, false);
+        if (config.speed > 0) {
+            uint64_t dueUs = startUs + static_cast<uint64_t>(session.openUs / config.speed);
+            uint64_t now = nowUs();
+            if (dueUs > now + 1000) Thread::sleep(static_cast<uint32_t>((dueUs - now) / 1000));
+        } else {
+            while (finished.load() < session.closedBefore) Thread::sleep(1);
+        }
+
+        SessionContext* context = new SessionContext();
+        context->config = &config;
+        context->session = &session;
+        context->startUs = startUs;
+        context->finished = &finished;
+        ThreadOptions options;
+        options.name = "replay";
+        options.stackSize = REPLAY_STACK_SIZE;
+        if (!context->thread.start(sessionThreadFunction, context, options)) {
+            std::cerr << "Cannot start replay thread" << std::endl;
+            delete context;
+            finished.fetch_add(1);
+            continue;
+        }
+        running.push_back(context);
+    }
+    collectFinished(running, totals, aborted, true);
+    double elapsedS = (nowUs() - startUs) / 1e6;
+    uint64_t messages = totals.messages;
+
+    RequestReport reports[REQ_KINDS];
+    uint64_t totalErrors = 0;
+    for (unsigned request = 0; request < REQ_KINDS; request++) {
+        reports[request] = summarize(totals.latencyUs[request], totals.errors[request]);
+        totalErrors += totals.errors[request];
+    }
+
+    std::printf("\n%zu connection(s), %llu message(s) in %.1f s (%.1f s captured), %zu cut short\n",
+                sessions.size(), static_cast<unsigned long long>(messages), elapsedS, capturedS, aborted);
+    std::printf("%-11s %10s %10s %10s %10s %10s %8s\n", "request", "count", "mean ms", "p50 ms", "p99 ms",
+                "p999 ms", "errors");
+    for (unsigned request = 0; request < REQ_KINDS; request++) {
+        const RequestReport& r = reports[request];
+        if (r.count == 0 && r.errors == 0) continue;
+        std::printf("%-11s %10llu %10.3f %10.3f %10.3f %10.3f %8llu\n", REQUEST_NAMES[request],
+                    static_cast<unsigned long long>(r.count), r.meanUs / 1000.0, r.p50Us / 1000.0,
+                    r.p99Us / 1000.0, r.p999Us / 1000.0, static_cast<unsigned long long>(r.errors));
+    }
+
+    bool ok = true;
+    if (!config.jsonPath.empty() &&
+        !writeJson(config, reports, sessions.size(), aborted, messages, capturedS, elapsedS)) {
+        std::cerr << "Cannot write " << config.jsonPath << std::endl;
+        ok = false;
+    }
+
+    PlatformUtils::cleanup();
+    return ok && totalErrors == 0 && aborted == 0 ? 0 : 2;
+}
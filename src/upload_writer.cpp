@@ -0,0 +1,368 @@
+#include "../include/upload_writer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <malloc.h>
+    #include <sys/stat.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+// Write-behind upload writer implementation
+
+static const size_t IO_ALIGNMENT = 4096;
+
+static uint8_t* allocateAligned(size_t size) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, IO_ALIGNMENT));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, IO_ALIGNMENT, size) != 0) return nullptr;
+    return static_cast<uint8_t*>(ptr);
+#endif
+}
+
+static void freeAligned(uint8_t* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// positional write of the whole buffer, retrying short writes
+static bool writeFully(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+#ifdef _WIN32
+        if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+        int written = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(length, 1 << 30)));
+#else
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) return false;
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+UploadWriter::UploadWriter()
+    : m_fd(-1), m_pipelined(false), m_directIO(false), m_blockSize(0), m_bytesQueued(0),
+      m_fill(0), m_ringIo(nullptr), m_head(0), m_tail(0), m_closing(false), m_failed(false),
+      m_producerWaiting(false), m_consumerWaiting(false) {
+}
+
+UploadWriter::~UploadWriter() {
+    if (isOpen()) {
+        close();
+    }
+}
+
+bool UploadWriter::open(const std::string& path, uint64_t expectedSize, const UploadWriterOptions& options) {
+    if (isOpen()) return false;
+
+    m_blockSize = std::max(IO_ALIGNMENT, options.blockSize / IO_ALIGNMENT * IO_ALIGNMENT);
+    m_pipelined = expectedSize > m_blockSize && options.queueDepth > 0;
+    m_directIO = false;
+
+#ifdef _WIN32
+    m_fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    // a fresh inode instead of truncating in place, downloads may have
+    // the old file mapped and would fault on the vanished pages
+    ::unlink(path.c_str());
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (options.directIO) {
+        m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        // tmpfs and some network filesystems refuse O_DIRECT, fall back quietly
+        m_directIO = (m_fd >= 0);
+    }
+#endif
+    if (m_fd < 0) {
+        m_fd = ::open(path.c_str(), flags, 0644);
+    }
+#endif
+    if (m_fd < 0) return false;
+
+#ifdef __linux__
+    // reserve the extents up front, the declared size is known from the request
+    if (expectedSize > 0) {
+        posix_fallocate(m_fd, 0, static_cast<off_t>(expectedSize));
+    }
+#endif
+
+    size_t slots = m_pipelined ? options.queueDepth : 1;
+    m_ring.assign(slots, Block{nullptr, 0, 0, IoCompletion()});
+    for (Block& block : m_ring) {
+        block.data = allocateAligned(m_blockSize);
+        if (!block.data) {
+            releaseBuffers();
+#ifdef _WIN32
+            _close(m_fd);
+#else
+            ::close(m_fd);
+#endif
+            m_fd = -1;
+            return false;
+        }
+    }
+
+    m_bytesQueued = 0;
+    m_fill = 0;
+    m_head = 0;
+    m_tail = 0;
+    m_closing = false;
+    m_failed = false;
+
+    if (options.ring && attachRing(options.ring)) {
+        // the ring overlaps the writes, no thread needed
+        m_pipelined = false;
+        return true;
+    }
+
+    if (m_pipelined && !m_diskThread.start(diskThreadFunction, this)) {
+        // no thread, still correct, just not overlapped
+        m_pipelined = false;
+    }
+    return true;
+}
+
+bool UploadWriter::write(const uint8_t* data, size_t length) {
+    if (!isOpen()) return false;
+
+    while (length > 0) {
+        if (m_fill == 0 && !waitForSpace()) {
+            return false;
+        }
+
+        Block& block = m_ring[m_head % m_ring.size()];
+        size_t n = std::min(length, m_blockSize - m_fill);
+        std::memcpy(block.data + m_fill, data, n);
+        m_fill += n;
+        m_bytesQueued += n;
+        data += n;
+        length -= n;
+
+        if (m_fill == m_blockSize && !submitCurrentBlock()) {
+            return false;
+        }
+    }
+
+    return !m_failed;
+}
+
+bool UploadWriter::close() {
+    if (!isOpen()) return false;
+
+    if (m_fill > 0) {
+        submitCurrentBlock();
+    }
+
+    if (m_ringIo) {
+        for (uint64_t i = m_tail; i < m_head; i++) {
+            if (!m_ringIo->waitFor(m_ring[i % m_ring.size()].completion)) {
+                m_failed = true;
+                break;
+            }
+        }
+        retireRingWrites();
+        m_ringIo->updateFile(RING_FILE_DATA, -1);
+        m_ringIo->unregisterBuffers();
+        m_ringIo = nullptr;
+    }
+
+    if (m_pipelined) {
+        m_closing = true;
+        if (m_consumerWaiting) {
+            LockGuard lock(m_waitMutex);
+            m_dataCond.notifyOne();
+        }
+        m_diskThread.join();
+    }
+
+    bool success = !m_failed;
+
+#ifdef _WIN32
+    if (_chsize_s(m_fd, static_cast<__int64>(m_bytesQueued)) != 0) success = false;
+    _close(m_fd);
+#else
+    // drops the preallocated tail and any O_DIRECT padding
+    if (ftruncate(m_fd, static_cast<off_t>(m_bytesQueued)) != 0) success = false;
+    if (::close(m_fd) != 0) success = false;
+#endif
+
+    m_fd = -1;
+    releaseBuffers();
+    return success;
+}
+
+// the producer may only start filling a slot the disk thread is done with
+bool UploadWriter::waitForSpace() {
+    if (m_ringIo) {
+        retireRingWrites();
+        while (m_head - m_tail >= m_ring.size()) {
+            if (!m_ringIo->waitFor(m_ring[m_tail % m_ring.size()].completion)) {
+                m_failed = true;
+                return false;
+            }
+            retireRingWrites();
+        }
+        return !m_failed;
+    }
+
+    while (m_head.load() - m_tail.load() >= m_ring.size()) {
+        if (m_failed) return false;
+
+        LockGuard lock(m_waitMutex);
+        m_producerWaiting = true;
+        if (m_head.load() - m_tail.load() >= m_ring.size()) {
+            m_spaceCond.waitFor(m_waitMutex, 10);
+        }
+        m_producerWaiting = false;
+    }
+    return true;
+}
+
+bool UploadWriter::submitCurrentBlock() {
+    Block& block = m_ring[m_head % m_ring.size()];
+    block.length = m_fill;
+    block.offset = m_bytesQueued - m_fill;
+    m_fill = 0;
+
+    if (m_ringIo) {
+        // goes to the kernel with the next enter on this ring
+        size_t slot = m_head % m_ring.size();
+        if (!m_ringIo->prepWriteFixed(RING_FILE_DATA, block.data, padForDirectIO(block), block.offset,
+                                      static_cast<unsigned>(slot), &block.completion)) {
+            m_failed = true;
+            return false;
+        }
+        m_head.store(m_head.load() + 1);
+        return !m_failed;
+    }
+
+    if (!m_pipelined) {
+        if (!writeBlock(block)) {
+            m_failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    m_head.store(m_head.load() + 1);
+    if (m_consumerWaiting) {
+        LockGuard lock(m_waitMutex);
+        m_dataCond.notifyOne();
+    }
+    return !m_failed;
+}
+
+// O_DIRECT needs whole sectors, the padding is truncated in close()
+size_t UploadWriter::padForDirectIO(const Block& block) {
+    size_t length = block.length;
+    if (m_directIO && length % IO_ALIGNMENT != 0) {
+        size_t padded = (length + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+        std::memset(block.data + length, 0, padded - length);
+        length = padded;
+    }
+    return length;
+}
+
+bool UploadWriter::writeBlock(const Block& block) {
+    return writeFully(m_fd, block.data, padForDirectIO(block), block.offset);
+}
+
+// registers the blocks and the file with the ring, false leaves the
+// writer on the thread/inline path (e.g. RLIMIT_MEMLOCK on old kernels)
+bool UploadWriter::attachRing(IoRing* ring) {
+    std::vector<uint8_t*> buffers;
+    for (const Block& block : m_ring) {
+        buffers.push_back(block.data);
+    }
+
+    if (!ring->registerBuffers(buffers.data(), m_blockSize, static_cast<unsigned>(buffers.size()))) {
+        return false;
+    }
+    if (!ring->updateFile(RING_FILE_DATA, m_fd)) {
+        ring->unregisterBuffers();
+        return false;
+    }
+
+    m_ringIo = ring;
+    return true;
+}
+
+// frees finished slots in order, writes may complete out of order
+void UploadWriter::retireRingWrites() {
+    while (m_tail < m_head) {
+        Block& block = m_ring[m_tail % m_ring.size()];
+        if (!block.completion.done) break;
+
+        size_t length = padForDirectIO(block);
+        int32_t result = block.completion.result;
+        if (result < 0) {
+            std::cerr << "[UploadWriter] Disk write failed: " << std::strerror(-result) << std::endl;
+            m_failed = true;
+        } else if (static_cast<size_t>(result) < length && !m_failed) {
+            // short write, finish it synchronously
+            if (!writeFully(m_fd, block.data + result, length - result, block.offset + result)) {
+                m_failed = true;
+            }
+        }
+        m_tail.store(m_tail.load() + 1);
+    }
+}
+
+void UploadWriter::releaseBuffers() {
+    for (Block& block : m_ring) {
+        if (block.data) freeAligned(block.data);
+    }
+    m_ring.clear();
+}
+
+ThreadReturn THREAD_CALL UploadWriter::diskThreadFunction(void* arg) {
+    static_cast<UploadWriter*>(arg)->diskThreadMain();
+#ifdef _WIN32
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+void UploadWriter::diskThreadMain() {
+    while (true) {
+        uint64_t tail = m_tail.load();
+        if (tail == m_head.load()) {
+            // closing is set after the last publish, so head is final here
+            if (m_closing && tail == m_head.load()) break;
+
+            LockGuard lock(m_waitMutex);
+            m_consumerWaiting = true;
+            if (tail == m_head.load() && !m_closing) {
+                m_dataCond.waitFor(m_waitMutex, 10);
+            }
+            m_consumerWaiting = false;
+            continue;
+        }
+
+        // after a failure keep draining so the producer never blocks forever
+        if (!m_failed && !writeBlock(m_ring[tail % m_ring.size()])) {
+            std::cerr << "[UploadWriter] Disk write failed: "
+                      << PlatformUtils::getLastErrorString() << std::endl;
+            m_failed = true;
+        }
+
+        m_tail.store(tail + 1);
+        if (m_producerWaiting) {
+            LockGuard lock(m_waitMutex);
+            m_spaceCond.notifyOne();
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#include "admission_queue.h"
+#include "check.h"
+#include <iostream>
+#include <vector>
+
+// Checks the admission FIFO (order, capacity, expiry) and the bounds and
+// scaling of the busy retry hint. the sockets are never opened, the
+// queue only holds and deletes them
+// g++ -std=c++17 -pthread -Iinclude -o admission_queue_test test/admission_queue_test.cpp
+//     src/admission_queue.cpp src/socket.cpp src/platform_utils.cpp src/tracer.cpp src/mutex.cpp
+//     src/thread.cpp
+
+static void testFifo() {
+    AdmissionQueue queue(3, 1000);
+    Socket* a = new Socket();
+    Socket* b = new Socket();
+    Socket* c = new Socket();
+    Socket* d = new Socket();
+
+    CHECK(queue.idle());
+    CHECK(queue.push(a));
+    CHECK(queue.push(b));
+    CHECK(queue.push(c));
+    // full, d stays with the caller
+    CHECK(!queue.push(d));
+    CHECK(queue.size() == 3);
+
+    CHECK(queue.pop() == a);
+    CHECK(queue.push(d));
+    CHECK(queue.pop() == b);
+    CHECK(queue.pop() == c);
+    CHECK(queue.pop() == d);
+    CHECK(queue.pop() == nullptr);
+    CHECK(queue.empty());
+
+    delete a;
+    delete b;
+    delete c;
+    delete d;
+}
+
+static void testCapacityZero() {
+    AdmissionQueue queue(0, 1000);
+    Socket socket;
+    CHECK(!queue.push(&socket));
+    CHECK(queue.empty());
+}
+
+static void testExpire() {
+    std::vector<Socket*> expired;
+
+    // maxWaitMs 0 gives up on everything at once, oldest first
+    AdmissionQueue immediate(4, 0);
+    Socket* a = new Socket();
+    Socket* b = new Socket();
+    immediate.push(a);
+    immediate.push(b);
+    immediate.expire(expired);
+    CHECK(expired.size() == 2 && expired[0] == a && expired[1] == b);
+    CHECK(immediate.empty());
+    delete a;
+    delete b;
+
+    // only the ones that waited long enough
+    expired.clear();
+    AdmissionQueue queue(4, 50);
+    Socket* old = new Socket();
+    Socket* young = new Socket();
+    queue.push(old);
+    Thread::sleep(80);
+    queue.push(young);
+    queue.expire(expired);
+    CHECK(expired.size() == 1 && expired[0] == old);
+    CHECK(queue.size() == 1);
+    delete old;
+    // young is still queued, the destructor deletes it
+}
+
+static void testRetryHint() {
+    AdmissionQueue queue(16, 1000);
+
+    // starts from a 1 s slot estimate, spread over the slots
+    CHECK(queue.retryAfterMs(1) == 1000);
+    CHECK(queue.retryAfterMs(4) == 250);
+    CHECK(queue.retryAfterMs(0) == 1000);
+
+    // grows with the backlog ahead of the client
+    for (int i = 0; i < 3; i++) queue.push(new Socket());
+    CHECK(queue.retryAfterMs(1) == 4000);
+    CHECK(queue.retryAfterMs(2) == 2000);
+
+    // moving average over an eighth of each new sample
+    queue.recordSlotTime(9000);
+    CHECK(queue.retryAfterMs(1) == 8000);
+
+    // clamped on both ends
+    for (int i = 0; i < 200; i++) queue.recordSlotTime(1000000);
+    CHECK(queue.retryAfterMs(1) == 30000);
+    for (int i = 0; i < 200; i++) queue.recordSlotTime(0);
+    CHECK(queue.retryAfterMs(1) == 100);
+}
+
+int main() {
+    if (!PlatformUtils::initialize()) return 1;
+
+    testFifo();
+    testCapacityZero();
+    testExpire();
+    testRetryHint();
+
+    PlatformUtils::cleanup();
+    return checkResult();
+}
@@ -0,0 +1,27 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+
+// the checks under test/ are one program each: CHECK reports a failed
+// condition and carries on, main ends with `return checkResult();`
+
+static int g_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+        g_failures++; \
+    } \
+} while (0)
+
+// the exit status for main
+inline int checkResult() {
+    if (g_failures) {
+        std::cerr << g_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include "client_registry.h"
+#include "check.h"
+#include <atomic>
+#include <iostream>
+#include <set>
+#include <vector>
+
+// Checks slot handout, the finished stack under concurrent handlers and
+// that a snapshot taken while slots are reused never reports one
+// connection's numbers under another's id
+// g++ -std=c++17 -pthread -Iinclude -o client_registry_test test/client_registry_test.cpp
+//     src/client_registry.cpp src/thread.cpp src/mutex.cpp src/platform_utils.cpp src/socket.cpp
+//     src/tracer.cpp
+
+static void testSlots() {
+    ClientRegistry registry(std::vector<size_t>{2, 1});
+
+    ClientSlot* a = registry.acquire(0, registry.allocateId());
+    ClientSlot* b = registry.acquire(0, registry.allocateId());
+    CHECK(a && b && a->index == 0 && b->index == 1);
+    CHECK(registry.acquire(0, 99) == nullptr);
+    CHECK(!registry.hasFreeSlot(0));
+    CHECK(registry.hasFreeSlot(1));
+    CHECK(registry.getActiveCount(0) == 2);
+    CHECK(a->clientId.load() != b->clientId.load());
+
+    registry.release(a);
+    CHECK(a->clientId.load() == 0);
+    CHECK(registry.getActiveCount(0) == 1);
+    ClientSlot* again = registry.acquire(0, registry.allocateId());
+    CHECK(again == a);
+
+    std::vector<ClientSlot*> active;
+    registry.getActive(0, active);
+    CHECK(active.size() == 2);
+    active.clear();
+    registry.getActive(1, active);
+    CHECK(active.empty());
+}
+
+struct Finisher {
+    ClientRegistry* registry;
+    std::vector<ClientSlot*> slots;
+    std::atomic<bool>* go;
+};
+
+static ThreadReturn THREAD_CALL finisherFunction(void* arg) {
+    Finisher* finisher = static_cast<Finisher*>(arg);
+    while (!finisher->go->load(std::memory_order_acquire)) {}
+    for (ClientSlot* slot : finisher->slots) {
+        finisher->registry->markFinished(slot);
+    }
+    return 0;
+}
+
+// handlers on several threads push at once, every slot comes back once
+static void testFinishedStack() {
+    const unsigned THREADS = 4;
+    const unsigned PER_THREAD = 500;
+    ClientRegistry registry(std::vector<size_t>{THREADS * PER_THREAD});
+    std::atomic<bool> go(false);
+
+    Finisher finishers[THREADS];
+    for (unsigned t = 0; t < THREADS; t++) {
+        finishers[t].registry = &registry;
+        finishers[t].go = &go;
+        for (unsigned i = 0; i < PER_THREAD; i++) {
+            finishers[t].slots.push_back(registry.acquire(0, registry.allocateId()));
+        }
+    }
+
+    Thread threads[THREADS];
+    for (unsigned t = 0; t < THREADS; t++) {
+        CHECK(threads[t].start(finisherFunction, &finishers[t]));
+    }
+    go.store(true, std::memory_order_release);
+
+    std::set<ClientSlot*> seen;
+    std::vector<ClientSlot*> finished;
+    size_t taken = 0;
+    for (unsigned t = 0; t < THREADS; t++) {
+        threads[t].join();
+    }
+    registry.takeFinished(0, finished);
+    for (ClientSlot* slot : finished) {
+        seen.insert(slot);
+        taken++;
+    }
+    CHECK(taken == THREADS * PER_THREAD);
+    CHECK(seen.size() == THREADS * PER_THREAD);
+
+    finished.clear();
+    registry.takeFinished(0, finished);
+    CHECK(finished.empty());
+}
+
+// every stat of connection id is written as a function of id, a reader
+// finding a value of another id has mixed two connections. the race
+// needs the writer to run mid-copy, so it is caught far more often with
+// more than one CPU
+static uint64_t statFor(uint32_t clientId, unsigned field) {
+    return static_cast<uint64_t>(clientId) * 4 + field;
+}
+
+struct Churn {
+    ClientRegistry* registry;
+    std::atomic<bool>* stop;
+    uint64_t cycles;
+};
+
+// accept loop and handler in one: take the slot, fill in its stats as a
+// handler would, give it back and reuse it for the next id
+static ThreadReturn THREAD_CALL churnFunction(void* arg) {
+    Churn* churn = static_cast<Churn*>(arg);
+    while (!churn->stop->load(std::memory_order_relaxed)) {
+        ClientSlot* slot = churn->registry->acquire(0, churn->registry->allocateId());
+        uint32_t clientId = slot->clientId.load(std::memory_order_relaxed);
+        for (unsigned step = 0; step < 8; step++) {
+            slot->stats.bytesIn.store(statFor(clientId, 1), std::memory_order_relaxed);
+            slot->stats.bytesOut.store(statFor(clientId, 2), std::memory_order_relaxed);
+            slot->stats.operations.store(statFor(clientId, 3), std::memory_order_relaxed);
+        }
+        churn->registry->release(slot);
+        churn->cycles++;
+    }
+    return 0;
+}
+
+static void testSnapshotConsistency() {
+    ClientRegistry registry(std::vector<size_t>{1});
+    std::atomic<bool> stop(false);
+    Churn churn = {&registry, &stop, 0};
+
+    Thread thread;
+    CHECK(thread.start(churnFunction, &churn));
+
+    std::vector<ConnectionSnapshot> connections;
+    uint64_t reported = 0;
+    uint64_t mixed = 0;
+    uint64_t startMs = ClientRegistry::nowMs();
+    while (ClientRegistry::nowMs() - startMs < 500) {
+        connections.clear();
+        registry.snapshot(connections);
+        for (const ConnectionSnapshot& connection : connections) {
+            reported++;
+            // 0 is a stat not written yet, anything else must be this id's
+            if ((connection.bytesIn != 0 && connection.bytesIn != statFor(connection.clientId, 1)) ||
+                (connection.bytesOut != 0 && connection.bytesOut != statFor(connection.clientId, 2)) ||
+                (connection.operations != 0 && connection.operations != statFor(connection.clientId, 3))) {
+                mixed++;
+            }
+        }
+    }
+    stop.store(true, std::memory_order_relaxed);
+    thread.join();
+
+    if (mixed) {
+        std::cerr << "  " << mixed << " of " << reported << " snapshots mixed two connections" << std::endl;
+    }
+    CHECK(mixed == 0);
+    CHECK(churn.cycles > 0);
+}
+
+int main() {
+    testSlots();
+    testFinishedStack();
+    testSnapshotConsistency();
+
+    return checkResult();
+}
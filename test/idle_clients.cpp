@@ -0,0 +1,47 @@
+#include "platform_wrapper.h"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+// Opens count connections to the server and holds them without sending
+// anything, so every one of them parks a handler thread in receive.
+// prints "connected <n>" once all are up, then waits for stdin to close
+// g++ -std=c++17 -pthread -Iinclude -o idle_clients test/idle_clients.cpp
+//     src/socket.cpp src/platform_utils.cpp src/tracer.cpp src/mutex.cpp
+// ./idle_clients 127.0.0.1 8080 10000
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <host> <port> <count>" << std::endl;
+        return 1;
+    }
+
+    std::string host = argv[1];
+    uint16_t port = static_cast<uint16_t>(std::atoi(argv[2]));
+    int count = std::atoi(argv[3]);
+
+    if (!PlatformUtils::initialize()) return 1;
+
+    std::vector<Socket*> sockets;
+    sockets.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Socket* socket = new Socket();
+        if (!socket->create() || !socket->connect(host, port)) {
+            std::cerr << "Connection " << i << " failed: " << socket->getLastError() << std::endl;
+            delete socket;
+            break;
+        }
+        sockets.push_back(socket);
+    }
+
+    std::cout << "connected " << sockets.size() << std::endl;
+
+    std::string line;
+    while (std::getline(std::cin, line)) {}
+
+    for (Socket* socket : sockets) {
+        delete socket;
+    }
+    PlatformUtils::cleanup();
+    return static_cast<int>(sockets.size()) == count ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#!/bin/bash
+# 10k idle connections on small handler stacks must stay inside a fixed
+# memory envelope. Linux only, run like run_tests.sh from a directory
+# holding ./fileserver_mt
+#   bash test/idle_connections_test.sh [count]
+
+COUNT=${1:-10000}
+PORT=8091
+STACK_KB=64
+# per connection: the handler object, one small stack and a kernel socket
+RSS_LIMIT_KB=$((COUNT * 16 + 64 * 1024))
+VSZ_LIMIT_KB=$((COUNT * (STACK_KB + 16) + 1024 * 1024))
+
+REPO_DIR=$(cd "$(dirname "$0")/.." && pwd)
+
+if [ "$(ulimit -Hn)" != "unlimited" ] && [ "$(ulimit -Hn)" -lt $((COUNT + 64)) ]; then
+    echo "Need $((COUNT + 64)) file descriptors, hard limit is $(ulimit -Hn)"
+    exit 1
+fi
+ulimit -n $((COUNT + 64))
+
+g++ -std=c++17 -O2 -pthread -I"$REPO_DIR/include" -o idle_clients "$REPO_DIR/test/idle_clients.cpp" \
+    "$REPO_DIR/src/socket.cpp" "$REPO_DIR/src/platform_utils.cpp" "$REPO_DIR/src/tracer.cpp" \
+    "$REPO_DIR/src/mutex.cpp" || exit 1
+
+./fileserver_mt $PORT idle_test_files $COUNT testpass --handler-stack $STACK_KB > /dev/null 2>&1 &
+SERVER_PID=$!
+sleep 1
+# accept, reaper, stats, log and other service threads; only what the
+# clients add on top of these are handlers
+BASE_THREADS=$(awk '/^Threads:/ {print $2}' /proc/$SERVER_PID/status)
+
+# the clients hold their connections until the fifo closes
+rm -f idle_ctl && mkfifo idle_ctl
+./idle_clients 127.0.0.1 $PORT $COUNT < idle_ctl > idle_clients.out 2>&1 &
+CLIENTS_PID=$!
+exec 3> idle_ctl
+
+HANDLERS=0
+for i in $(seq 120); do
+    THREADS=$(awk '/^Threads:/ {print $2}' /proc/$SERVER_PID/status)
+    HANDLERS=$((THREADS - BASE_THREADS))
+    [ "$HANDLERS" -ge "$COUNT" ] && break
+    kill -0 $CLIENTS_PID 2>/dev/null || break
+    sleep 1
+done
+
+RSS_KB=$(awk '/^VmRSS:/ {print $2}' /proc/$SERVER_PID/status)
+VSZ_KB=$(awk '/^VmSize:/ {print $2}' /proc/$SERVER_PID/status)
+PTE_KB=$(awk '/^VmPTE:/ {print $2}' /proc/$SERVER_PID/status)
+
+exec 3>&-
+wait $CLIENTS_PID
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+rm -rf idle_ctl idle_clients idle_clients.out idle_test_files
+
+echo "Idle connections: $HANDLERS handler threads"
+echo "  RSS $((RSS_KB / 1024)) MB (limit $((RSS_LIMIT_KB / 1024)) MB)"
+echo "  VSZ $((VSZ_KB / 1024)) MB (limit $((VSZ_LIMIT_KB / 1024)) MB)"
+echo "  page tables $((PTE_KB / 1024)) MB"
+
+if [ "$HANDLERS" -lt "$COUNT" ]; then
+    echo "FAILED: only $HANDLERS of $COUNT connections were served"
+    exit 1
+fi
+if [ "$RSS_KB" -gt "$RSS_LIMIT_KB" ] || [ "$VSZ_KB" -gt "$VSZ_LIMIT_KB" ]; then
+    echo "FAILED: outside the memory envelope"
+    exit 1
+fi
+echo "PASSED"
+exit 0
@@ -0,0 +1,142 @@
+#include "logger.h"
+#include "check.h"
+#include "platform_wrapper.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks the logger's rings through the public API: lines of varying
+// length, logged in bursts the drain thread keeps up with, wrap each
+// 16 KB ring many times (with a filler before every wrap) and must all
+// come out intact and in order. a burst far larger than a ring must be
+// counted as dropped, line for line
+// g++ -std=c++17 -pthread -Iinclude -o logger_test test/logger_test.cpp src/logger.cpp
+//     src/thread.cpp src/mutex.cpp src/condition_variable.cpp src/platform_utils.cpp
+//     src/socket.cpp src/tracer.cpp
+
+static const int LINES_PER_WRITER = 2000;
+static const int BURST = 40;
+
+// lengths 0..299, so the record in front of a wrap ends at every offset
+static std::string payloadFor(int writer, int seq) {
+    std::string payload(static_cast<size_t>((seq * 7 + writer * 13) % 300), ' ');
+    for (size_t k = 0; k < payload.size(); k++) {
+        payload[k] = static_cast<char>('a' + (seq + k) % 26);
+    }
+    return payload;
+}
+
+struct Writer {
+    int id;
+};
+
+static ThreadReturn THREAD_CALL writerFunction(void* arg) {
+    Writer* writer = static_cast<Writer*>(arg);
+    for (int seq = 0; seq < LINES_PER_WRITER; seq++) {
+        Logger::info(LogFields(), "writer=%d seq=%d %s", writer->id, seq, payloadFor(writer->id, seq).c_str());
+        // well under a ring per burst, the drain runs every 20 ms
+        if (seq % BURST == BURST - 1) Thread::sleep(30);
+    }
+    return 0;
+}
+
+// every line of every writer once, in order and unchanged
+static void testWraparound(const std::string& path) {
+    std::remove(path.c_str());
+    CHECK(Logger::start(path, LOG_INFO));
+    uint64_t droppedBefore = Logger::getDropped();
+
+    Writer writers[2] = {{0}, {1}};
+    Thread thread;
+    CHECK(thread.start(writerFunction, &writers[1]));
+    writerFunction(&writers[0]);
+    thread.join();
+    Logger::stop();
+
+    uint64_t dropped = Logger::getDropped() - droppedBefore;
+    if (dropped) {
+        std::cerr << "  " << dropped << " line(s) dropped, the drain thread fell behind" << std::endl;
+    }
+    CHECK(dropped == 0);
+
+    int next[2] = {0, 0};
+    int corrupt = 0;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        // nothing else is logged meanwhile, a filler must never show up
+        size_t at = line.find("writer=");
+        if (at == std::string::npos) {
+            if (corrupt++ < 5) std::cerr << "  unexpected: " << line.substr(0, 120) << std::endl;
+            continue;
+        }
+        int writer = -1;
+        int seq = -1;
+        int consumed = 0;
+        if (std::sscanf(line.c_str() + at, "writer=%d seq=%d %n", &writer, &seq, &consumed) != 2 ||
+            writer < 0 || writer > 1) {
+            corrupt++;
+            continue;
+        }
+        if (seq != next[writer] || line.compare(at + consumed, std::string::npos, payloadFor(writer, seq)) != 0) {
+            if (corrupt++ < 5) std::cerr << "  unexpected: " << line.substr(0, 120) << std::endl;
+        }
+        next[writer] = seq + 1;
+    }
+    CHECK(corrupt == 0);
+    CHECK(next[0] == LINES_PER_WRITER);
+    CHECK(next[1] == LINES_PER_WRITER);
+    std::remove(path.c_str());
+}
+
+// far more than a ring at once: whatever did not fit is counted, and the
+// counts reported in the log add up with the lines that made it
+static void testDropped(const std::string& path) {
+    const int LINES = 2000;
+    std::remove(path.c_str());
+    CHECK(Logger::start(path, LOG_INFO));
+    uint64_t droppedBefore = Logger::getDropped();
+
+    std::string payload(400, 'x');
+    for (int seq = 0; seq < LINES; seq++) {
+        Logger::info(LogFields(), "flood seq=%d %s", seq, payload.c_str());
+    }
+    Logger::stop();
+    uint64_t dropped = Logger::getDropped() - droppedBefore;
+
+    int written = 0;
+    int previous = -1;
+    uint64_t reported = 0;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t at = line.find("flood seq=");
+        unsigned long long count = 0;
+        if (at != std::string::npos) {
+            int seq = std::atoi(line.c_str() + at + std::strlen("flood seq="));
+            CHECK(seq > previous);
+            previous = seq;
+            written++;
+        } else if (std::sscanf(line.c_str(), "[Logger] %llu line(s) dropped", &count) == 1) {
+            reported += count;
+        }
+    }
+
+    CHECK(dropped > 0);
+    CHECK(written + dropped == static_cast<uint64_t>(LINES));
+    CHECK(reported == dropped);
+    std::remove(path.c_str());
+}
+
+int main() {
+    if (!PlatformUtils::initialize()) return 1;
+
+    testWraparound("logger_test_wrap.log");
+    testDropped("logger_test_drop.log");
+
+    PlatformUtils::cleanup();
+    return checkResult();
+}
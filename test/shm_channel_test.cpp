@@ -0,0 +1,200 @@
+#include "shm_channel.h"
+#include "check.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+// Checks the shared-memory channel between a server and a client mapping
+// in one process: bytes come through in order across the ring's wrap,
+// and a client that rewrites the indices in the segment gets -1 (EPROTO)
+// on the server's next send/receive instead of copies past the ring
+// g++ -std=c++17 -pthread -Iinclude -o shm_channel_test test/shm_channel_test.cpp
+//     src/shm_channel.cpp src/thread.cpp src/mutex.cpp src/platform_utils.cpp src/socket.cpp
+//     src/tracer.cpp
+
+#ifdef __linux__
+static const size_t RING = ShmChannel::MIN_RING_SIZE;
+
+// where the indices sit in the segment, as a hostile client sees it: a
+// 64-byte header, then per ring the producer's line (head) and the
+// consumer's line (tail). ring 0 is client->server, ring 1 the reverse
+struct RawIndices {
+    uint8_t* base;
+    std::atomic<uint64_t>& at(size_t offset) { return *reinterpret_cast<std::atomic<uint64_t>*>(base + offset); }
+    std::atomic<uint64_t>& head(int ring) { return at(64 + ring * 128); }
+    std::atomic<uint64_t>& tail(int ring) { return at(64 + ring * 128 + 64); }
+};
+
+static void fill(std::vector<uint8_t>& data, size_t seed) {
+    for (size_t k = 0; k < data.size(); k++) data[k] = static_cast<uint8_t>((seed + k * 31) & 0xff);
+}
+
+// both directions, chunks that do not divide the ring so every offset of
+// the wrap gets hit
+static void testRoundTrip(ShmChannel& server, ShmChannel& client) {
+    std::vector<uint8_t> out(7001);
+    std::vector<uint8_t> in(out.size());
+    for (size_t round = 0; round < 40; round++) {
+        fill(out, round);
+        ShmChannel& sender = round % 2 ? server : client;
+        ShmChannel& receiver = round % 2 ? client : server;
+        CHECK(sender.send(out.data(), out.size()) == static_cast<int>(out.size()));
+        size_t received = 0;
+        while (received < in.size()) {
+            int r = receiver.receive(in.data() + received, in.size() - received);
+            CHECK(r > 0);
+            if (r <= 0) return;
+            received += static_cast<size_t>(r);
+        }
+        CHECK(in == out);
+    }
+}
+
+// the reviewer's case: a head far beyond what the ring holds would have
+// the receive copy megabytes out of the segment
+static void testHeadAhead(ShmChannel& server, RawIndices& raw) {
+    uint64_t head = raw.head(0).load();
+    raw.head(0).store(raw.tail(0).load() + 8 * 1024 * 1024);
+    uint8_t buffer[256];
+    errno = 0;
+    CHECK(server.receive(buffer, sizeof(buffer)) == -1);
+    CHECK(errno == EPROTO);
+
+    // the server's own tail rewritten ahead of what was written
+    raw.head(0).store(head);
+    uint64_t tail = raw.tail(0).load();
+    raw.tail(0).store(head + 1);
+    errno = 0;
+    CHECK(server.receive(buffer, sizeof(buffer)) == -1);
+    CHECK(errno == EPROTO);
+    raw.tail(0).store(tail);
+}
+
+// a tail ahead of head made the free space look larger than the ring,
+// the send wrote past it
+static void testTailAhead(ShmChannel& server, RawIndices& raw) {
+    uint64_t tail = raw.tail(1).load();
+    raw.tail(1).store(raw.head(1).load() + 4096);
+    std::vector<uint8_t> data(RING * 2);
+    errno = 0;
+    CHECK(server.send(data.data(), data.size()) == -1);
+    CHECK(errno == EPROTO);
+
+    raw.tail(1).store(raw.head(1).load() - RING - 1);
+    errno = 0;
+    CHECK(server.send(data.data(), data.size()) == -1);
+    CHECK(errno == EPROTO);
+    raw.tail(1).store(tail);
+}
+
+struct Corrupter {
+    RawIndices* raw;
+};
+
+static ThreadReturn THREAD_CALL corrupterFunction(void* arg) {
+    Corrupter* corrupter = static_cast<Corrupter*>(arg);
+    Thread::sleep(50);
+    corrupter->raw->tail(1).store(corrupter->raw->head(1).load() + 1);
+    return 0;
+}
+
+// a sender waiting for space rechecks after every wake-up, it has to
+// give up on the corrupt tail rather than sleep or copy
+static void testCorruptWhileWaiting(ShmChannel& server, RawIndices& raw) {
+    std::vector<uint8_t> data(RING);
+    CHECK(server.send(data.data(), data.size()) == static_cast<int>(RING));
+
+    Corrupter corrupter = {&raw};
+    Thread thread;
+    CHECK(thread.start(corrupterFunction, &corrupter));
+    errno = 0;
+    CHECK(server.send(data.data(), data.size()) == -1);
+    CHECK(errno == EPROTO);
+    thread.join();
+}
+
+struct Drain {
+    ShmChannel* channel;
+    size_t received;
+    int last;
+};
+
+static ThreadReturn THREAD_CALL drainFunction(void* arg) {
+    Drain* drain = static_cast<Drain*>(arg);
+    uint8_t buffer[4096];
+    int r;
+    while ((r = drain->channel->receive(buffer, sizeof(buffer))) > 0) {
+        drain->received += static_cast<size_t>(r);
+    }
+    drain->last = r;
+    return 0;
+}
+
+// the client writes and closes at once while the server is mid-receive:
+// the last bytes must come out before the 0, however the two interleave
+static void testWriteThenClose() {
+    const int ROUNDS = 300;
+    int lost = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        ShmChannel server;
+        ShmChannel client;
+        int fd = -1;
+        if (!server.create(RING, nullptr, fd) || !client.attach(fd, nullptr)) {
+            CHECK(false);
+            return;
+        }
+        close(fd);
+
+        Drain drain = {&server, 0, -1};
+        Thread thread;
+        CHECK(thread.start(drainFunction, &drain));
+        std::vector<uint8_t> data(100 + round * 7);
+        if (round % 2) Thread::sleep(1);
+        CHECK(client.send(data.data(), data.size()) == static_cast<int>(data.size()));
+        client.close();
+        thread.join();
+
+        CHECK(drain.last == 0);
+        if (drain.received != data.size()) lost++;
+    }
+    if (lost) std::cerr << "  " << lost << " of " << ROUNDS << " rounds lost bytes at close" << std::endl;
+    CHECK(lost == 0);
+}
+
+int main() {
+    ShmChannel server;
+    ShmChannel client;
+    int fd = -1;
+    CHECK(server.create(RING, nullptr, fd));
+    CHECK(client.attach(fd, nullptr));
+    CHECK(server.getRingSize() == RING && client.getRingSize() == RING);
+
+    void* mapped = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(mapped != MAP_FAILED);
+    if (mapped == MAP_FAILED || g_failures) return 1;
+    RawIndices raw = {static_cast<uint8_t*>(mapped)};
+
+    testRoundTrip(server, client);
+    testHeadAhead(server, raw);
+    testTailAhead(server, raw);
+    testRoundTrip(server, client);
+    testCorruptWhileWaiting(server, raw);
+    testWriteThenClose();
+
+    munmap(mapped, 4096);
+    return checkResult();
+}
+#else
+int main() {
+    // Linux only, like the channel
+    return 0;
+}
+#endif
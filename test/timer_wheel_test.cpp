@@ -0,0 +1,126 @@
+#include "timer_wheel.h"
+#include "check.h"
+#include <iostream>
+#include <vector>
+
+// Checks that timers fire on exactly their tick, also when they start
+// on a higher level and cascade down across slot and level boundaries
+// g++ -std=c++17 -Iinclude -o timer_wheel_test test/timer_wheel_test.cpp src/timer_wheel.cpp
+
+// steps one tick at a time and checks every entry fires exactly once,
+// at its expiry
+static void runUntilEmpty(TimerWheel& wheel, std::vector<TimerEntry>& entries, uint64_t limit) {
+    std::vector<int> fired(entries.size(), 0);
+    std::vector<TimerEntry*> expired;
+    while (wheel.getPendingCount() > 0 && wheel.getCurrentTick() < limit) {
+        expired.clear();
+        wheel.advance(wheel.getCurrentTick() + 1, expired);
+        for (TimerEntry* entry : expired) {
+            size_t index = entry - entries.data();
+            CHECK(index < entries.size());
+            if (index >= entries.size()) continue;
+            CHECK(entry->expiry == wheel.getCurrentTick());
+            CHECK(!entry->scheduled);
+            fired[index]++;
+        }
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (fired[i] != 1) {
+            std::cerr << "  entry " << i << " (expiry " << entries[i].expiry << ") fired "
+                      << fired[i] << " times" << std::endl;
+        }
+        CHECK(fired[i] == 1);
+    }
+    CHECK(wheel.getPendingCount() == 0);
+}
+
+// delays on both sides of every level boundary, from tick 0
+static void testLevelBoundaries() {
+    const uint64_t delays[] = {
+        1, 2, 63, 64, 65, 127, 128,
+        4095, 4096, 4097, 4160,
+        262143, 262144, 262145, 266240,
+        TimerWheel::MAX_DELAY - 1, TimerWheel::MAX_DELAY
+    };
+    const size_t count = sizeof(delays) / sizeof(delays[0]);
+
+    TimerWheel wheel;
+    std::vector<TimerEntry> entries(count);
+    for (size_t i = 0; i < count; i++) {
+        wheel.schedule(&entries[i], delays[i]);
+    }
+    CHECK(wheel.getPendingCount() == count);
+    runUntilEmpty(wheel, entries, TimerWheel::MAX_DELAY + 1);
+}
+
+// the same from a current tick that is not aligned to any slot, so a
+// timer's first cascade comes sooner than its distance suggests
+static void testUnalignedStart() {
+    const uint64_t starts[] = {1, 63, 4000, 4095, 262100, 300001};
+    for (uint64_t start : starts) {
+        TimerWheel wheel;
+        std::vector<TimerEntry*> expired;
+        wheel.advance(start, expired);
+        CHECK(expired.empty());
+        CHECK(wheel.getCurrentTick() == start);
+
+        std::vector<TimerEntry> entries(200);
+        for (size_t i = 0; i < entries.size(); i++) {
+            // spread over the first three levels, crossing several cascades
+            uint64_t delay = 1 + (i * i * 37) % 300000;
+            wheel.schedule(&entries[i], start + delay);
+        }
+        runUntilEmpty(wheel, entries, start + 300001);
+    }
+}
+
+static void testCancelAndReschedule() {
+    TimerWheel wheel;
+    std::vector<TimerEntry*> expired;
+    TimerEntry cancelled, moved, past;
+
+    wheel.schedule(&cancelled, 5000);
+    wheel.schedule(&moved, 5000);
+    wheel.cancel(&cancelled);
+    CHECK(!cancelled.scheduled);
+    CHECK(wheel.getPendingCount() == 1);
+
+    // a second schedule replaces the first, it is not added twice
+    wheel.schedule(&moved, 70);
+    CHECK(wheel.getPendingCount() == 1);
+
+    wheel.advance(69, expired);
+    CHECK(expired.empty());
+    wheel.advance(70, expired);
+    CHECK(expired.size() == 1 && expired[0] == &moved);
+
+    // an expiry not in the future fires on the next tick
+    expired.clear();
+    wheel.schedule(&past, 10);
+    wheel.advance(71, expired);
+    CHECK(expired.size() == 1 && expired[0] == &past);
+
+    expired.clear();
+    wheel.advance(10000, expired);
+    CHECK(expired.empty());
+    CHECK(wheel.getPendingCount() == 0);
+}
+
+static void testClamp() {
+    TimerWheel wheel;
+    std::vector<TimerEntry*> expired;
+    TimerEntry far;
+    wheel.schedule(&far, TimerWheel::MAX_DELAY * 4);
+    CHECK(far.expiry == TimerWheel::MAX_DELAY);
+    wheel.advance(TimerWheel::MAX_DELAY, expired);
+    CHECK(expired.size() == 1 && expired[0] == &far);
+}
+
+int main() {
+    testLevelBoundaries();
+    testUnalignedStart();
+    testCancelAndReschedule();
+    testClamp();
+
+    return checkResult();
+}
@@ -0,0 +1,47 @@
+#!/bin/bash
+# checks for the server's self-contained building blocks, each one a
+# small program built from its own sources. run like run_tests.sh
+#   bash test/unit_tests.sh
+
+REPO_DIR=$(cd "$(dirname "$0")/.." && pwd)
+CXX="g++ -std=c++17 -O2 -Wall -pthread -I$REPO_DIR/include"
+
+PASSED=0
+FAILED=0
+
+# name, then the sources besides test/<name>.cpp
+run_check() {
+    local name=$1
+    shift
+    local sources=()
+    for source in "$@"; do
+        sources+=("$REPO_DIR/src/$source")
+    done
+
+    echo "Check: $name..."
+    if ! $CXX -o "$name" "$REPO_DIR/test/$name.cpp" "${sources[@]}"; then
+        echo "  FAILED (build)"
+        ((FAILED++))
+        return
+    fi
+    if ./"$name"; then
+        echo "  PASSED"
+        ((PASSED++))
+    else
+        echo "  FAILED"
+        ((FAILED++))
+    fi
+    rm -f "$name"
+}
+
+run_check timer_wheel_test timer_wheel.cpp
+run_check admission_queue_test admission_queue.cpp socket.cpp platform_utils.cpp tracer.cpp mutex.cpp thread.cpp
+run_check client_registry_test client_registry.cpp thread.cpp mutex.cpp platform_utils.cpp socket.cpp tracer.cpp
+run_check logger_test logger.cpp thread.cpp mutex.cpp condition_variable.cpp platform_utils.cpp socket.cpp tracer.cpp
+run_check shm_channel_test shm_channel.cpp thread.cpp mutex.cpp platform_utils.cpp socket.cpp tracer.cpp
+
+echo "========================================="
+echo "Results: $PASSED passed, $FAILED failed"
+echo "========================================="
+
+exit $FAILED